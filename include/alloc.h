@@ -0,0 +1,48 @@
+/*
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License version 2.1,
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNLINE_ALLOC_H__
+#define __CONNLINE_ALLOC_H__
+
+#include <connline/connline.h>
+
+#include <stddef.h>
+
+/*
+ * What connline and its plugins allocate goes through these,  to the
+ * allocator set by connline_set_allocator(), and is accounted in the
+ * given category.  Blocks are freed by __connline_free() only, which
+ * finds their size and category back.
+ */
+
+void *__connline_malloc(enum connline_memory category, size_t size);
+
+void *__connline_calloc(enum connline_memory category,
+					size_t nmemb, size_t size);
+
+/* A NULL ptr allocates in category, else the block keeps its own */
+void *__connline_realloc(enum connline_memory category,
+					void *ptr, size_t size);
+
+char *__connline_strdup(enum connline_memory category, const char *string);
+
+void __connline_free(void *ptr);
+
+#endif
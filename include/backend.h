@@ -31,6 +31,9 @@ struct connline_backend_methods {
 	__connline_open_f __connline_open;
 	__connline_close_f __connline_close;
 	__connline_get_bearer_f __connline_get_bearer;
+
+	/* The daemon tells online itself: no online probe is needed */
+	bool checks_online;
 };
 
 typedef struct connline_backend_methods *(*__connline_setup_backend_f) (void);
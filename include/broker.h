@@ -0,0 +1,96 @@
+/*
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License version 2.1,
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNLINE_BROKER_H__
+#define __CONNLINE_BROKER_H__
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * With CONNLINE_BROKER set, connline does not talk to D-Bus: it connects
+ * to the connlined broker listening on the abstract unix socket named by
+ * the variable (CONNLINE_BROKER_DEFAULT if empty), which sends back two
+ * fds: a read-only memfd holding a struct connline_broker_page, and an
+ * eventfd the broker writes to after each update of the page.
+ */
+#define CONNLINE_BROKER_ENV "CONNLINE_BROKER"
+#define CONNLINE_BROKER_DEFAULT "connline"
+
+#define CONNLINE_BROKER_VERSION 1
+
+#define CONNLINE_BROKER_PAGE_SIZE 4096
+#define CONNLINE_BROKER_PROPERTIES_SIZE (CONNLINE_BROKER_PAGE_SIZE - 20)
+
+enum connline_broker_status {
+	CONNLINE_BROKER_NO_BACKEND   = 0,
+	CONNLINE_BROKER_DISCONNECTED = 1,
+	CONNLINE_BROKER_CONNECTED    = 2,
+};
+
+struct connline_broker_state {
+	uint32_t status;
+	uint32_t bearer;
+	/* Bumped on every update, properties included */
+	uint32_t generation;
+	/* name\0value\0 pairs, as the broker got them */
+	uint32_t properties_size;
+	char properties[CONNLINE_BROKER_PROPERTIES_SIZE];
+};
+
+/* The sequence is odd while the broker writes the state */
+struct connline_broker_page {
+	uint32_t sequence;
+	struct connline_broker_state state;
+};
+
+static inline
+void __connline_broker_write_begin(struct connline_broker_page *page)
+{
+	__atomic_store_n(&page->sequence, page->sequence + 1,
+							__ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline
+void __connline_broker_write_end(struct connline_broker_page *page)
+{
+	__atomic_store_n(&page->sequence, page->sequence + 1,
+							__ATOMIC_RELEASE);
+}
+
+static inline
+void __connline_broker_read(const struct connline_broker_page *page,
+					struct connline_broker_state *state)
+{
+	uint32_t sequence;
+
+	do {
+		sequence = __atomic_load_n(&page->sequence, __ATOMIC_ACQUIRE);
+		if (sequence & 1)
+			continue;
+
+		memcpy(state, &page->state, sizeof(*state));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((sequence & 1) ||
+		__atomic_load_n(&page->sequence, __ATOMIC_RELAXED) != sequence);
+}
+
+#endif
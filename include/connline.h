@@ -26,6 +26,7 @@ extern "C" {
 #endif
 
 #include <stdbool.h>
+#include <stddef.h>
 
 /**
  * Event loop type enumeration
@@ -74,7 +75,12 @@ enum connline_bearer {
  * Such behavior is currently proper to ConnMan backend. All other are directly
  * put online.
  * CONNLINE_EVENT_PROPERTY: when a property has its value changed.
+ * CONNLINE_EVENT_TIMEOUT: when the connection manager did not answer a
+ * request within the deadline the context was given.  The request is sent
+ * again later, after longer and longer delays, and the context stays usable.
+ * Not part of CONNLINE_EVENT_MASK_ALL: it is to be asked for in the mask.
  * @see connline_is_online()
+ * @see connline_set_deadline()
  */
 enum connline_event {
 	CONNLINE_EVENT_ERROR          = 0,
@@ -82,6 +88,7 @@ enum connline_event {
 	CONNLINE_EVENT_DISCONNECTED   = 2,
 	CONNLINE_EVENT_CONNECTED      = 3,
 	CONNLINE_EVENT_PROPERTY       = 4,
+	CONNLINE_EVENT_TIMEOUT        = 5,
 };
 
 /**
@@ -120,11 +127,122 @@ typedef void (*connline_callback_f)(struct connline_context *context,
  * @param data a pointer on a specific data depending on event loop type
  * This affects only CONNLINE_EVENT_LOOP_LIBEVENT,  data should be a pointer on
  * a valid struct event_base.
+ * With CONNLINE_BROKER set in the environment, connline  gets  its  state from
+ * the connlined broker instead of D-Bus (see README), falling back to D-Bus if
+ * the broker cannot be reached.  Contexts then act as background ones.
+ * Without any connection manager running, or without a system bus at all, a
+ * daemonless backend (netlink) is used if available: contexts  then  act  as
+ * background ones too.
  * @return 0 on success or a negative value instead
  * @see connline_event_loop
  */
 int connline_init(enum connline_event_loop event_loop_type, void *data);
 
+struct DBusConnection;
+
+/**
+ * Initialize Connline library on a D-Bus connection the application drives
+ * Connline  only  adds  its  filters and  match  rules  on  the  connection:
+ * reading and  dispatching it, as  well as  closing it  if  private, is  left
+ * to the application.  The event loop is still used to run the callbacks.
+ * @param event_loop_type a supported event loop type
+ * @param data a pointer on a specific data depending on event loop type
+ * @param connection a valid connection on the system bus
+ * @return 0 on success or a negative value instead
+ * @see connline_init()
+ */
+int connline_init_with_dbus(enum connline_event_loop event_loop_type,
+					void *data,
+					struct DBusConnection *connection);
+
+/**
+ * Use a private D-Bus connection, instead of the process-wide shared one
+ * On the  shared  connection,  connline's  dispatching  competes  with  the
+ * other  libraries using it.  A private connection has its own filters and
+ * message queue, at the cost of one more connection to the bus.
+ * It is to be called before connline_init().
+ * @param private_connection true for a private connection
+ * @return 0 on success or a negative value instead
+ */
+int connline_set_private_dbus(bool private_connection);
+
+/**
+ * Let other threads than the event loop's one use connline
+ * The thread calling connline_init() is the loop thread.  From any other,
+ * connline_open()  and  connline_close()  queue their work for the loop
+ * thread, without taking any lock, and return right away:  the context is
+ * opened, or freed, once the loop thread got to it.  No callback is
+ * started anymore for a context once connline_close() returned.
+ * connline_is_online()  and  connline_get_bearer()  read what the loop
+ * thread last published of the context.  connline_set_event_mask()  can be
+ * called from any thread.  All else, callbacks included, stays on the loop
+ * thread, and a custom allocator has then to be thread-safe.
+ * It is to be called before connline_init().
+ * @param enable true to be thread-safe
+ * @return 0 on success or a negative value instead
+ */
+int connline_set_thread_safe(bool enable);
+
+/**
+ * Memory category enumeration
+ * Every allocation connline and its plugins make is accounted in one:
+ * CONNLINE_MEMORY_CONTEXT: the contexts themselves.
+ * CONNLINE_MEMORY_LIST: the nodes of connline's internal lists.
+ * CONNLINE_MEMORY_BACKEND: backends' per context data, monitors, services
+ * and links.
+ * CONNLINE_MEMORY_PROPERTY: property lists given to the callbacks.
+ * CONNLINE_MEMORY_EVENT: event loop plugins' watches, timeouts, fd handlers
+ * and queued callbacks.
+ * CONNLINE_MEMORY_DBUS: D-Bus message templates, match rules and decoded
+ * arrays.
+ * CONNLINE_MEMORY_PLUGIN: loaded plugins.
+ */
+enum connline_memory {
+	CONNLINE_MEMORY_CONTEXT  = 0,
+	CONNLINE_MEMORY_LIST     = 1,
+	CONNLINE_MEMORY_BACKEND  = 2,
+	CONNLINE_MEMORY_PROPERTY = 3,
+	CONNLINE_MEMORY_EVENT    = 4,
+	CONNLINE_MEMORY_DBUS     = 5,
+	CONNLINE_MEMORY_PLUGIN   = 6,
+	CONNLINE_MEMORY_MAX      = 7,
+};
+
+/**
+ * Allocator connline and its plugins get their memory from
+ * Sizes are the ones connline asked for plus a small header of its own,
+ * which is how it knows the size to give back to free.  realloc may be
+ * NULL: connline then allocates, copies and frees.  Memory given to the
+ * application, as callback properties, is still owned by connline.
+ * Neither libdbus nor the event loops allocate through it.
+ * @param malloc returns size bytes, or NULL on failure
+ * @param realloc resizes a block of old_size bytes to size bytes
+ * @param free releases a block of size bytes
+ * @param user_data given back to each of them
+ * @param limit most bytes connline may have allocated at once, 0 for no
+ * limit: past it, allocations fail as if malloc did
+ */
+struct connline_allocator {
+	void *(*malloc)(size_t size, void *user_data);
+	void *(*realloc)(void *ptr, size_t old_size,
+				size_t size, void *user_data);
+	void (*free)(void *ptr, size_t size, void *user_data);
+	void *user_data;
+
+	size_t limit;
+};
+
+/**
+ * Set the allocator connline and its plugins use
+ * It is to be called before connline_init(), and not again until all
+ * contexts are closed and connline_cleanup() is done.  The structure is
+ * copied.
+ * @param allocator the allocator to use, or NULL for the C library's one
+ * @return 0 on success or a negative value instead
+ * @see struct connline_stats for the memory currently in use
+ */
+int connline_set_allocator(const struct connline_allocator *allocator);
+
 /**
  * Request the context to open a connection
  * Depending on  the  connection  manager  daemon, this  might  lead  to  valid
@@ -132,6 +250,8 @@ int connline_init(enum connline_event_loop event_loop_type, void *data);
  * A background connection is when you are just requesting to be  notified when
  * a connection  has  been  set,  but you are  not  requesting  the  underlying
  * backend to get connected.
+ * On ConnMan, background connections do not create any session: they all
+ * share one monitor of the service list.
  * If a network connection happens and follows  the  bearer  type  you  set for
  * this context,  connected  event  will  be triggered  (if  only an  connected
  * callback was set)
@@ -145,12 +265,123 @@ struct connline_context *connline_open(enum connline_bearer bearer_type,
 						connline_callback_f callback,
 						void *user_data);
 
+/**
+ * Bit of an event, in an event mask
+ */
+#define CONNLINE_EVENT_MASK(event) (1U << (event))
+
+/**
+ * Mask of all the events but CONNLINE_EVENT_TIMEOUT, the one a context
+ * starts with
+ */
+#define CONNLINE_EVENT_MASK_ALL					\
+	(CONNLINE_EVENT_MASK(CONNLINE_EVENT_ERROR) |		\
+	CONNLINE_EVENT_MASK(CONNLINE_EVENT_NO_BACKEND) |	\
+	CONNLINE_EVENT_MASK(CONNLINE_EVENT_DISCONNECTED) |	\
+	CONNLINE_EVENT_MASK(CONNLINE_EVENT_CONNECTED) |		\
+	CONNLINE_EVENT_MASK(CONNLINE_EVENT_PROPERTY))
+
+/**
+ * Select the events a context gets
+ * The backends skip what only masked events need:  without
+ * CONNLINE_EVENT_PROPERTY,  no property is decoded,  nor fetched by extra
+ * calls to the daemon.  CONNLINE_EVENT_ERROR and CONNLINE_EVENT_NO_BACKEND
+ * are always delivered.  Masked events already queued are dropped.
+ * It is best called right after connline_open(), before the event loop
+ * runs: properties unmasked later come with their next change.
+ * @param context a valid connline context
+ * @param event_mask CONNLINE_EVENT_MASK() bits of the events to deliver
+ * @return 0 on success or a negative value instead
+ */
+int connline_set_event_mask(struct connline_context *context,
+						unsigned int event_mask);
+
+/**
+ * Times a timed out request is sent again, before its context gets an error
+ */
+#define CONNLINE_DEADLINE_RETRIES 3
+
+/**
+ * Set how long the connection manager gets to answer the context's requests
+ * A context has no deadline at first:  its requests wait for the D-Bus
+ * default timeout, and a request timing out fails the context.  Past the
+ * deadline,  the request is cancelled,  the context gets a
+ * CONNLINE_EVENT_TIMEOUT,  if its mask asks for it,  and the request is
+ * sent again after a delay:  a quarter of a second at first, doubling at
+ * each timeout up to 30 seconds, less up to half of it at random.  A request
+ * the connection manager would carry out twice,  as creating a session, is
+ * not sent again but waited for,  until the next deadline.  Past
+ * CONNLINE_DEADLINE_RETRIES retries,  the context gets CONNLINE_EVENT_ERROR
+ * instead.  From the loop thread,  it applies to the requests already
+ * waiting too, from other threads to the next ones.
+ * @param context a valid connline context
+ * @param deadline in milliseconds, 0 for none
+ * @return 0 on success or a negative value instead
+ */
+int connline_set_deadline(struct connline_context *context,
+						unsigned int deadline);
+
+/**
+ * One event of a batch, as a context callback would have got it
+ */
+struct connline_event_record {
+	struct connline_context *context;
+	enum connline_event event;
+	const char **properties;
+	void *user_data;
+};
+
+/**
+ * Batch callbacks get many events at once
+ * @param records the events, in the order contexts would have got them.
+ * Properties are freed by connline once the callback returned.
+ * @param nb_records how many records there are, at least 1
+ * @param user_data the pointer given to connline_set_batch_callback()
+ */
+typedef void (*connline_batch_callback_f)(
+			const struct connline_event_record *records,
+			unsigned int nb_records, void *user_data);
+
+/**
+ * Deliver the events of contexts opened without a callback in batches
+ * Instead of one call per context and per event, the events one daemon
+ * update brings to these contexts come in one call,  each with the
+ * user_data given to connline_open().  Events of contexts with their own
+ * callback are still delivered in between, in priority order, which may
+ * split a batch.  It is to be called from the event loop's thread.
+ * @param callback the batch callback, or NULL for these contexts to get
+ * no event anymore
+ * @param user_data a pointer given to the batch callback
+ * @return 0 on success or a negative value instead
+ */
+int connline_set_batch_callback(connline_batch_callback_f callback,
+							void *user_data);
+
+/**
+ * Deliver the events of a group of contexts in batches of its own
+ * As connline_set_batch_callback(), for the contexts connline_open_many()
+ * opened along with this one, without a callback:  their events go to this
+ * batch callback instead of the global one.  Events of other contexts,
+ * coming in between in priority order, may split a batch.  It is to be
+ * called from the event loop's thread.
+ * @param context any context of the group
+ * @param callback the group's batch callback, or NULL for the global one
+ * @param user_data a pointer given to the batch callback
+ * @return 0 on success or a negative value instead, -EINVAL if the context
+ * was not opened by connline_open_many()
+ */
+int connline_set_group_batch_callback(struct connline_context *context,
+					connline_batch_callback_f callback,
+					void *user_data);
+
 /**
  * Return context's status
  * @param context a valid connline context
  * @return a boolean indicating context is online or not
  * Note:  on ConnMan backend, getting a CONNLINE_EVENT_CONNECTED  does not mean
  * the context went online. Check this status via this function.
+ * The same goes for all backends with an online probe set.
+ * @see connline_set_online_probe()
  */
 bool connline_is_online(struct connline_context *context);
 
@@ -173,12 +404,183 @@ enum connline_bearer connline_get_bearer(struct connline_context *context);
  */
 void connline_close(struct connline_context *context);
 
+/**
+ * Completion callbacks tell a group of contexts got their first event
+ * @param user_data the pointer given to connline_open_many()
+ */
+typedef void (*connline_completion_f)(void *user_data);
+
+/**
+ * Open many contexts at once
+ * As many connline_open() calls, but connline checks the connection manager
+ * is there once for all,  allocates the contexts in one block, and sends
+ * all the backend requests without waiting between them.  Each context is
+ * closed as usual, its memory being released with the last one of them.
+ * From another thread, see connline_set_thread_safe(), the contexts are
+ * opened once the loop thread got to them.
+ * @param contexts where the nb_contexts new contexts are stored
+ * @param nb_contexts how many contexts to open
+ * @param bearer_type as given to connline_open(), for all the contexts
+ * @param background_connection as given to connline_open()
+ * @param callback as given to connline_open()
+ * @param user_data nb_contexts pointers, one per context, or NULL
+ * @param completion called once, on the event loop, when all the contexts
+ * got their first event,  masked or not:  closing one before cancels it.
+ * NULL for none.
+ * @param completion_data a pointer given to the completion callback
+ * @return 0 on success or a negative value instead, no context being opened
+ */
+int connline_open_many(struct connline_context **contexts,
+				unsigned int nb_contexts,
+				enum connline_bearer bearer_type,
+				bool background_connection,
+				connline_callback_f callback,
+				void *const *user_data,
+				connline_completion_f completion,
+				void *completion_data);
+
+/**
+ * Close many contexts at once
+ * As many connline_close() calls, sending the backend requests without
+ * waiting for the bus in between for contexts opened by
+ * connline_open_many().
+ * @param contexts the contexts to close, NULL ones are skipped
+ * @param nb_contexts how many there are
+ */
+void connline_close_many(struct connline_context **contexts,
+						unsigned int nb_contexts);
+
 /**
  * Final library cleanup
  * @see connline_init()
  */
 void connline_cleanup(void);
 
+/**
+ * Bound how much D-Bus dispatching connline does in one go
+ * On  a  signal storm,  dispatching  everything  at  once  would  starve the
+ * application's event loop.  Once either budget is spent,  connline  gives
+ * the loop back and dispatches the rest on a later  iteration,  once the
+ * events already pending are handled.  Defaults are 64 messages and 2000
+ * microseconds.
+ * @param messages the most messages dispatched in one go, 0 for no limit
+ * @param usec the longest time dispatching in one go, 0 for no limit
+ * @return 0 on success or a negative value instead
+ */
+int connline_set_dispatch_budget(unsigned int messages, unsigned int usec);
+
+/**
+ * Default least time between two online probes, in seconds
+ */
+#define CONNLINE_PROBE_INTERVAL 10
+
+/**
+ * Verify connections reach an HTTP endpoint before telling them online
+ * But ConnMan, backends only know about connections,  not  whether they
+ * reach anything.  With a probe set, connline_is_online() is true only
+ * once an HTTP GET of url got the expected status,  and contexts then get
+ * CONNLINE_EVENT_CONNECTED  a second  time, as  they  do  on  ConnMan.
+ * The probe runs in a thread of its own,  once for all contexts and again
+ * only after a disconnection:  requests meanwhile are coalesced, and
+ * probes are at least interval apart.  While it fails, it is retried at
+ * that pace.
+ * It is to be called before connline_init().
+ * @param url "http://host[:port]/path", or NULL to remove the probe
+ * @param status the HTTP status telling online, e.g. 204, or 0 for any 2xx
+ * @param interval least seconds between two probes, 0 for the default
+ * @return 0 on success or a negative value instead
+ */
+int connline_set_online_probe(const char *url, unsigned int status,
+						unsigned int interval);
+
+/**
+ * Number of buckets of a connline histogram
+ */
+#define CONNLINE_STATS_BUCKETS 32
+
+/**
+ * Log-bucketed histogram of durations, in microseconds
+ * buckets[0] counts durations below 1us,  and  buckets[i]  the  ones  from
+ * 2^(i-1) to 2^i - 1 us.  The last bucket gets all longer durations.
+ */
+struct connline_histogram {
+	unsigned long buckets[CONNLINE_STATS_BUCKETS];
+};
+
+/**
+ * Connline runtime statistics
+ * All  counters  are  cumulative  since  the  process  started,  but  for
+ * match_rules, which tells how many D-Bus match rules are currently  set,
+ * and for contexts_*, which is a snapshot of the opened contexts:
+ * - opening: no connection state reported yet,
+ * - connected/disconnected: as the last event on the context told,
+ * - invalid: got CONNLINE_EVENT_ERROR or CONNLINE_EVENT_NO_BACKEND.
+ * Histograms measure the time from connline_open() to the first event  of
+ * a context, backend's  D-Bus round trips,  and  the delay  between  queuing
+ * an event and its callback being called.
+ * dbus_signals  also counts  the notifications  ConnMan  sends  as  method
+ * calls.  allocations counts every block connline and its plugins allocate,
+ * and the D-Bus messages they create, and memory tells, per enum
+ * connline_memory, how many bytes are in use right now: the ones of libdbus
+ * and of the event loop are not accounted.
+ * dispatch_yields counts  how  many times  the dispatch  budget ran out with
+ * messages left, and dispatch_pending tells  whether some are queued  right
+ * now (libdbus does not tell how many).
+ */
+struct connline_stats {
+	unsigned long dbus_calls;
+	unsigned long dbus_replies;
+	unsigned long dbus_signals;
+	unsigned long match_rules;
+	unsigned long triggers_queued;
+	unsigned long triggers_dropped;
+	unsigned long allocations;
+	unsigned long dbus_dispatched;
+	unsigned long dispatch_yields;
+	unsigned long dbus_timeouts;
+
+	unsigned int dispatch_pending;
+	unsigned int contexts_opening;
+	unsigned int contexts_connected;
+	unsigned int contexts_disconnected;
+	unsigned int contexts_invalid;
+
+	unsigned long memory[CONNLINE_MEMORY_MAX];
+
+	struct connline_histogram first_event_latency;
+	struct connline_histogram round_trip;
+	struct connline_histogram callback_delay;
+};
+
+/**
+ * Get connline runtime statistics
+ * Counters are kept per thread,  so updating them costs nothing but a few
+ * additions: this function sums them all up.
+ * @param stats a valid pointer on a struct connline_stats to fill in
+ * @return 0 on success or a negative value instead
+ */
+int connline_get_stats(struct connline_stats *stats);
+
+/**
+ * Dump connline trace ring buffer
+ * Connline always records its last few thousands trace points in memory:
+ * contexts open and close, backends setup and teardown, D-Bus calls,
+ * replies and signals, events queued and run, and debug messages.  This
+ * writes them out, oldest first, as binary records tools/connline-trace
+ * can decode.  It is async-signal-safe.
+ * @param fd a file descriptor opened for writing
+ * @return 0 on success or a negative value instead
+ */
+int connline_trace_dump(int fd);
+
+/**
+ * Dump connline trace ring buffer when receiving a signal
+ * @param signum the signal to dump on, e.g. SIGUSR1
+ * @param path the file to dump to, truncated on each dump
+ * @return 0 on success or a negative value instead
+ */
+int connline_trace_dump_on_signal(int signum, const char *path);
+
 #ifdef __cplusplus
 }
 #endif
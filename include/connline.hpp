@@ -0,0 +1,436 @@
+/*
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License version 2.1,
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNLINE_HPP__
+#define __CONNLINE_HPP__
+
+/**
+ * C++20 binding of connline
+ * Header only:  it  adds  no  symbol  to  libconnline.   Contexts  are
+ * move-only owners closing on destruction, and event handlers are given
+ * as template arguments:  the C callback connline calls is generated per
+ * handler and invokes it directly, without any type erasure.
+ * Nothing here throws: failures are reported the way the C API does.
+ */
+
+#include <cerrno>
+#include <coroutine>
+#include <cstddef>
+#include <functional>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include <connline/connline.h>
+
+namespace connline {
+
+using event = connline_event;
+using bearer = connline_bearer;
+using event_loop = connline_event_loop;
+
+/**
+ * Library lifetime
+ * connline_init() on construction and, if it succeeded, connline_cleanup()
+ * on destruction.  Contexts must be gone before it is.
+ */
+class library {
+public:
+	explicit library(event_loop type, void *data = nullptr) noexcept
+		: error_(connline_init(type, data)) {}
+
+	~library()
+	{
+		if (error_ == 0)
+			connline_cleanup();
+	}
+
+	library(const library &) = delete;
+	library &operator=(const library &) = delete;
+
+	/**
+	 * @return 0 if connline got initialized, or a negative value instead
+	 */
+	int error() const noexcept { return error_; }
+
+	explicit operator bool() const noexcept { return error_ == 0; }
+
+private:
+	int error_;
+};
+
+/**
+ * View over the properties array given along CONNLINE_EVENT_PROPERTY
+ * Iterating yields  (key, value)  pairs.  It is only valid within the
+ * handler it was given to: connline frees the array right after.
+ */
+class properties {
+public:
+	using value_type = std::pair<std::string_view, std::string_view>;
+
+	class iterator {
+	public:
+		using value_type = properties::value_type;
+		using difference_type = std::ptrdiff_t;
+
+		iterator() noexcept = default;
+		explicit iterator(const char **position) noexcept
+			: position_(position) {}
+
+		value_type operator*() const noexcept
+		{
+			return { position_[0], position_[1] };
+		}
+
+		iterator &operator++() noexcept
+		{
+			position_ += 2;
+			return *this;
+		}
+
+		iterator operator++(int) noexcept
+		{
+			iterator previous = *this;
+
+			position_ += 2;
+			return previous;
+		}
+
+		bool operator==(const iterator &other) const noexcept
+		{
+			return at_end() == other.at_end() &&
+				(at_end() || position_ == other.position_);
+		}
+
+	private:
+		bool at_end() const noexcept
+		{
+			return position_ == nullptr || *position_ == nullptr;
+		}
+
+		const char **position_ = nullptr;
+	};
+
+	properties() noexcept = default;
+	explicit properties(const char **array) noexcept : array_(array) {}
+
+	iterator begin() const noexcept { return iterator(array_); }
+	iterator end() const noexcept { return iterator(); }
+
+	bool empty() const noexcept { return begin() == end(); }
+
+	/**
+	 * @param key a property name
+	 * @return its value, or an empty view if it is not there
+	 */
+	std::string_view find(std::string_view key) const noexcept
+	{
+		for (const auto &[name, value] : *this) {
+			if (name == key)
+				return value;
+		}
+
+		return {};
+	}
+
+	const char **data() const noexcept { return array_; }
+
+private:
+	const char **array_ = nullptr;
+};
+
+/**
+ * Owner of a connline context
+ * Move-only, and closes the context when destroyed or reset.  Moving it
+ * does not move the handler's object: that one must outlive the context.
+ */
+class context {
+public:
+	context() noexcept = default;
+	explicit context(struct connline_context *handle) noexcept
+		: handle_(handle) {}
+
+	~context() { reset(); }
+
+	context(const context &) = delete;
+	context &operator=(const context &) = delete;
+
+	context(context &&other) noexcept
+		: handle_(std::exchange(other.handle_, nullptr)) {}
+
+	context &operator=(context &&other) noexcept
+	{
+		if (this != &other)
+			reset(std::exchange(other.handle_, nullptr));
+
+		return *this;
+	}
+
+	void reset(struct connline_context *handle = nullptr) noexcept
+	{
+		struct connline_context *previous;
+
+		previous = std::exchange(handle_, handle);
+		if (previous != nullptr)
+			connline_close(previous);
+	}
+
+	struct connline_context *release() noexcept
+	{
+		return std::exchange(handle_, nullptr);
+	}
+
+	struct connline_context *get() const noexcept { return handle_; }
+
+	explicit operator bool() const noexcept { return handle_ != nullptr; }
+
+	bool is_online() const noexcept
+	{
+		return handle_ != nullptr && connline_is_online(handle_);
+	}
+
+	/**
+	 * @param event_mask see connline_set_event_mask()
+	 * @return 0 on success or a negative value instead
+	 */
+	int set_event_mask(unsigned int event_mask) noexcept
+	{
+		if (handle_ == nullptr)
+			return -EINVAL;
+
+		return connline_set_event_mask(handle_, event_mask);
+	}
+
+	connline::bearer bearer() const noexcept
+	{
+		if (handle_ == nullptr)
+			return CONNLINE_BEARER_UNKNOWN;
+
+		return connline_get_bearer(handle_);
+	}
+
+private:
+	struct connline_context *handle_ = nullptr;
+};
+
+namespace detail {
+
+/*
+ * Handlers take (event, properties), optionally preceded by the raw
+ * context so they can query it from within the event.
+ */
+template <typename Handler, typename... Object>
+inline void invoke(Handler &&handler, struct connline_context *ctx,
+			event ev, const char **props, Object &&...object)
+{
+	if constexpr (std::is_invocable_v<Handler, Object...,
+					struct connline_context *,
+					event, properties>)
+		std::invoke(std::forward<Handler>(handler),
+				std::forward<Object>(object)...,
+				ctx, ev, properties(props));
+	else
+		std::invoke(std::forward<Handler>(handler),
+				std::forward<Object>(object)...,
+				ev, properties(props));
+}
+
+template <auto Method, typename T>
+void member_callback(struct connline_context *ctx, event ev,
+				const char **props, void *user_data)
+{
+	invoke(Method, ctx, ev, props, *static_cast<T *>(user_data));
+}
+
+template <auto Function>
+void function_callback(struct connline_context *ctx, event ev,
+				const char **props, void *user_data)
+{
+	invoke(Function, ctx, ev, props);
+}
+
+} /* namespace detail */
+
+/**
+ * Open a context whose events go to a member function of object
+ * @param object receiver of the events, outliving the returned context
+ * @param bearers mask of the connline_bearer values the context accepts
+ * @param background true to only be notified, see connline_open()
+ * @return the context, empty if connline_open() failed
+ */
+template <auto Method, typename T>
+inline context open(T &object, unsigned int bearers,
+				bool background = true) noexcept
+{
+	return context(connline_open(static_cast<bearer>(bearers), background,
+				&detail::member_callback<Method, T>,
+				static_cast<void *>(std::addressof(object))));
+}
+
+/**
+ * Open a context whose events go to a function, or a captureless lambda
+ * @param bearers mask of the connline_bearer values the context accepts
+ * @param background true to only be notified, see connline_open()
+ * @return the context, empty if connline_open() failed
+ */
+template <auto Function>
+inline context open(unsigned int bearers, bool background = true) noexcept
+{
+	return context(connline_open(static_cast<bearer>(bearers), background,
+				&detail::function_callback<Function>,
+				nullptr));
+}
+
+/**
+ * Outcome of co_await connline::online() or connline::offline()
+ * reached is false when connline reported an error instead.
+ */
+struct status {
+	bool reached;
+	connline::bearer bearer;
+
+	explicit operator bool() const noexcept { return reached; }
+};
+
+namespace detail {
+
+/*
+ * The awaiter lives in the awaiting coroutine's frame,  and is what the
+ * context's user_data points to: waiting allocates nothing but the
+ * context itself.  The coroutine is resumed right from the event,  and
+ * closes the context in await_resume(),  which connline allows from
+ * within a callback.
+ */
+template <bool Online>
+class state_awaiter {
+public:
+	state_awaiter(unsigned int bearers, bool background) noexcept
+		: bearers_(bearers), background_(background) {}
+
+	~state_awaiter()
+	{
+		if (context_ != nullptr)
+			connline_close(context_);
+	}
+
+	state_awaiter(const state_awaiter &) = delete;
+	state_awaiter &operator=(const state_awaiter &) = delete;
+
+	bool await_ready() const noexcept { return false; }
+
+	bool await_suspend(std::coroutine_handle<> handle) noexcept
+	{
+		handle_ = handle;
+
+		context_ = connline_open(static_cast<bearer>(bearers_),
+						background_, &callback, this);
+		if (context_ == nullptr)
+			return false;
+
+		/* Properties are not needed to tell the state */
+		connline_set_event_mask(context_,
+			CONNLINE_EVENT_MASK(CONNLINE_EVENT_CONNECTED) |
+			CONNLINE_EVENT_MASK(CONNLINE_EVENT_DISCONNECTED));
+
+		return true;
+	}
+
+	status await_resume() noexcept
+	{
+		if (context_ != nullptr) {
+			connline_close(context_);
+			context_ = nullptr;
+		}
+
+		return result_;
+	}
+
+private:
+	static void callback(struct connline_context *ctx, event ev,
+				const char **props, void *user_data)
+	{
+		state_awaiter *self = static_cast<state_awaiter *>(user_data);
+
+		switch (ev) {
+		case CONNLINE_EVENT_ERROR:
+		case CONNLINE_EVENT_NO_BACKEND:
+			break;
+		case CONNLINE_EVENT_TIMEOUT:
+			/* Asked again: the state may still come */
+			return;
+		case CONNLINE_EVENT_DISCONNECTED:
+			if (Online)
+				return;
+
+			self->result_.reached = true;
+			break;
+		case CONNLINE_EVENT_CONNECTED:
+		case CONNLINE_EVENT_PROPERTY:
+			if (!Online || !connline_is_online(ctx))
+				return;
+
+			self->result_.reached = true;
+			self->result_.bearer = connline_get_bearer(ctx);
+			break;
+		}
+
+		/* self is likely gone once resumed */
+		self->handle_.resume();
+	}
+
+	unsigned int bearers_;
+	bool background_;
+
+	struct connline_context *context_ = nullptr;
+	std::coroutine_handle<> handle_;
+	status result_ = { false, CONNLINE_BEARER_UNKNOWN };
+};
+
+} /* namespace detail */
+
+/**
+ * Wait, in a coroutine, for a connection on one of the given bearers
+ * co_await connline::online() opens a context for the wait and closes it
+ * when resuming.  It does not suspend if the context cannot be opened.
+ * @param bearers mask of the connline_bearer values to wait for
+ * @param background true to only wait, false to request the connection
+ * @return an awaitable yielding a connline::status
+ */
+inline detail::state_awaiter<true> online(
+			unsigned int bearers = CONNLINE_BEARER_UNKNOWN,
+			bool background = true) noexcept
+{
+	return detail::state_awaiter<true>(bearers, background);
+}
+
+/**
+ * Wait, in a coroutine, for no connection on the given bearers
+ * @param bearers mask of the connline_bearer values to watch
+ * @return an awaitable yielding a connline::status
+ */
+inline detail::state_awaiter<false> offline(
+			unsigned int bearers = CONNLINE_BEARER_UNKNOWN) noexcept
+{
+	return detail::state_awaiter<false>(bearers, true);
+}
+
+} /* namespace connline */
+
+#endif
@@ -27,6 +27,36 @@
 #include <errno.h>
 #include <dbus/dbus.h>
 
+/* Disconnections and errors, connections, then properties */
+#define CONNLINE_TRIGGER_RANKS 3
+
+struct connline_trigger;
+
+enum connline_context_state {
+	CONNLINE_CONTEXT_OPENING      = 0,
+	CONNLINE_CONTEXT_CONNECTED    = 1,
+	CONNLINE_CONTEXT_DISCONNECTED = 2,
+	CONNLINE_CONTEXT_INVALID      = 3,
+};
+
+enum connline_command_type {
+	CONNLINE_COMMAND_OPEN  = 0,
+	CONNLINE_COMMAND_CLOSE = 1,
+	CONNLINE_COMMAND_OPEN_MANY = 2,
+};
+
+/* Queued by other threads, in thread-safe mode, see src/command.c */
+struct connline_command {
+	struct connline_command *next;
+	enum connline_command_type type;
+	struct connline_context *context;
+};
+
+/* What other threads read of a context, in thread-safe mode */
+#define CONNLINE_PUBLISHED_ONLINE (1U << 31)
+
+struct connline_group;
+
 struct connline_context {
 	DBusConnection *dbus_cnx;
 
@@ -35,10 +65,64 @@ struct connline_context {
 
 	connline_callback_f event_callback;
 	void *user_data;
+	unsigned int event_mask;
+	/* In milliseconds, 0 for none */
+	unsigned int deadline;
 
 	bool is_online;
 
 	void *backend_data;
+
+	/*
+	 * Opened by connline_open_many(): the backend skips the checks done
+	 * once for the group, and does not wait for the bus.
+	 */
+	struct connline_group *group;
+	bool pipelined;
+	/* Its first event happened, whether it was delivered or not */
+	bool group_noted;
+
+	/* Statistics, see src/event.c */
+	enum connline_context_state state;
+	bool got_event;
+	unsigned long opened_at;
+
+	/* Pending triggers, in queuing order, see src/event.c */
+	struct connline_trigger *triggers;
+	struct connline_trigger *last_trigger;
+	unsigned int ranked_triggers[CONNLINE_TRIGGER_RANKS];
+	unsigned int pending_triggers;
+	/* In the trigger queue, plus one: 0 when not queued */
+	unsigned int trigger_slot;
+
+	/* Thread-safe mode */
+	struct connline_command open_command;
+	struct connline_command close_command;
+	bool closing;
+	unsigned int published;
+};
+
+/* Contexts connline_open_many() allocated in one block, see src/group.c */
+struct connline_group {
+	/* Waiting for its completion to be called */
+	struct connline_group *next;
+	bool completing;
+
+	connline_completion_f completion;
+	void *completion_data;
+
+	/* For the members without a callback, instead of the global one */
+	connline_batch_callback_f batch_callback;
+	void *batch_data;
+
+	/* Not closed yet, and without any event yet */
+	unsigned int members;
+	unsigned int waiting;
+
+	struct connline_command open_command;
+
+	unsigned int nb_contexts;
+	struct connline_context contexts[];
 };
 
 #endif
@@ -21,6 +21,8 @@
 #ifndef __CONNLINE_DBUS_H__
 #define __CONNLINE_DBUS_H__
 
+#include <connline/token.h>
+
 #include <dbus/dbus.h>
 #include <stdbool.h>
 
@@ -28,6 +30,10 @@
 	#define DBUS_TIMEOUT_USE_DEFAULT (-1)
 #endif
 
+#ifndef DBUS_TIMEOUT_INFINITE
+	#define DBUS_TIMEOUT_INFINITE 0x7fffffff
+#endif
+
 #define DBUS_SERVICE_OWNER_CHANGED "NameOwnerChanged"
 
 /* 
@@ -40,6 +46,17 @@ enum connline_dbus_entry {
 	CONNLINE_DBUS_ENTRY_ARRAY       = 1,
 	CONNLINE_DBUS_ENTRY_FIXED_ARRAY = 2,
 	CONNLINE_DBUS_ENTRY_DICT        = 3,
+	CONNLINE_DBUS_ENTRY_ARRAY_VIEW  = 4,
+};
+
+/*
+ * Zero-copy access to an array of strings, object paths or signatures.
+ * Returned values point into the DBusMessage, thus it must stay referenced
+ * as long as they are in use.
+ */
+struct connline_dbus_array_view {
+	DBusMessageIter iter;
+	int dbus_type;
 };
 
 typedef void (*connline_dbus_property_f) (DBusMessageIter *iter,
@@ -148,6 +165,15 @@ int connline_dbus_get_fixed_array(DBusMessageIter *iter,
 					int *length,
 					void *destination);
 
+int connline_dbus_get_array_view(DBusMessageIter *iter,
+				int dbus_type,
+				struct connline_dbus_array_view *view);
+
+/* Returns NULL once all the elements have been walked through */
+const char *connline_dbus_array_view_next(struct connline_dbus_array_view *view);
+
+int connline_dbus_array_view_length(struct connline_dbus_array_view *view);
+
 
 int connline_dbus_foreach_dict_entry(DBusMessageIter *iter,
 				connline_dbus_foreach_callback_f callback,
@@ -197,6 +223,17 @@ int connline_dbus_get_dict_entry_fixed_array(DBusMessageIter *iter,
 					dbus_type, length, destination);
 }
 
+static inline
+int connline_dbus_get_dict_entry_array_view(DBusMessageIter *iter,
+				const char *key_name,
+				int dbus_type,
+				struct connline_dbus_array_view *view)
+{
+	return connline_dbus_get_dict_entry(iter, key_name,
+					CONNLINE_DBUS_ENTRY_ARRAY_VIEW,
+					dbus_type, NULL, view);
+}
+
 static inline
 int connline_dbus_get_dict_entry_dict(DBusMessageIter *iter,
 					const char *key_name,
@@ -250,6 +287,17 @@ int connline_dbus_get_struct_entry_fixed_array(DBusMessageIter *iter,
 					dbus_type, length, destination);
 }
 
+static inline
+int connline_dbus_get_struct_entry_array_view(DBusMessageIter *iter,
+				unsigned int position,
+				int dbus_type,
+				struct connline_dbus_array_view *view)
+{
+	return connline_dbus_get_struct_entry(iter, position,
+					CONNLINE_DBUS_ENTRY_ARRAY_VIEW,
+					dbus_type, NULL, view);
+}
+
 static inline
 int connline_dbus_get_struct_entry_dict(DBusMessageIter *iter,
 						unsigned int position,
@@ -260,6 +308,20 @@ int connline_dbus_get_struct_entry_dict(DBusMessageIter *iter,
 					DBUS_TYPE_INVALID, NULL, dict);
 }
 
+/*
+ * Same as dbus_message_new_method_call(), but the message is built only once
+ * per destination/path/interface/method, and then copied.  Arguments are
+ * appended by the caller, as usual.  Patching the path of a copy costs more
+ * than building a new message, and templates are kept until cleanup: do not
+ * use it for short-lived object paths, such as devices or links.
+ */
+DBusMessage *connline_dbus_new_method_call(const char *destination,
+						const char *path,
+						const char *interface,
+						const char *method);
+
+void connline_dbus_cleanup_method_calls(void);
+
 static inline dbus_bool_t connline_dbus_is_service_running(DBusConnection *dbus_cnx,
 					const char *dbus_service_name)
 {
@@ -270,6 +332,27 @@ static inline dbus_bool_t connline_dbus_is_service_running(DBusConnection *dbus_
 	return TRUE;
 }
 
+/*
+ * dbus_message_is_signal(), but the member is matched through its token:
+ * a filter sees all the messages of the connection,  mostly for others.
+ * A NULL interface matches any.
+ */
+static inline bool connline_dbus_is_signal(DBusMessage *message,
+						const char *interface,
+						enum connline_token member)
+{
+	if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_SIGNAL)
+		return false;
+
+	if (connline_token_lookup(dbus_message_get_member(message)) != member)
+		return false;
+
+	if (interface == NULL)
+		return true;
+
+	return dbus_message_has_interface(message, interface) == TRUE;
+}
+
 int connline_dbus_setup_watch(DBusConnection *dbus_cnx,
 					const char *rule,
 					DBusHandleMessageFunction filter,
@@ -280,4 +363,53 @@ void connline_dbus_remove_watch(DBusConnection *dbus_cnx,
 					DBusHandleMessageFunction filter,
 					void *user_data);
 
+/*
+ * Same as above, but the match rule is sent without waiting for the bus
+ * to answer: a failure to add it goes unnoticed.  Opening many contexts
+ * at once does not then cost a round trip each.
+ */
+int connline_dbus_setup_watch_nowait(DBusConnection *dbus_cnx,
+					const char *rule,
+					DBusHandleMessageFunction filter,
+					void *user_data);
+
+void connline_dbus_remove_watch_nowait(DBusConnection *dbus_cnx,
+					const char *rule,
+					DBusHandleMessageFunction filter,
+					void *user_data);
+
+struct connline_context;
+
+/*
+ * dbus_connection_send_with_reply() and dbus_pending_call_set_notify() at
+ * once, the reply being waited for until the context's deadline, if it has
+ * one, see connline_set_deadline(), or for the D-Bus default timeout.  Past
+ * the deadline, the context gets CONNLINE_EVENT_TIMEOUT and the message is
+ * sent again later, *pending being replaced:  the notify function only ever
+ * sees a reply.  *pending is to be dropped with connline_dbus_cancel_call(),
+ * not with dbus_pending_call_cancel(), until the function got called.
+ * Without a context, as for calls shared by many, there is no deadline.
+ */
+int connline_dbus_send_with_deadline(struct connline_context *context,
+					DBusConnection *dbus_cnx,
+					DBusMessage *message,
+					DBusPendingCall **pending,
+					DBusPendingCallNotifyFunction function,
+					void *user_data);
+
+/*
+ * The same,  for requests doing something each time they are received, as
+ * creating a session:  past the deadline,  the message is not sent again
+ * but its reply is waited for until the next one,  *pending being kept.
+ */
+int connline_dbus_send_once_with_deadline(struct connline_context *context,
+					DBusConnection *dbus_cnx,
+					DBusMessage *message,
+					DBusPendingCall **pending,
+					DBusPendingCallNotifyFunction function,
+					void *user_data);
+
+/* Cancels and releases *pending, which is set to NULL, if not already */
+void connline_dbus_cancel_call(DBusPendingCall **pending);
+
 #endif /* __CONNLINE_DBUS_H__ */
@@ -23,7 +23,7 @@
 
 #include <connline/data.h>
 
-typedef DBusConnection *(*__connline_setup_event_loop_f) (void *);
+typedef int (*__connline_setup_event_loop_f) (DBusConnection *, void *);
 typedef int (*__connline_trigger_callback_f) (struct connline_context *,
 						connline_callback_f,
 						enum connline_event,
@@ -31,6 +31,12 @@ typedef int (*__connline_trigger_callback_f) (struct connline_context *,
 typedef void (*__connline_trigger_cleanup_f) (struct connline_context *);
 typedef void (*__connline_cleanup_event_loop_f) (DBusConnection *);
 
+/* Called when the fd is readable, or hung up */
+typedef void (*__connline_fd_callback_f) (int, void *);
+typedef int (*__connline_watch_fd_f) (void *, int,
+					__connline_fd_callback_f, void *);
+typedef void (*__connline_unwatch_fd_f) (int);
+
 
 int __connline_trigger_callback(struct connline_context *context,
 					connline_callback_f callback,
@@ -39,11 +45,62 @@ int __connline_trigger_callback(struct connline_context *context,
 
 void __connline_trigger_cleanup(struct connline_context *context);
 
+/* To be called when a group member gets its first event, see src/group.c */
+void __connline_group_event(struct connline_context *context);
+
+/* Before the callback and mask checks:  a group does not wait for those */
+static inline void __connline_note_event(struct connline_context *context)
+{
+	if (context->group != NULL && context->group_noted == false)
+		__connline_group_event(context);
+}
+
+int __connline_watch_fd(void *data, int fd,
+			__connline_fd_callback_f callback, void *user_data);
+
+void __connline_unwatch_fd(int fd);
+
+/* Dispatches within the budget, returns true if messages are left */
+bool __connline_dispatch_dbus(DBusConnection *dbus_cnx);
+
+/* Contexts without a callback of their own are delivered in batches */
+bool __connline_has_batch_callback(void);
+
+static inline bool __connline_has_callback(struct connline_context *context)
+{
+	if (context->event_callback != NULL)
+		return true;
+
+	if (context->group != NULL && context->group->batch_callback != NULL)
+		return true;
+
+	return __connline_has_batch_callback();
+}
+
+/* Errors are delivered whatever the mask */
+static inline
+bool __connline_wants_event(struct connline_context *context,
+						enum connline_event event)
+{
+	if (__connline_has_callback(context) == false)
+		return false;
+
+	if (event == CONNLINE_EVENT_ERROR ||
+				event == CONNLINE_EVENT_NO_BACKEND)
+		return true;
+
+	/* Other threads may change it, in thread-safe mode */
+	return (__atomic_load_n(&context->event_mask, __ATOMIC_RELAXED) &
+					CONNLINE_EVENT_MASK(event)) != 0;
+}
+
 static inline
 void __connline_call_error_callback(struct connline_context *context,
 							bool no_backend)
 {
-	if (context->event_callback != NULL) {
+	__connline_note_event(context);
+
+	if (__connline_has_callback(context) == true) {
 		__connline_trigger_cleanup(context);
 
 		__connline_trigger_callback(context,
@@ -57,7 +114,9 @@ void __connline_call_error_callback(struct connline_context *context,
 static inline
 void __connline_call_disconnected_callback(struct connline_context *context)
 {
-	if (context->event_callback != NULL)
+	__connline_note_event(context);
+
+	if (__connline_has_callback(context) == true)
 		__connline_trigger_callback(context,
 					context->event_callback,
 					CONNLINE_EVENT_DISCONNECTED, NULL);
@@ -66,17 +125,32 @@ void __connline_call_disconnected_callback(struct connline_context *context)
 static inline
 void __connline_call_connected_callback(struct connline_context *context)
 {
-	if (context->event_callback != NULL)
+	__connline_note_event(context);
+
+	if (__connline_has_callback(context) == true)
 		__connline_trigger_callback(context,
 					context->event_callback,
 					CONNLINE_EVENT_CONNECTED, NULL);
 }
 
+static inline
+void __connline_call_timeout_callback(struct connline_context *context)
+{
+	__connline_note_event(context);
+
+	if (__connline_has_callback(context) == true)
+		__connline_trigger_callback(context,
+					context->event_callback,
+					CONNLINE_EVENT_TIMEOUT, NULL);
+}
+
 static inline
 void __connline_call_property_callback(struct connline_context *context,
 							char **property_values)
 {
-	if (context->event_callback != NULL)
+	__connline_note_event(context);
+
+	if (__connline_has_callback(context) == true)
 		__connline_trigger_callback(context,
 					context->event_callback,
 					CONNLINE_EVENT_PROPERTY,
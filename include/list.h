@@ -21,7 +21,7 @@
 #ifndef __LIST_H__
 #define __LIST_H__
 
-#include <stdlib.h>
+#include <connline/alloc.h>
 
 struct _dlist;
 typedef struct _dlist dlist;
@@ -30,7 +30,7 @@ typedef void (*dlist_data_cb_f)(void *data);
 
 static inline void dlist_free(dlist *list)
 {
-	free(list);
+	__connline_free(list);
 }
 
 void dlist_free_all(dlist *list);
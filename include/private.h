@@ -33,16 +33,21 @@ struct connline_event_loop_plugin {
 	__connline_trigger_callback_f trigger_callback;
 	__connline_trigger_cleanup_f trigger_cleanup;
 	__connline_cleanup_event_loop_f cleanup_event_loop;
+
+	/* Optional, only the broker mode needs them */
+	__connline_watch_fd_f watch_fd;
+	__connline_unwatch_fd_f unwatch_fd;
 };
 
 int __connline_setup_event_loop(enum connline_event_loop event_loop_type);
 
-DBusConnection *__connline_setup_dbus_event_loop(void *data);
+int __connline_setup_dbus_event_loop(DBusConnection *dbus_cnx, void *data);
 
 void __connline_cleanup_event_loop(DBusConnection *dbus_cnx);
 
 #include <connline/backend.h>
 
+/* Daemonless backends, with no service name, are used when no daemon runs */
 struct connline_backend_plugin {
 	void *handle;
 
@@ -59,12 +64,73 @@ void __connline_close(struct connline_context *context);
 
 void __connline_disconnect_contexts(void);
 
+void __connline_close_contexts(void);
+
 void __connline_reconnect_contexts(void);
 
 void __connline_invalidate_contexts(void);
 
+void __connline_count_contexts(struct connline_stats *stats);
+
 void __connline_cleanup_backend(void);
 
+int __connline_setup_broker(void *data);
+
+void __connline_cleanup_broker(void);
+
+void __connline_notify_online_contexts(void);
+
+/* To be called on the loop thread, whenever a context state may change */
+void __connline_publish_state(struct connline_context *context);
+
+typedef void (*__connline_command_f) (struct connline_command *);
+
+int __connline_setup_commands(void *data, __connline_command_f run);
+
+void __connline_cleanup_commands(void);
+
+/* True as well when not in thread-safe mode */
+bool __connline_is_loop_thread(void);
+
+void __connline_push_command(struct connline_command *command);
+
+struct connline_group *__connline_group_new(unsigned int nb_contexts,
+					connline_completion_f completion,
+					void *completion_data);
+
+void __connline_complete_groups(void);
+
+/* Runs the completions of the groups at the next dispatch */
+int __connline_schedule_completions(void);
+
+/* Frees the context, or its group once all of the group are released */
+void __connline_group_release(struct connline_context *context);
+
+/* Whether the daemon of the backend in use is there, true without any */
+bool __connline_backend_is_running(void);
+
+void __connline_setup_calls(void *data);
+
+void __connline_update_deadlines(struct connline_context *context);
+
+/* Forgets about the requests the plugins did not cancel */
+void __connline_cleanup_calls(void);
+
+void __connline_setup_probe(void *data);
+
+void __connline_cleanup_probe(void);
+
+/* Tells the probe about contexts going connected, or not anymore */
+void __connline_probe_connected(void);
+
+void __connline_probe_changed(void);
+
+bool __connline_probe_is_online(void);
+
+int __connline_setup_record(DBusConnection *dbus_cnx);
+
+void __connline_cleanup_record(DBusConnection *dbus_cnx);
+
 struct connline_event_loop_plugin *
 __connline_load_event_loop_plugin(enum connline_event_loop event_loop_type);
 
@@ -0,0 +1,62 @@
+/*
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License version 2.1,
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNLINE_RECORD_H__
+#define __CONNLINE_RECORD_H__
+
+#include <stdint.h>
+
+/*
+ * With CONNLINE_RECORD set to a file path, connline records there every
+ * signal and method call its D-Bus connection gets, before its own
+ * filters and object paths see them.  The file is a header followed by
+ * entries, each made of a struct connline_record_entry and then size
+ * bytes of the message, as dbus_message_marshal() serializes it.
+ */
+#define CONNLINE_RECORD_ENV "CONNLINE_RECORD"
+
+#define CONNLINE_RECORD_MAGIC "CLRECORD"
+#define CONNLINE_RECORD_VERSION 1
+
+/*
+ * The netlink backend records, with CONNLINE_NETLINK_RECORD set, every
+ * rtnetlink datagram it gets in the same format, under its own magic.
+ * With CONNLINE_NETLINK_REPLAY set, it reads them back instead of
+ * listening to the kernel.
+ */
+#define CONNLINE_NETLINK_RECORD_ENV "CONNLINE_NETLINK_RECORD"
+#define CONNLINE_NETLINK_REPLAY_ENV "CONNLINE_NETLINK_REPLAY"
+
+#define CONNLINE_NETLINK_RECORD_MAGIC "CLNETLNK"
+
+struct connline_record_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+};
+
+struct connline_record_entry {
+	/* Monotonic time, in nanoseconds */
+	uint64_t timestamp;
+	uint32_t size;
+	uint32_t reserved;
+};
+
+#endif
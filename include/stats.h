@@ -0,0 +1,73 @@
+/*
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License version 2.1,
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNLINE_STATS_H__
+#define __CONNLINE_STATS_H__
+
+#include <connline/data.h>
+#include <connline/trace.h>
+
+enum connline_stats_counter {
+	CONNLINE_STATS_DBUS_CALLS       = 0,
+	CONNLINE_STATS_DBUS_REPLIES     = 1,
+	CONNLINE_STATS_DBUS_SIGNALS     = 2,
+	CONNLINE_STATS_MATCH_RULES      = 3,
+	CONNLINE_STATS_TRIGGERS_QUEUED  = 4,
+	CONNLINE_STATS_TRIGGERS_DROPPED = 5,
+	CONNLINE_STATS_ALLOCATIONS      = 6,
+	CONNLINE_STATS_DBUS_DISPATCHED  = 7,
+	CONNLINE_STATS_DISPATCH_YIELDS  = 8,
+	CONNLINE_STATS_DBUS_TIMEOUTS    = 9,
+	/* Bytes in use, one counter per enum connline_memory */
+	CONNLINE_STATS_MEMORY           = 10,
+	CONNLINE_STATS_COUNTERS_MAX     = 10 + CONNLINE_MEMORY_MAX,
+};
+
+enum connline_stats_histogram {
+	CONNLINE_STATS_FIRST_EVENT_LATENCY = 0,
+	CONNLINE_STATS_ROUND_TRIP          = 1,
+	CONNLINE_STATS_CALLBACK_DELAY      = 2,
+	CONNLINE_STATS_HISTOGRAMS_MAX      = 3,
+};
+
+/* Monotonic time, in microseconds */
+unsigned long __connline_stats_now(void);
+
+void __connline_stats_add(enum connline_stats_counter counter, long value);
+
+/* Records the time elapsed since start, as given by __connline_stats_now() */
+void __connline_stats_record(enum connline_stats_histogram histogram,
+							unsigned long start);
+
+/* To be called once a method call has been sent, pending being its reply */
+void __connline_stats_call(DBusPendingCall *pending);
+
+/* To be called from the pending call notify function */
+void __connline_stats_reply(DBusPendingCall *pending);
+
+/* To be called by watch callbacks, member being the handled signal */
+static inline void __connline_stats_signal(const char *member)
+{
+	CONNLINE_TRACE1(dbus_signal, member);
+
+	__connline_stats_add(CONNLINE_STATS_DBUS_SIGNALS, 1);
+}
+
+#endif
@@ -0,0 +1,163 @@
+/*
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License version 2.1,
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNLINE_TRACE_H__
+#define __CONNLINE_TRACE_H__
+
+#include <config.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Connline keeps its last CONNLINE_TRACE_RECORDS trace points in memory,
+ * as fixed-size binary records.  Writers take a slot with an atomic  add
+ * and never wait, the sequence being stored last tells a complete record.
+ * connline_trace_dump() writes a header followed by the records, oldest
+ * first, up to the end of file: tools/connline-trace decodes it.
+ */
+#define CONNLINE_TRACE_RECORDS 4096
+
+#define CONNLINE_TRACE_MAGIC "CLTRACE"
+#define CONNLINE_TRACE_VERSION 1
+
+enum connline_trace_event {
+	CONNLINE_TRACE_DEBUG            = 0,
+	CONNLINE_TRACE_CONTEXT_OPEN     = 1,
+	CONNLINE_TRACE_CONTEXT_CLOSE    = 2,
+	CONNLINE_TRACE_BACKEND_SETUP    = 3,
+	CONNLINE_TRACE_BACKEND_TEARDOWN = 4,
+	CONNLINE_TRACE_DBUS_CALL        = 5,
+	CONNLINE_TRACE_DBUS_REPLY       = 6,
+	CONNLINE_TRACE_DBUS_SIGNAL      = 7,
+	CONNLINE_TRACE_TRIGGER_QUEUE    = 8,
+	CONNLINE_TRACE_TRIGGER_RUN      = 9,
+	CONNLINE_TRACE_EVENTS_MAX       = 10,
+};
+
+#define CONNLINE_TRACE_STRING_SIZE 16
+
+/*
+ * arg is a small integer: a bearer, an event, a line or a status.
+ * data holds either a pointer, or a string cut to 15 characters.
+ */
+struct connline_trace_record {
+	uint64_t sequence;
+	uint64_t timestamp;
+	uint64_t context;
+	uint32_t event;
+	uint32_t arg;
+	union {
+		uint64_t value;
+		char string[CONNLINE_TRACE_STRING_SIZE];
+	} data;
+};
+
+struct connline_trace_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+};
+
+void __connline_trace_write(enum connline_trace_event event,
+				const void *context, unsigned int arg,
+				uint64_t value);
+
+void __connline_trace_write_string(enum connline_trace_event event,
+					const void *context, unsigned int arg,
+					const char *string);
+
+static inline void __connline_trace_context_open(const void *context,
+							unsigned int bearer)
+{
+	__connline_trace_write(CONNLINE_TRACE_CONTEXT_OPEN,
+						context, bearer, 0);
+}
+
+static inline void __connline_trace_context_close(const void *context)
+{
+	__connline_trace_write(CONNLINE_TRACE_CONTEXT_CLOSE, context, 0, 0);
+}
+
+static inline void __connline_trace_backend_setup(const char *service,
+							unsigned int ok)
+{
+	__connline_trace_write_string(CONNLINE_TRACE_BACKEND_SETUP,
+							NULL, ok, service);
+}
+
+static inline void __connline_trace_backend_teardown(const char *service)
+{
+	__connline_trace_write_string(CONNLINE_TRACE_BACKEND_TEARDOWN,
+							NULL, 0, service);
+}
+
+static inline void __connline_trace_dbus_call(const void *pending)
+{
+	__connline_trace_write(CONNLINE_TRACE_DBUS_CALL,
+					NULL, 0, (uintptr_t) pending);
+}
+
+static inline void __connline_trace_dbus_reply(const void *pending)
+{
+	__connline_trace_write(CONNLINE_TRACE_DBUS_REPLY,
+					NULL, 0, (uintptr_t) pending);
+}
+
+static inline void __connline_trace_dbus_signal(const char *member)
+{
+	__connline_trace_write_string(CONNLINE_TRACE_DBUS_SIGNAL,
+							NULL, 0, member);
+}
+
+static inline void __connline_trace_trigger_queue(const void *context,
+							unsigned int event)
+{
+	__connline_trace_write(CONNLINE_TRACE_TRIGGER_QUEUE,
+						context, event, 0);
+}
+
+static inline void __connline_trace_trigger_run(const void *context,
+							unsigned int event)
+{
+	__connline_trace_write(CONNLINE_TRACE_TRIGGER_RUN, context, event, 0);
+}
+
+/*
+ * Every trace point lands in the ring buffer.  With --enable-usdt, it is
+ * also a static tracepoint, under the "connline" provider, for SystemTap
+ * or bpftrace: a single nop until a tracer attaches to it.
+ */
+#ifdef CONNLINE_USDT
+#include <sys/sdt.h>
+#define CONNLINE_TRACE1(name, a) { \
+	DTRACE_PROBE1(connline, name, a); \
+	__connline_trace_##name(a); \
+}
+#define CONNLINE_TRACE2(name, a, b) { \
+	DTRACE_PROBE2(connline, name, a, b); \
+	__connline_trace_##name(a, b); \
+}
+#else
+#define CONNLINE_TRACE1(name, a) __connline_trace_##name(a)
+#define CONNLINE_TRACE2(name, a, b) __connline_trace_##name(a, b)
+#endif
+
+#endif
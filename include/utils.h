@@ -23,20 +23,31 @@
 
 #include <config.h>
 #include <connline/connline.h>
+#include <connline/trace.h>
+
+#include <stddef.h>
+
+/* Always recorded, as function and line, in the trace ring buffer */
+#define DBG_TRACE() __connline_trace_write_string(CONNLINE_TRACE_DEBUG, \
+					NULL, __LINE__, __FUNCTION__)
 
 #ifdef DEBUG
 #include <stdio.h>
 #define DBG(fmt, arg...) { \
+	DBG_TRACE(); \
 	fprintf(stdout, "DBG:%s:%s() " fmt "\n", \
 		__FILE__, __FUNCTION__ , ## arg); \
 }
 #else
-#define DBG(fmt, arg...) {}
+#define DBG(fmt, arg...) DBG_TRACE()
 #endif
 
-char *get_process_name(void);
+/* <process name>_<pid>_<counter> */
+#define UNIQUE_NAME_SIZE 64
 
-char *get_new_unique_name(void);
+int setup_unique_name_prefix(void);
+
+int get_new_unique_name(char *name, size_t size);
 
 char **insert_into_property_list(char **properties,
 					const char *name,
@@ -46,4 +57,7 @@ void property_list_free(char **properties);
 
 const char *connline_bearer_to_string(enum connline_bearer bearer);
 
+/* From sysfs, with the ARPHRD link type if known, else -1 */
+enum connline_bearer connline_interface_to_bearer(const char *name, int type);
+
 #endif
@@ -18,11 +18,14 @@
  *
  */
 
+#include <connline/alloc.h>
 #include <connline/data.h>
 #include <connline/event.h>
 #include <connline/utils.h>
 #include <connline/dbus.h>
 #include <connline/backend.h>
+#include <connline/list.h>
+#include <connline/stats.h>
 
 #include <dbus/dbus.h>
 #include <string.h>
@@ -35,6 +38,7 @@
 #define CONNMAN_MANAGER_INTERFACE CONNMAN_DBUS_NAME ".Manager"
 #define CONNMAN_NOTIFICATION_INTERFACE CONNMAN_DBUS_NAME ".Notification"
 #define CONNMAN_SESSION_INTERFACE CONNMAN_DBUS_NAME ".Session"
+#define CONNMAN_SERVICE_INTERFACE CONNMAN_DBUS_NAME ".Service"
 
 #define CONNMAN_SERVICE_MATCH_RULE "type='signal'" \
 				",sender='" DBUS_INTERFACE_DBUS "'" \
@@ -42,19 +46,66 @@
 				",member='" DBUS_SERVICE_OWNER_CHANGED "'" \
 				",arg0='" CONNMAN_DBUS_NAME "'"
 
+#define CONNMAN_SERVICES_MATCH_RULE "type='signal'" \
+				",sender='" CONNMAN_DBUS_NAME "'" \
+				",interface='" CONNMAN_MANAGER_INTERFACE "'" \
+				",member='ServicesChanged'"
+
+#define CONNMAN_SERVICE_PROPERTY_MATCH_RULE "type='signal'" \
+				",sender='" CONNMAN_DBUS_NAME "'" \
+				",interface='" CONNMAN_SERVICE_INTERFACE "'" \
+				",member='PropertyChanged'"
+
+struct connman_service {
+	char *path;
+	enum connline_bearer bearer;
+
+	dbus_bool_t connected;
+	dbus_bool_t online;
+
+	char *interface;
+	char *ipv4;
+	char *ipv6;
+
+	dbus_bool_t updated;
+};
+
+/*
+ * Background contexts do not need a session: they only listen.
+ * They all share one monitor which follows the Manager's service list.
+ */
+struct connman_monitor {
+	DBusConnection *dbus_cnx;
+	dlist *contexts;
+
+	struct connman_service **services;
+	int nb_services;
+
+	dbus_bool_t services_watched;
+	dbus_bool_t properties_watched;
+	dbus_bool_t ready;
+
+	DBusPendingCall *call;
+};
+
 struct connman_dbus {
-	char *session_name;
+	char session_name[UNIQUE_NAME_SIZE];
 	char *session_path;
 	enum connline_bearer bearer;
 
-	char *notifier_path;
+	/* Notifier path = /<session_name> */
+	char notifier_path[UNIQUE_NAME_SIZE + 1];
 	struct DBusObjectPathVTable notification;
 
 	DBusPendingCall *call;
+
+	dbus_bool_t passive;
+	dbus_bool_t notified;
+	struct connman_service *service;
 };
 
 struct connman_dbus_method {
-	const char *method;
+	enum connline_token method;
 	const char *signature;
 
 	DBusObjectPathMessageFunction function;
@@ -63,16 +114,18 @@ struct connman_dbus_method {
 const char *connline_backend_watch_rule = CONNMAN_SERVICE_MATCH_RULE;
 const char *connline_backend_service_name = CONNMAN_DBUS_NAME;
 
+static struct connman_monitor *monitor = NULL;
+
+static void connman_monitor_remove(struct connline_context *context);
+
 static void free_connman_dbus(struct connman_dbus *connman)
 {
 	if (connman == NULL)
 		return;
 
-	free(connman->session_name);
-	free(connman->session_path);
-	free(connman->notifier_path);
+	__connline_free(connman->session_path);
 
-	free(connman);
+	__connline_free(connman);
 }
 
 static int connman_connect(struct connline_context *context)
@@ -98,6 +151,8 @@ static int connman_connect(struct connline_context *context)
 	if (dbus_connection_send(context->dbus_cnx, message, NULL) == FALSE)
 		goto error;
 
+	__connline_stats_call(NULL);
+
 	dbus_message_unref(message);
 
 	return 0;
@@ -115,7 +170,7 @@ static void close_notification(struct connline_context *context)
 	char *rule;
 	int length;
 
-	if (connman == NULL || connman->notifier_path == NULL)
+	if (connman == NULL || connman->notifier_path[0] == '\0')
 		return;
 
 	dbus_connection_unregister_object_path(context->dbus_cnx,
@@ -123,16 +178,18 @@ static void close_notification(struct connline_context *context)
 
 	length = strlen(connman->notifier_path) + 60;
 
-	rule = calloc(length, sizeof(char));
+	rule = __connline_calloc(CONNLINE_MEMORY_DBUS, length, sizeof(char));
 	if (rule == NULL)
 		return;
 
 	if (snprintf(rule, length, "type='signal',interface='%s',path='%s'",
 					CONNMAN_NOTIFICATION_INTERFACE,
-					connman->notifier_path) > 0)
+					connman->notifier_path) > 0) {
 		dbus_bus_remove_match(context->dbus_cnx, rule, NULL);
+		__connline_stats_add(CONNLINE_STATS_MATCH_RULES, -1);
+	}
 
-	free(rule);
+	__connline_free(rule);
 }
 
 static void connman_backend_data_cleanup(struct connline_context *context)
@@ -144,10 +201,10 @@ static void connman_backend_data_cleanup(struct connline_context *context)
 	close_notification(context);
 
 	if (connman != NULL) {
-		if (connman->call != NULL) {
-			dbus_pending_call_cancel(connman->call);
-			dbus_pending_call_unref(connman->call);
-		}
+		if (connman->passive == TRUE)
+			connman_monitor_remove(context);
+
+		connline_dbus_cancel_call(&connman->call);
 
 		free_connman_dbus(connman);
 		context->backend_data = NULL;
@@ -161,46 +218,48 @@ static DBusHandlerResult notifier_release_method(DBusConnection *dbus_cnx,
 	struct connline_context *context = user_data;
 
 	connman_backend_data_cleanup(context);
-	dbus_message_unref(message);
 
 	return DBUS_HANDLER_RESULT_HANDLED;
 }
 
 static enum connline_bearer connman_to_connline_bearer(const char *bearer)
 {
-	int len;
-
-	len = strlen(bearer);
-
-	if (strncmp(bearer, "ethernet", len) == 0)
+	switch (connline_token_lookup(bearer)) {
+	case CONNLINE_TOKEN_ETHERNET:
 		return CONNLINE_BEARER_ETHERNET;
-	if (strncmp(bearer, "wifi", len) == 0)
+	case CONNLINE_TOKEN_WIFI:
 		return CONNLINE_BEARER_WIFI;
-	if (strncmp(bearer, "cellular", len) == 0)
+	case CONNLINE_TOKEN_CELLULAR:
 		return CONNLINE_BEARER_CELLULAR;
-	if (strncmp(bearer, "wimax", len) == 0)
+	case CONNLINE_TOKEN_WIMAX:
 		return CONNLINE_BEARER_WIMAX;
-	if (strncmp(bearer, "bluetooth", len) == 0)
+	case CONNLINE_TOKEN_BLUETOOTH:
 		return CONNLINE_BEARER_BLUETOOTH;
-	if (strncmp(bearer, "usb", len) == 0)
+	case CONNLINE_TOKEN_USB:
 		return CONNLINE_BEARER_USB;
+	default:
+		break;
+	}
 
 	return CONNLINE_BEARER_UNKNOWN;
 }
 
 static dbus_bool_t is_connected(const char *state)
 {
-	if (strncmp(state, "connected", 9) == 0)
-		return TRUE;
-	if (strncmp(state, "online", 6) == 0)
+	switch (connline_token_lookup(state)) {
+	case CONNLINE_TOKEN_CONNECTED:
+	case CONNLINE_TOKEN_ONLINE:
 		return TRUE;
+	default:
+		break;
+	}
 
 	return FALSE;
 }
 
 static dbus_bool_t is_online(const char *state)
 {
-	if (strncmp(state, "online", 6) == 0)
+	if (connline_token_lookup(state) == CONNLINE_TOKEN_ONLINE)
 		return TRUE;
 
 	return FALSE;
@@ -216,6 +275,8 @@ static DBusHandlerResult notifier_update_method(DBusConnection *dbus_cnx,
 	DBusMessageIter arg, dict;
 	const char *value;
 
+	__connline_stats_signal("Update");
+
 	connman = context->backend_data;
 
 	dbus_message_iter_init(message, &arg);
@@ -237,6 +298,9 @@ static DBusHandlerResult notifier_update_method(DBusConnection *dbus_cnx,
 		}
 	}
 
+	if (__connline_wants_event(context, CONNLINE_EVENT_PROPERTY) == false)
+		return DBUS_HANDLER_RESULT_HANDLED;
+
 	properties = insert_into_property_list(properties, "bearer",
 				connline_bearer_to_string(connman->bearer));
 
@@ -265,15 +329,13 @@ static DBusHandlerResult notifier_update_method(DBusConnection *dbus_cnx,
 	if (properties != NULL)
 		__connline_call_property_callback(context, properties);
 
-	dbus_message_unref(message);
-
 	return DBUS_HANDLER_RESULT_HANDLED;
 }
 
 static const struct connman_dbus_method notifier_object_methods[] = {
-	{ "Release", "", notifier_release_method },
-	{ "Update", "a{sv}", notifier_update_method },
-	{ NULL }
+	{ CONNLINE_TOKEN_MEMBER_RELEASE, "", notifier_release_method },
+	{ CONNLINE_TOKEN_MEMBER_UPDATE, "a{sv}", notifier_update_method },
+	{ CONNLINE_TOKEN_UNKNOWN }
 };
 
 static DBusHandlerResult notification_callback(DBusConnection *dbus_cnx,
@@ -281,13 +343,16 @@ static DBusHandlerResult notification_callback(DBusConnection *dbus_cnx,
 						void *user_data)
 {
 	const struct connman_dbus_method *handler;
-	const char *interface;
+	enum connline_token method;
+
+	if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_METHOD_CALL)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-	interface = dbus_message_get_interface(message);
+	method = connline_token_lookup(dbus_message_get_member(message));
 
-	for (handler = notifier_object_methods; handler != NULL; handler++) {
-		if (dbus_message_is_method_call(message,
-					interface, handler->method) == FALSE)
+	for (handler = notifier_object_methods;
+			handler->method != CONNLINE_TOKEN_UNKNOWN; handler++) {
+		if (handler->method != method)
 			continue;
 
 		if (dbus_message_has_signature(message,
@@ -312,7 +377,7 @@ static int setup_notification(struct connline_context *context)
 
 	length = strlen(connman->notifier_path) + 60;
 
-	rule = calloc(length, sizeof(char));
+	rule = __connline_calloc(CONNLINE_MEMORY_DBUS, length, sizeof(char));
 	if (rule == NULL) {
 		ret = -ENOMEM;
 		goto error;
@@ -327,7 +392,10 @@ static int setup_notification(struct connline_context *context)
 
 	dbus_error_init(&error);
 
-	dbus_bus_add_match(context->dbus_cnx, rule, &error);
+	if (context->pipelined == true)
+		dbus_bus_add_match(context->dbus_cnx, rule, NULL);
+	else
+		dbus_bus_add_match(context->dbus_cnx, rule, &error);
 
 	if (dbus_error_is_set(&error)) {
 		DBG("cannot add match - %s - rule: %s",
@@ -342,16 +410,21 @@ static int setup_notification(struct connline_context *context)
 	if (dbus_connection_register_object_path(context->dbus_cnx,
 						connman->notifier_path,
 						&connman->notification,
-						(void*) context) == FALSE)
+						(void*) context) == FALSE) {
+		dbus_bus_remove_match(context->dbus_cnx, rule, NULL);
 		ret = -EINVAL;
 
-error:
-	if (ret < 0) {
-		free(connman->notifier_path);
-		connman->notifier_path = NULL;
+		goto error;
 	}
 
-	free(rule);
+	/* Not a filter, so not set through connline_dbus_setup_watch() */
+	__connline_stats_add(CONNLINE_STATS_MATCH_RULES, 1);
+
+error:
+	if (ret < 0)
+		connman->notifier_path[0] = '\0';
+
+	__connline_free(rule);
 
 	return ret;
 }
@@ -397,6 +470,8 @@ static void create_session_callback(DBusPendingCall *pending, void *user_data)
 	if (dbus_pending_call_get_completed(pending) == FALSE)
 		return;
 
+	__connline_stats_reply(pending);
+
 	connman = context->backend_data;
 	connman->call = NULL;
 
@@ -414,9 +489,10 @@ static void create_session_callback(DBusPendingCall *pending, void *user_data)
 	length = strlen(session_path) + 1;
 
 	if (connman->session_path != NULL)
-		free(connman->session_path);
+		__connline_free(connman->session_path);
 
-	connman->session_path = calloc(length, sizeof(char));
+	connman->session_path = __connline_calloc(CONNLINE_MEMORY_BACKEND,
+						length, sizeof(char));
 	if (connman->session_path == NULL)
 		goto error;
 
@@ -445,32 +521,22 @@ static int connman_create_session(struct connline_context *context)
 {
 	struct connman_dbus *connman = context->backend_data;
 	DBusMessage *message = NULL;
+	const char *notifier_path;
 	int ret = -EINVAL;
 	DBusMessageIter arg;
-	size_t length;
-
-	connman->session_name = get_new_unique_name();
-	if (connman->session_name == NULL)
-		goto error;
-
-	length = strlen(connman->session_name) + 2;
 
-	/* Notifier path = /<session_name> */
-	connman->notifier_path = calloc(length, sizeof(char));
-	if (connman->notifier_path == NULL) {
-		ret = -ENOMEM;
+	ret = get_new_unique_name(connman->session_name, UNIQUE_NAME_SIZE);
+	if (ret < 0)
 		goto error;
-	}
 
-	if (snprintf(connman->notifier_path, length, "/%s",
-						connman->session_name) < 0)
-		goto error;
+	connman->notifier_path[0] = '/';
+	strcpy(connman->notifier_path + 1, connman->session_name);
 
 	ret = setup_notification(context);
 	if (ret < 0)
 		goto error;
 
-	message = dbus_message_new_method_call(CONNMAN_DBUS_NAME,
+	message = connline_dbus_new_method_call(CONNMAN_DBUS_NAME,
 						CONNMAN_MANAGER_PATH,
 						CONNMAN_MANAGER_INTERFACE,
 						"CreateSession");
@@ -484,15 +550,14 @@ static int connman_create_session(struct connline_context *context)
 	connline_dbus_append_dict(&arg, NULL,
 				append_session_settings, context);
 
+	notifier_path = connman->notifier_path;
 	connline_dbus_append_basic(&arg, NULL,
-			DBUS_TYPE_OBJECT_PATH, &connman->notifier_path);
-
-	if (dbus_connection_send_with_reply(context->dbus_cnx, message,
-			&connman->call, DBUS_TIMEOUT_USE_DEFAULT) == FALSE)
-		goto error;
+			DBUS_TYPE_OBJECT_PATH, &notifier_path);
 
-	if (dbus_pending_call_set_notify(connman->call,
-			create_session_callback, context, NULL) == FALSE)
+	/* Sent again, it would create a second session */
+	if (connline_dbus_send_once_with_deadline(context, context->dbus_cnx,
+				message, &connman->call,
+				create_session_callback, context) < 0)
 		goto error;
 
 	dbus_message_unref(message);
@@ -508,6 +573,560 @@ error:
 	return ret;
 }
 
+static dbus_bool_t is_service_connected(const char *state)
+{
+	switch (connline_token_lookup(state)) {
+	case CONNLINE_TOKEN_READY:
+	case CONNLINE_TOKEN_ONLINE:
+		return TRUE;
+	default:
+		break;
+	}
+
+	return FALSE;
+}
+
+static void free_connman_service(struct connman_service *service)
+{
+	if (service == NULL)
+		return;
+
+	__connline_free(service->path);
+	__connline_free(service->interface);
+	__connline_free(service->ipv4);
+	__connline_free(service->ipv6);
+
+	__connline_free(service);
+}
+
+static void free_services(struct connman_service **services, int nb_services)
+{
+	int i;
+
+	if (services == NULL)
+		return;
+
+	for (i = 0; i < nb_services; i++)
+		free_connman_service(services[i]);
+
+	__connline_free(services);
+}
+
+static void service_set_string(char **destination, const char *value)
+{
+	__connline_free(*destination);
+	*destination = NULL;
+
+	if (value != NULL)
+		*destination = __connline_strdup(CONNLINE_MEMORY_BACKEND,
+							value);
+}
+
+static const char *get_sub_property(DBusMessageIter *iter, const char *key)
+{
+	DBusMessageIter dict;
+	const char *value = NULL;
+
+	if (dbus_message_iter_get_arg_type(iter) != DBUS_TYPE_VARIANT)
+		return NULL;
+
+	dbus_message_iter_recurse(iter, &dict);
+
+	if (connline_dbus_get_dict_entry_basic(&dict, key,
+					DBUS_TYPE_STRING, &value) != 0)
+		return NULL;
+
+	return value;
+}
+
+static bool update_service_property(DBusMessageIter *iter, void *user_data)
+{
+	struct connman_service *service = user_data;
+	const char *value = NULL;
+	const char *name;
+
+	if (connline_dbus_get_basic(iter, DBUS_TYPE_STRING, &name) != 0)
+		return false;
+
+	dbus_message_iter_next(iter);
+
+	switch (connline_token_lookup(name)) {
+	case CONNLINE_TOKEN_KEY_TYPE:
+		if (connline_dbus_get_basic_variant(iter,
+					DBUS_TYPE_STRING, &value) != 0)
+			return false;
+
+		service->bearer = connman_to_connline_bearer(value);
+		break;
+	case CONNLINE_TOKEN_KEY_STATE:
+		if (connline_dbus_get_basic_variant(iter,
+					DBUS_TYPE_STRING, &value) != 0)
+			return false;
+
+		service->connected = is_service_connected(value);
+		service->online = is_online(value);
+		break;
+	case CONNLINE_TOKEN_KEY_ETHERNET:
+		service_set_string(&service->interface,
+					get_sub_property(iter, "Interface"));
+		break;
+	case CONNLINE_TOKEN_KEY_IPV4:
+		service_set_string(&service->ipv4,
+					get_sub_property(iter, "Address"));
+		break;
+	case CONNLINE_TOKEN_KEY_IPV6:
+		service_set_string(&service->ipv6,
+					get_sub_property(iter, "Address"));
+		break;
+	default:
+		return false;
+	}
+
+	service->updated = TRUE;
+
+	return false;
+}
+
+static struct connman_service *find_service(const char *path)
+{
+	int i;
+
+	for (i = 0; i < monitor->nb_services; i++) {
+		if (strcmp(monitor->services[i]->path, path) == 0)
+			return monitor->services[i];
+	}
+
+	return NULL;
+}
+
+static struct connman_service *
+lookup_connected_service(struct connline_context *context)
+{
+	struct connman_service *service;
+	int i;
+
+	for (i = 0; i < monitor->nb_services; i++) {
+		service = monitor->services[i];
+
+		if (service->connected == FALSE)
+			continue;
+
+		if (context->bearer_type == CONNLINE_BEARER_UNKNOWN ||
+					service->bearer & context->bearer_type)
+			return service;
+	}
+
+	return NULL;
+}
+
+static void passive_context_update(void *data)
+{
+	struct connline_context *context = data;
+	struct connman_dbus *connman = context->backend_data;
+	struct connman_service *service;
+	char **properties = NULL;
+	dbus_bool_t was_connected;
+
+	service = lookup_connected_service(context);
+
+	if (service == NULL) {
+		if (connman->service == NULL && connman->notified == TRUE)
+			return;
+
+		connman->service = NULL;
+		connman->notified = TRUE;
+		connman->bearer = CONNLINE_BEARER_UNKNOWN;
+		context->is_online = FALSE;
+
+		__connline_call_disconnected_callback(context);
+
+		return;
+	}
+
+	if (service == connman->service && service->updated == FALSE)
+		return;
+
+	/* Already connected, a change of service is only a property one */
+	was_connected = connman->service != NULL;
+
+	connman->service = service;
+	connman->notified = TRUE;
+	connman->bearer = service->bearer;
+	context->is_online = service->online;
+
+	if (was_connected == FALSE)
+		__connline_call_connected_callback(context);
+
+	if (__connline_wants_event(context, CONNLINE_EVENT_PROPERTY) == false)
+		return;
+
+	properties = insert_into_property_list(properties, "bearer",
+				connline_bearer_to_string(connman->bearer));
+
+	properties = insert_into_property_list(properties,
+					"interface", service->interface);
+
+	properties = insert_into_property_list(properties,
+						"address", service->ipv4);
+
+	properties = insert_into_property_list(properties,
+						"address", service->ipv6);
+
+	if (properties != NULL)
+		__connline_call_property_callback(context, properties);
+}
+
+static void invalidate_passive_context(void *data)
+{
+	struct connline_context *context = data;
+
+	context->is_online = FALSE;
+	__connline_call_error_callback(context, false);
+}
+
+static void monitor_dispatch_update(void)
+{
+	int i;
+
+	dlist_foreach(monitor->contexts, passive_context_update);
+
+	for (i = 0; i < monitor->nb_services; i++)
+		monitor->services[i]->updated = FALSE;
+}
+
+static bool is_service_listed(struct connman_service **services,
+					int nb_services,
+					struct connman_service *service)
+{
+	int i;
+
+	for (i = 0; i < nb_services; i++) {
+		if (services[i] == service)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Both GetServices and ServicesChanged provide the complete, ordered,
+ * service list.  Services not present anymore are only released once
+ * contexts have been updated, so their pointer cannot be recycled in
+ * between.
+ */
+static int update_services(DBusMessageIter *iter)
+{
+	struct connman_service **old_services = monitor->services;
+	struct connman_service **services = NULL;
+	int nb_old_services = monitor->nb_services;
+	struct connman_service *service;
+	DBusMessageIter array, entry;
+	int nb_services = 0;
+	const char *path;
+	int i;
+
+	if (dbus_message_iter_get_arg_type(iter) != DBUS_TYPE_ARRAY)
+		return -EINVAL;
+
+	dbus_message_iter_recurse(iter, &array);
+
+	for (entry = array; dbus_message_iter_get_arg_type(&entry) ==
+			DBUS_TYPE_STRUCT; dbus_message_iter_next(&entry))
+		nb_services++;
+
+	if (nb_services > 0) {
+		services = __connline_calloc(CONNLINE_MEMORY_BACKEND,
+							nb_services,
+					sizeof(struct connman_service *));
+		if (services == NULL)
+			return -ENOMEM;
+	}
+
+	for (i = 0; i < nb_services; i++, dbus_message_iter_next(&array)) {
+		dbus_message_iter_recurse(&array, &entry);
+
+		if (connline_dbus_get_basic(&entry,
+					DBUS_TYPE_OBJECT_PATH, &path) != 0)
+			goto error;
+
+		dbus_message_iter_next(&entry);
+
+		service = find_service(path);
+		if (service == NULL) {
+			service = __connline_calloc(CONNLINE_MEMORY_BACKEND,
+					1, sizeof(struct connman_service));
+			if (service == NULL)
+				goto error;
+
+			service->path = __connline_strdup(
+						CONNLINE_MEMORY_BACKEND, path);
+			if (service->path == NULL) {
+				__connline_free(service);
+				goto error;
+			}
+
+			service->bearer = CONNLINE_BEARER_UNKNOWN;
+			service->updated = TRUE;
+		}
+
+		services[i] = service;
+
+		connline_dbus_foreach_dict_entry(&entry,
+					update_service_property, service);
+	}
+
+	monitor->services = services;
+	monitor->nb_services = nb_services;
+
+	monitor_dispatch_update();
+
+	for (i = 0; i < nb_old_services; i++) {
+		if (is_service_listed(services, nb_services,
+						old_services[i]) == false)
+			free_connman_service(old_services[i]);
+	}
+
+	__connline_free(old_services);
+
+	return 0;
+
+error:
+	for (i = 0; i < nb_services && services[i] != NULL; i++) {
+		if (is_service_listed(old_services, nb_old_services,
+						services[i]) == false)
+			free_connman_service(services[i]);
+	}
+
+	__connline_free(services);
+
+	return -EINVAL;
+}
+
+static DBusHandlerResult watch_connman_services(DBusConnection *dbus_cnx,
+							DBusMessage *message,
+							void *user_data)
+{
+	DBusMessageIter arg;
+
+	if (monitor == NULL || monitor->ready == FALSE)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	if (connline_dbus_is_signal(message, CONNMAN_MANAGER_INTERFACE,
+			CONNLINE_TOKEN_MEMBER_SERVICES_CHANGED) == false)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	__connline_stats_signal("ServicesChanged");
+
+	if (dbus_message_iter_init(message, &arg) == FALSE ||
+					update_services(&arg) != 0)
+		dlist_foreach(monitor->contexts, invalidate_passive_context);
+
+	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+static DBusHandlerResult watch_connman_service_property(
+						DBusConnection *dbus_cnx,
+						DBusMessage *message,
+						void *user_data)
+{
+	struct connman_service *service;
+	DBusMessageIter arg;
+	const char *path;
+
+	if (monitor == NULL || monitor->ready == FALSE)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	if (connline_dbus_is_signal(message, CONNMAN_SERVICE_INTERFACE,
+			CONNLINE_TOKEN_MEMBER_PROPERTY_CHANGED) == false)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	__connline_stats_signal("PropertyChanged");
+
+	path = dbus_message_get_path(message);
+	if (path == NULL)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	service = find_service(path);
+	if (service == NULL)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	if (dbus_message_iter_init(message, &arg) == FALSE)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	update_service_property(&arg, service);
+
+	if (service->updated == TRUE)
+		monitor_dispatch_update();
+
+	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+static void get_services_callback(DBusPendingCall *pending, void *user_data)
+{
+	DBusMessage *reply = NULL;
+	DBusMessageIter arg;
+
+	if (dbus_pending_call_get_completed(pending) == FALSE)
+		return;
+
+	__connline_stats_reply(pending);
+
+	monitor->call = NULL;
+
+	reply = dbus_pending_call_steal_reply(pending);
+	if (reply == NULL)
+		goto error;
+
+	if (dbus_message_iter_init(reply, &arg) == FALSE)
+		goto error;
+
+	if (update_services(&arg) != 0)
+		goto error;
+
+	monitor->ready = TRUE;
+
+	dbus_message_unref(reply);
+	dbus_pending_call_unref(pending);
+
+	return;
+
+error:
+	if (reply != NULL)
+		dbus_message_unref(reply);
+
+	dbus_pending_call_unref(pending);
+
+	/* The next ServicesChanged, carrying the whole list, may recover it */
+	monitor->ready = TRUE;
+
+	dlist_foreach(monitor->contexts, invalidate_passive_context);
+}
+
+static void connman_monitor_stop(void)
+{
+	if (monitor == NULL)
+		return;
+
+	if (monitor->services_watched == TRUE)
+		connline_dbus_remove_watch(monitor->dbus_cnx,
+					CONNMAN_SERVICES_MATCH_RULE,
+					watch_connman_services, NULL);
+
+	if (monitor->properties_watched == TRUE)
+		connline_dbus_remove_watch(monitor->dbus_cnx,
+					CONNMAN_SERVICE_PROPERTY_MATCH_RULE,
+					watch_connman_service_property, NULL);
+
+	connline_dbus_cancel_call(&monitor->call);
+
+	free_services(monitor->services, monitor->nb_services);
+	dlist_free_all(monitor->contexts);
+
+	dbus_connection_unref(monitor->dbus_cnx);
+
+	__connline_free(monitor);
+	monitor = NULL;
+}
+
+static int connman_monitor_start(DBusConnection *dbus_cnx)
+{
+	DBusMessage *message;
+	int ret = -ENOMEM;
+
+	monitor = __connline_calloc(CONNLINE_MEMORY_BACKEND,
+					1, sizeof(struct connman_monitor));
+	if (monitor == NULL)
+		return -ENOMEM;
+
+	monitor->dbus_cnx = dbus_connection_ref(dbus_cnx);
+
+	/* Watching first, so no change can be missed until GetServices */
+	ret = connline_dbus_setup_watch(dbus_cnx, CONNMAN_SERVICES_MATCH_RULE,
+						watch_connman_services, NULL);
+	if (ret < 0)
+		goto error;
+
+	monitor->services_watched = TRUE;
+
+	ret = connline_dbus_setup_watch(dbus_cnx,
+					CONNMAN_SERVICE_PROPERTY_MATCH_RULE,
+					watch_connman_service_property, NULL);
+	if (ret < 0)
+		goto error;
+
+	monitor->properties_watched = TRUE;
+
+	message = connline_dbus_new_method_call(CONNMAN_DBUS_NAME,
+						CONNMAN_MANAGER_PATH,
+						CONNMAN_MANAGER_INTERFACE,
+						"GetServices");
+	if (message == NULL) {
+		ret = -ENOMEM;
+		goto error;
+	}
+
+	ret = -EINVAL;
+
+	if (connline_dbus_send_with_deadline(NULL, dbus_cnx, message,
+			&monitor->call, get_services_callback, NULL) < 0) {
+		dbus_message_unref(message);
+		goto error;
+	}
+
+	dbus_message_unref(message);
+
+	return 0;
+
+error:
+	connman_monitor_stop();
+
+	return ret;
+}
+
+static int connman_monitor_add(struct connline_context *context)
+{
+	struct connman_dbus *connman = context->backend_data;
+	dlist *new_list;
+	int ret;
+
+	if (monitor == NULL) {
+		ret = connman_monitor_start(context->dbus_cnx);
+		if (ret < 0)
+			return ret;
+	}
+
+	new_list = dlist_prepend(monitor->contexts, context);
+	if (new_list == monitor->contexts) {
+		if (monitor->contexts == NULL)
+			connman_monitor_stop();
+
+		return -ENOMEM;
+	}
+
+	monitor->contexts = new_list;
+	connman->passive = TRUE;
+
+	if (monitor->ready == TRUE)
+		passive_context_update(context);
+
+	return 0;
+}
+
+static void connman_monitor_remove(struct connline_context *context)
+{
+	struct connman_dbus *connman = context->backend_data;
+
+	connman->passive = FALSE;
+	connman->service = NULL;
+
+	if (monitor == NULL)
+		return;
+
+	monitor->contexts = dlist_remove(monitor->contexts, context);
+	if (monitor->contexts == NULL)
+		connman_monitor_stop();
+}
+
 static int connman_open(struct connline_context *context)
 {
 	struct connman_dbus *connman;
@@ -517,14 +1136,17 @@ static int connman_open(struct connline_context *context)
 	if (context == NULL || context->dbus_cnx == NULL)
 		return -EINVAL;
 
-	if (connline_dbus_is_service_running(context->dbus_cnx,
+	/* Opened with others, the daemon was checked for once */
+	if (context->pipelined == false &&
+			connline_dbus_is_service_running(context->dbus_cnx,
 						CONNMAN_DBUS_NAME) == FALSE)
 		return -EINVAL;
 
 	connman = context->backend_data;
 
 	if (connman == NULL) {
-		connman = calloc(1, sizeof(struct connman_dbus));
+		connman = __connline_calloc(CONNLINE_MEMORY_BACKEND,
+						1, sizeof(struct connman_dbus));
 		if (connman == NULL)
 			return -ENOMEM;
 
@@ -532,7 +1154,14 @@ static int connman_open(struct connline_context *context)
 		context->backend_data = connman;
 	}
 
-	if (connman->session_name != NULL)
+	if (context->background_connection == TRUE) {
+		if (connman->passive == TRUE)
+			return 0;
+
+		return connman_monitor_add(context);
+	}
+
+	if (connman->session_name[0] != '\0')
 		return connman_connect(context);
 
 	return connman_create_session(context);
@@ -561,6 +1190,8 @@ static int connman_close(struct connline_context *context)
 				dbus_connection_send(context->dbus_cnx,
 							message, NULL);
 				dbus_message_unref(message);
+
+				__connline_stats_call(NULL);
 			}
 		}
 
@@ -585,7 +1216,8 @@ static enum connline_bearer connman_get_bearer(struct connline_context *context)
 static struct connline_backend_methods connman = {
 	connman_open,
 	connman_close,
-	connman_get_bearer
+	connman_get_bearer,
+	true
 };
 
 struct connline_backend_methods *connline_plugin_setup_backend(void)
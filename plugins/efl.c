@@ -17,8 +17,10 @@
  *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  *
  */
+#include <connline/alloc.h>
 #include <connline/connline.h>
 #include <connline/data.h>
+#include <connline/event.h>
 #include <connline/utils.h>
 
 #include <errno.h>
@@ -47,29 +49,56 @@ struct callback_trigger_data {
 	char **changed_property;
 };
 
+struct fd_handler {
+	Ecore_Fd_Handler *e_handler;
+	int fd;
+	__connline_fd_callback_f callback;
+	void *user_data;
+};
+
 static Eina_Hash *triggers_table = NULL;
+static Eina_Hash *fds_table = NULL;
+
+/* At most one dispatch is pending, on a timer or on an idler */
+static Ecore_Timer *dispatch_timer = NULL;
+static Ecore_Idler *dispatch_idler = NULL;
 
 static Eina_Bool efl_dispatch_dbus(void *data)
 {
 	DBusConnection *dbus_cnx = data;
 
+	dispatch_timer = NULL;
+	dispatch_idler = NULL;
+
 	dbus_connection_ref(dbus_cnx);
 
-	while (dbus_connection_dispatch(dbus_cnx) ==
-					DBUS_DISPATCH_DATA_REMAINS);
+	/* Out of budget: the rest waits for the loop to be idle */
+	if (__connline_dispatch_dbus(dbus_cnx) == true)
+		dispatch_idler = ecore_idler_add(efl_dispatch_dbus, dbus_cnx);
 
 	dbus_connection_unref(dbus_cnx);
 
 	return EINA_FALSE;
 }
 
+static void schedule_dispatch(DBusConnection *dbus_cnx)
+{
+	if (dispatch_timer != NULL || dispatch_idler != NULL)
+		return;
+
+	dispatch_timer = ecore_timer_add(0, efl_dispatch_dbus, dbus_cnx);
+}
+
 static Eina_Bool watch_handler_dispatch(void *data,
 					Ecore_Fd_Handler *e_handler)
 {
 	struct watch_handler *io_handler = data;
+	DBusConnection *dbus_cnx = io_handler->dbus_cnx;
 	DBusDispatchStatus status;
 	unsigned int flags = 0;
 
+	dbus_connection_ref(dbus_cnx);
+
 	if (ecore_main_fd_handler_active_get(e_handler, ECORE_FD_ERROR)
 								== EINA_TRUE)
 		flags |= DBUS_WATCH_ERROR;
@@ -80,13 +109,14 @@ static Eina_Bool watch_handler_dispatch(void *data,
 								== EINA_TRUE)
 		flags |= DBUS_WATCH_WRITABLE;
 
+	/* Toggling the watch, while handling it, frees io_handler */
 	dbus_watch_handle(io_handler->watch, flags);
 
-	status = dbus_connection_get_dispatch_status(io_handler->dbus_cnx);
+	status = dbus_connection_get_dispatch_status(dbus_cnx);
 	if (status == DBUS_DISPATCH_DATA_REMAINS)
-		ecore_timer_add(0, efl_dispatch_dbus, io_handler->dbus_cnx);
+		schedule_dispatch(dbus_cnx);
 
-	dbus_connection_unref(io_handler->dbus_cnx);
+	dbus_connection_unref(dbus_cnx);
 
 	return TRUE;
 }
@@ -103,7 +133,7 @@ static void watch_handler_free(void *data)
 
 	dbus_connection_unref(io_handler->dbus_cnx);
 
-	free(io_handler);
+	__connline_free(io_handler);
 }
 
 static dbus_bool_t efl_dbus_watch_add(DBusWatch *watch, void *data)
@@ -117,7 +147,8 @@ static dbus_bool_t efl_dbus_watch_add(DBusWatch *watch, void *data)
 	if (dbus_watch_get_enabled(watch) == FALSE)
 		return TRUE;
 
-	io_handler = calloc(1, sizeof(struct watch_handler));
+	io_handler = __connline_calloc(CONNLINE_MEMORY_EVENT,
+					1, sizeof(struct watch_handler));
 	if (io_handler == NULL)
 		return FALSE;
 
@@ -169,7 +200,7 @@ static void timeout_handler_free(void *data)
 	if (to_handler->e_timer != NULL)
 		ecore_timer_del(to_handler->e_timer);
 
-	free(to_handler);
+	__connline_free(to_handler);
 }
 
 static Eina_Bool timeout_handler_dispatch(void *data)
@@ -188,7 +219,8 @@ static dbus_bool_t efl_dbus_timeout_add(DBusTimeout *timeout, void *data)
 	if (dbus_timeout_get_enabled(timeout) == FALSE)
 		return TRUE;
 
-	to_handler = calloc(1, sizeof(struct timeout_handler));
+	to_handler = __connline_calloc(CONNLINE_MEMORY_EVENT,
+					1, sizeof(struct timeout_handler));
 	if (to_handler == NULL)
 		return FALSE;
 
@@ -224,7 +256,7 @@ static void efl_dbus_dispatch_status(DBusConnection *connection,
 
 	status = dbus_connection_get_dispatch_status(connection);
 	if (status == DBUS_DISPATCH_DATA_REMAINS)
-		ecore_timer_add(0, efl_dispatch_dbus, connection);
+		schedule_dispatch(connection);
 }
 
 static dbus_bool_t setup_dbus_in_efl_mainloop(DBusConnection *dbus_cnx)
@@ -246,7 +278,7 @@ static dbus_bool_t setup_dbus_in_efl_mainloop(DBusConnection *dbus_cnx)
 
 	status = dbus_connection_get_dispatch_status(dbus_cnx);
 	if (status == DBUS_DISPATCH_DATA_REMAINS)
-		ecore_timer_add(0, efl_dispatch_dbus, dbus_cnx);
+		schedule_dispatch(dbus_cnx);
 
 	return TRUE;
 }
@@ -294,7 +326,7 @@ static void remove_trigger(void *data)
 	 if (trigger->changed_property != NULL)
 		 property_list_free(trigger->changed_property);
 
-	 free(trigger);
+	 __connline_free(trigger);
 }
 
 static void remove_context_triggers(void *data)
@@ -304,24 +336,21 @@ static void remove_context_triggers(void *data)
 	eina_hash_free(context_ht);
 }
 
-DBusConnection *connline_plugin_setup_event_loop(void)
+static void setup_triggers_table(void)
 {
-	DBusConnection *dbus_cnx;
-
-	dbus_cnx = dbus_bus_get(DBUS_BUS_SYSTEM, NULL);
-	if (dbus_cnx == NULL)
-		return NULL;
-
-	if (setup_dbus_in_efl_mainloop(dbus_cnx) == FALSE) {
-		dbus_connection_unref(dbus_cnx);
-		return NULL;
-	}
-
 	if (triggers_table == NULL)
 		triggers_table = eina_hash_pointer_new(
 						remove_context_triggers);
+}
 
-	return dbus_cnx;
+int connline_plugin_setup_event_loop(DBusConnection *dbus_cnx, void *data)
+{
+	if (dbus_cnx != NULL && setup_dbus_in_efl_mainloop(dbus_cnx) == FALSE)
+		return -EINVAL;
+
+	setup_triggers_table();
+
+	return 0;
 }
 
 int connline_plugin_trigger_callback(struct connline_context *context,
@@ -335,7 +364,8 @@ int connline_plugin_trigger_callback(struct connline_context *context,
 	if (callback == NULL || context == NULL)
 		return -EINVAL;
 
-	trigger = calloc(1, sizeof(struct callback_trigger_data));
+	trigger = __connline_calloc(CONNLINE_MEMORY_EVENT,
+				1, sizeof(struct callback_trigger_data));
 	if (trigger == NULL)
 		return -ENOMEM;
 
@@ -366,12 +396,89 @@ void connline_plugin_trigger_cleanup(struct connline_context *context)
 	eina_hash_del(triggers_table, context, NULL);
 }
 
+static void fd_handler_free(void *data)
+{
+	struct fd_handler *handler = data;
+
+	if (handler->e_handler != NULL)
+		ecore_main_fd_handler_del(handler->e_handler);
+
+	__connline_free(handler);
+}
+
+/* The callback may unwatch its own fd, thus freeing the handler */
+static Eina_Bool fd_handler_dispatch(void *data,
+					Ecore_Fd_Handler *e_handler)
+{
+	struct fd_handler *handler = data;
+
+	handler->callback(handler->fd, handler->user_data);
+
+	return EINA_TRUE;
+}
+
+int connline_plugin_watch_fd(void *data, int fd,
+				__connline_fd_callback_f callback,
+				void *user_data)
+{
+	struct fd_handler *handler;
+
+	if (fd < 0 || callback == NULL)
+		return -EINVAL;
+
+	setup_triggers_table();
+
+	if (fds_table == NULL)
+		fds_table = eina_hash_int32_new(fd_handler_free);
+
+	handler = __connline_calloc(CONNLINE_MEMORY_EVENT,
+						1, sizeof(struct fd_handler));
+	if (handler == NULL)
+		return -ENOMEM;
+
+	handler->fd = fd;
+	handler->callback = callback;
+	handler->user_data = user_data;
+
+	handler->e_handler = ecore_main_fd_handler_add(fd,
+					ECORE_FD_READ | ECORE_FD_ERROR,
+					fd_handler_dispatch, handler,
+					NULL, NULL);
+	if (handler->e_handler == NULL) {
+		__connline_free(handler);
+		return -ENOMEM;
+	}
+
+	eina_hash_del(fds_table, &fd, NULL);
+	eina_hash_add(fds_table, &handler->fd, handler);
+
+	return 0;
+}
+
+void connline_plugin_unwatch_fd(int fd)
+{
+	if (fds_table != NULL)
+		eina_hash_del(fds_table, &fd, NULL);
+}
+
 void connline_plugin_cleanup_event_loop(DBusConnection *dbus_cnx)
 {
 	if (triggers_table != NULL)
 		eina_hash_free(triggers_table);
 	triggers_table = NULL;
 
+	if (fds_table != NULL)
+		eina_hash_free(fds_table);
+	fds_table = NULL;
+
+	if (dispatch_timer != NULL)
+		ecore_timer_del(dispatch_timer);
+	dispatch_timer = NULL;
+
+	if (dispatch_idler != NULL)
+		ecore_idler_del(dispatch_idler);
+	dispatch_idler = NULL;
+
 	if (dbus_cnx == NULL)
 		return;
 
@@ -18,8 +18,10 @@
  *
  */
 
+#include <connline/alloc.h>
 #include <connline/connline.h>
 #include <connline/data.h>
+#include <connline/event.h>
 #include <connline/utils.h>
 
 #include <errno.h>
@@ -48,16 +50,41 @@ struct callback_trigger_data {
 	char **changed_property;
 };
 
+struct fd_handler {
+	unsigned int id;
+	int fd;
+	__connline_fd_callback_f callback;
+	void *user_data;
+};
+
 static GHashTable *triggers_table = NULL;
+static GHashTable *fds_table = NULL;
+
+/* At most one dispatch is pending */
+static guint dispatch_id = 0;
+
+static gboolean glib_dispatch_dbus(gpointer data);
+
+static void schedule_dispatch(DBusConnection *dbus_cnx, gint priority)
+{
+	if (dispatch_id > 0)
+		return;
+
+	dispatch_id = g_timeout_add_full(priority, 0,
+					glib_dispatch_dbus, dbus_cnx, NULL);
+}
 
 static gboolean glib_dispatch_dbus(gpointer data)
 {
 	DBusConnection *dbus_cnx = data;
 
+	dispatch_id = 0;
+
 	dbus_connection_ref(dbus_cnx);
 
-	while (dbus_connection_dispatch(dbus_cnx) ==
-					DBUS_DISPATCH_DATA_REMAINS);
+	/* Out of budget: the rest waits for the loop to be idle */
+	if (__connline_dispatch_dbus(dbus_cnx) == true)
+		schedule_dispatch(dbus_cnx, G_PRIORITY_LOW);
 
 	dbus_connection_unref(dbus_cnx);
 
@@ -68,10 +95,11 @@ static gboolean watch_handler_dispatch(GIOChannel *source,
 					GIOCondition condition, gpointer data)
 {
 	struct watch_handler *io_handler = data;
+	DBusConnection *dbus_cnx = io_handler->dbus_cnx;
 	DBusDispatchStatus status;
 	unsigned int flags = 0;
 
-	dbus_connection_ref(io_handler->dbus_cnx);
+	dbus_connection_ref(dbus_cnx);
 
 	if (condition & G_IO_ERR)
 		flags |= DBUS_WATCH_ERROR;
@@ -82,13 +110,14 @@ static gboolean watch_handler_dispatch(GIOChannel *source,
 	if (condition & G_IO_OUT)
 		flags |= DBUS_WATCH_WRITABLE;
 
+	/* Toggling the watch, while handling it, frees io_handler */
 	dbus_watch_handle(io_handler->watch, flags);
 
-	status = dbus_connection_get_dispatch_status(io_handler->dbus_cnx);
+	status = dbus_connection_get_dispatch_status(dbus_cnx);
 	if (status == DBUS_DISPATCH_DATA_REMAINS)
-		g_timeout_add(0, glib_dispatch_dbus, io_handler->dbus_cnx);
+		schedule_dispatch(dbus_cnx, G_PRIORITY_DEFAULT);
 
-	dbus_connection_unref(io_handler->dbus_cnx);
+	dbus_connection_unref(dbus_cnx);
 
 	return TRUE;
 }
@@ -105,7 +134,7 @@ static void watch_handler_free(void *data)
 
 	dbus_connection_unref(io_handler->dbus_cnx);
 
-	free(io_handler);
+	__connline_free(io_handler);
 }
 
 static dbus_bool_t glib_dbus_watch_add(DBusWatch *watch, void *data)
@@ -119,7 +148,8 @@ static dbus_bool_t glib_dbus_watch_add(DBusWatch *watch, void *data)
 	if (dbus_watch_get_enabled(watch) == FALSE)
 		return TRUE;
 
-	io_handler = calloc(1, sizeof(struct watch_handler));
+	io_handler = __connline_calloc(CONNLINE_MEMORY_EVENT,
+					1, sizeof(struct watch_handler));
 	if (io_handler == NULL)
 		return FALSE;
 
@@ -173,7 +203,7 @@ static void timeout_handler_free(void *data)
 	if (to_handler->id > 0)
 		g_source_remove(to_handler->id);
 
-	free(to_handler);
+	__connline_free(to_handler);
 }
 
 static gboolean timeout_handler_dispatch(gpointer data)
@@ -192,7 +222,8 @@ static dbus_bool_t glib_dbus_timeout_add(DBusTimeout *timeout, void *data)
 	if (dbus_timeout_get_enabled(timeout) == FALSE)
 		return TRUE;
 
-	to_handler = calloc(1, sizeof(struct timeout_handler));
+	to_handler = __connline_calloc(CONNLINE_MEMORY_EVENT,
+					1, sizeof(struct timeout_handler));
 	if (to_handler == NULL)
 		return FALSE;
 
@@ -227,7 +258,7 @@ static void glib_dbus_dispatch_status(DBusConnection *connection,
 
 	status = dbus_connection_get_dispatch_status(connection);
 	if (status == DBUS_DISPATCH_DATA_REMAINS)
-		g_timeout_add(0, glib_dispatch_dbus, connection);
+		schedule_dispatch(connection, G_PRIORITY_DEFAULT);
 }
 
 static dbus_bool_t setup_dbus_in_glib_mainloop(DBusConnection *dbus_cnx)
@@ -249,7 +280,7 @@ static dbus_bool_t setup_dbus_in_glib_mainloop(DBusConnection *dbus_cnx)
 
 	status = dbus_connection_get_dispatch_status(dbus_cnx);
 	if (status == DBUS_DISPATCH_DATA_REMAINS)
-		g_timeout_add(0, glib_dispatch_dbus, dbus_cnx);
+		schedule_dispatch(dbus_cnx, G_PRIORITY_DEFAULT);
 
 	return TRUE;
 }
@@ -285,7 +316,7 @@ static gboolean trigger_run(gpointer data)
 							context->user_data);
 
 	if (changed_property != NULL)
-		g_strfreev(changed_property);
+		property_list_free(changed_property);
 
 	return FALSE;
 }
@@ -300,7 +331,7 @@ static void remove_trigger(gpointer data)
 	if (trigger->changed_property != NULL)
 		property_list_free(trigger->changed_property);
 
-	free(trigger);
+	__connline_free(trigger);
 }
 
 static void remove_context_triggers(gpointer data)
@@ -310,24 +341,21 @@ static void remove_context_triggers(gpointer data)
 	g_hash_table_destroy(context_ht);
 }
 
-DBusConnection *connline_plugin_setup_event_loop(void)
+static void setup_triggers_table(void)
 {
-	DBusConnection *dbus_cnx;
-
-	dbus_cnx = dbus_bus_get(DBUS_BUS_SYSTEM, NULL);
-	if (dbus_cnx == NULL)
-		return NULL;
-
-	if (setup_dbus_in_glib_mainloop(dbus_cnx) == FALSE) {
-		dbus_connection_unref(dbus_cnx);
-		return NULL;
-	}
-
 	if (triggers_table == NULL)
 		triggers_table = g_hash_table_new_full(NULL, NULL,
 					NULL, remove_context_triggers);
+}
 
-	return dbus_cnx;
+int connline_plugin_setup_event_loop(DBusConnection *dbus_cnx, void *data)
+{
+	if (dbus_cnx != NULL && setup_dbus_in_glib_mainloop(dbus_cnx) == FALSE)
+		return -EINVAL;
+
+	setup_triggers_table();
+
+	return 0;
 }
 
 int connline_plugin_trigger_callback(struct connline_context *context,
@@ -341,7 +369,8 @@ int connline_plugin_trigger_callback(struct connline_context *context,
 	if (callback == NULL || context == NULL)
 		return -EINVAL;
 
-	trigger = calloc(1, sizeof(struct callback_trigger_data));
+	trigger = __connline_calloc(CONNLINE_MEMORY_EVENT,
+				1, sizeof(struct callback_trigger_data));
 	if (trigger == NULL)
 		return -ENOMEM;
 
@@ -375,12 +404,84 @@ void connline_plugin_trigger_cleanup(struct connline_context *context)
 	g_hash_table_remove(triggers_table, context);
 }
 
+static void fd_handler_free(gpointer data)
+{
+	struct fd_handler *handler = data;
+
+	if (handler->id > 0)
+		g_source_remove(handler->id);
+
+	__connline_free(handler);
+}
+
+/* The callback may unwatch its own fd, thus freeing the handler */
+static gboolean fd_handler_dispatch(GIOChannel *source,
+					GIOCondition condition, gpointer data)
+{
+	struct fd_handler *handler = data;
+
+	handler->callback(handler->fd, handler->user_data);
+
+	return TRUE;
+}
+
+int connline_plugin_watch_fd(void *data, int fd,
+				__connline_fd_callback_f callback,
+				void *user_data)
+{
+	struct fd_handler *handler;
+	GIOChannel *io_channel;
+
+	if (fd < 0 || callback == NULL)
+		return -EINVAL;
+
+	setup_triggers_table();
+
+	if (fds_table == NULL)
+		fds_table = g_hash_table_new_full(NULL, NULL,
+						NULL, fd_handler_free);
+
+	handler = __connline_calloc(CONNLINE_MEMORY_EVENT,
+						1, sizeof(struct fd_handler));
+	if (handler == NULL)
+		return -ENOMEM;
+
+	handler->fd = fd;
+	handler->callback = callback;
+	handler->user_data = user_data;
+
+	io_channel = g_io_channel_unix_new(fd);
+
+	handler->id = g_io_add_watch(io_channel, G_IO_IN | G_IO_ERR | G_IO_HUP,
+					fd_handler_dispatch, handler);
+
+	g_io_channel_unref(io_channel);
+
+	g_hash_table_replace(fds_table, GINT_TO_POINTER(fd), handler);
+
+	return 0;
+}
+
+void connline_plugin_unwatch_fd(int fd)
+{
+	if (fds_table != NULL)
+		g_hash_table_remove(fds_table, GINT_TO_POINTER(fd));
+}
+
 void connline_plugin_cleanup_event_loop(DBusConnection *dbus_cnx)
 {
 	if (triggers_table != NULL)
 		g_hash_table_destroy(triggers_table);
 	triggers_table = NULL;
 
+	if (fds_table != NULL)
+		g_hash_table_destroy(fds_table);
+	fds_table = NULL;
+
+	if (dispatch_id > 0)
+		g_source_remove(dispatch_id);
+	dispatch_id = 0;
+
 	if (dbus_cnx == NULL)
 		return;
 
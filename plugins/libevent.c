@@ -18,8 +18,10 @@
  *
  */
 
+#include <connline/alloc.h>
 #include <connline/connline.h>
 #include <connline/data.h>
+#include <connline/event.h>
 #include <connline/utils.h>
 
 #include <event2/event.h>
@@ -51,8 +53,19 @@ struct callback_trigger_data {
 	char **changed_property;
 };
 
+struct fd_handler {
+	struct event *ev;
+	int fd;
+	__connline_fd_callback_f callback;
+	void *user_data;
+};
+
 static struct event_base *ev_base = NULL;
 static GHashTable *triggers_table = NULL;
+static GHashTable *fds_table = NULL;
+
+/* At most one dispatch is pending */
+static struct timeout_handler *dispatch_handler = NULL;
 
 static void timeout_handler_free(void *data)
 {
@@ -69,30 +82,43 @@ static void timeout_handler_free(void *data)
 	if (to_handler->dbus_cnx != NULL)
 		dbus_connection_unref(to_handler->dbus_cnx);
 
-	free(to_handler);
+	__connline_free(to_handler);
 }
 
+static void schedule_dispatch(DBusConnection *dbus_cnx);
+
 static void libevent_dispatch_dbus(int fd, short event, void *data)
 {
 	struct timeout_handler *to_handler = data;
 	DBusConnection *dbus_cnx = to_handler->dbus_cnx;
 
+	dispatch_handler = NULL;
+
 	dbus_connection_ref(dbus_cnx);
 
-	while (dbus_connection_dispatch(dbus_cnx) ==
-					DBUS_DISPATCH_DATA_REMAINS);
+	timeout_handler_free(to_handler);
 
-	dbus_connection_unref(dbus_cnx);
+	/*
+	 * Out of budget: the rest waits for the other events to be handled.
+	 * A timer only runs once the loop polled again,  and the events it
+	 * found then are run first,  whatever priorities the base has.
+	 */
+	if (__connline_dispatch_dbus(dbus_cnx) == true)
+		schedule_dispatch(dbus_cnx);
 
-	timeout_handler_free(to_handler);
+	dbus_connection_unref(dbus_cnx);
 }
 
-static inline void throw_libevent_dispatch_dbus(DBusConnection *dbus_cnx)
+static void schedule_dispatch(DBusConnection *dbus_cnx)
 {
 	const struct timeval timeout = {0,0};
 	struct timeout_handler *to_handler;
 
-	to_handler = calloc(1, sizeof(struct timeout_handler));
+	if (dispatch_handler != NULL)
+		return;
+
+	to_handler = __connline_calloc(CONNLINE_MEMORY_EVENT,
+					1, sizeof(struct timeout_handler));
 	if (to_handler == NULL)
 		return;
 
@@ -101,15 +127,18 @@ static inline void throw_libevent_dispatch_dbus(DBusConnection *dbus_cnx)
 	to_handler->ev = evtimer_new(ev_base,
 				libevent_dispatch_dbus, to_handler);
 	evtimer_add(to_handler->ev, &timeout);
+
+	dispatch_handler = to_handler;
 }
 
 static void watch_handler_dispatch(int fd, short event, void *data)
 {
 	struct watch_handler *io_handler = data;
+	DBusConnection *dbus_cnx = io_handler->dbus_cnx;
 	DBusDispatchStatus status;
 	unsigned int flags = 0;
 
-	dbus_connection_ref(io_handler->dbus_cnx);
+	dbus_connection_ref(dbus_cnx);
 
 	if (evutil_socket_geterror(fd) != 0)
 		flags |= DBUS_WATCH_ERROR;
@@ -119,13 +148,14 @@ static void watch_handler_dispatch(int fd, short event, void *data)
 	if (event & EV_WRITE)
 		flags |= DBUS_WATCH_WRITABLE;
 
+	/* Toggling the watch, while handling it, frees io_handler */
 	dbus_watch_handle(io_handler->watch, flags);
 
-	status = dbus_connection_get_dispatch_status(io_handler->dbus_cnx);
+	status = dbus_connection_get_dispatch_status(dbus_cnx);
 	if (status == DBUS_DISPATCH_DATA_REMAINS)
-		throw_libevent_dispatch_dbus(io_handler->dbus_cnx);
+		schedule_dispatch(dbus_cnx);
 
-	dbus_connection_unref(io_handler->dbus_cnx);
+	dbus_connection_unref(dbus_cnx);
 }
 
 static void watch_handler_free(void *data)
@@ -142,7 +172,7 @@ static void watch_handler_free(void *data)
 
 	dbus_connection_unref(io_handler->dbus_cnx);
 
-	free(io_handler);
+	__connline_free(io_handler);
 }
 
 static dbus_bool_t libevent_dbus_watch_add(DBusWatch *watch, void *data)
@@ -156,7 +186,8 @@ static dbus_bool_t libevent_dbus_watch_add(DBusWatch *watch, void *data)
 	if (dbus_watch_get_enabled(watch) == FALSE)
 		return TRUE;
 
-	io_handler = calloc(1, sizeof(struct watch_handler));
+	io_handler = __connline_calloc(CONNLINE_MEMORY_EVENT,
+					1, sizeof(struct watch_handler));
 	if (io_handler == NULL)
 		return FALSE;
 
@@ -221,7 +252,8 @@ static dbus_bool_t libevent_dbus_timeout_add(DBusTimeout *timeout, void *data)
 	if (dbus_timeout_get_enabled(timeout) == FALSE)
 		return TRUE;
 
-	to_handler = calloc(1, sizeof(struct timeout_handler));
+	to_handler = __connline_calloc(CONNLINE_MEMORY_EVENT,
+					1, sizeof(struct timeout_handler));
 	if (to_handler == NULL)
 		return FALSE;
 
@@ -259,7 +291,7 @@ static void libevent_dbus_dispatch_status(DBusConnection *dbus_cnx,
 
 	status = dbus_connection_get_dispatch_status(dbus_cnx);
 	if (status == DBUS_DISPATCH_DATA_REMAINS)
-		throw_libevent_dispatch_dbus(dbus_cnx);
+		schedule_dispatch(dbus_cnx);
 }
 
 static dbus_bool_t setup_dbus_in_libevent_mainloop(DBusConnection *dbus_cnx)
@@ -281,7 +313,7 @@ static dbus_bool_t setup_dbus_in_libevent_mainloop(DBusConnection *dbus_cnx)
 
 	status = dbus_connection_get_dispatch_status(dbus_cnx);
 	if (status == DBUS_DISPATCH_DATA_REMAINS)
-		throw_libevent_dispatch_dbus(dbus_cnx);
+		schedule_dispatch(dbus_cnx);
 
 	return TRUE;
 }
@@ -316,13 +348,8 @@ static void trigger_run(int fd, short event, void *data)
 	callback(context, c_event, (const char **)changed_property,
 							context->user_data);
 
-	if (changed_property != NULL) {
-		char **prop;
-
-		for (prop = changed_property; *prop != NULL; prop++)
-			free(*prop);
-		free(changed_property);
-	}
+	if (changed_property != NULL)
+		property_list_free(changed_property);
 }
 
 static void remove_trigger(gpointer data)
@@ -337,7 +364,7 @@ static void remove_trigger(gpointer data)
 	if (trigger->changed_property != NULL)
 		property_list_free(trigger->changed_property);
 
-	free(trigger);
+	__connline_free(trigger);
 }
 
 static void remove_context_triggers(gpointer data)
@@ -347,28 +374,26 @@ static void remove_context_triggers(gpointer data)
 	g_hash_table_destroy(context_ht);
 }
 
-DBusConnection *connline_plugin_setup_event_loop(void *data)
+static void setup_triggers_table(void)
 {
-	DBusConnection *dbus_cnx;
+	if (triggers_table == NULL)
+		triggers_table = g_hash_table_new_full(NULL, NULL,
+					NULL, remove_context_triggers);
+}
 
+int connline_plugin_setup_event_loop(DBusConnection *dbus_cnx, void *data)
+{
 	ev_base = (struct event_base *) data;
 	if (ev_base == NULL)
-		return NULL;
-
-	dbus_cnx = dbus_bus_get(DBUS_BUS_SYSTEM, NULL);
-	if (dbus_cnx == NULL)
-		return NULL;
+		return -EINVAL;
 
-	if (setup_dbus_in_libevent_mainloop(dbus_cnx) == FALSE) {
-		dbus_connection_unref(dbus_cnx);
-		return NULL;
-	}
+	if (dbus_cnx != NULL &&
+			setup_dbus_in_libevent_mainloop(dbus_cnx) == FALSE)
+		return -EINVAL;
 
-	if (triggers_table == NULL)
-		triggers_table = g_hash_table_new_full(NULL, NULL,
-					NULL, remove_context_triggers);
+	setup_triggers_table();
 
-	return dbus_cnx;
+	return 0;
 }
 
 int connline_plugin_trigger_callback(struct connline_context *context,
@@ -383,7 +408,8 @@ int connline_plugin_trigger_callback(struct connline_context *context,
 	if (callback == NULL || context == NULL)
 		return -EINVAL;
 
-	trigger = calloc(1, sizeof(struct callback_trigger_data));
+	trigger = __connline_calloc(CONNLINE_MEMORY_EVENT,
+				1, sizeof(struct callback_trigger_data));
 	if (trigger == NULL)
 		return -ENOMEM;
 
@@ -416,6 +442,73 @@ void connline_plugin_trigger_cleanup(struct connline_context *context)
 	g_hash_table_remove(triggers_table, context);
 }
 
+static void fd_handler_free(gpointer data)
+{
+	struct fd_handler *handler = data;
+
+	if (handler->ev != NULL)
+		event_free(handler->ev);
+
+	__connline_free(handler);
+}
+
+/* The callback may unwatch its own fd, thus freeing the handler */
+static void fd_handler_dispatch(int fd, short event, void *data)
+{
+	struct fd_handler *handler = data;
+
+	handler->callback(handler->fd, handler->user_data);
+}
+
+int connline_plugin_watch_fd(void *data, int fd,
+				__connline_fd_callback_f callback,
+				void *user_data)
+{
+	struct fd_handler *handler;
+
+	if (fd < 0 || callback == NULL)
+		return -EINVAL;
+
+	if (ev_base == NULL)
+		ev_base = (struct event_base *) data;
+	if (ev_base == NULL)
+		return -EINVAL;
+
+	setup_triggers_table();
+
+	if (fds_table == NULL)
+		fds_table = g_hash_table_new_full(NULL, NULL,
+						NULL, fd_handler_free);
+
+	handler = __connline_calloc(CONNLINE_MEMORY_EVENT,
+						1, sizeof(struct fd_handler));
+	if (handler == NULL)
+		return -ENOMEM;
+
+	handler->fd = fd;
+	handler->callback = callback;
+	handler->user_data = user_data;
+
+	handler->ev = event_new(ev_base, fd, EV_READ | EV_PERSIST,
+					fd_handler_dispatch, handler);
+	if (handler->ev == NULL) {
+		__connline_free(handler);
+		return -ENOMEM;
+	}
+
+	event_add(handler->ev, NULL);
+
+	g_hash_table_replace(fds_table, GINT_TO_POINTER(fd), handler);
+
+	return 0;
+}
+
+void connline_plugin_unwatch_fd(int fd)
+{
+	if (fds_table != NULL)
+		g_hash_table_remove(fds_table, GINT_TO_POINTER(fd));
+}
+
 void connline_plugin_cleanup_event_loop(DBusConnection *dbus_cnx)
 {
 	if (triggers_table != NULL)
@@ -423,6 +516,16 @@ void connline_plugin_cleanup_event_loop(DBusConnection *dbus_cnx)
 
 	triggers_table = NULL;
 
+	if (fds_table != NULL)
+		g_hash_table_destroy(fds_table);
+
+	fds_table = NULL;
+
+	if (dispatch_handler != NULL)
+		timeout_handler_free(dispatch_handler);
+
+	dispatch_handler = NULL;
+
 	if (dbus_cnx == NULL)
 		return;
 
@@ -0,0 +1,969 @@
+/*
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License version 2.1,
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <connline/alloc.h>
+#include <connline/data.h>
+#include <connline/event.h>
+#include <connline/utils.h>
+#include <connline/backend.h>
+#include <connline/list.h>
+#include <connline/record.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#define NETLINK_GROUPS (RTMGRP_LINK | RTMGRP_IPV4_IFADDR | \
+			RTMGRP_IPV6_IFADDR | RTMGRP_IPV4_ROUTE | \
+			RTMGRP_IPV6_ROUTE)
+
+#define NETLINK_BUFFER_SIZE 32768
+#define NETLINK_ADDRESSES_SIZE 512
+
+/* The dumps are run one after the other, as the kernel wants it */
+enum netlink_dump {
+	NETLINK_DUMP_LINK  = 0,
+	NETLINK_DUMP_ADDR  = 1,
+	NETLINK_DUMP_ROUTE = 2,
+	NETLINK_DUMP_NONE  = 3,
+};
+
+struct netlink_link {
+	int index;
+	char name[IF_NAMESIZE];
+	unsigned int flags;
+	enum connline_bearer bearer;
+};
+
+/* Global scope addresses only */
+struct netlink_address {
+	int index;
+	char address[INET6_ADDRSTRLEN];
+};
+
+/* Default routes of the main table only */
+struct netlink_route {
+	int index;
+	unsigned char family;
+	uint32_t metric;
+};
+
+/* What is reported: the link holding the best default route */
+struct netlink_state {
+	bool online;
+	enum connline_bearer bearer;
+	char interface[IF_NAMESIZE];
+
+	/* '\0' separated */
+	char addresses[NETLINK_ADDRESSES_SIZE];
+	size_t addresses_size;
+};
+
+/* What a context has been told so far */
+struct netlink_data {
+	bool updated;
+	uint32_t generation;
+};
+
+/*
+ * All contexts share one rtnetlink socket, opened along with the first
+ * one and closed along with the last one.  Nothing is reported until the
+ * link, address and route dumps are over.
+ */
+struct netlink_monitor {
+	dlist *contexts;
+	unsigned int contexts_count;
+
+	int fd;
+	uint32_t sequence;
+
+	enum netlink_dump dump;
+	bool resync;
+	bool synced;
+
+	struct netlink_link *links;
+	unsigned int links_count;
+	struct netlink_address *addresses;
+	unsigned int addresses_count;
+	struct netlink_route *routes;
+	unsigned int routes_count;
+
+	struct netlink_state state;
+	uint32_t generation;
+
+	FILE *record;
+
+	/* Replaying: the file is pumped through the other end */
+	FILE *replay;
+	int replay_fd;
+	struct connline_record_entry replay_entry;
+	char *replay_data;
+};
+
+static struct netlink_monitor monitor = {
+	.fd = -1,
+	.dump = NETLINK_DUMP_NONE,
+	.replay_fd = -1,
+};
+
+static char netlink_buffer[NETLINK_BUFFER_SIZE];
+
+static void *array_grow(void *array, unsigned int count, size_t size)
+{
+	/* Doubling at each power of 2 */
+	if (count != 0 && (count & (count - 1)) != 0)
+		return array;
+
+	return __connline_realloc(CONNLINE_MEMORY_BACKEND,
+				array, (count == 0 ? 1 : count * 2) * size);
+}
+
+static struct netlink_link *find_link(int index)
+{
+	unsigned int i;
+
+	for (i = 0; i < monitor.links_count; i++) {
+		if (monitor.links[i].index == index)
+			return &monitor.links[i];
+	}
+
+	return NULL;
+}
+
+static bool has_address(int index)
+{
+	unsigned int i;
+
+	for (i = 0; i < monitor.addresses_count; i++) {
+		if (monitor.addresses[i].index == index)
+			return true;
+	}
+
+	return false;
+}
+
+static void remove_link_addresses(int index)
+{
+	unsigned int i = 0;
+
+	while (i < monitor.addresses_count) {
+		if (monitor.addresses[i].index != index) {
+			i++;
+			continue;
+		}
+
+		monitor.addresses[i] =
+			monitor.addresses[--monitor.addresses_count];
+	}
+}
+
+static void remove_link_routes(int index)
+{
+	unsigned int i = 0;
+
+	while (i < monitor.routes_count) {
+		if (monitor.routes[i].index != index) {
+			i++;
+			continue;
+		}
+
+		monitor.routes[i] = monitor.routes[--monitor.routes_count];
+	}
+}
+
+static void clear_model(void)
+{
+	__connline_free(monitor.links);
+	monitor.links = NULL;
+	monitor.links_count = 0;
+
+	__connline_free(monitor.addresses);
+	monitor.addresses = NULL;
+	monitor.addresses_count = 0;
+
+	__connline_free(monitor.routes);
+	monitor.routes = NULL;
+	monitor.routes_count = 0;
+}
+
+static void parse_attributes(struct rtattr **table, int max,
+					struct rtattr *rta, int length)
+{
+	memset(table, 0, sizeof(struct rtattr *) * (max + 1));
+
+	for (; RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+		if (rta->rta_type <= max)
+			table[rta->rta_type] = rta;
+	}
+}
+
+static void handle_link(struct nlmsghdr *nh)
+{
+	struct ifinfomsg *ifi = NLMSG_DATA(nh);
+	struct rtattr *table[IFLA_MAX + 1];
+	struct netlink_link *link, *links;
+
+	if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifi)))
+		return;
+
+	link = find_link(ifi->ifi_index);
+
+	if (nh->nlmsg_type == RTM_DELLINK) {
+		if (link == NULL)
+			return;
+
+		remove_link_addresses(ifi->ifi_index);
+		remove_link_routes(ifi->ifi_index);
+
+		*link = monitor.links[--monitor.links_count];
+
+		return;
+	}
+
+	parse_attributes(table, IFLA_MAX, IFLA_RTA(ifi),
+				nh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifi)));
+
+	if (link == NULL) {
+		if (table[IFLA_IFNAME] == NULL)
+			return;
+
+		links = array_grow(monitor.links, monitor.links_count,
+						sizeof(struct netlink_link));
+		if (links == NULL)
+			return;
+
+		monitor.links = links;
+		link = &monitor.links[monitor.links_count++];
+
+		memset(link, 0, sizeof(struct netlink_link));
+		link->index = ifi->ifi_index;
+	}
+
+	/* Renaming a link makes it another device, as far as sysfs knows */
+	if (table[IFLA_IFNAME] != NULL) {
+		char name[IF_NAMESIZE];
+
+		snprintf(name, sizeof(name), "%s",
+				(char *) RTA_DATA(table[IFLA_IFNAME]));
+
+		if (strcmp(name, link->name) != 0) {
+			strcpy(link->name, name);
+			link->bearer = connline_interface_to_bearer(name,
+							ifi->ifi_type);
+		}
+	}
+
+	link->flags = ifi->ifi_flags;
+}
+
+static void handle_address(struct nlmsghdr *nh)
+{
+	struct ifaddrmsg *ifa = NLMSG_DATA(nh);
+	struct rtattr *table[IFA_MAX + 1];
+	struct netlink_address *addresses;
+	char address[INET6_ADDRSTRLEN];
+	struct rtattr *rta;
+	unsigned int i;
+
+	if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifa)))
+		return;
+
+	if (ifa->ifa_scope != RT_SCOPE_UNIVERSE)
+		return;
+
+	if (ifa->ifa_family != AF_INET && ifa->ifa_family != AF_INET6)
+		return;
+
+	parse_attributes(table, IFA_MAX, IFA_RTA(ifa),
+				nh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifa)));
+
+	/* On point to point links, IFA_ADDRESS is the peer's one */
+	rta = table[IFA_LOCAL];
+	if (rta == NULL || ifa->ifa_family == AF_INET6)
+		rta = table[IFA_ADDRESS];
+	if (rta == NULL)
+		return;
+
+	if (inet_ntop(ifa->ifa_family, RTA_DATA(rta),
+					address, sizeof(address)) == NULL)
+		return;
+
+	for (i = 0; i < monitor.addresses_count; i++) {
+		if (monitor.addresses[i].index == (int) ifa->ifa_index &&
+			strcmp(monitor.addresses[i].address, address) == 0)
+			break;
+	}
+
+	if (nh->nlmsg_type == RTM_DELADDR) {
+		if (i < monitor.addresses_count)
+			monitor.addresses[i] =
+				monitor.addresses[--monitor.addresses_count];
+
+		return;
+	}
+
+	if (i < monitor.addresses_count)
+		return;
+
+	addresses = array_grow(monitor.addresses, monitor.addresses_count,
+					sizeof(struct netlink_address));
+	if (addresses == NULL)
+		return;
+
+	monitor.addresses = addresses;
+
+	monitor.addresses[i].index = ifa->ifa_index;
+	strcpy(monitor.addresses[i].address, address);
+	monitor.addresses_count++;
+}
+
+static void handle_route(struct nlmsghdr *nh)
+{
+	struct rtmsg *rtm = NLMSG_DATA(nh);
+	struct rtattr *table[RTA_MAX + 1];
+	struct netlink_route *routes;
+	uint32_t rt_table, metric = 0;
+	unsigned int i;
+	int index;
+
+	if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(*rtm)))
+		return;
+
+	if (rtm->rtm_dst_len != 0 || rtm->rtm_type != RTN_UNICAST)
+		return;
+
+	parse_attributes(table, RTA_MAX, RTM_RTA(rtm),
+				nh->nlmsg_len - NLMSG_LENGTH(sizeof(*rtm)));
+
+	rt_table = rtm->rtm_table;
+	if (table[RTA_TABLE] != NULL)
+		rt_table = *(uint32_t *) RTA_DATA(table[RTA_TABLE]);
+
+	if (rt_table != RT_TABLE_MAIN || table[RTA_OIF] == NULL)
+		return;
+
+	index = *(int *) RTA_DATA(table[RTA_OIF]);
+	if (table[RTA_PRIORITY] != NULL)
+		metric = *(uint32_t *) RTA_DATA(table[RTA_PRIORITY]);
+
+	for (i = 0; i < monitor.routes_count; i++) {
+		if (monitor.routes[i].index == index &&
+				monitor.routes[i].family == rtm->rtm_family &&
+				monitor.routes[i].metric == metric)
+			break;
+	}
+
+	if (nh->nlmsg_type == RTM_DELROUTE) {
+		if (i < monitor.routes_count)
+			monitor.routes[i] =
+				monitor.routes[--monitor.routes_count];
+
+		return;
+	}
+
+	if (i < monitor.routes_count)
+		return;
+
+	routes = array_grow(monitor.routes, monitor.routes_count,
+					sizeof(struct netlink_route));
+	if (routes == NULL)
+		return;
+
+	monitor.routes = routes;
+
+	monitor.routes[i].index = index;
+	monitor.routes[i].family = rtm->rtm_family;
+	monitor.routes[i].metric = metric;
+	monitor.routes_count++;
+}
+
+static bool is_link_usable(struct netlink_link *link)
+{
+	if (link == NULL || (link->flags & IFF_LOOPBACK) != 0)
+		return false;
+
+	if ((link->flags & (IFF_UP | IFF_RUNNING)) != (IFF_UP | IFF_RUNNING))
+		return false;
+
+	return has_address(link->index);
+}
+
+static void compute_state(struct netlink_state *state)
+{
+	struct netlink_route *best = NULL;
+	struct netlink_link *link;
+	unsigned int i;
+	size_t size;
+
+	memset(state, 0, sizeof(struct netlink_state));
+
+	for (i = 0; i < monitor.routes_count; i++) {
+		if (best != NULL && best->metric <= monitor.routes[i].metric)
+			continue;
+
+		if (is_link_usable(find_link(monitor.routes[i].index)) == false)
+			continue;
+
+		best = &monitor.routes[i];
+	}
+
+	if (best == NULL)
+		return;
+
+	link = find_link(best->index);
+
+	state->online = true;
+	state->bearer = link->bearer;
+	strcpy(state->interface, link->name);
+
+	for (i = 0; i < monitor.addresses_count; i++) {
+		if (monitor.addresses[i].index != link->index)
+			continue;
+
+		size = strlen(monitor.addresses[i].address) + 1;
+		if (state->addresses_size + size > NETLINK_ADDRESSES_SIZE)
+			break;
+
+		memcpy(state->addresses + state->addresses_size,
+					monitor.addresses[i].address, size);
+		state->addresses_size += size;
+	}
+}
+
+static bool is_bearer_matching(struct connline_context *context)
+{
+	if (context->bearer_type == CONNLINE_BEARER_UNKNOWN)
+		return true;
+
+	return (monitor.state.bearer & context->bearer_type) != 0;
+}
+
+static void send_netlink_properties(struct connline_context *context)
+{
+	struct netlink_state *state = &monitor.state;
+	char **properties = NULL;
+	const char *address;
+
+	if (__connline_wants_event(context, CONNLINE_EVENT_PROPERTY) == false)
+		return;
+
+	properties = insert_into_property_list(properties, "bearer",
+				connline_bearer_to_string(state->bearer));
+
+	properties = insert_into_property_list(properties,
+					"interface", state->interface);
+
+	for (address = state->addresses;
+			address < state->addresses + state->addresses_size;
+			address += strlen(address) + 1)
+		properties = insert_into_property_list(properties,
+							"address", address);
+
+	if (properties != NULL)
+		__connline_call_property_callback(context, properties);
+}
+
+/* Sends what changed since the context was last updated */
+static void update_context(void *data)
+{
+	struct connline_context *context = data;
+	struct netlink_data *netlink = context->backend_data;
+
+	if (monitor.synced == false)
+		return;
+
+	if (monitor.state.online == true &&
+				is_bearer_matching(context) == true) {
+		if (context->is_online == false) {
+			context->is_online = true;
+
+			__connline_call_connected_callback(context);
+			send_netlink_properties(context);
+		} else if (netlink->generation != monitor.generation)
+			send_netlink_properties(context);
+	} else if (context->is_online == true || netlink->updated == false) {
+		context->is_online = false;
+
+		__connline_call_disconnected_callback(context);
+	}
+
+	netlink->updated = true;
+	netlink->generation = monitor.generation;
+}
+
+static void update_state(void)
+{
+	struct netlink_state state;
+
+	compute_state(&state);
+
+	if (memcmp(&state, &monitor.state, sizeof(state)) != 0) {
+		monitor.state = state;
+		monitor.generation++;
+	}
+
+	dlist_foreach(monitor.contexts, update_context);
+}
+
+static int send_dump_request(int type)
+{
+	struct {
+		struct nlmsghdr nh;
+		struct rtgenmsg rtgen;
+	} request;
+
+	if (monitor.replay != NULL)
+		return 0;
+
+	memset(&request, 0, sizeof(request));
+	request.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtgenmsg));
+	request.nh.nlmsg_type = type;
+	request.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	request.nh.nlmsg_seq = ++monitor.sequence;
+	request.rtgen.rtgen_family = AF_UNSPEC;
+
+	if (send(monitor.fd, &request, request.nh.nlmsg_len, 0) < 0)
+		return -errno;
+
+	return 0;
+}
+
+static int request_dump(void)
+{
+	switch (monitor.dump) {
+	case NETLINK_DUMP_LINK:
+		return send_dump_request(RTM_GETLINK);
+	case NETLINK_DUMP_ADDR:
+		return send_dump_request(RTM_GETADDR);
+	case NETLINK_DUMP_ROUTE:
+		return send_dump_request(RTM_GETROUTE);
+	case NETLINK_DUMP_NONE:
+		break;
+	}
+
+	return 0;
+}
+
+/* From scratch: the kernel does not say what got lost */
+static int start_dump(void)
+{
+	clear_model();
+
+	monitor.synced = false;
+	monitor.resync = false;
+	monitor.dump = NETLINK_DUMP_LINK;
+
+	return request_dump();
+}
+
+static void dump_done(void)
+{
+	if (monitor.dump == NETLINK_DUMP_NONE)
+		return;
+
+	if (monitor.resync == true) {
+		start_dump();
+		return;
+	}
+
+	monitor.dump++;
+	if (monitor.dump != NETLINK_DUMP_NONE) {
+		request_dump();
+		return;
+	}
+
+	monitor.synced = true;
+}
+
+static void process_datagram(char *buffer, size_t size)
+{
+	struct nlmsghdr *nh;
+
+	for (nh = (struct nlmsghdr *) buffer; NLMSG_OK(nh, size);
+						nh = NLMSG_NEXT(nh, size)) {
+		switch (nh->nlmsg_type) {
+		case NLMSG_DONE:
+		case NLMSG_ERROR:
+			dump_done();
+			break;
+		case RTM_NEWLINK:
+		case RTM_DELLINK:
+			handle_link(nh);
+			break;
+		case RTM_NEWADDR:
+		case RTM_DELADDR:
+			handle_address(nh);
+			break;
+		case RTM_NEWROUTE:
+		case RTM_DELROUTE:
+			handle_route(nh);
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (monitor.synced == true)
+		update_state();
+}
+
+static void record_datagram(char *buffer, size_t size)
+{
+	struct connline_record_entry entry;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	memset(&entry, 0, sizeof(entry));
+	entry.timestamp = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	entry.size = size;
+
+	if (fwrite(&entry, sizeof(entry), 1, monitor.record) != 1 ||
+			fwrite(buffer, size, 1, monitor.record) != 1)
+		perror("Connline: cannot record netlink message");
+
+	fflush(monitor.record);
+}
+
+static FILE *open_record_file(const char *path, bool replay)
+{
+	struct connline_record_header header;
+	FILE *file;
+
+	file = fopen(path, replay == true ? "r" : "w");
+	if (file == NULL)
+		return NULL;
+
+	memset(&header, 0, sizeof(header));
+
+	if (replay == true) {
+		if (fread(&header, sizeof(header), 1, file) == 1 &&
+				memcmp(header.magic,
+					CONNLINE_NETLINK_RECORD_MAGIC,
+					sizeof(header.magic)) == 0 &&
+				header.version == CONNLINE_RECORD_VERSION)
+			return file;
+	} else {
+		memcpy(header.magic, CONNLINE_NETLINK_RECORD_MAGIC,
+						sizeof(header.magic));
+		header.version = CONNLINE_RECORD_VERSION;
+
+		if (fwrite(&header, sizeof(header), 1, file) == 1)
+			return file;
+	}
+
+	fclose(file);
+	errno = EIO;
+
+	return NULL;
+}
+
+/* Feeds the socket as much as it takes, and hangs it up at the end */
+static void pump_replay(void)
+{
+	struct connline_record_entry *entry = &monitor.replay_entry;
+
+	if (monitor.replay_fd < 0)
+		return;
+
+	while (true) {
+		if (monitor.replay_data == NULL) {
+			if (fread(entry, sizeof(*entry), 1,
+						monitor.replay) != 1 ||
+					entry->size > NETLINK_BUFFER_SIZE)
+				break;
+
+			monitor.replay_data = __connline_malloc(
+					CONNLINE_MEMORY_BACKEND, entry->size);
+			if (monitor.replay_data == NULL)
+				break;
+
+			if (fread(monitor.replay_data, entry->size, 1,
+							monitor.replay) != 1)
+				break;
+		}
+
+		if (send(monitor.replay_fd, monitor.replay_data,
+						entry->size, 0) < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				return;
+
+			break;
+		}
+
+		__connline_free(monitor.replay_data);
+		monitor.replay_data = NULL;
+	}
+
+	__connline_free(monitor.replay_data);
+	monitor.replay_data = NULL;
+
+	close(monitor.replay_fd);
+	monitor.replay_fd = -1;
+}
+
+static void netlink_cb(int fd, void *user_data)
+{
+	ssize_t ret;
+
+	while (true) {
+		ret = recv(fd, netlink_buffer, sizeof(netlink_buffer), 0);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+
+			/* Multicast messages got dropped */
+			if (errno == ENOBUFS) {
+				DBG("netlink overrun, resyncing");
+
+				if (monitor.dump == NETLINK_DUMP_NONE)
+					start_dump();
+				else
+					monitor.resync = true;
+
+				continue;
+			}
+
+			return;
+		}
+
+		/* Only a replay ends */
+		if (ret == 0) {
+			__connline_unwatch_fd(fd);
+			return;
+		}
+
+		if (monitor.record != NULL)
+			record_datagram(netlink_buffer, ret);
+
+		process_datagram(netlink_buffer, ret);
+
+		pump_replay();
+	}
+}
+
+static int open_netlink_socket(void)
+{
+	struct sockaddr_nl addr;
+	int fd;
+
+	fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK,
+							NETLINK_ROUTE);
+	if (fd < 0)
+		return -errno;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = NETLINK_GROUPS;
+
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -errno;
+	}
+
+	return fd;
+}
+
+static int open_replay_socket(const char *path)
+{
+	int fds[2];
+
+	monitor.replay = open_record_file(path, true);
+	if (monitor.replay == NULL)
+		return -errno;
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC |
+					SOCK_NONBLOCK, 0, fds) < 0)
+		return -errno;
+
+	monitor.replay_fd = fds[1];
+
+	return fds[0];
+}
+
+static void stop_monitor(void)
+{
+	if (monitor.fd >= 0) {
+		__connline_unwatch_fd(monitor.fd);
+		close(monitor.fd);
+	}
+	monitor.fd = -1;
+
+	if (monitor.replay_fd >= 0)
+		close(monitor.replay_fd);
+	monitor.replay_fd = -1;
+
+	__connline_free(monitor.replay_data);
+	monitor.replay_data = NULL;
+
+	if (monitor.replay != NULL)
+		fclose(monitor.replay);
+	monitor.replay = NULL;
+
+	if (monitor.record != NULL)
+		fclose(monitor.record);
+	monitor.record = NULL;
+
+	clear_model();
+
+	memset(&monitor.state, 0, sizeof(monitor.state));
+	monitor.dump = NETLINK_DUMP_NONE;
+	monitor.synced = false;
+	monitor.resync = false;
+}
+
+static int start_monitor(void)
+{
+	const char *path;
+	int ret;
+
+	/* Neither is to be trusted in a setuid or setgid process */
+	path = secure_getenv(CONNLINE_NETLINK_REPLAY_ENV);
+	if (path != NULL && *path != '\0')
+		monitor.fd = open_replay_socket(path);
+	else
+		monitor.fd = open_netlink_socket();
+
+	if (monitor.fd < 0) {
+		ret = monitor.fd;
+		goto error;
+	}
+
+	path = secure_getenv(CONNLINE_NETLINK_RECORD_ENV);
+	if (path != NULL && *path != '\0' && monitor.replay == NULL) {
+		monitor.record = open_record_file(path, false);
+		if (monitor.record == NULL)
+			perror("Connline: cannot record netlink messages");
+	}
+
+	ret = __connline_watch_fd(NULL, monitor.fd, netlink_cb, NULL);
+	if (ret < 0)
+		goto error;
+
+	ret = start_dump();
+	if (ret < 0)
+		goto error;
+
+	pump_replay();
+
+	return 0;
+
+error:
+	stop_monitor();
+
+	return ret;
+}
+
+static int netlink_open(struct connline_context *context)
+{
+	struct netlink_data *netlink = context->backend_data;
+	dlist *new_list;
+	int ret;
+
+	/* Reconnecting */
+	if (netlink != NULL) {
+		update_context(context);
+		return 0;
+	}
+
+	netlink = __connline_calloc(CONNLINE_MEMORY_BACKEND,
+						1, sizeof(struct netlink_data));
+	if (netlink == NULL)
+		return -ENOMEM;
+
+	new_list = dlist_prepend(monitor.contexts, context);
+	if (new_list == monitor.contexts) {
+		__connline_free(netlink);
+		return -ENOMEM;
+	}
+
+	monitor.contexts = new_list;
+	monitor.contexts_count++;
+	context->backend_data = netlink;
+
+	if (monitor.fd < 0) {
+		ret = start_monitor();
+		if (ret < 0) {
+			DBG("cannot monitor rtnetlink: %s", strerror(-ret));
+
+			monitor.contexts = dlist_remove(monitor.contexts,
+								context);
+			monitor.contexts_count--;
+
+			__connline_free(netlink);
+			context->backend_data = NULL;
+
+			/* The core does not look at it: the context is told */
+			__connline_call_error_callback(context, false);
+
+			return ret;
+		}
+	}
+
+	update_context(context);
+
+	return 0;
+}
+
+static int netlink_close(struct connline_context *context)
+{
+	if (context == NULL || context->backend_data == NULL)
+		return -EINVAL;
+
+	monitor.contexts = dlist_remove(monitor.contexts, context);
+	monitor.contexts_count--;
+
+	__connline_free(context->backend_data);
+	context->backend_data = NULL;
+
+	if (monitor.contexts_count == 0)
+		stop_monitor();
+
+	return 0;
+}
+
+static enum connline_bearer netlink_get_bearer(struct connline_context *context)
+{
+	if (context == NULL || context->is_online == false)
+		return CONNLINE_BEARER_UNKNOWN;
+
+	return monitor.state.bearer;
+}
+
+static struct connline_backend_methods netlink = {
+	netlink_open,
+	netlink_close,
+	netlink_get_bearer
+};
+
+struct connline_backend_methods *connline_plugin_setup_backend(void)
+{
+	return &netlink;
+}
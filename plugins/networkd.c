@@ -0,0 +1,852 @@
+/*
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License version 2.1,
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <connline/alloc.h>
+#include <connline/data.h>
+#include <connline/event.h>
+#include <connline/dbus.h>
+#include <connline/utils.h>
+#include <connline/backend.h>
+#include <connline/list.h>
+#include <connline/stats.h>
+
+#include <dbus/dbus.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <ifaddrs.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <netinet/in.h>
+
+#define NETWORKD_DBUS_NAME "org.freedesktop.network1"
+#define NETWORKD_MANAGER_PATH "/org/freedesktop/network1"
+#define NETWORKD_LINK_PATH_PREFIX NETWORKD_MANAGER_PATH "/link/"
+#define NETWORKD_MANAGER_INTERFACE NETWORKD_DBUS_NAME ".Manager"
+#define NETWORKD_LINK_INTERFACE NETWORKD_DBUS_NAME ".Link"
+
+#define NETWORKD_SERVICE_MATCH_RULE "type='signal'" \
+				",sender='" DBUS_INTERFACE_DBUS "'" \
+				",interface='" DBUS_INTERFACE_DBUS "'" \
+				",member='" DBUS_SERVICE_OWNER_CHANGED "'" \
+				",arg0='" NETWORKD_DBUS_NAME "'"
+
+#define NETWORKD_LINK_PROPERTY_MATCH_RULE "type='signal'" \
+				",sender='" NETWORKD_DBUS_NAME "'" \
+				",interface='" DBUS_INTERFACE_PROPERTIES "'" \
+				",member='PropertiesChanged'" \
+				",arg0='" NETWORKD_LINK_INTERFACE "'"
+
+struct networkd_link {
+	char *path;
+	int index;
+	char *name;
+	enum connline_bearer bearer;
+
+	enum connline_token operational_state;
+	enum connline_token address_state;
+
+	dbus_bool_t online;
+	dbus_bool_t updated;
+	/* Gone from networkd, or lingering until it is */
+	dbus_bool_t removed;
+
+	DBusPendingCall *call;
+};
+
+/*
+ * networkd cannot be asked for a connection: all contexts only listen,
+ * and share one monitor.  It lists the links once, gets each one's
+ * properties, then follows their PropertiesChanged signals.
+ */
+struct networkd_monitor {
+	DBusConnection *dbus_cnx;
+	dlist *contexts;
+
+	struct networkd_link **links;
+	int nb_links;
+	int pending_links;
+
+	dbus_bool_t properties_watched;
+	dbus_bool_t ready;
+
+	DBusPendingCall *call;
+};
+
+struct networkd_dbus {
+	enum connline_bearer bearer;
+
+	dbus_bool_t monitored;
+	dbus_bool_t notified;
+	struct networkd_link *link;
+};
+
+const char *connline_backend_watch_rule = NETWORKD_SERVICE_MATCH_RULE;
+const char *connline_backend_service_name = NETWORKD_DBUS_NAME;
+
+static struct networkd_monitor *monitor = NULL;
+
+static void free_networkd_link(struct networkd_link *link)
+{
+	connline_dbus_cancel_call(&link->call);
+
+	__connline_free(link->path);
+	__connline_free(link->name);
+
+	__connline_free(link);
+}
+
+/* States other than routable are all CONNLINE_TOKEN_UNKNOWN */
+static dbus_bool_t is_link_online(struct networkd_link *link)
+{
+	if (link->operational_state != CONNLINE_TOKEN_ROUTABLE ||
+			link->address_state != CONNLINE_TOKEN_ROUTABLE)
+		return FALSE;
+
+	return TRUE;
+}
+
+static bool update_link_property(DBusMessageIter *iter, void *user_data)
+{
+	struct networkd_link *link = user_data;
+	enum connline_token *state;
+	const char *value = NULL;
+	dbus_bool_t online;
+	const char *name;
+
+	if (connline_dbus_get_basic(iter, DBUS_TYPE_STRING, &name) != 0)
+		return false;
+
+	dbus_message_iter_next(iter);
+
+	switch (connline_token_lookup(name)) {
+	case CONNLINE_TOKEN_KEY_ADMINISTRATIVE_STATE:
+		if (connline_dbus_get_basic_variant(iter,
+					DBUS_TYPE_STRING, &value) != 0)
+			return false;
+
+		if (connline_token_lookup(value) == CONNLINE_TOKEN_LINGER)
+			link->removed = TRUE;
+
+		return false;
+	case CONNLINE_TOKEN_KEY_OPERATIONAL_STATE:
+		state = &link->operational_state;
+		break;
+	case CONNLINE_TOKEN_KEY_ADDRESS_STATE:
+		state = &link->address_state;
+		break;
+	default:
+		return false;
+	}
+
+	if (connline_dbus_get_basic_variant(iter,
+				DBUS_TYPE_STRING, &value) != 0)
+		return false;
+
+	*state = connline_token_lookup(value);
+
+	online = is_link_online(link);
+	if (online != link->online) {
+		link->online = online;
+		link->updated = TRUE;
+	}
+
+	return false;
+}
+
+/* The label is the index, escaped as systemd does: "2" is "_32" */
+static int path_to_index(const char *path)
+{
+	const char *label;
+	char digits[16];
+	unsigned int i = 0;
+	char *end;
+	long index;
+
+	if (strncmp(path, NETWORKD_LINK_PATH_PREFIX,
+				strlen(NETWORKD_LINK_PATH_PREFIX)) != 0)
+		return -1;
+
+	label = path + strlen(NETWORKD_LINK_PATH_PREFIX);
+
+	while (*label != '\0' && i < sizeof(digits) - 1) {
+		char hex[3];
+
+		if (*label != '_') {
+			digits[i++] = *label++;
+			continue;
+		}
+
+		if (isxdigit(label[1]) == 0 || isxdigit(label[2]) == 0)
+			return -1;
+
+		hex[0] = label[1];
+		hex[1] = label[2];
+		hex[2] = '\0';
+
+		digits[i++] = strtol(hex, NULL, 16);
+		label += 3;
+	}
+
+	digits[i] = '\0';
+
+	index = strtol(digits, &end, 10);
+	if (i == 0 || *end != '\0' || index <= 0)
+		return -1;
+
+	return index;
+}
+
+static struct networkd_link *find_link(const char *path)
+{
+	int i;
+
+	for (i = 0; i < monitor->nb_links; i++) {
+		if (strcmp(monitor->links[i]->path, path) == 0)
+			return monitor->links[i];
+	}
+
+	return NULL;
+}
+
+static struct networkd_link *
+lookup_online_link(struct connline_context *context)
+{
+	struct networkd_link *link;
+	int i;
+
+	for (i = 0; i < monitor->nb_links; i++) {
+		link = monitor->links[i];
+
+		if (link->online == FALSE)
+			continue;
+
+		if (context->bearer_type == CONNLINE_BEARER_UNKNOWN ||
+					link->bearer & context->bearer_type)
+			return link;
+	}
+
+	return NULL;
+}
+
+/* networkd does not export the addresses: the kernel tells */
+static char **insert_link_addresses(char **properties, const char *name)
+{
+	char address[INET6_ADDRSTRLEN];
+	struct ifaddrs *ifaddrs, *ifa;
+	struct sockaddr_in6 *sin6;
+	struct sockaddr_in *sin;
+	const void *data;
+
+	if (name == NULL || getifaddrs(&ifaddrs) < 0)
+		return properties;
+
+	for (ifa = ifaddrs; ifa != NULL; ifa = ifa->ifa_next) {
+		if (ifa->ifa_addr == NULL || strcmp(ifa->ifa_name, name) != 0)
+			continue;
+
+		if (ifa->ifa_addr->sa_family == AF_INET) {
+			sin = (struct sockaddr_in *) ifa->ifa_addr;
+
+			/* Link local, 169.254.0.0/16 */
+			if ((ntohl(sin->sin_addr.s_addr) >> 16) == 0xa9fe)
+				continue;
+
+			data = &sin->sin_addr;
+		} else if (ifa->ifa_addr->sa_family == AF_INET6) {
+			sin6 = (struct sockaddr_in6 *) ifa->ifa_addr;
+
+			if (IN6_IS_ADDR_LINKLOCAL(&sin6->sin6_addr))
+				continue;
+
+			data = &sin6->sin6_addr;
+		} else
+			continue;
+
+		if (inet_ntop(ifa->ifa_addr->sa_family, data,
+					address, sizeof(address)) == NULL)
+			continue;
+
+		properties = insert_into_property_list(properties,
+							"address", address);
+	}
+
+	freeifaddrs(ifaddrs);
+
+	return properties;
+}
+
+static void context_update(void *data)
+{
+	struct connline_context *context = data;
+	struct networkd_dbus *networkd = context->backend_data;
+	struct networkd_link *link;
+	char **properties = NULL;
+
+	link = lookup_online_link(context);
+
+	if (link == NULL) {
+		if (networkd->link == NULL && networkd->notified == TRUE)
+			return;
+
+		networkd->link = NULL;
+		networkd->notified = TRUE;
+		networkd->bearer = CONNLINE_BEARER_UNKNOWN;
+		context->is_online = FALSE;
+
+		__connline_call_disconnected_callback(context);
+
+		return;
+	}
+
+	if (link == networkd->link && link->updated == FALSE)
+		return;
+
+	networkd->link = link;
+	networkd->notified = TRUE;
+	networkd->bearer = link->bearer;
+	context->is_online = TRUE;
+
+	__connline_call_connected_callback(context);
+
+	/* Spares getifaddrs() too */
+	if (__connline_wants_event(context, CONNLINE_EVENT_PROPERTY) == false)
+		return;
+
+	properties = insert_into_property_list(properties, "bearer",
+				connline_bearer_to_string(networkd->bearer));
+
+	properties = insert_into_property_list(properties,
+						"interface", link->name);
+
+	properties = insert_link_addresses(properties, link->name);
+
+	if (properties != NULL)
+		__connline_call_property_callback(context, properties);
+}
+
+static void invalidate_context(void *data)
+{
+	struct connline_context *context = data;
+
+	context->is_online = FALSE;
+	__connline_call_error_callback(context, false);
+}
+
+static void monitor_dispatch_update(void)
+{
+	int i;
+
+	dlist_foreach(monitor->contexts, context_update);
+
+	for (i = 0; i < monitor->nb_links; i++)
+		monitor->links[i]->updated = FALSE;
+}
+
+/* Those on the link move off it first, while it is still to be found */
+static void remove_link(struct networkd_link *link)
+{
+	int i;
+
+	link->online = FALSE;
+	if (monitor->ready == TRUE)
+		monitor_dispatch_update();
+
+	for (i = 0; i < monitor->nb_links; i++) {
+		if (monitor->links[i] == link)
+			break;
+	}
+
+	if (i == monitor->nb_links)
+		return;
+
+	monitor->nb_links--;
+	monitor->links[i] = monitor->links[monitor->nb_links];
+
+	/* Its GetAll reply was waited for, before the first dispatch */
+	if (link->call != NULL && monitor->ready == FALSE)
+		monitor->pending_links--;
+
+	free_networkd_link(link);
+}
+
+static void get_link_properties_callback(DBusPendingCall *pending,
+							void *user_data)
+{
+	struct networkd_link *link = user_data;
+	DBusMessage *reply;
+	DBusMessageIter arg;
+
+	if (dbus_pending_call_get_completed(pending) == FALSE)
+		return;
+
+	__connline_stats_reply(pending);
+
+	link->call = NULL;
+
+	/* Without its properties, a link is just never online */
+	reply = dbus_pending_call_steal_reply(pending);
+	if (reply != NULL) {
+		if (dbus_message_get_type(reply) ==
+					DBUS_MESSAGE_TYPE_METHOD_RETURN &&
+				dbus_message_iter_init(reply, &arg) == TRUE)
+			connline_dbus_foreach_dict_entry(&arg,
+						update_link_property, link);
+		else if (dbus_message_is_error(reply,
+				DBUS_ERROR_UNKNOWN_OBJECT) == TRUE)
+			link->removed = TRUE;
+
+		dbus_message_unref(reply);
+	}
+
+	dbus_pending_call_unref(pending);
+
+	if (link->removed == TRUE)
+		remove_link(link);
+
+	/* A link seen in a signal may be done before ListLinks is */
+	if (monitor->ready == FALSE) {
+		if (--monitor->pending_links > 0 || monitor->call != NULL)
+			return;
+
+		monitor->ready = TRUE;
+	}
+
+	monitor_dispatch_update();
+}
+
+static int get_link_properties(struct networkd_link *link)
+{
+	const char *interface = NETWORKD_LINK_INTERFACE;
+	DBusMessage *message;
+	int ret = -EINVAL;
+
+	/* Links come and go: no template for their paths */
+	message = dbus_message_new_method_call(NETWORKD_DBUS_NAME,
+						link->path,
+						DBUS_INTERFACE_PROPERTIES,
+						"GetAll");
+	if (message == NULL)
+		return -ENOMEM;
+
+	if (dbus_message_append_args(message, DBUS_TYPE_STRING, &interface,
+						DBUS_TYPE_INVALID) == FALSE)
+		goto out;
+
+	if (connline_dbus_send_with_deadline(NULL, monitor->dbus_cnx,
+				message, &link->call,
+				get_link_properties_callback, link) < 0)
+		goto out;
+
+	ret = 0;
+
+out:
+	dbus_message_unref(message);
+
+	return ret;
+}
+
+static struct networkd_link *add_link(int index, const char *name,
+							const char *path)
+{
+	struct networkd_link **links;
+	struct networkd_link *link;
+	char ifname[IF_NAMESIZE];
+
+	link = __connline_calloc(CONNLINE_MEMORY_BACKEND,
+					1, sizeof(struct networkd_link));
+	if (link == NULL)
+		return NULL;
+
+	link->index = index;
+	link->path = __connline_strdup(CONNLINE_MEMORY_BACKEND, path);
+
+	/* Older networkd versions have no AddressState */
+	link->address_state = CONNLINE_TOKEN_ROUTABLE;
+
+	if (name == NULL)
+		name = if_indextoname(index, ifname);
+	if (name != NULL)
+		link->name = __connline_strdup(CONNLINE_MEMORY_BACKEND, name);
+
+	links = __connline_realloc(CONNLINE_MEMORY_BACKEND,
+				monitor->links, sizeof(struct networkd_link *) *
+						(monitor->nb_links + 1));
+	if (link->path == NULL || links == NULL) {
+		if (links != NULL)
+			monitor->links = links;
+
+		free_networkd_link(link);
+		return NULL;
+	}
+
+	link->bearer = CONNLINE_BEARER_UNKNOWN;
+	if (link->name != NULL)
+		link->bearer = connline_interface_to_bearer(link->name, -1);
+
+	monitor->links = links;
+	monitor->links[monitor->nb_links++] = link;
+
+	return link;
+}
+
+static int update_links(DBusMessageIter *iter)
+{
+	DBusMessageIter array, entry;
+	struct networkd_link *link;
+	const char *name, *path;
+	dbus_int32_t index;
+
+	if (dbus_message_iter_get_arg_type(iter) != DBUS_TYPE_ARRAY)
+		return -EINVAL;
+
+	dbus_message_iter_recurse(iter, &array);
+
+	for (; dbus_message_iter_get_arg_type(&array) == DBUS_TYPE_STRUCT;
+					dbus_message_iter_next(&array)) {
+		dbus_message_iter_recurse(&array, &entry);
+
+		if (connline_dbus_get_basic(&entry,
+					DBUS_TYPE_INT32, &index) != 0)
+			return -EINVAL;
+
+		dbus_message_iter_next(&entry);
+
+		if (connline_dbus_get_basic(&entry,
+					DBUS_TYPE_STRING, &name) != 0)
+			return -EINVAL;
+
+		dbus_message_iter_next(&entry);
+
+		if (connline_dbus_get_basic(&entry,
+					DBUS_TYPE_OBJECT_PATH, &path) != 0)
+			return -EINVAL;
+
+		if (find_link(path) != NULL)
+			continue;
+
+		link = add_link(index, name, path);
+		if (link == NULL)
+			return -ENOMEM;
+
+		if (get_link_properties(link) < 0)
+			return -EINVAL;
+
+		monitor->pending_links++;
+	}
+
+	return 0;
+}
+
+static DBusHandlerResult watch_networkd_link_property(
+						DBusConnection *dbus_cnx,
+						DBusMessage *message,
+						void *user_data)
+{
+	struct networkd_link *link;
+	DBusMessageIter arg;
+	const char *path;
+	int index;
+
+	if (monitor == NULL)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	if (connline_dbus_is_signal(message, DBUS_INTERFACE_PROPERTIES,
+			CONNLINE_TOKEN_MEMBER_PROPERTIES_CHANGED) == false)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	__connline_stats_signal("PropertiesChanged");
+
+	path = dbus_message_get_path(message);
+	if (path == NULL)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	link = find_link(path);
+	if (link == NULL) {
+		/* A link which appeared since ListLinks */
+		index = path_to_index(path);
+		if (index < 0)
+			return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+		link = add_link(index, NULL, path);
+		if (link == NULL || get_link_properties(link) < 0)
+			return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+		if (monitor->ready == FALSE)
+			monitor->pending_links++;
+	}
+
+	if (dbus_message_iter_init(message, &arg) == FALSE)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	/* Interface name, then the changed properties */
+	dbus_message_iter_next(&arg);
+
+	connline_dbus_foreach_dict_entry(&arg, update_link_property, link);
+
+	if (link->removed == TRUE) {
+		remove_link(link);
+
+		/* Its GetAll may have been the last one waited for */
+		if (monitor->ready == FALSE && monitor->pending_links == 0 &&
+						monitor->call == NULL) {
+			monitor->ready = TRUE;
+			monitor_dispatch_update();
+		}
+
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	}
+
+	/* Until ready, the link is kept updated for the first dispatch */
+	if (link->updated == TRUE && monitor->ready == TRUE)
+		monitor_dispatch_update();
+
+	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+static void list_links_callback(DBusPendingCall *pending, void *user_data)
+{
+	DBusMessage *reply = NULL;
+	DBusMessageIter arg;
+
+	if (dbus_pending_call_get_completed(pending) == FALSE)
+		return;
+
+	__connline_stats_reply(pending);
+
+	monitor->call = NULL;
+
+	reply = dbus_pending_call_steal_reply(pending);
+	if (reply == NULL)
+		goto error;
+
+	if (dbus_message_iter_init(reply, &arg) == FALSE)
+		goto error;
+
+	if (update_links(&arg) != 0)
+		goto error;
+
+	dbus_message_unref(reply);
+	dbus_pending_call_unref(pending);
+
+	if (monitor->pending_links == 0) {
+		monitor->ready = TRUE;
+		monitor_dispatch_update();
+	}
+
+	return;
+
+error:
+	if (reply != NULL)
+		dbus_message_unref(reply);
+
+	dbus_pending_call_unref(pending);
+
+	dlist_foreach(monitor->contexts, invalidate_context);
+}
+
+static void networkd_monitor_stop(void)
+{
+	int i;
+
+	if (monitor == NULL)
+		return;
+
+	if (monitor->properties_watched == TRUE)
+		connline_dbus_remove_watch(monitor->dbus_cnx,
+					NETWORKD_LINK_PROPERTY_MATCH_RULE,
+					watch_networkd_link_property, NULL);
+
+	connline_dbus_cancel_call(&monitor->call);
+
+	for (i = 0; i < monitor->nb_links; i++)
+		free_networkd_link(monitor->links[i]);
+
+	__connline_free(monitor->links);
+	dlist_free_all(monitor->contexts);
+
+	dbus_connection_unref(monitor->dbus_cnx);
+
+	__connline_free(monitor);
+	monitor = NULL;
+}
+
+static int networkd_monitor_start(DBusConnection *dbus_cnx)
+{
+	DBusMessage *message;
+	int ret = -ENOMEM;
+
+	monitor = __connline_calloc(CONNLINE_MEMORY_BACKEND,
+					1, sizeof(struct networkd_monitor));
+	if (monitor == NULL)
+		return -ENOMEM;
+
+	monitor->dbus_cnx = dbus_connection_ref(dbus_cnx);
+
+	/* Watching first, so no change can be missed until ListLinks */
+	ret = connline_dbus_setup_watch(dbus_cnx,
+					NETWORKD_LINK_PROPERTY_MATCH_RULE,
+					watch_networkd_link_property, NULL);
+	if (ret < 0)
+		goto error;
+
+	monitor->properties_watched = TRUE;
+
+	message = connline_dbus_new_method_call(NETWORKD_DBUS_NAME,
+						NETWORKD_MANAGER_PATH,
+						NETWORKD_MANAGER_INTERFACE,
+						"ListLinks");
+	if (message == NULL) {
+		ret = -ENOMEM;
+		goto error;
+	}
+
+	ret = -EINVAL;
+
+	if (connline_dbus_send_with_deadline(NULL, dbus_cnx, message,
+			&monitor->call, list_links_callback, NULL) < 0) {
+		dbus_message_unref(message);
+		goto error;
+	}
+
+	dbus_message_unref(message);
+
+	return 0;
+
+error:
+	networkd_monitor_stop();
+
+	return ret;
+}
+
+static int networkd_monitor_add(struct connline_context *context)
+{
+	struct networkd_dbus *networkd = context->backend_data;
+	dlist *new_list;
+	int ret;
+
+	if (monitor == NULL) {
+		ret = networkd_monitor_start(context->dbus_cnx);
+		if (ret < 0)
+			return ret;
+	}
+
+	new_list = dlist_prepend(monitor->contexts, context);
+	if (new_list == monitor->contexts) {
+		if (monitor->contexts == NULL)
+			networkd_monitor_stop();
+
+		return -ENOMEM;
+	}
+
+	monitor->contexts = new_list;
+	networkd->monitored = TRUE;
+
+	if (monitor->ready == TRUE)
+		context_update(context);
+
+	return 0;
+}
+
+static void networkd_monitor_remove(struct connline_context *context)
+{
+	struct networkd_dbus *networkd = context->backend_data;
+
+	networkd->monitored = FALSE;
+	networkd->link = NULL;
+
+	if (monitor == NULL)
+		return;
+
+	monitor->contexts = dlist_remove(monitor->contexts, context);
+	if (monitor->contexts == NULL)
+		networkd_monitor_stop();
+}
+
+static int networkd_open(struct connline_context *context)
+{
+	struct networkd_dbus *networkd;
+
+	DBG("context %p", context);
+
+	if (context == NULL || context->dbus_cnx == NULL)
+		return -EINVAL;
+
+	networkd = context->backend_data;
+
+	if (networkd == NULL) {
+		networkd = __connline_calloc(CONNLINE_MEMORY_BACKEND,
+					1, sizeof(struct networkd_dbus));
+		if (networkd == NULL)
+			return -ENOMEM;
+
+		networkd->bearer = CONNLINE_BEARER_UNKNOWN;
+		context->backend_data = networkd;
+	}
+
+	if (networkd->monitored == TRUE)
+		return 0;
+
+	return networkd_monitor_add(context);
+}
+
+static int networkd_close(struct connline_context *context)
+{
+	DBG("");
+
+	if (context == NULL || context->dbus_cnx == NULL)
+		return -EINVAL;
+
+	if (context->backend_data == NULL)
+		return 0;
+
+	networkd_monitor_remove(context);
+
+	__connline_free(context->backend_data);
+	context->backend_data = NULL;
+
+	return 0;
+}
+
+static enum connline_bearer networkd_get_bearer(struct connline_context *context)
+{
+	struct networkd_dbus *networkd;
+
+	if (context == NULL || context->dbus_cnx == NULL)
+		return CONNLINE_BEARER_UNKNOWN;
+
+	networkd = context->backend_data;
+	if (networkd == NULL)
+		return CONNLINE_BEARER_UNKNOWN;
+
+	return networkd->bearer;
+}
+
+static struct connline_backend_methods networkd = {
+	networkd_open,
+	networkd_close,
+	networkd_get_bearer
+};
+
+struct connline_backend_methods *connline_plugin_setup_backend(void)
+{
+	return &networkd;
+}
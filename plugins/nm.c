@@ -18,11 +18,13 @@
  *
  */
 
+#include <connline/alloc.h>
 #include <connline/data.h>
 #include <connline/event.h>
 #include <connline/dbus.h>
 #include <connline/utils.h>
 #include <connline/backend.h>
+#include <connline/stats.h>
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -73,9 +75,9 @@ struct nm_dbus {
 	enum nm_state state;
 	enum connline_bearer bearer;
 
-	char **devices;
-	int nb_devices;
-	int current_device;
+	/* Device paths are read in place from the GetDevices reply */
+	DBusMessage *devices_reply;
+	struct connline_dbus_array_view devices;
 
 	dbus_bool_t state_watched;
 	DBusPendingCall *call;
@@ -92,17 +94,10 @@ static DBusHandlerResult watch_nm_state(DBusConnection *dbus_cnx,
 
 static inline void free_devices(struct nm_dbus *nm)
 {
-	int i;
+	if (nm->devices_reply != NULL)
+		dbus_message_unref(nm->devices_reply);
 
-	if (nm->devices != NULL) {
-		for (i = 0; i < nm->nb_devices; free(nm->devices[i]), i++);
-
-		free(nm->devices);
-	}
-
-	nm->devices = NULL;
-	nm->nb_devices = 0;
-	nm->current_device = 0;
+	nm->devices_reply = NULL;
 }
 
 static void nm_backend_data_cleanup(struct connline_context *context)
@@ -112,18 +107,18 @@ static void nm_backend_data_cleanup(struct connline_context *context)
 	if (nm == NULL)
 		return;
 
-	if (nm->state_watched == TRUE)
+	if (nm->state_watched == TRUE && context->pipelined == true)
+		connline_dbus_remove_watch_nowait(context->dbus_cnx,
+			NM_STATE_SIGNAL_MATCH_RULE, watch_nm_state, context);
+	else if (nm->state_watched == TRUE)
 		connline_dbus_remove_watch(context->dbus_cnx,
 			NM_STATE_SIGNAL_MATCH_RULE, watch_nm_state, context);
 
-	if (nm->call != NULL) {
-		dbus_pending_call_cancel(nm->call);
-		dbus_pending_call_unref(nm->call);
-	}
+	connline_dbus_cancel_call(&nm->call);
 
 	free_devices(nm);
 
-	free(nm);
+	__connline_free(nm);
 
 	context->backend_data = NULL;
 }
@@ -162,10 +157,13 @@ static void nm_device_all_cb(DBusPendingCall *pending, void *user_data)
 	struct nm_dbus *nm;
 	struct in_addr in4;
 	unsigned int ip4;
+	int ret;
 
 	if (dbus_pending_call_get_completed(pending) == FALSE)
 		return;
 
+	__connline_stats_reply(pending);
+
 	nm = context->backend_data;
 	nm->call = NULL;
 
@@ -199,10 +197,14 @@ static void nm_device_all_cb(DBusPendingCall *pending, void *user_data)
 					nm->bearer & context->bearer_type))
 		goto next;
 
+	context->is_online = TRUE;
 	__connline_call_connected_callback(context);
 
 	free_devices(nm);
 
+	if (__connline_wants_event(context, CONNLINE_EVENT_PROPERTY) == false)
+		goto out;
+
 	if (connline_dbus_get_dict_entry_basic(&arg, "Ip4Address",
 						DBUS_TYPE_UINT32, &ip4) < 0)
 		goto error;
@@ -232,16 +234,14 @@ static void nm_device_all_cb(DBusPendingCall *pending, void *user_data)
 	goto out;
 
 next:
-	nm->current_device++;
-
-	if (nm->current_device < nm->nb_devices) {
-		if (nm_device_get_all(context) < 0)
-			goto error;
-	} else {
+	ret = nm_device_get_all(context);
+	if (ret == -ENOENT) {
 		free_devices(nm);
 
+		context->is_online = FALSE;
 		__connline_call_disconnected_callback(context);
-	}
+	} else if (ret < 0)
+		goto error;
 
 out:
 	dbus_message_unref(reply);
@@ -264,14 +264,17 @@ static int nm_device_get_all(struct connline_context *context)
 	struct nm_dbus *nm = context->backend_data;
 	const char *dbus_if = NM_DBUS_NAME ".Device";
 	DBusMessage *message = NULL;
+	const char *device_path;
 	int ret = -EINVAL;
-	char *device_path;
 
-	if (nm->current_device >= nm->nb_devices || nm->devices == NULL)
-		return 0;
+	if (nm->devices_reply == NULL)
+		return -ENOENT;
 
-	device_path = nm->devices[nm->current_device];
+	device_path = connline_dbus_array_view_next(&nm->devices);
+	if (device_path == NULL)
+		return -ENOENT;
 
+	/* Device paths come and go: no template for them */
 	message = dbus_message_new_method_call(NM_DBUS_NAME,
 			device_path, DBUS_FREEDESKTOP_PROPERTIES, "GetAll");
 	if (message == NULL)
@@ -281,12 +284,9 @@ static int nm_device_get_all(struct connline_context *context)
 						DBUS_TYPE_INVALID) == FALSE)
 		goto out;
 
-	if (dbus_connection_send_with_reply(context->dbus_cnx, message,
-				&nm->call, DBUS_TIMEOUT_USE_DEFAULT) == FALSE)
-		goto out;
-
-	if (dbus_pending_call_set_notify(nm->call, nm_device_all_cb,
-						context, NULL) == FALSE)
+	if (connline_dbus_send_with_deadline(context, context->dbus_cnx,
+				message, &nm->call,
+				nm_device_all_cb, context) < 0)
 		goto out;
 
 	ret = 0;
@@ -300,16 +300,16 @@ out:
 static void nm_devices_cb(DBusPendingCall *pending, void *user_data)
 {
 	struct connline_context *context = user_data;
-	char **devices_obj = NULL;
 	DBusMessageIter arg;
 	DBusMessage *reply;
 	struct nm_dbus *nm;
-	int len;
-	int i;
+	int ret;
 
 	if (dbus_pending_call_get_completed(pending) == FALSE)
 		return;
 
+	__connline_stats_reply(pending);
+
 	nm = context->backend_data;
 	nm->call = NULL;
 
@@ -320,43 +320,27 @@ static void nm_devices_cb(DBusPendingCall *pending, void *user_data)
 	if (dbus_message_iter_init(reply, &arg) == FALSE)
 		goto error;
 
-	if (connline_dbus_get_array(&arg, DBUS_TYPE_OBJECT_PATH,
-						&len, &devices_obj) < 0)
-		goto error;
-
-	if (devices_obj != NULL && len > 0) {
-		free_devices(nm);
-
-		nm->nb_devices = len;
-		nm->devices = calloc(nm->nb_devices, sizeof(char *));
-		if (nm->devices == NULL)
-			goto error;
-
-		for (i = 0; i < len; i++) {
-			nm->devices[i] = strdup(devices_obj[i]);
-			if (nm->devices[i] == NULL) {
-				nm->nb_devices = i;
-				goto error;
-			}
-		}
+	free_devices(nm);
 
-		nm->current_device = 0;
+	if (connline_dbus_get_array_view(&arg, DBUS_TYPE_OBJECT_PATH,
+							&nm->devices) < 0)
+		goto error;
 
-		if (nm_device_get_all(context) < 0)
-			goto error;
+	/* The reply is kept as long as devices are being looked at */
+	nm->devices_reply = reply;
 
-		free(devices_obj);
-	}
+	ret = nm_device_get_all(context);
+	if (ret == -ENOENT)
+		free_devices(nm);
+	else if (ret < 0)
+		goto error;
 
-	dbus_message_unref(reply);
 	dbus_pending_call_unref(pending);
 
 	return;
 
 error:
-	free(devices_obj);
-
-	if (reply != NULL)
+	if (reply != NULL && reply != nm->devices_reply)
 		dbus_message_unref(reply);
 
 	dbus_pending_call_unref(pending);
@@ -371,19 +355,15 @@ static int nm_get_devices(struct connline_context *context)
 	DBusMessage *message = NULL;
 	int ret = -EINVAL;
 
-	message = dbus_message_new_method_call(NM_DBUS_NAME,
+	message = connline_dbus_new_method_call(NM_DBUS_NAME,
 						NM_MANAGER_PATH,
 						NM_DBUS_NAME,
 						"GetDevices");
 	if (message == NULL)
 		return -ENOMEM;
 
-	if (dbus_connection_send_with_reply(context->dbus_cnx, message,
-				&nm->call, DBUS_TIMEOUT_USE_DEFAULT) == FALSE)
-		goto out;
-
-	if (dbus_pending_call_set_notify(nm->call, nm_devices_cb,
-						context, NULL) == FALSE)
+	if (connline_dbus_send_with_deadline(context, context->dbus_cnx,
+				message, &nm->call, nm_devices_cb, context) < 0)
 		goto out;
 
 	ret = 0;
@@ -412,15 +392,13 @@ static DBusHandlerResult watch_nm_state(DBusConnection *dbus_cnx,
 	const char *member;
 	unsigned int state;
 
-	if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_SIGNAL)
+	if (connline_dbus_is_signal(message, NULL,
+			CONNLINE_TOKEN_MEMBER_STATE_CHANGED) == false)
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
 	member = dbus_message_get_member(message);
-	if (member == NULL)
-		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-	if (strncmp(member, "StateChanged", sizeof("StateChanged")) != 0)
-		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	__connline_stats_signal(member);
 
 	nm = context->backend_data;
 
@@ -431,17 +409,15 @@ static DBusHandlerResult watch_nm_state(DBusConnection *dbus_cnx,
 		goto error;
 
 	if (is_connected(state) == TRUE && state != nm->state) {
-		if (nm->call != NULL) {
-			dbus_pending_call_cancel(nm->call);
-			dbus_pending_call_unref(nm->call);
-			nm->call = NULL;
-		}
+		connline_dbus_cancel_call(&nm->call);
 
 		if (nm_get_devices(context) != 0)
 			goto error;
 	} else {
-		if (is_connected(nm->state) == TRUE)
+		if (is_connected(nm->state) == TRUE) {
+			context->is_online = FALSE;
 			__connline_call_disconnected_callback(context);
+		}
 	}
 
 	nm->state = state;
@@ -462,16 +438,25 @@ static void nm_state_cb(DBusPendingCall *pending, void *user_data)
 	DBusMessageIter arg;
 	struct nm_dbus *nm;
 	unsigned int state;
+	int ret;
 
 	if (dbus_pending_call_get_completed(pending) == FALSE)
 		return;
 
+	__connline_stats_reply(pending);
+
 	nm = context->backend_data;
 	nm->call = NULL;
 
-	if (connline_dbus_setup_watch(context->dbus_cnx,
+	if (context->pipelined == true)
+		ret = connline_dbus_setup_watch_nowait(context->dbus_cnx,
+						NM_STATE_SIGNAL_MATCH_RULE,
+						watch_nm_state, context);
+	else
+		ret = connline_dbus_setup_watch(context->dbus_cnx,
 						NM_STATE_SIGNAL_MATCH_RULE,
-						watch_nm_state, context) != 0)
+						watch_nm_state, context);
+	if (ret != 0)
 		goto error;
 
 	nm->state_watched = TRUE;
@@ -489,8 +474,10 @@ static void nm_state_cb(DBusPendingCall *pending, void *user_data)
 	if (is_connected(state) == TRUE) {
 		if (nm_get_devices(context) != 0)
 			goto error;
-	} else
+	} else {
+		context->is_online = FALSE;
 		__connline_call_disconnected_callback(context);
+	}
 
 	nm->state = state;
 
@@ -515,19 +502,15 @@ static int nm_get_state(struct connline_context *context)
 	DBusMessage *message = NULL;
 	int ret = -EINVAL;
 
-	message = dbus_message_new_method_call(NM_DBUS_NAME,
+	message = connline_dbus_new_method_call(NM_DBUS_NAME,
 						NM_MANAGER_PATH,
 						NM_DBUS_NAME,
 						"state");
 	if (message == NULL)
 		return -ENOMEM;
 
-	if (dbus_connection_send_with_reply(context->dbus_cnx, message,
-				&nm->call, DBUS_TIMEOUT_USE_DEFAULT) == FALSE)
-		goto out;
-
-	if (dbus_pending_call_set_notify(nm->call, nm_state_cb,
-						context, NULL) == FALSE)
+	if (connline_dbus_send_with_deadline(context, context->dbus_cnx,
+				message, &nm->call, nm_state_cb, context) < 0)
 		goto out;
 
 	ret = 0;
@@ -545,14 +528,17 @@ static int nm_open(struct connline_context *context)
 	if (context == NULL || context->dbus_cnx == NULL)
 		return -EINVAL;
 
-	if (connline_dbus_is_service_running(context->dbus_cnx,
+	/* Opened with others, the daemon was checked for once */
+	if (context->pipelined == false &&
+			connline_dbus_is_service_running(context->dbus_cnx,
 						NM_DBUS_NAME) == FALSE)
 		return -EINVAL;
 
 	nm = context->backend_data;
 
 	if (nm == NULL) {
-		nm = calloc(1, sizeof(struct nm_dbus));
+		nm = __connline_calloc(CONNLINE_MEMORY_BACKEND,
+						1, sizeof(struct nm_dbus));
 		if (nm == NULL)
 			goto error;
 
@@ -18,11 +18,14 @@
  *
  */
 
+#include <connline/alloc.h>
 #include <connline/data.h>
 #include <connline/event.h>
 #include <connline/dbus.h>
 #include <connline/utils.h>
 #include <connline/backend.h>
+#include <connline/list.h>
+#include <connline/stats.h>
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -53,17 +56,50 @@ struct wicd_dbus {
 	enum connline_bearer bearer;
 	char *ip;
 
+	dbus_bool_t monitored;
 	dbus_bool_t status_watched;
+	dbus_bool_t properties_pending;
 	DBusPendingCall *call;
 };
 
+/*
+ * All contexts share one StatusChanged watch, and the interface names which
+ * are fetched only once per daemon's life, when a context first wants its
+ * properties: when it disappears, all contexts are closed, and the monitor
+ * with them.
+ */
+struct wicd_monitor {
+	DBusConnection *dbus_cnx;
+	dlist *contexts;
+
+	char *wired_interface;
+	char *wireless_interface;
+
+	dbus_bool_t interfaces_requested;
+	int pending_interfaces;
+	DBusPendingCall *wired_call;
+	DBusPendingCall *wireless_call;
+
+	dbus_bool_t status_watched;
+};
+
+struct wicd_status {
+	unsigned int state;
+	const char *ip;
+};
+
 const char *connline_backend_watch_rule = WICD_SERVICE_MATCH_RULE;
 const char *connline_backend_service_name = WICD_DBUS_NAME;
 
+static struct wicd_monitor *monitor = NULL;
+static struct wicd_status *current_status = NULL;
+
 static DBusHandlerResult watch_wicd_status(DBusConnection *dbus_cnx,
 						DBusMessage *message,
 						void *user_data);
 
+static int wicd_monitor_get_interfaces(void);
+
 static enum connline_bearer wicd_state_to_connline_bearer(enum wicd_state state)
 {
 	switch (state) {
@@ -89,6 +125,29 @@ static dbus_bool_t is_connected(enum wicd_state state)
 	return FALSE;
 }
 
+static void wicd_monitor_stop(void)
+{
+	if (monitor == NULL)
+		return;
+
+	if (monitor->status_watched == TRUE)
+		connline_dbus_remove_watch(monitor->dbus_cnx,
+				WICD_STATUS_MATCH_RULE, watch_wicd_status, NULL);
+
+	connline_dbus_cancel_call(&monitor->wired_call);
+	connline_dbus_cancel_call(&monitor->wireless_call);
+
+	__connline_free(monitor->wired_interface);
+	__connline_free(monitor->wireless_interface);
+
+	dlist_free_all(monitor->contexts);
+
+	dbus_connection_unref(monitor->dbus_cnx);
+
+	__connline_free(monitor);
+	monitor = NULL;
+}
+
 static void wicd_backend_data_cleanup(struct connline_context *context)
 {
 	struct wicd_dbus *wicd = context->backend_data;
@@ -96,45 +155,44 @@ static void wicd_backend_data_cleanup(struct connline_context *context)
 	if (wicd == NULL)
 		return;
 
-	if (wicd->status_watched == TRUE)
-		connline_dbus_remove_watch(context->dbus_cnx,
-			WICD_STATUS_MATCH_RULE, watch_wicd_status, context);
-
-	if (wicd->call != NULL) {
-		dbus_pending_call_cancel(wicd->call);
-		dbus_pending_call_unref(wicd->call);
+	if (wicd->monitored == TRUE && monitor != NULL) {
+		monitor->contexts = dlist_remove(monitor->contexts, context);
+		if (monitor->contexts == NULL)
+			wicd_monitor_stop();
 	}
 
-	free(wicd->ip);
-	free(wicd);
+	connline_dbus_cancel_call(&wicd->call);
+
+	__connline_free(wicd->ip);
+	__connline_free(wicd);
 
 	context->backend_data = NULL;
 }
 
-static void wicd_interface_cb(DBusPendingCall *pending, void *user_data)
+static void wicd_send_properties(struct connline_context *context)
 {
-	struct connline_context *context = user_data;
+	struct wicd_dbus *wicd = context->backend_data;
 	char **properties = NULL;
-	struct wicd_dbus *wicd;
-	DBusMessageIter arg;
-	DBusMessage *reply;
-	const char *iface;
+	const char *iface = NULL;
 
-	if (dbus_pending_call_get_completed(pending) == FALSE)
+	if (__connline_wants_event(context, CONNLINE_EVENT_PROPERTY) == false)
 		return;
 
-	wicd = context->backend_data;
-	wicd->call = NULL;
+	/* Failing that, the interfaces are just not advertised */
+	if (monitor->interfaces_requested == FALSE)
+		wicd_monitor_get_interfaces();
 
-	reply = dbus_pending_call_steal_reply(pending);
-	if (reply == NULL)
-		goto error;
+	if (monitor->pending_interfaces > 0) {
+		wicd->properties_pending = TRUE;
+		return;
+	}
 
-	if (dbus_message_iter_init(reply, &arg) == FALSE)
-		goto error;
+	wicd->properties_pending = FALSE;
 
-	if (connline_dbus_get_basic(&arg, DBUS_TYPE_STRING, &iface) != 0)
-		goto error;
+	if (wicd->bearer == CONNLINE_BEARER_ETHERNET)
+		iface = monitor->wired_interface;
+	else if (wicd->bearer == CONNLINE_BEARER_WIFI)
+		iface = monitor->wireless_interface;
 
 	properties = insert_into_property_list(properties, "bearer",
 				connline_bearer_to_string(wicd->bearer));
@@ -146,51 +204,85 @@ static void wicd_interface_cb(DBusPendingCall *pending, void *user_data)
 
 	if (properties != NULL)
 		__connline_call_property_callback(context, properties);
+}
 
-	dbus_message_unref(reply);
-	dbus_pending_call_unref(pending);
+static void send_pending_properties(void *data)
+{
+	struct connline_context *context = data;
+	struct wicd_dbus *wicd = context->backend_data;
 
-	return;
+	/* Only a context still online waits for its properties */
+	if (wicd->properties_pending == TRUE && context->is_online == TRUE)
+		wicd_send_properties(context);
+}
+
+static void wicd_interface_reply(DBusPendingCall *pending,
+						DBusPendingCall **call,
+						char **interface)
+{
+	DBusMessage *reply;
+	DBusMessageIter arg;
+	const char *iface;
+
+	if (dbus_pending_call_get_completed(pending) == FALSE)
+		return;
+
+	__connline_stats_reply(pending);
+
+	*call = NULL;
+	monitor->pending_interfaces--;
+
+	/* Without its name, the interface is just not advertised */
+	reply = dbus_pending_call_steal_reply(pending);
+	if (reply != NULL) {
+		if (dbus_message_get_type(reply) != DBUS_MESSAGE_TYPE_ERROR &&
+				dbus_message_iter_init(reply, &arg) == TRUE &&
+				connline_dbus_get_basic(&arg,
+					DBUS_TYPE_STRING, &iface) == 0)
+			*interface = __connline_strdup(CONNLINE_MEMORY_BACKEND,
+								iface);
 
-error:
-	if (reply != NULL)
 		dbus_message_unref(reply);
+	}
 
 	dbus_pending_call_unref(pending);
 
-	wicd_backend_data_cleanup(context);
-	__connline_call_error_callback(context, false);
+	if (monitor->pending_interfaces == 0)
+		dlist_foreach(monitor->contexts, send_pending_properties);
 }
 
-static int wicd_get_interface(struct connline_context *context)
+static void wicd_wired_interface_cb(DBusPendingCall *pending, void *user_data)
+{
+	wicd_interface_reply(pending, &monitor->wired_call,
+					&monitor->wired_interface);
+}
+
+static void wicd_wireless_interface_cb(DBusPendingCall *pending,
+							void *user_data)
+{
+	wicd_interface_reply(pending, &monitor->wireless_call,
+					&monitor->wireless_interface);
+}
+
+static int wicd_get_interface(const char *method,
+				DBusPendingCallNotifyFunction function,
+				DBusPendingCall **call)
 {
-	struct wicd_dbus *wicd = context->backend_data;
 	DBusMessage *message = NULL;
 	int ret = -EINVAL;
 
-	if (wicd->bearer == CONNLINE_BEARER_ETHERNET) {
-		message = dbus_message_new_method_call(WICD_DBUS_NAME,
-							WICD_MANAGER_PATH,
-							WICD_DBUS_NAME,
-							"GetWiredInterface");
-	} else if (wicd->bearer == CONNLINE_BEARER_WIFI) {
-		message = dbus_message_new_method_call(WICD_DBUS_NAME,
+	message = connline_dbus_new_method_call(WICD_DBUS_NAME,
 						WICD_MANAGER_PATH,
 						WICD_DBUS_NAME,
-						"GetWirelessInterface");
-	} else
-		return -EINVAL;
-
+						method);
 	if (message == NULL)
 		return -ENOMEM;
 
-	if (dbus_connection_send_with_reply(context->dbus_cnx, message,
-			&wicd->call, DBUS_TIMEOUT_USE_DEFAULT) == FALSE)
+	if (connline_dbus_send_with_deadline(NULL, monitor->dbus_cnx,
+				message, call, function, NULL) < 0)
 		goto out;
 
-	if (dbus_pending_call_set_notify(wicd->call,
-				wicd_interface_cb, context, NULL) == FALSE)
-		goto out;
+	monitor->pending_interfaces++;
 
 	ret = 0;
 
@@ -200,10 +292,78 @@ out:
 	return ret;
 }
 
+static int wicd_monitor_get_interfaces(void)
+{
+	int ret;
+
+	monitor->interfaces_requested = TRUE;
+
+	ret = wicd_get_interface("GetWiredInterface",
+				wicd_wired_interface_cb, &monitor->wired_call);
+	if (ret < 0)
+		return ret;
+
+	return wicd_get_interface("GetWirelessInterface",
+					wicd_wireless_interface_cb,
+					&monitor->wireless_call);
+}
+
+static int wicd_monitor_start(DBusConnection *dbus_cnx)
+{
+	int ret;
+
+	monitor = __connline_calloc(CONNLINE_MEMORY_BACKEND,
+						1, sizeof(struct wicd_monitor));
+	if (monitor == NULL)
+		return -ENOMEM;
+
+	monitor->dbus_cnx = dbus_connection_ref(dbus_cnx);
+
+	/* Watch connection status signals */
+	ret = connline_dbus_setup_watch(dbus_cnx, WICD_STATUS_MATCH_RULE,
+						watch_wicd_status, NULL);
+	if (ret < 0)
+		goto error;
+
+	monitor->status_watched = TRUE;
+
+	return 0;
+
+error:
+	wicd_monitor_stop();
+
+	return ret;
+}
+
+static int wicd_monitor_add(struct connline_context *context)
+{
+	struct wicd_dbus *wicd = context->backend_data;
+	dlist *new_list;
+	int ret;
+
+	if (monitor == NULL) {
+		ret = wicd_monitor_start(context->dbus_cnx);
+		if (ret < 0)
+			return ret;
+	}
+
+	new_list = dlist_prepend(monitor->contexts, context);
+	if (new_list == monitor->contexts) {
+		if (monitor->contexts == NULL)
+			wicd_monitor_stop();
+
+		return -ENOMEM;
+	}
+
+	monitor->contexts = new_list;
+	wicd->monitored = TRUE;
+
+	return 0;
+}
+
 static int process_with_connection(struct connline_context *context,
 							unsigned int state,
-							char **ip,
-							int len)
+							const char *ip)
 {
 	struct wicd_dbus *wicd = context->backend_data;
 
@@ -211,14 +371,13 @@ static int process_with_connection(struct connline_context *context,
 
 	if (context->bearer_type == CONNLINE_BEARER_UNKNOWN ||
 				wicd->bearer & context->bearer_type) {
-		if (len <= 0)
+		if (ip == NULL)
 			return -1;
 
 		context->is_online = TRUE;
-		wicd->ip = strdup(ip[0]);
 
-		if (wicd_get_interface(context) != 0)
-			return -1;
+		__connline_free(wicd->ip);
+		wicd->ip = __connline_strdup(CONNLINE_MEMORY_BACKEND, ip);
 
 		return 1;
 	}
@@ -226,74 +385,106 @@ static int process_with_connection(struct connline_context *context,
 	return 0;
 }
 
+static int process_status(struct connline_context *context,
+					struct wicd_status *status)
+{
+	struct wicd_dbus *wicd = context->backend_data;
+	int ret;
+
+	if (is_connected(status->state) == TRUE) {
+		if (context->is_online == TRUE)
+			return 0;
+
+		ret = process_with_connection(context,
+						status->state, status->ip);
+		if (ret < 0)
+			return ret;
+
+		if (ret > 0) {
+			__connline_call_connected_callback(context);
+			wicd_send_properties(context);
+		}
+	} else {
+		if (context->is_online == FALSE)
+			return 0;
+
+		context->is_online = FALSE;
+
+		__connline_free(wicd->ip);
+		wicd->ip = NULL;
+		wicd->bearer = CONNLINE_BEARER_UNKNOWN;
+		wicd->properties_pending = FALSE;
+
+		__connline_call_disconnected_callback(context);
+	}
+
+	return 0;
+}
+
+static void update_context_status(void *data)
+{
+	struct connline_context *context = data;
+	struct wicd_dbus *wicd = context->backend_data;
+
+	if (wicd->status_watched == FALSE)
+		return;
+
+	if (process_status(context, current_status) == 0)
+		return;
+
+	wicd_backend_data_cleanup(context);
+	__connline_call_error_callback(context, false);
+}
+
+static void invalidate_context(void *data)
+{
+	struct connline_context *context = data;
+
+	wicd_backend_data_cleanup(context);
+	__connline_call_error_callback(context, false);
+}
+
 static DBusHandlerResult watch_wicd_status(DBusConnection *dbus_cnx,
 						DBusMessage *message,
 						void *user_data)
 {
-	struct connline_context *context = user_data;
-	struct wicd_dbus *wicd;
+	struct connline_dbus_array_view ip;
+	struct wicd_status status;
 	DBusMessageIter arg;
-	const char *member;
-	unsigned int state;
-	char **ip = NULL;
-	int len, ret;
-
-	if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_SIGNAL)
-		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-	member = dbus_message_get_member(message);
-	if (member == NULL)
+	if (monitor == NULL)
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-	if (strncmp(member, "StatusChanged", sizeof("StatusChanged")) != 0)
+	if (connline_dbus_is_signal(message, WICD_DBUS_NAME,
+			CONNLINE_TOKEN_MEMBER_STATUS_CHANGED) == false)
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-	wicd = context->backend_data;
+	__connline_stats_signal("StatusChanged");
 
 	if (dbus_message_iter_init(message, &arg) == FALSE)
 		goto error;
 
-	if (connline_dbus_get_basic(&arg, DBUS_TYPE_UINT32, &state) != 0)
+	if (connline_dbus_get_basic(&arg, DBUS_TYPE_UINT32,
+						&status.state) != 0)
 		goto error;
 
 	dbus_message_iter_next(&arg);
 
-	if (connline_dbus_get_array(&arg, DBUS_TYPE_STRING, &len, &ip) != 0)
+	if (connline_dbus_get_array_view(&arg, DBUS_TYPE_STRING, &ip) != 0)
 		goto error;
 
-	if (is_connected(state) == TRUE) {
-		if (context->is_online == TRUE)
-			goto out;
-
-		ret = process_with_connection(context, state, ip, len);
-		if (ret < 0)
-			goto error;
-
-		if (ret > 0)
-			__connline_call_connected_callback(context);
-	} else {
-		if (context->is_online == FALSE)
-			goto out;
-
-		context->is_online = FALSE;
+	/* Only the first address is relevant */
+	status.ip = connline_dbus_array_view_next(&ip);
 
-		free(wicd->ip);
-		wicd->ip = NULL;
-		wicd->bearer = CONNLINE_BEARER_UNKNOWN;
-
-		__connline_call_disconnected_callback(context);
-	}
-
-out:
-	free(ip);
+	/* Decoded once, for all contexts */
+	current_status = &status;
+	dlist_foreach(monitor->contexts, update_context_status);
+	current_status = NULL;
 
 	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
 error:
-	free(ip);
-
-	wicd_backend_data_cleanup(context);
-	__connline_call_error_callback(context, false);
+	dlist_foreach(monitor->contexts, invalidate_context);
 
 	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
@@ -306,6 +497,8 @@ static void wicd_autoconnect_cb(DBusPendingCall *pending, void *user_data)
 	if (dbus_pending_call_get_completed(pending) == FALSE)
 		return;
 
+	__connline_stats_reply(pending);
+
 	wicd = context->backend_data;
 	wicd->call = NULL;
 
@@ -319,7 +512,7 @@ static int wicd_autoconnect(struct connline_context *context)
 	dbus_bool_t fresh = TRUE;
 	int ret = -EINVAL;
 
-	message = dbus_message_new_method_call(WICD_DBUS_NAME,
+	message = connline_dbus_new_method_call(WICD_DBUS_NAME,
 						WICD_MANAGER_PATH,
 						WICD_DBUS_NAME,
 						"AutoConnect");
@@ -330,12 +523,9 @@ static int wicd_autoconnect(struct connline_context *context)
 						DBUS_TYPE_INVALID) == FALSE)
 		goto out;
 
-	if (dbus_connection_send_with_reply(context->dbus_cnx, message,
-			&wicd->call, DBUS_TIMEOUT_USE_DEFAULT) == FALSE)
-		goto out;
-
-	if (dbus_pending_call_set_notify(wicd->call,
-			wicd_autoconnect_cb, context, NULL) == FALSE)
+	/* Sent again, it would restart the connection attempt */
+	if (connline_dbus_send_once_with_deadline(context, context->dbus_cnx,
+			message, &wicd->call, wicd_autoconnect_cb, context) < 0)
 		goto out;
 
 	ret = 0;
@@ -350,24 +540,22 @@ static void wicd_connection_status_cb(DBusPendingCall *pending, void *user_data)
 {
 	struct connline_context *context = user_data;
 	DBusMessage *reply = NULL;
+	struct connline_dbus_array_view ips;
 	struct wicd_dbus *wicd;
 	DBusMessageIter arg;
 	unsigned int state;
-	char **ip = NULL;
-	int len, ret;
+	const char *ip;
+	int ret;
 
 	if (dbus_pending_call_get_completed(pending) == FALSE)
 		return;
 
+	__connline_stats_reply(pending);
+
 	wicd = context->backend_data;
 	wicd->call = NULL;
 
-	/* Watch connection status signals */
-	if (connline_dbus_setup_watch(context->dbus_cnx,
-				WICD_STATUS_MATCH_RULE,
-				watch_wicd_status, context) != 0)
-		goto error;
-
+	/* From now on, status signals are relevant to this context */
 	wicd->status_watched = TRUE;
 
 	reply = dbus_pending_call_steal_reply(pending);
@@ -381,23 +569,31 @@ static void wicd_connection_status_cb(DBusPendingCall *pending, void *user_data)
 					DBUS_TYPE_UINT32, &state) != 0)
 		goto error;
 
-	if (connline_dbus_get_struct_entry_array(&arg, 2,
-					DBUS_TYPE_STRING, &len, &ip) != 0)
+	if (connline_dbus_get_struct_entry_array_view(&arg, 2,
+					DBUS_TYPE_STRING, &ips) != 0)
 		goto error;
 
+	ip = connline_dbus_array_view_next(&ips);
+
 	if (is_connected(state) == TRUE) {
-		ret = process_with_connection(context, state, ip, len);
+		ret = process_with_connection(context, state, ip);
 		if (ret < 0)
 			goto error;
 
-		if (ret > 0)
+		if (ret > 0) {
 			__connline_call_connected_callback(context);
-		else
+			wicd_send_properties(context);
+		} else {
+			wicd->properties_pending = FALSE;
 			__connline_call_disconnected_callback(context);
+		}
 
 		goto out;
 	}
 
+	/* What was asked for a former connection is not to be sent */
+	wicd->properties_pending = FALSE;
+
 	if (context->background_connection == FALSE) {
 		if (wicd_autoconnect(context) != 0)
 			goto error;
@@ -405,16 +601,12 @@ static void wicd_connection_status_cb(DBusPendingCall *pending, void *user_data)
 		__connline_call_disconnected_callback(context);
 
 out:
-	free(ip);
-
 	dbus_message_unref(reply);
 	dbus_pending_call_unref(pending);
 
 	return;
 
 error:
-	free(ip);
-
 	if (reply != NULL)
 		dbus_message_unref(reply);
 
@@ -430,19 +622,16 @@ static int wicd_get_connection_status(struct connline_context *context)
 	DBusMessage *message = NULL;
 	int ret = -EINVAL;
 
-	message = dbus_message_new_method_call(WICD_DBUS_NAME,
+	message = connline_dbus_new_method_call(WICD_DBUS_NAME,
 						WICD_MANAGER_PATH,
 						WICD_DBUS_NAME,
 						"GetConnectionStatus");
 	if (message == NULL)
 		return -ENOMEM;
 
-	if (dbus_connection_send_with_reply(context->dbus_cnx, message,
-			&wicd->call, DBUS_TIMEOUT_USE_DEFAULT) == FALSE)
-		goto out;
-
-	if (dbus_pending_call_set_notify(wicd->call,
-			wicd_connection_status_cb, context, NULL) == FALSE)
+	if (connline_dbus_send_with_deadline(context, context->dbus_cnx,
+			message, &wicd->call,
+			wicd_connection_status_cb, context) < 0)
 		goto out;
 
 	ret = 0;
@@ -460,19 +649,25 @@ static int wicd_open(struct connline_context *context)
 	if (context == NULL || context->dbus_cnx == NULL)
 		return -EINVAL;
 
-	if (connline_dbus_is_service_running(context->dbus_cnx,
+	/* Opened with others, the daemon was checked for once */
+	if (context->pipelined == false &&
+			connline_dbus_is_service_running(context->dbus_cnx,
 						WICD_DBUS_NAME) == FALSE)
 		return -EINVAL;
 
 	wicd = context->backend_data;
 
 	if (wicd == NULL) {
-		wicd = calloc(1, sizeof(struct wicd_dbus));
+		wicd = __connline_calloc(CONNLINE_MEMORY_BACKEND,
+						1, sizeof(struct wicd_dbus));
 		if (wicd == NULL)
 			goto error;
 
 		context->backend_data = wicd;
 
+		if (wicd_monitor_add(context) < 0)
+			goto error;
+
 		if (wicd_get_connection_status(context) < 0)
 			goto error;
 	} else {
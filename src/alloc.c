@@ -0,0 +1,234 @@
+/*
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License version 2.1,
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <connline/alloc.h>
+#include <connline/stats.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Each block starts with its header: size and category are what freeing
+ * needs to give the right size back to the allocator, and to account it.
+ * The header keeps the block aligned as glibc's malloc() would.
+ */
+struct alloc_header {
+	size_t size;
+	enum connline_memory category;
+} __attribute__((aligned(2 * sizeof(size_t))));
+
+#define HEADER_SIZE sizeof(struct alloc_header)
+
+static void *default_malloc(size_t size, void *user_data)
+{
+	return malloc(size);
+}
+
+static void *default_realloc(void *ptr, size_t old_size,
+					size_t size, void *user_data)
+{
+	return realloc(ptr, size);
+}
+
+static void default_free(void *ptr, size_t size, void *user_data)
+{
+	free(ptr);
+}
+
+static const struct connline_allocator default_allocator = {
+	.malloc = default_malloc,
+	.realloc = default_realloc,
+	.free = default_free,
+};
+
+static struct connline_allocator allocator = {
+	.malloc = default_malloc,
+	.realloc = default_realloc,
+	.free = default_free,
+};
+
+/* Bytes allocated, headers included: what the limit applies to */
+static size_t in_use = 0;
+
+static bool reserve(size_t size)
+{
+	size_t total;
+
+	total = __atomic_add_fetch(&in_use, size, __ATOMIC_RELAXED);
+	if (allocator.limit == 0 || total <= allocator.limit)
+		return true;
+
+	__atomic_sub_fetch(&in_use, size, __ATOMIC_RELAXED);
+
+	return false;
+}
+
+static inline void unreserve(size_t size)
+{
+	__atomic_sub_fetch(&in_use, size, __ATOMIC_RELAXED);
+}
+
+static inline void account(enum connline_memory category, long size)
+{
+	__connline_stats_add(CONNLINE_STATS_MEMORY + category, size);
+}
+
+void *__connline_malloc(enum connline_memory category, size_t size)
+{
+	struct alloc_header *header;
+
+	if (size > SIZE_MAX - HEADER_SIZE)
+		return NULL;
+
+	if (reserve(size + HEADER_SIZE) == false)
+		return NULL;
+
+	header = allocator.malloc(size + HEADER_SIZE, allocator.user_data);
+	if (header == NULL) {
+		unreserve(size + HEADER_SIZE);
+		return NULL;
+	}
+
+	header->size = size;
+	header->category = category;
+
+	__connline_stats_add(CONNLINE_STATS_ALLOCATIONS, 1);
+	account(category, size);
+
+	return header + 1;
+}
+
+void *__connline_calloc(enum connline_memory category,
+					size_t nmemb, size_t size)
+{
+	void *ptr;
+
+	if (size != 0 && nmemb > SIZE_MAX / size)
+		return NULL;
+
+	ptr = __connline_malloc(category, nmemb * size);
+	if (ptr != NULL)
+		memset(ptr, 0, nmemb * size);
+
+	return ptr;
+}
+
+void *__connline_realloc(enum connline_memory category,
+					void *ptr, size_t size)
+{
+	struct alloc_header *header, *new_header;
+	size_t old_size;
+
+	if (ptr == NULL)
+		return __connline_malloc(category, size);
+
+	if (size > SIZE_MAX - HEADER_SIZE)
+		return NULL;
+
+	header = (struct alloc_header *) ptr - 1;
+	old_size = header->size;
+	category = header->category;
+
+	if (size > old_size && reserve(size - old_size) == false)
+		return NULL;
+
+	if (allocator.realloc != NULL) {
+		new_header = allocator.realloc(header, old_size + HEADER_SIZE,
+					size + HEADER_SIZE, allocator.user_data);
+	} else {
+		new_header = allocator.malloc(size + HEADER_SIZE,
+							allocator.user_data);
+		if (new_header != NULL) {
+			memcpy(new_header, header, HEADER_SIZE +
+				(size < old_size ? size : old_size));
+			allocator.free(header, old_size + HEADER_SIZE,
+							allocator.user_data);
+		}
+	}
+
+	if (new_header == NULL) {
+		if (size > old_size)
+			unreserve(size - old_size);
+
+		return NULL;
+	}
+
+	if (size < old_size)
+		unreserve(old_size - size);
+
+	new_header->size = size;
+
+	__connline_stats_add(CONNLINE_STATS_ALLOCATIONS, 1);
+	account(category, (long) size - (long) old_size);
+
+	return new_header + 1;
+}
+
+char *__connline_strdup(enum connline_memory category, const char *string)
+{
+	size_t length;
+	char *copy;
+
+	length = strlen(string) + 1;
+
+	copy = __connline_malloc(category, length);
+	if (copy != NULL)
+		memcpy(copy, string, length);
+
+	return copy;
+}
+
+void __connline_free(void *ptr)
+{
+	struct alloc_header *header;
+	size_t size;
+
+	if (ptr == NULL)
+		return;
+
+	header = (struct alloc_header *) ptr - 1;
+	size = header->size;
+
+	account(header->category, -(long) size);
+
+	allocator.free(header, size + HEADER_SIZE, allocator.user_data);
+
+	unreserve(size + HEADER_SIZE);
+}
+
+int connline_set_allocator(const struct connline_allocator *new_allocator)
+{
+	if (new_allocator != NULL && (new_allocator->malloc == NULL ||
+						new_allocator->free == NULL))
+		return -EINVAL;
+
+	/* Blocks of the former allocator would be given to the new one */
+	if (__atomic_load_n(&in_use, __ATOMIC_RELAXED) != 0)
+		return -EBUSY;
+
+	if (new_allocator == NULL)
+		new_allocator = &default_allocator;
+
+	allocator = *new_allocator;
+
+	return 0;
+}
@@ -22,14 +22,39 @@
 #include <connline/list.h>
 #include <connline/dbus.h>
 #include <connline/private.h>
+#include <connline/stats.h>
+#include <connline/utils.h>
 
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+#define DAEMONLESS_NAME "daemonless"
+
 static dlist *backends_list = NULL;
 static DBusConnection *dbus = NULL;
 struct connline_backend_methods *connection_backend = NULL;
+/* D-Bus name of the daemon behind connection_backend, if any */
+static const char *connection_service = NULL;
+
+static struct connline_backend_plugin *daemonless_backend = NULL;
+static struct connline_backend_methods *daemonless_methods = NULL;
+
+/* Only when no daemon backend is in use */
+static void setup_daemonless_backend(void)
+{
+	if (connection_backend != NULL || daemonless_backend == NULL)
+		return;
+
+	if (daemonless_methods == NULL)
+		daemonless_methods = daemonless_backend->setup();
+
+	connection_backend = daemonless_methods;
+	connection_service = NULL;
+
+	CONNLINE_TRACE2(backend_setup, DAEMONLESS_NAME,
+					connection_backend != NULL);
+}
 
 static DBusHandlerResult watch_service_callback(DBusConnection *dbus_cnx,
 							DBusMessage *message,
@@ -38,16 +63,11 @@ static DBusHandlerResult watch_service_callback(DBusConnection *dbus_cnx,
 	struct connline_backend_plugin *backend = user_data;
 	const char *member, *name, *old_owner, *new_owner;
 
-	if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_SIGNAL)
+	if (connline_dbus_is_signal(message, DBUS_INTERFACE_DBUS,
+			CONNLINE_TOKEN_MEMBER_NAME_OWNER_CHANGED) == false)
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
 	member = dbus_message_get_member(message);
-	if (member == NULL)
-		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-
-	if (strncmp(member, DBUS_SERVICE_OWNER_CHANGED,
-				sizeof(DBUS_SERVICE_OWNER_CHANGED)) != 0)
-		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
 	if (dbus_message_get_args(message, NULL, DBUS_TYPE_STRING,
 					&name, DBUS_TYPE_STRING, &old_owner,
@@ -55,14 +75,36 @@ static DBusHandlerResult watch_service_callback(DBusConnection *dbus_cnx,
 					DBUS_TYPE_INVALID) == FALSE)
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-	if (strncmp(name, backend->service_name,
-					sizeof(backend->service_name)) != 0)
+	/* NetworkManager and networkd names share a prefix */
+	if (strcmp(name, backend->service_name) != 0)
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
+	__connline_stats_signal(member);
+
 	if (connline_dbus_is_service_running(dbus,
 					backend->service_name) == TRUE) {
-		if (connection_backend == NULL)
+		/* Another daemon is already the backend */
+		if (connection_service != NULL &&
+				connection_service != backend->service_name)
+			return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+		/* A daemon knows more than a daemonless backend */
+		if (connection_backend != NULL &&
+				connection_backend == daemonless_methods) {
+			CONNLINE_TRACE1(backend_teardown, DAEMONLESS_NAME);
+
+			__connline_close_contexts();
+			connection_backend = NULL;
+			connection_service = NULL;
+		}
+
+		if (connection_backend == NULL) {
 			connection_backend = backend->setup();
+			connection_service = backend->service_name;
+
+			CONNLINE_TRACE2(backend_setup, backend->service_name,
+						connection_backend != NULL);
+		}
 
 		if (connection_backend == NULL) {
 			perror("Connline fatal error: no recovery\n");
@@ -73,20 +115,29 @@ static DBusHandlerResult watch_service_callback(DBusConnection *dbus_cnx,
 
 		__connline_reconnect_contexts();
 	} else {
+		/* Only the daemon in use matters when it vanishes */
+		if (connection_service != backend->service_name)
+			return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+		CONNLINE_TRACE1(backend_teardown, backend->service_name);
+
 		__connline_disconnect_contexts();
 		connection_backend = NULL;
+		connection_service = NULL;
+
+		setup_daemonless_backend();
+		if (connection_backend != NULL)
+			__connline_reconnect_contexts();
 	}
 
 	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
+/* Without D-Bus, only daemonless backends can be used */
 int __connline_setup_backend(DBusConnection *dbus_cnx)
 {
 	int ret = 0;
 
-	if (dbus_cnx == NULL)
-		return -EINVAL;
-
 	dbus = dbus_cnx;
 
 	ret = __connline_load_backend_plugins();
@@ -97,6 +148,8 @@ int __connline_setup_backend(DBusConnection *dbus_cnx)
 		return ret;
 	}
 
+	setup_daemonless_backend();
+
 	return 0;
 }
 
@@ -105,29 +158,66 @@ int __connline_backend_add(struct connline_backend_plugin *backend_plugin)
 	dlist *new_list;
 	int ret;
 
-	ret = connline_dbus_setup_watch(dbus, backend_plugin->watch_rule,
-				watch_service_callback, backend_plugin);
-	if (ret < 0)
-		return ret;
+	if (backend_plugin->service_name != NULL && dbus != NULL) {
+		ret = connline_dbus_setup_watch(dbus,
+					backend_plugin->watch_rule,
+					watch_service_callback, backend_plugin);
+		if (ret < 0)
+			return ret;
+	}
 
 	new_list = dlist_prepend(backends_list, backend_plugin);
-	if (new_list == backends_list)
-		return -ENOMEM;
+	if (new_list == backends_list) {
+		ret = -ENOMEM;
+		goto error;
+	}
 
 	backends_list = new_list;
 
+	if (backend_plugin->service_name == NULL) {
+		if (daemonless_backend == NULL)
+			daemonless_backend = backend_plugin;
+
+		return 0;
+	}
+
+	if (dbus == NULL)
+		return 0;
+
 	if (connline_dbus_is_service_running(dbus,
 				backend_plugin->service_name) == TRUE) {
-		/* -ENOEXEC is a fatal error for connline */
-		if (connection_backend != NULL)
-			return -ENOEXEC;
+		/* The first daemon found is the one used */
+		if (connection_backend != NULL) {
+			DBG("%s ignored: %s is in use",
+					backend_plugin->service_name,
+					connection_service != NULL ?
+					connection_service : DAEMONLESS_NAME);
+			return 0;
+		}
 
+		/* -ENOEXEC is a fatal error for connline */
+		ret = -ENOEXEC;
 		connection_backend = backend_plugin->setup();
+		connection_service = backend_plugin->service_name;
+
+		CONNLINE_TRACE2(backend_setup, backend_plugin->service_name,
+						connection_backend != NULL);
+
 		if (connection_backend == NULL)
-			return -ENOEXEC;
+			goto error;
 	}
 
 	return 0;
+
+error:
+	/* The caller frees the plugin */
+	backends_list = dlist_remove(backends_list, backend_plugin);
+
+	if (backend_plugin->service_name != NULL && dbus != NULL)
+		connline_dbus_remove_watch(dbus, backend_plugin->watch_rule,
+				watch_service_callback, backend_plugin);
+
+	return ret;
 }
 
 static void __cleanup_backend(void *data)
@@ -137,13 +227,37 @@ static void __cleanup_backend(void *data)
 	if (backend == NULL)
 		return;
 
-	connline_dbus_remove_watch(dbus, backend->watch_rule,
+	if (backend->service_name == NULL) {
+		CONNLINE_TRACE1(backend_teardown, DAEMONLESS_NAME);
+	} else {
+		CONNLINE_TRACE1(backend_teardown, backend->service_name);
+
+		if (dbus != NULL)
+			connline_dbus_remove_watch(dbus, backend->watch_rule,
 					watch_service_callback, backend);
+	}
+
 	__connline_cleanup_backend_plugin(backend);
 }
 
 void __connline_cleanup_backend(void)
 {
 	dlist_foreach(backends_list, __cleanup_backend);
+	dlist_free_all(backends_list);
 	backends_list = NULL;
+
+	connection_backend = NULL;
+	connection_service = NULL;
+	daemonless_backend = NULL;
+	daemonless_methods = NULL;
+}
+
+/* What the daemon backends check for at each open, asked only once */
+bool __connline_backend_is_running(void)
+{
+	if (connection_service == NULL || dbus == NULL)
+		return true;
+
+	return connline_dbus_is_service_running(dbus,
+					connection_service) == TRUE;
 }
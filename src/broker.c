@@ -0,0 +1,398 @@
+/*
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License version 2.1,
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <connline/alloc.h>
+#include <connline/broker.h>
+#include <connline/backend.h>
+#include <connline/event.h>
+#include <connline/private.h>
+#include <connline/utils.h>
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+extern struct connline_backend_methods *connection_backend;
+
+/* What a context has been told so far: nothing yet means no backend */
+struct broker_data {
+	uint32_t status;
+	uint32_t generation;
+};
+
+static bool broker_mode = false;
+static int broker_socket = -1;
+static int broker_event = -1;
+static struct connline_broker_page *broker_page = NULL;
+static struct connline_broker_state broker_state;
+
+static void read_broker_state(void)
+{
+	__connline_broker_read(broker_page, &broker_state);
+
+	if (broker_state.properties_size > CONNLINE_BROKER_PROPERTIES_SIZE)
+		broker_state.properties_size = CONNLINE_BROKER_PROPERTIES_SIZE;
+	broker_state.properties[CONNLINE_BROKER_PROPERTIES_SIZE - 1] = '\0';
+}
+
+static char **get_broker_properties(void)
+{
+	const char *name, *value, *end;
+	char **properties = NULL;
+
+	name = broker_state.properties;
+	end = name + broker_state.properties_size;
+
+	while (name < end) {
+		value = name + strlen(name) + 1;
+		if (value >= end)
+			break;
+
+		properties = insert_into_property_list(properties,
+							name, value);
+
+		name = value + strlen(value) + 1;
+	}
+
+	return properties;
+}
+
+static bool is_bearer_matching(struct connline_context *context)
+{
+	if (context->bearer_type == CONNLINE_BEARER_UNKNOWN)
+		return true;
+
+	return (broker_state.bearer & context->bearer_type) != 0;
+}
+
+static void send_broker_properties(struct connline_context *context)
+{
+	char **properties;
+
+	if (__connline_wants_event(context, CONNLINE_EVENT_PROPERTY) == false)
+		return;
+
+	properties = get_broker_properties();
+	if (properties != NULL)
+		__connline_call_property_callback(context, properties);
+}
+
+/* Called on open and on each update, it sends what changed since */
+static int broker_open(struct connline_context *context)
+{
+	struct broker_data *broker = context->backend_data;
+	bool opening = false;
+
+	if (broker == NULL) {
+		broker = __connline_calloc(CONNLINE_MEMORY_BACKEND,
+						1, sizeof(struct broker_data));
+		if (broker == NULL)
+			return -ENOMEM;
+
+		broker->status = CONNLINE_BROKER_NO_BACKEND;
+		context->backend_data = broker;
+		opening = true;
+	}
+
+	/* As on D-Bus, a context opened without any backend is told so */
+	if (broker_state.status == CONNLINE_BROKER_NO_BACKEND) {
+		if (opening == true ||
+				broker->status != CONNLINE_BROKER_NO_BACKEND) {
+			context->is_online = false;
+			__connline_call_error_callback(context, true);
+		}
+	} else if (broker_state.status == CONNLINE_BROKER_CONNECTED &&
+					is_bearer_matching(context) == true) {
+		if (context->is_online == false) {
+			context->is_online = true;
+
+			__connline_call_connected_callback(context);
+			send_broker_properties(context);
+		} else if (broker->generation != broker_state.generation)
+			send_broker_properties(context);
+	} else if (context->is_online == true ||
+			broker->status == CONNLINE_BROKER_NO_BACKEND) {
+		context->is_online = false;
+
+		__connline_call_disconnected_callback(context);
+	}
+
+	broker->status = broker_state.status;
+	broker->generation = broker_state.generation;
+
+	return 0;
+}
+
+static int broker_close(struct connline_context *context)
+{
+	__connline_free(context->backend_data);
+	context->backend_data = NULL;
+
+	return 0;
+}
+
+static enum connline_bearer broker_get_bearer(struct connline_context *context)
+{
+	if (context->is_online == false)
+		return CONNLINE_BEARER_UNKNOWN;
+
+	return broker_state.bearer;
+}
+
+static struct connline_backend_methods broker_methods = {
+	broker_open,
+	broker_close,
+	broker_get_bearer
+};
+
+static void release_broker(void)
+{
+	if (broker_socket >= 0) {
+		__connline_unwatch_fd(broker_socket);
+		close(broker_socket);
+	}
+	broker_socket = -1;
+
+	if (broker_event >= 0) {
+		__connline_unwatch_fd(broker_event);
+		close(broker_event);
+	}
+	broker_event = -1;
+
+	if (broker_page != NULL)
+		munmap(broker_page, CONNLINE_BROKER_PAGE_SIZE);
+	broker_page = NULL;
+}
+
+static void broker_event_cb(int fd, void *user_data)
+{
+	uint32_t generation = broker_state.generation;
+	uint64_t count;
+
+	if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		return;
+
+	read_broker_state();
+
+	if (broker_state.generation != generation)
+		__connline_reconnect_contexts();
+}
+
+/* The broker never writes to the socket: readable means it is gone */
+static void broker_socket_cb(int fd, void *user_data)
+{
+	char buffer[64];
+	ssize_t ret;
+
+	ret = read(fd, buffer, sizeof(buffer));
+	if (ret > 0 || (ret < 0 && (errno == EAGAIN || errno == EINTR)))
+		return;
+
+	DBG("broker vanished");
+
+	__connline_disconnect_contexts();
+
+	connection_backend = NULL;
+	release_broker();
+}
+
+/* Only root, or our own user, may tell us about connectivity */
+static int check_broker_peer(int fd)
+{
+	socklen_t length = sizeof(struct ucred);
+	struct ucred credentials;
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED,
+					&credentials, &length) < 0)
+		return -errno;
+
+	if (credentials.uid != 0 && credentials.uid != getuid())
+		return -EPERM;
+
+	return 0;
+}
+
+static int connect_broker(const char *name)
+{
+	struct timeval timeout = { 1, 0 };
+	struct sockaddr_un addr;
+	socklen_t length;
+	size_t size;
+	int fd, ret;
+
+	size = strlen(name);
+	if (size == 0) {
+		name = CONNLINE_BROKER_DEFAULT;
+		size = strlen(name);
+	}
+
+	if (size > sizeof(addr.sun_path) - 1)
+		return -ENAMETOOLONG;
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -errno;
+
+	/* Abstract socket: a leading '\0', no trailing one */
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path + 1, name, size);
+	length = offsetof(struct sockaddr_un, sun_path) + 1 + size;
+
+	if (connect(fd, (struct sockaddr *) &addr, length) < 0 ||
+			setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO,
+					&timeout, sizeof(timeout)) < 0) {
+		close(fd);
+		return -errno;
+	}
+
+	/* Anyone may have taken the name: an abstract socket has no owner */
+	ret = check_broker_peer(fd);
+	if (ret < 0) {
+		close(fd);
+		return ret;
+	}
+
+	return fd;
+}
+
+/* The broker sends its version, along with the page and event fds */
+static int receive_broker_fds(int fd, int *page_fd, int *event_fd)
+{
+	char control[CMSG_SPACE(2 * sizeof(int))];
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	uint32_t version;
+	struct stat st;
+	ssize_t ret;
+	int fds[2];
+
+	iov.iov_base = &version;
+	iov.iov_len = sizeof(version);
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	ret = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+	if (ret < 0)
+		return -errno;
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET ||
+				cmsg->cmsg_type != SCM_RIGHTS ||
+				cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+		return -EPROTO;
+
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+	/* Reading the page must not fault past its end */
+	if (ret != sizeof(version) || version != CONNLINE_BROKER_VERSION ||
+			fstat(fds[0], &st) < 0 ||
+			st.st_size < CONNLINE_BROKER_PAGE_SIZE) {
+		close(fds[0]);
+		close(fds[1]);
+
+		return -EPROTO;
+	}
+
+	*page_fd = fds[0];
+	*event_fd = fds[1];
+
+	return 0;
+}
+
+int __connline_setup_broker(void *data)
+{
+	const char *name;
+	int page_fd = -1;
+	int ret;
+
+	/* A setuid or setgid host must not trust a broker its caller runs */
+	name = secure_getenv(CONNLINE_BROKER_ENV);
+	if (name == NULL)
+		return 0;
+
+	broker_socket = connect_broker(name);
+	if (broker_socket < 0)
+		return broker_socket;
+
+	ret = receive_broker_fds(broker_socket, &page_fd, &broker_event);
+	if (ret < 0)
+		goto error;
+
+	broker_page = mmap(NULL, CONNLINE_BROKER_PAGE_SIZE, PROT_READ,
+						MAP_SHARED, page_fd, 0);
+	close(page_fd);
+
+	if (broker_page == MAP_FAILED) {
+		broker_page = NULL;
+		ret = -errno;
+		goto error;
+	}
+
+	fcntl(broker_event, F_SETFL, O_NONBLOCK);
+	fcntl(broker_socket, F_SETFL, O_NONBLOCK);
+
+	ret = __connline_watch_fd(data, broker_event, broker_event_cb, NULL);
+	if (ret < 0)
+		goto error;
+
+	ret = __connline_watch_fd(data, broker_socket,
+						broker_socket_cb, NULL);
+	if (ret < 0)
+		goto error;
+
+	read_broker_state();
+
+	connection_backend = &broker_methods;
+	broker_mode = true;
+
+	return 1;
+
+error:
+	release_broker();
+
+	return ret;
+}
+
+void __connline_cleanup_broker(void)
+{
+	if (broker_mode == false)
+		return;
+
+	if (connection_backend == &broker_methods)
+		connection_backend = NULL;
+
+	release_broker();
+	broker_mode = false;
+}
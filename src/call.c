@@ -0,0 +1,460 @@
+/*
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License version 2.1,
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <connline/dbus.h>
+#include <connline/event.h>
+#include <connline/private.h>
+#include <connline/stats.h>
+#include <connline/utils.h>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+/* First delay before sending a timed out request again, in microseconds */
+#define CALL_BACKOFF_MIN 250000UL
+/* The delay doubles at each timeout of the same request, up to this */
+#define CALL_BACKOFF_MAX 30000000UL
+
+/*
+ * A context's request the table looks after,  from its sending until its
+ * reply: either it is on the bus,  until deadline if its context has one,
+ * or it timed out and is sent again at retry_at.  The plugin's slot always
+ * holds the last pending call, cancelled while waiting to retry,  which
+ * points back to its entry.  A request sent once is never sent again: past
+ * its deadline,  it is waited for until the next one instead.
+ */
+struct connline_call {
+	struct connline_call *prev;
+	struct connline_call *next;
+
+	struct connline_context *context;
+	DBusConnection *dbus_cnx;
+	DBusMessage *message;
+	DBusPendingCall **slot;
+	DBusPendingCallNotifyFunction function;
+	void *user_data;
+
+	bool once;
+	unsigned int timeouts;
+	unsigned long sent_at;
+	unsigned long deadline;
+	unsigned long retry_at;
+};
+
+static struct connline_call *calls = NULL;
+static dbus_int32_t call_data_slot = -1;
+
+/* One timer for the whole table, set to its earliest deadline or retry */
+static void *call_data = NULL;
+static int timer_fd = -1;
+static unsigned long armed_at = 0;
+
+static unsigned int jitter_seed = 0;
+
+/* In microseconds, 0 when the context has none */
+static unsigned long get_deadline(struct connline_context *context)
+{
+	unsigned int deadline;
+
+	deadline = __atomic_load_n(&context->deadline, __ATOMIC_RELAXED);
+
+	return deadline * 1000UL;
+}
+
+/* Equal jitter: half the delay, plus up to as much again at random */
+static unsigned long get_backoff(unsigned int timeouts)
+{
+	unsigned long delay = CALL_BACKOFF_MIN;
+
+	while (timeouts-- > 1 && delay < CALL_BACKOFF_MAX)
+		delay <<= 1;
+
+	if (delay > CALL_BACKOFF_MAX)
+		delay = CALL_BACKOFF_MAX;
+
+	if (jitter_seed == 0)
+		jitter_seed = __connline_stats_now() ^ getpid();
+
+	return delay / 2 + rand_r(&jitter_seed) % (delay / 2);
+}
+
+static void arm_timer(unsigned long time)
+{
+	struct itimerspec spec = { { 0, 0 }, { 0, 0 } };
+
+	if (armed_at != 0 && armed_at <= time)
+		return;
+
+	spec.it_value.tv_sec = time / 1000000UL;
+	spec.it_value.tv_nsec = (time % 1000000UL) * 1000;
+
+	if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) == 0)
+		armed_at = time;
+}
+
+static void timer_cb(int fd, void *user_data);
+
+static int setup_timer(void)
+{
+	int ret;
+
+	if (timer_fd >= 0)
+		return 0;
+
+	if (call_data_slot < 0 &&
+		dbus_pending_call_allocate_data_slot(&call_data_slot) == FALSE)
+		return -ENOMEM;
+
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (timer_fd < 0)
+		return -errno;
+
+	ret = __connline_watch_fd(call_data, timer_fd, timer_cb, NULL);
+	if (ret < 0) {
+		close(timer_fd);
+		timer_fd = -1;
+	}
+
+	return ret;
+}
+
+static void remove_call(struct connline_call *call)
+{
+	if (call->prev != NULL)
+		call->prev->next = call->next;
+	else
+		calls = call->next;
+
+	if (call->next != NULL)
+		call->next->prev = call->prev;
+
+	dbus_message_unref(call->message);
+	__connline_free(call);
+}
+
+static void call_reply(DBusPendingCall *pending, void *user_data)
+{
+	struct connline_call *call = user_data;
+	DBusPendingCallNotifyFunction function = call->function;
+
+	user_data = call->user_data;
+
+	/* The function may well free the context, and cancel anything */
+	dbus_pending_call_set_data(pending, call_data_slot, NULL, NULL);
+	remove_call(call);
+
+	function(pending, user_data);
+}
+
+/* Without a deadline, D-Bus enforces its default timeout, as it used to */
+static int send_call(struct connline_call *call, DBusMessage *message,
+						DBusPendingCall **pending)
+{
+	unsigned long deadline = get_deadline(call->context);
+
+	if (dbus_connection_send_with_reply(call->dbus_cnx, message, pending,
+				deadline != 0 ? DBUS_TIMEOUT_INFINITE :
+						DBUS_TIMEOUT_USE_DEFAULT) == FALSE ||
+				*pending == NULL)
+		return -ENOMEM;
+
+	__connline_stats_call(*pending);
+
+	if (dbus_pending_call_set_notify(*pending,
+					call_reply, call, NULL) == FALSE ||
+		dbus_pending_call_set_data(*pending, call_data_slot,
+						call, NULL) == FALSE) {
+		dbus_pending_call_cancel(*pending);
+		dbus_pending_call_unref(*pending);
+		*pending = NULL;
+
+		return -ENOMEM;
+	}
+
+	call->sent_at = __connline_stats_now();
+	call->deadline = 0;
+	call->retry_at = 0;
+
+	if (deadline != 0) {
+		call->deadline = call->sent_at + deadline;
+		arm_timer(call->deadline);
+	}
+
+	return 0;
+}
+
+/* As a D-Bus timeout would: the context is not usable anymore */
+static void fail_call(struct connline_call *call)
+{
+	struct connline_context *context = call->context;
+
+	/* The slot keeps the cancelled call, for the plugin to drop */
+	dbus_pending_call_set_data(*call->slot, call_data_slot, NULL, NULL);
+	remove_call(call);
+
+	__connline_call_error_callback(context, false);
+}
+
+static void expire_call(struct connline_call *call)
+{
+	unsigned long deadline;
+
+	call->timeouts++;
+	call->deadline = 0;
+
+	__connline_stats_add(CONNLINE_STATS_DBUS_TIMEOUTS, 1);
+
+	if (call->timeouts > CONNLINE_DEADLINE_RETRIES) {
+		dbus_pending_call_cancel(*call->slot);
+		fail_call(call);
+		return;
+	}
+
+	if (call->once == true) {
+		/* Still on the bus, as if it was sent right now */
+		deadline = get_deadline(call->context);
+		call->sent_at = __connline_stats_now();
+
+		if (deadline != 0)
+			call->deadline = call->sent_at + deadline;
+	} else {
+		dbus_pending_call_cancel(*call->slot);
+		call->retry_at = __connline_stats_now() +
+						get_backoff(call->timeouts);
+	}
+
+	__connline_call_timeout_callback(call->context);
+}
+
+static void retry_call(struct connline_call *call)
+{
+	DBusPendingCall *pending = NULL;
+	DBusMessage *message;
+	int ret = -ENOMEM;
+
+	/* A sent message is locked, and has its serial */
+	message = dbus_message_copy(call->message);
+	if (message != NULL) {
+		ret = send_call(call, message, &pending);
+		dbus_message_unref(message);
+	}
+
+	if (ret < 0) {
+		fail_call(call);
+		return;
+	}
+
+	dbus_pending_call_unref(*call->slot);
+	*call->slot = pending;
+}
+
+static void timer_cb(int fd, void *user_data)
+{
+	struct connline_call *call, *next;
+	unsigned long now, earliest = 0;
+	uint64_t expirations;
+
+	if (read(fd, &expirations, sizeof(expirations)) < 0)
+		return;
+
+	armed_at = 0;
+	now = __connline_stats_now();
+
+	for (call = calls; call != NULL; call = next) {
+		next = call->next;
+
+		if (call->deadline != 0 && call->deadline <= now)
+			expire_call(call);
+		else if (call->retry_at != 0 && call->retry_at <= now)
+			retry_call(call);
+	}
+
+	for (call = calls; call != NULL; call = call->next) {
+		if (call->deadline != 0 &&
+				(earliest == 0 || call->deadline < earliest))
+			earliest = call->deadline;
+
+		if (call->retry_at != 0 &&
+				(earliest == 0 || call->retry_at < earliest))
+			earliest = call->retry_at;
+	}
+
+	if (earliest != 0)
+		arm_timer(earliest);
+}
+
+/* Requests no context may give a deadline to, or when there is no timer */
+static int send_untracked(DBusConnection *dbus_cnx, DBusMessage *message,
+					DBusPendingCall **pending,
+					DBusPendingCallNotifyFunction function,
+					void *user_data)
+{
+	if (dbus_connection_send_with_reply(dbus_cnx, message, pending,
+				DBUS_TIMEOUT_USE_DEFAULT) == FALSE ||
+				*pending == NULL)
+		return -ENOMEM;
+
+	__connline_stats_call(*pending);
+
+	if (dbus_pending_call_set_notify(*pending,
+				function, user_data, NULL) == FALSE) {
+		dbus_pending_call_cancel(*pending);
+		dbus_pending_call_unref(*pending);
+		*pending = NULL;
+
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static int send_tracked(struct connline_context *context,
+				DBusConnection *dbus_cnx,
+				DBusMessage *message, bool once,
+				DBusPendingCall **pending,
+				DBusPendingCallNotifyFunction function,
+				void *user_data)
+{
+	struct connline_call *call;
+	int ret;
+
+	if (context == NULL || setup_timer() < 0)
+		return send_untracked(dbus_cnx, message, pending,
+							function, user_data);
+
+	call = __connline_calloc(CONNLINE_MEMORY_DBUS, 1,
+					sizeof(struct connline_call));
+	if (call == NULL)
+		return -ENOMEM;
+
+	call->context = context;
+	call->dbus_cnx = dbus_cnx;
+	call->message = dbus_message_ref(message);
+	call->slot = pending;
+	call->function = function;
+	call->user_data = user_data;
+	call->once = once;
+
+	ret = send_call(call, message, pending);
+	if (ret < 0) {
+		dbus_message_unref(call->message);
+		__connline_free(call);
+
+		return ret;
+	}
+
+	call->next = calls;
+	if (calls != NULL)
+		calls->prev = call;
+	calls = call;
+
+	return 0;
+}
+
+int connline_dbus_send_with_deadline(struct connline_context *context,
+					DBusConnection *dbus_cnx,
+					DBusMessage *message,
+					DBusPendingCall **pending,
+					DBusPendingCallNotifyFunction function,
+					void *user_data)
+{
+	return send_tracked(context, dbus_cnx, message, false,
+					pending, function, user_data);
+}
+
+int connline_dbus_send_once_with_deadline(struct connline_context *context,
+					DBusConnection *dbus_cnx,
+					DBusMessage *message,
+					DBusPendingCall **pending,
+					DBusPendingCallNotifyFunction function,
+					void *user_data)
+{
+	return send_tracked(context, dbus_cnx, message, true,
+					pending, function, user_data);
+}
+
+void connline_dbus_cancel_call(DBusPendingCall **pending)
+{
+	struct connline_call *call = NULL;
+
+	if (*pending == NULL)
+		return;
+
+	/* Not sent through the table, or not anymore, when there is none */
+	if (call_data_slot >= 0)
+		call = dbus_pending_call_get_data(*pending, call_data_slot);
+
+	if (call != NULL) {
+		dbus_pending_call_set_data(*pending,
+					call_data_slot, NULL, NULL);
+		remove_call(call);
+	}
+
+	dbus_pending_call_cancel(*pending);
+	dbus_pending_call_unref(*pending);
+	*pending = NULL;
+}
+
+/*
+ * The context's requests on the bus get the new deadline as well:  those
+ * sent without one still have the D-Bus default timeout on top of it.
+ */
+void __connline_update_deadlines(struct connline_context *context)
+{
+	unsigned long deadline = get_deadline(context);
+	struct connline_call *call;
+
+	for (call = calls; call != NULL; call = call->next) {
+		if (call->context != context || call->retry_at != 0)
+			continue;
+
+		call->deadline = 0;
+
+		if (deadline != 0) {
+			call->deadline = call->sent_at + deadline;
+			arm_timer(call->deadline);
+		}
+	}
+}
+
+void __connline_setup_calls(void *data)
+{
+	call_data = data;
+}
+
+/* Plugins cancelled theirs already: what is left is a leak to stop */
+void __connline_cleanup_calls(void)
+{
+	while (calls != NULL)
+		remove_call(calls);
+
+	if (timer_fd >= 0) {
+		__connline_unwatch_fd(timer_fd);
+		close(timer_fd);
+		timer_fd = -1;
+	}
+
+	armed_at = 0;
+	call_data = NULL;
+}
@@ -0,0 +1,178 @@
+/*
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License version 2.1,
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <connline/event.h>
+#include <connline/private.h>
+#include <connline/utils.h>
+
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+/*
+ * Intrusive multi-producer single-consumer queue: other threads push with
+ * one atomic exchange, never waiting on each other nor on the loop thread,
+ * which pops in push order.  The stub node keeps the queue never empty,
+ * so that pushing needs no special case.  Commands are embedded in their
+ * context, nothing gets allocated.
+ */
+static struct connline_command stub;
+static struct connline_command *head = &stub;
+static struct connline_command *tail = &stub;
+
+/* Only written to when nothing is pending, the loop thread reads it all */
+static int wakeup[2] = { -1, -1 };
+static bool wakeup_pending = false;
+
+static pthread_t loop_thread;
+static bool set_up = false;
+static __connline_command_f run_command = NULL;
+
+static void push(struct connline_command *command)
+{
+	struct connline_command *previous;
+
+	__atomic_store_n(&command->next, NULL, __ATOMIC_RELAXED);
+
+	previous = __atomic_exchange_n(&tail, command, __ATOMIC_ACQ_REL);
+
+	/* Until then, the loop thread sees the queue end at previous */
+	__atomic_store_n(&previous->next, command, __ATOMIC_RELEASE);
+}
+
+/* NULL when empty, or while a push is halfway: its wakeup comes after */
+static struct connline_command *pop(void)
+{
+	struct connline_command *command = head;
+	struct connline_command *next;
+
+	next = __atomic_load_n(&command->next, __ATOMIC_ACQUIRE);
+
+	if (command == &stub) {
+		if (next == NULL)
+			return NULL;
+
+		head = next;
+		command = next;
+		next = __atomic_load_n(&command->next, __ATOMIC_ACQUIRE);
+	}
+
+	if (next != NULL) {
+		head = next;
+		return command;
+	}
+
+	if (command != __atomic_load_n(&tail, __ATOMIC_ACQUIRE))
+		return NULL;
+
+	/* The last command: the stub goes after it, to be popped alone */
+	push(&stub);
+
+	next = __atomic_load_n(&command->next, __ATOMIC_ACQUIRE);
+	if (next == NULL)
+		return NULL;
+
+	head = next;
+
+	return command;
+}
+
+static void drain(void)
+{
+	struct connline_command *command;
+
+	while ((command = pop()) != NULL)
+		run_command(command);
+}
+
+static void wakeup_cb(int fd, void *user_data)
+{
+	char buffer[64];
+
+	while (read(fd, buffer, sizeof(buffer)) > 0);
+
+	/* Pushes from now on wake the loop up again */
+	__atomic_store_n(&wakeup_pending, false, __ATOMIC_SEQ_CST);
+
+	drain();
+}
+
+bool __connline_is_loop_thread(void)
+{
+	if (set_up == false)
+		return true;
+
+	return pthread_equal(pthread_self(), loop_thread) != 0;
+}
+
+void __connline_push_command(struct connline_command *command)
+{
+	char byte = 0;
+
+	push(command);
+
+	if (__atomic_exchange_n(&wakeup_pending, true, __ATOMIC_SEQ_CST))
+		return;
+
+	if (write(wakeup[1], &byte, 1) != 1)
+		DBG("cannot wake the loop thread up");
+}
+
+int __connline_setup_commands(void *data, __connline_command_f run)
+{
+	int ret;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+							0, wakeup) < 0)
+		return -errno;
+
+	ret = __connline_watch_fd(data, wakeup[0], wakeup_cb, NULL);
+	if (ret < 0) {
+		close(wakeup[0]);
+		close(wakeup[1]);
+		wakeup[0] = wakeup[1] = -1;
+
+		return ret;
+	}
+
+	run_command = run;
+	loop_thread = pthread_self();
+	set_up = true;
+
+	return 0;
+}
+
+/* Commands still queued are run: other threads must be done by now */
+void __connline_cleanup_commands(void)
+{
+	if (set_up == false)
+		return;
+
+	drain();
+
+	__connline_unwatch_fd(wakeup[0]);
+	close(wakeup[0]);
+	close(wakeup[1]);
+	wakeup[0] = wakeup[1] = -1;
+
+	wakeup_pending = false;
+	run_command = NULL;
+	set_up = false;
+}
@@ -18,26 +18,37 @@
  *
  */
 
+#include <connline/alloc.h>
 #include <connline/data.h>
 #include <connline/list.h>
 #include <connline/private.h>
 #include <connline/backend.h>
 #include <connline/utils.h>
+#include <connline/dbus.h>
+#include <connline/stats.h>
 
 #include <stdlib.h>
-#include <time.h>
+#include <stdio.h>
+#include <string.h>
 
 extern struct connline_backend_methods *connection_backend;
 
 static DBusConnection *dbus_cnx = NULL;
 static dlist *contexts_list = NULL;
 
+static bool private_dbus = false;
+/* Handed in by the application, which drives it */
+static bool external_dbus = false;
+
+/* Through D-Bus, the broker, or daemonless backends only */
+static bool initialized = false;
+
+/* Contexts may then be opened and closed from any thread */
+static bool thread_safe = false;
+
 static inline bool is_connline_initialized(void)
 {
-	if (dbus_cnx == NULL)
-		return false;
-
-	return true;
+	return initialized;
 }
 
 static inline bool is_backend_up(void)
@@ -60,6 +71,8 @@ void __connline_close(struct connline_context *context)
 
 out:
 	context->is_online = false;
+
+	__atomic_store_n(&context->published, 0, __ATOMIC_RELEASE);
 }
 
 static void disconnect_context(void *data)
@@ -75,6 +88,17 @@ void __connline_disconnect_contexts(void)
 	dlist_foreach(contexts_list, disconnect_context);
 }
 
+static void close_context(void *data)
+{
+	__connline_close(data);
+}
+
+/* Silently, when another backend is about to take over */
+void __connline_close_contexts(void)
+{
+	dlist_foreach(contexts_list, close_context);
+}
+
 static void reconnect_context(void *data)
 {
 	struct connline_context *context = data;
@@ -101,56 +125,342 @@ void __connline_invalidate_contexts(void)
 	dlist_foreach(contexts_list, invalidate_context);
 }
 
+static void notify_online_context(void *data)
+{
+	struct connline_context *context = data;
+
+	if (context->is_online == true)
+		__connline_call_connected_callback(context);
+}
+
+/* The online probe succeeded: connected again, as ConnMan tells online */
+void __connline_notify_online_contexts(void)
+{
+	dlist_foreach(contexts_list, notify_online_context);
+}
+
+static struct connline_stats *counted_stats;
+
+static void count_context(void *data)
+{
+	struct connline_context *context = data;
+
+	switch (context->state) {
+	case CONNLINE_CONTEXT_OPENING:
+		counted_stats->contexts_opening++;
+		break;
+	case CONNLINE_CONTEXT_CONNECTED:
+		counted_stats->contexts_connected++;
+		break;
+	case CONNLINE_CONTEXT_DISCONNECTED:
+		counted_stats->contexts_disconnected++;
+		break;
+	case CONNLINE_CONTEXT_INVALID:
+		counted_stats->contexts_invalid++;
+		break;
+	}
+}
+
+void __connline_count_contexts(struct connline_stats *stats)
+{
+	counted_stats = stats;
+	dlist_foreach(contexts_list, count_context);
+	counted_stats = NULL;
+
+	if (dbus_cnx != NULL && dbus_connection_get_dispatch_status(dbus_cnx)
+						== DBUS_DISPATCH_DATA_REMAINS)
+		stats->dispatch_pending = 1;
+}
+
 static void __cleanup_context(void *data)
 {
 	struct connline_context *context = data;
 
 	__connline_close(context);
-	free(context);
+	__connline_trigger_cleanup(context);
+	__connline_group_release(context);
 }
 
-int connline_init(enum connline_event_loop event_loop_type, void *data)
+static DBusConnection *get_dbus_connection(void)
+{
+	DBusConnection *connection;
+
+	if (private_dbus == false)
+		return dbus_bus_get(DBUS_BUS_SYSTEM, NULL);
+
+	connection = dbus_bus_get_private(DBUS_BUS_SYSTEM, NULL);
+	if (connection != NULL)
+		dbus_connection_set_exit_on_disconnect(connection, FALSE);
+
+	return connection;
+}
+
+/* A private connection has to be closed by its owner */
+static void close_dbus_connection(void)
+{
+	if (dbus_cnx != NULL && private_dbus == true && external_dbus == false)
+		dbus_connection_close(dbus_cnx);
+}
+
+static void release_dbus_connection(void)
+{
+	if (dbus_cnx == NULL)
+		return;
+
+	dbus_connection_unref(dbus_cnx);
+
+	dbus_cnx = NULL;
+	external_dbus = false;
+}
+
+/* No system bus, as in minimal containers: daemonless backends only */
+static int init_daemonless(void *data)
+{
+	int ret;
+
+	if (__connline_setup_dbus_event_loop(NULL, data) < 0)
+		return -EINVAL;
+
+	ret = __connline_setup_backend(NULL);
+	if (ret < 0)
+		return ret;
+
+	if (is_backend_up() == false) {
+		__connline_cleanup_backend();
+		return -EINVAL;
+	}
+
+	initialized = true;
+
+	return 0;
+}
+
+static int setup(enum connline_event_loop event_loop_type, void *data,
+						DBusConnection *connection)
 {
 	int ret = 0;
 
+	if (setup_unique_name_prefix() < 0)
+		return -ENOMEM;
+
 	if (__connline_setup_event_loop(event_loop_type) < 0)
 		return -EINVAL;
 
-	dbus_cnx = __connline_setup_dbus_event_loop(data);
+	__connline_setup_calls(data);
+	__connline_setup_probe(data);
+
+	if (connection == NULL) {
+		ret = __connline_setup_broker(data);
+		if (ret > 0) {
+			initialized = true;
+			return 0;
+		}
+
+		if (ret < 0)
+			fprintf(stderr, "Connline: cannot use the broker: %s\n",
+								strerror(-ret));
+
+		dbus_cnx = get_dbus_connection();
+	} else {
+		dbus_cnx = dbus_connection_ref(connection);
+		external_dbus = true;
+	}
+
 	if (dbus_cnx == NULL)
+		return init_daemonless(data);
+
+	/* The application already set its own watch and timeout functions */
+	if (__connline_setup_dbus_event_loop(external_dbus == true ?
+						NULL : dbus_cnx, data) < 0) {
+		close_dbus_connection();
+		release_dbus_connection();
 		return -EINVAL;
+	}
+
+	ret = __connline_setup_record(dbus_cnx);
+	if (ret < 0)
+		perror("Connline: cannot record D-Bus messages");
 
 	ret = __connline_setup_backend(dbus_cnx);
 	if (ret < 0) {
-		dbus_connection_unref(dbus_cnx);
-		dbus_cnx = NULL;
+		__connline_cleanup_record(dbus_cnx);
+		close_dbus_connection();
+		release_dbus_connection();
 
 		return ret;
 	}
 
-	srand(time(NULL));
+	initialized = true;
 
 	return ret;
 }
 
-static struct connline_context *__connline_context_new(void)
+static void run_command(struct connline_command *command);
+
+static int init(enum connline_event_loop event_loop_type, void *data,
+						DBusConnection *connection)
 {
-	struct connline_context *context;
-	dlist *new_list;
+	int ret;
 
-	context = calloc(1, sizeof(struct connline_context));
-	if (context == NULL)
-		return NULL;
+	if (is_connline_initialized() == true)
+		return -EALREADY;
 
-	new_list = dlist_prepend(contexts_list, context);
-	if (new_list == contexts_list) {
-		free(context);
-		return NULL;
+	ret = setup(event_loop_type, data, connection);
+	if (ret < 0 || thread_safe == false)
+		return ret;
+
+	ret = __connline_setup_commands(data, run_command);
+	if (ret < 0) {
+		fprintf(stderr, "Connline: cannot be thread-safe: %s\n",
+								strerror(-ret));
+		connline_cleanup();
 	}
 
+	return ret;
+}
+
+int connline_init(enum connline_event_loop event_loop_type, void *data)
+{
+	return init(event_loop_type, data, NULL);
+}
+
+int connline_init_with_dbus(enum connline_event_loop event_loop_type,
+					void *data, DBusConnection *connection)
+{
+	if (connection == NULL)
+		return -EINVAL;
+
+	return init(event_loop_type, data, connection);
+}
+
+int connline_set_private_dbus(bool private_connection)
+{
+	if (is_connline_initialized() == true)
+		return -EALREADY;
+
+	private_dbus = private_connection;
+
+	return 0;
+}
+
+int connline_set_thread_safe(bool enable)
+{
+	if (is_connline_initialized() == true)
+		return -EALREADY;
+
+	thread_safe = enable;
+
+	return 0;
+}
+
+static int add_context(struct connline_context *context)
+{
+	dlist *new_list;
+
+	new_list = dlist_prepend(contexts_list, context);
+	if (new_list == contexts_list)
+		return -ENOMEM;
+
 	contexts_list = new_list;
 
-	return context;
+	return 0;
+}
+
+/* On the loop thread, once the context is listed */
+static void open_context(struct connline_context *context, bool running)
+{
+	__connline_open_f _connline_open;
+
+	if (dbus_cnx != NULL)
+		context->dbus_cnx = dbus_connection_ref(dbus_cnx);
+
+	CONNLINE_TRACE2(context_open, context, context->bearer_type);
+
+	if (is_backend_up() == false || running == false)
+		return;
+
+	_connline_open = connection_backend->__connline_open;
+	_connline_open(context);
+}
+
+static void close_context_now(struct connline_context *context)
+{
+	CONNLINE_TRACE1(context_close, context);
+
+	__connline_close(context);
+	__connline_trigger_cleanup(context);
+	if (context->dbus_cnx != NULL)
+		dbus_connection_unref(context->dbus_cnx);
+
+	contexts_list = dlist_remove(contexts_list, context);
+	__connline_group_release(context);
+}
+
+/* The daemon is checked for once, and nothing waits for the bus */
+static int open_group(struct connline_group *group)
+{
+	bool running;
+	unsigned int i;
+
+	for (i = 0; i < group->nb_contexts; i++) {
+		if (add_context(&group->contexts[i]) < 0)
+			goto error;
+	}
+
+	running = __connline_backend_is_running();
+
+	for (i = 0; i < group->nb_contexts; i++) {
+		/* Its close command comes next, no need to open it */
+		if (__atomic_load_n(&group->contexts[i].closing,
+						__ATOMIC_RELAXED) == false)
+			open_context(&group->contexts[i], running);
+	}
+
+	return 0;
+
+error:
+	/* Just prepended, thus right at the head of the list */
+	while (i-- > 0)
+		contexts_list = dlist_remove(contexts_list,
+						&group->contexts[i]);
+
+	return -ENOMEM;
+}
+
+static void invalidate_group(struct connline_group *group)
+{
+	unsigned int i;
+
+	for (i = 0; i < group->nb_contexts; i++)
+		__connline_call_error_callback(&group->contexts[i], false);
+}
+
+static void run_command(struct connline_command *command)
+{
+	struct connline_context *context = command->context;
+
+	switch (command->type) {
+	case CONNLINE_COMMAND_OPEN:
+		if (add_context(context) < 0) {
+			__connline_call_error_callback(context, false);
+			break;
+		}
+
+		/* Its close command comes next, no need to open it */
+		if (__atomic_load_n(&context->closing,
+						__ATOMIC_RELAXED) == false)
+			open_context(context, true);
+
+		break;
+	case CONNLINE_COMMAND_OPEN_MANY:
+		if (open_group(context->group) < 0)
+			invalidate_group(context->group);
+
+		break;
+	case CONNLINE_COMMAND_CLOSE:
+		close_context_now(context);
+		break;
+	}
 }
 
 struct connline_context *connline_open(enum connline_bearer bearer_type,
@@ -159,12 +469,12 @@ struct connline_context *connline_open(enum connline_bearer bearer_type,
 						void *user_data)
 {
 	struct connline_context *context;
-	__connline_open_f _connline_open;
 
 	if (is_connline_initialized() == false)
 		return NULL;
 
-	context = __connline_context_new();
+	context = __connline_calloc(CONNLINE_MEMORY_CONTEXT,
+					1, sizeof(struct connline_context));
 	if (context == NULL)
 		return NULL;
 
@@ -172,23 +482,107 @@ struct connline_context *connline_open(enum connline_bearer bearer_type,
 	context->background_connection = background_connection;
 	context->event_callback = callback;
 	context->user_data = user_data;
-	context->dbus_cnx = dbus_connection_ref(dbus_cnx);
+	context->event_mask = CONNLINE_EVENT_MASK_ALL;
+	context->opened_at = __connline_stats_now();
+
+	if (__connline_is_loop_thread() == false) {
+		context->open_command.type = CONNLINE_COMMAND_OPEN;
+		context->open_command.context = context;
+		__connline_push_command(&context->open_command);
 
-	if (is_backend_up() == false)
 		return context;
+	}
 
-	_connline_open = connection_backend->__connline_open;
-	_connline_open(context);
+	if (add_context(context) < 0) {
+		__connline_free(context);
+		return NULL;
+	}
+
+	open_context(context, true);
 
 	return context;
 }
 
+int connline_open_many(struct connline_context **contexts,
+				unsigned int nb_contexts,
+				enum connline_bearer bearer_type,
+				bool background_connection,
+				connline_callback_f callback,
+				void *const *user_data,
+				connline_completion_f completion,
+				void *completion_data)
+{
+	struct connline_context *context;
+	struct connline_group *group;
+	unsigned long now;
+	unsigned int i;
+
+	if (contexts == NULL || nb_contexts == 0)
+		return -EINVAL;
+
+	if (is_connline_initialized() == false)
+		return -EINVAL;
+
+	group = __connline_group_new(nb_contexts,
+					completion, completion_data);
+	if (group == NULL)
+		return -ENOMEM;
+
+	now = __connline_stats_now();
+
+	for (i = 0; i < nb_contexts; i++) {
+		context = &group->contexts[i];
+
+		context->bearer_type = bearer_type;
+		context->background_connection = background_connection;
+		context->event_callback = callback;
+		context->user_data = user_data != NULL ? user_data[i] : NULL;
+		context->event_mask = CONNLINE_EVENT_MASK_ALL;
+		context->opened_at = now;
+	}
+
+	if (__connline_is_loop_thread() == true &&
+					open_group(group) < 0) {
+		__connline_free(group);
+		return -ENOMEM;
+	}
+
+	/* Before the loop thread can call back with them */
+	for (i = 0; i < nb_contexts; i++)
+		contexts[i] = &group->contexts[i];
+
+	if (__connline_is_loop_thread() == false) {
+		group->open_command.type = CONNLINE_COMMAND_OPEN_MANY;
+		group->open_command.context = &group->contexts[0];
+		__connline_push_command(&group->open_command);
+	}
+
+	return 0;
+}
+
+/* Whatever the thread, published at each change on the loop thread */
+static unsigned int get_published(struct connline_context *context)
+{
+	return __atomic_load_n(&context->published, __ATOMIC_ACQUIRE);
+}
+
+static bool is_context_online(struct connline_context *context)
+{
+	if (context->is_online == false)
+		return false;
+
+	return __connline_probe_is_online();
+}
+
 bool connline_is_online(struct connline_context *context)
 {
 	if (context == NULL)
 		return false;
 
-	return context->is_online;
+	if (__connline_is_loop_thread() == false)
+		return (get_published(context) & CONNLINE_PUBLISHED_ONLINE) != 0;
+
+	return is_context_online(context);
 }
 
 void connline_close(struct connline_context *context)
@@ -196,18 +590,80 @@ void connline_close(struct connline_context *context)
 	if (context == NULL || is_connline_initialized() == false)
 		return;
 
-	__connline_close(context);
-	dbus_connection_unref(context->dbus_cnx);
+	if (__connline_is_loop_thread() == false) {
+		/* No more callback from now on, see run_callback() */
+		__atomic_store_n(&context->closing, true, __ATOMIC_RELAXED);
 
-	contexts_list = dlist_remove(contexts_list, context);
-	free(context);
+		context->close_command.type = CONNLINE_COMMAND_CLOSE;
+		context->close_command.context = context;
+		__connline_push_command(&context->close_command);
+
+		return;
+	}
+
+	close_context_now(context);
 }
 
-enum connline_bearer connline_get_bearer(struct connline_context *context)
+void connline_close_many(struct connline_context **contexts,
+						unsigned int nb_contexts)
 {
-	__connline_get_bearer_f __connline_get_bearer;
+	if (contexts == NULL)
+		return;
+
+	/* The last opened are at the head of the lists */
+	while (nb_contexts > 0) {
+		nb_contexts--;
+		connline_close(contexts[nb_contexts]);
+	}
+}
 
+int connline_set_event_mask(struct connline_context *context,
+						unsigned int event_mask)
+{
 	if (context == NULL || is_connline_initialized() == false)
+		return -EINVAL;
+
+	__atomic_store_n(&context->event_mask, event_mask, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+int connline_set_group_batch_callback(struct connline_context *context,
+					connline_batch_callback_f callback,
+					void *user_data)
+{
+	if (context == NULL || is_connline_initialized() == false)
+		return -EINVAL;
+
+	if (context->group == NULL)
+		return -EINVAL;
+
+	context->group->batch_callback = callback;
+	context->group->batch_data = user_data;
+
+	return 0;
+}
+
+int connline_set_deadline(struct connline_context *context,
+						unsigned int deadline)
+{
+	if (context == NULL || is_connline_initialized() == false)
+		return -EINVAL;
+
+	__atomic_store_n(&context->deadline, deadline, __ATOMIC_RELAXED);
+
+	if (__connline_is_loop_thread() == true)
+		__connline_update_deadlines(context);
+
+	return 0;
+}
+
+static enum connline_bearer get_context_bearer(
+					struct connline_context *context)
+{
+	__connline_get_bearer_f __connline_get_bearer;
+
+	if (is_backend_up() == false)
 		return CONNLINE_BEARER_UNKNOWN;
 
 	__connline_get_bearer = connection_backend->__connline_get_bearer;
@@ -217,17 +673,54 @@ enum connline_bearer connline_get_bearer(struct connline_context *context)
 	return __connline_get_bearer(context);
 }
 
+enum connline_bearer connline_get_bearer(struct connline_context *context)
+{
+	if (context == NULL || is_connline_initialized() == false)
+		return CONNLINE_BEARER_UNKNOWN;
+
+	if (__connline_is_loop_thread() == false)
+		return get_published(context) & ~CONNLINE_PUBLISHED_ONLINE;
+
+	return get_context_bearer(context);
+}
+
+void __connline_publish_state(struct connline_context *context)
+{
+	unsigned int state;
+
+	if (thread_safe == false)
+		return;
+
+	state = get_context_bearer(context);
+	if (is_context_online(context) == true)
+		state |= CONNLINE_PUBLISHED_ONLINE;
+
+	__atomic_store_n(&context->published, state, __ATOMIC_RELEASE);
+}
+
 void connline_cleanup(void)
 {
+	/* Contexts other threads opened get listed, to be cleaned up */
+	__connline_cleanup_commands();
+
 	dlist_foreach(contexts_list, __cleanup_context);
 	dlist_free_all(contexts_list);
 	contexts_list = NULL;
 
-	__connline_cleanup_event_loop(dbus_cnx);
+	__connline_cleanup_broker();
+	__connline_cleanup_record(dbus_cnx);
+	__connline_cleanup_probe();
 
-	if (dbus_cnx != NULL)
-		dbus_connection_unref(dbus_cnx);
+	/* Their service watches go away with the D-Bus connection */
+	__connline_cleanup_backend();
+	__connline_cleanup_calls();
 
-	dbus_cnx = NULL;
-}
+	/* Closing removes the watches, it needs the event loop plugin */
+	close_dbus_connection();
+	__connline_cleanup_event_loop(external_dbus == true ? NULL : dbus_cnx);
+
+	release_dbus_connection();
+	initialized = false;
 
+	connline_dbus_cleanup_method_calls();
+}
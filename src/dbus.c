@@ -18,13 +18,29 @@
  *
  */
 
+#include <connline/alloc.h>
 #include <connline/dbus.h>
+#include <connline/stats.h>
 
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+#define METHOD_CALL_TEMPLATES_MAX 32
+
+struct method_call_template {
+	char *destination;
+	char *path;
+	char *interface;
+	char *method;
+
+	DBusMessage *message;
+};
+
+static struct method_call_template templates[METHOD_CALL_TEMPLATES_MAX];
+static int nb_templates = 0;
+
 static const char *map_basic_to_signature(int dbus_type)
 {
 	switch (dbus_type) {
@@ -279,27 +295,50 @@ int connline_dbus_get_basic_variant(DBusMessageIter *iter,
 	return 0;
 }
 
+static int recurse_into_array(DBusMessageIter *iter, DBusMessageIter *array)
+{
+	DBusMessageIter variant;
+
+	if (dbus_message_iter_get_arg_type(iter) == DBUS_TYPE_VARIANT) {
+		dbus_message_iter_recurse(iter, &variant);
+		iter = &variant;
+	}
+
+	if (dbus_message_iter_get_arg_type(iter) != DBUS_TYPE_ARRAY)
+		return -EINVAL;
+
+	dbus_message_iter_recurse(iter, array);
+
+	return 0;
+}
+
 int connline_dbus_get_array(DBusMessageIter *iter,
 					int dbus_type,
 					int *length,
 					void *destination)
 {
-	DBusMessageIter variant, array;
-	void **value_array = NULL;
-	int iteration;
+	DBusMessageIter array, element;
+	char *value_array = NULL;
+	int nb_elements = 0;
 	int arg_type;
 	size_t size;
+	int i;
 
 	if (length == NULL || destination == NULL)
 		return -EINVAL;
 
+	/* Elements are stored as dbus_message_iter_get_basic() writes them */
 	switch (dbus_type) {
 	case DBUS_TYPE_BOOLEAN:
+		size = sizeof(dbus_bool_t);
+		break;
 	case DBUS_TYPE_INT16:
-	case DBUS_TYPE_INT32:
 	case DBUS_TYPE_UINT16:
+		size = sizeof(dbus_int16_t);
+		break;
+	case DBUS_TYPE_INT32:
 	case DBUS_TYPE_UINT32:
-		size = sizeof(int);
+		size = sizeof(dbus_int32_t);
 		break;
 	case DBUS_TYPE_DOUBLE:
 		size = sizeof(double);
@@ -314,55 +353,104 @@ int connline_dbus_get_array(DBusMessageIter *iter,
 	}
 
 	*length = 0;
-	iteration = 0;
 	*((void **) destination) = NULL;
 
-	arg_type = dbus_message_iter_get_arg_type(iter);
-	if (arg_type == DBUS_TYPE_VARIANT) {
-		dbus_message_iter_recurse(iter, &variant);
-		dbus_message_iter_recurse(&variant, &array);
-	} else
-		dbus_message_iter_recurse(iter, &array);
+	if (recurse_into_array(iter, &array) != 0)
+		return -EINVAL;
 
-	arg_type = dbus_message_iter_get_arg_type(&array);
-	while (arg_type != DBUS_TYPE_INVALID) {
-		void **new_array;
+	/* Counting first, so the array is allocated only once */
+	for (element = array; dbus_message_iter_get_arg_type(&element) !=
+			DBUS_TYPE_INVALID; dbus_message_iter_next(&element))
+		nb_elements++;
 
-		iteration++;
+	if (nb_elements == 0)
+		return 0;
 
-		new_array = realloc(value_array, size * (iteration + 1));
-		if (new_array == NULL)
-			goto error;
+	/* One more zeroed element: arrays of pointers are NULL terminated */
+	value_array = __connline_calloc(CONNLINE_MEMORY_DBUS,
+						nb_elements + 1, size);
+	if (value_array == NULL)
+		return -ENOMEM;
 
-		value_array = new_array;
+	for (i = 0; i < nb_elements; i++, dbus_message_iter_next(&array)) {
+		void *value = value_array + i * size;
 
+		arg_type = dbus_message_iter_get_arg_type(&array);
 		if (arg_type == DBUS_TYPE_VARIANT) {
-			if (connline_dbus_get_basic_variant(&array, dbus_type,
-					&value_array[iteration-1]) != 0)
+			if (connline_dbus_get_basic_variant(&array,
+						dbus_type, value) != 0)
 				goto error;
-		} else
-			dbus_message_iter_get_basic(&array,
-						&value_array[iteration-1]);
+		} else if (arg_type == dbus_type)
+			dbus_message_iter_get_basic(&array, value);
+		else
+			goto error;
+	}
 
-		dbus_message_iter_next(&array);
+	*length = nb_elements;
+	*((void **) destination) = value_array;
 
-		arg_type = dbus_message_iter_get_arg_type(&array);
-	}
+	return 0;
 
-	if (iteration > 0) {
-		value_array[iteration] = NULL;
-		*length = iteration;
+error:
+	__connline_free(value_array);
+
+	return -EINVAL;
+}
+
+int connline_dbus_get_array_view(DBusMessageIter *iter,
+				int dbus_type,
+				struct connline_dbus_array_view *view)
+{
+	if (view == NULL)
+		return -EINVAL;
+
+	switch (dbus_type) {
+	case DBUS_TYPE_STRING:
+	case DBUS_TYPE_OBJECT_PATH:
+	case DBUS_TYPE_SIGNATURE:
+		break;
+	default:
+		return -EINVAL;
 	}
 
-	*((void **) destination) = value_array;
+	if (recurse_into_array(iter, &view->iter) != 0)
+		return -EINVAL;
+
+	view->dbus_type = dbus_type;
 
 	return 0;
+}
 
-error:
-	if (value_array != NULL)
-		free(value_array);
+const char *connline_dbus_array_view_next(struct connline_dbus_array_view *view)
+{
+	const char *value = NULL;
+	int arg_type;
+
+	arg_type = dbus_message_iter_get_arg_type(&view->iter);
+	if (arg_type == DBUS_TYPE_VARIANT) {
+		if (connline_dbus_get_basic_variant(&view->iter,
+					view->dbus_type, &value) != 0)
+			return NULL;
+	} else if (arg_type == view->dbus_type)
+		dbus_message_iter_get_basic(&view->iter, &value);
+	else
+		return NULL;
+
+	dbus_message_iter_next(&view->iter);
 
-	return -ENOMEM;
+	return value;
+}
+
+int connline_dbus_array_view_length(struct connline_dbus_array_view *view)
+{
+	DBusMessageIter element;
+	int length = 0;
+
+	for (element = view->iter; dbus_message_iter_get_arg_type(&element)
+			!= DBUS_TYPE_INVALID; dbus_message_iter_next(&element))
+		length++;
+
+	return length;
 }
 
 int connline_dbus_get_fixed_array(DBusMessageIter *iter,
@@ -403,6 +491,9 @@ static int connline_dbus_get(DBusMessageIter *iter,
 		case CONNLINE_DBUS_ENTRY_FIXED_ARRAY:
 			return connline_dbus_get_fixed_array(iter,
 							length, destination);
+		case CONNLINE_DBUS_ENTRY_ARRAY_VIEW:
+			return connline_dbus_get_array_view(iter,
+						dbus_type, destination);
 		case CONNLINE_DBUS_ENTRY_DICT:
 			if (destination == NULL)
 				return -EINVAL;
@@ -466,7 +557,7 @@ static bool get_dict_entry_cb(DBusMessageIter *iter, void *user_data)
 
 	dbus_message_iter_get_basic(iter, &name);
 
-	if (strncmp(param->key_name, name, strlen(param->key_name)) == 0) {
+	if (strcmp(param->key_name, name) == 0) {
 		dbus_message_iter_next(iter);
 		dbus_message_iter_recurse(iter, &dict_value);
 
@@ -538,18 +629,17 @@ int connline_dbus_get_struct_entry(DBusMessageIter *iter,
 	return -EINVAL;
 }
 
-int connline_dbus_setup_watch(DBusConnection *dbus_cnx,
-					const char *rule,
-					DBusHandleMessageFunction filter,
-					void *user_data)
+/* With a NULL error, the bus is not waited for: failures go unnoticed */
+static int setup_watch(DBusConnection *dbus_cnx, const char *rule,
+				DBusHandleMessageFunction filter,
+				void *user_data, DBusError *error)
 {
-	DBusError error;
-
-	dbus_error_init(&error);
+	if (error != NULL)
+		dbus_error_init(error);
 
-	dbus_bus_add_match(dbus_cnx, rule, &error);
-	if (dbus_error_is_set(&error) == TRUE) {
-		dbus_error_free(&error);
+	dbus_bus_add_match(dbus_cnx, rule, error);
+	if (error != NULL && dbus_error_is_set(error) == TRUE) {
+		dbus_error_free(error);
 		return -ENOMEM;
 	}
 
@@ -559,22 +649,190 @@ int connline_dbus_setup_watch(DBusConnection *dbus_cnx,
 		return -ENOMEM;
 	}
 
+	__connline_stats_add(CONNLINE_STATS_MATCH_RULES, 1);
+
 	return 0;
 }
 
-void connline_dbus_remove_watch(DBusConnection *dbus_cnx,
+static void remove_watch(DBusConnection *dbus_cnx, const char *rule,
+				DBusHandleMessageFunction filter,
+				void *user_data, DBusError *error)
+{
+	if (error != NULL)
+		dbus_error_init(error);
+
+	dbus_bus_remove_match(dbus_cnx, rule, error);
+	if (error != NULL && dbus_error_is_set(error) == TRUE)
+		dbus_error_free(error);
+
+	dbus_connection_remove_filter(dbus_cnx, filter, user_data);
+
+	__connline_stats_add(CONNLINE_STATS_MATCH_RULES, -1);
+}
+
+int connline_dbus_setup_watch(DBusConnection *dbus_cnx,
 					const char *rule,
 					DBusHandleMessageFunction filter,
 					void *user_data)
+{
+	DBusError error;
 
+	return setup_watch(dbus_cnx, rule, filter, user_data, &error);
+}
+
+int connline_dbus_setup_watch_nowait(DBusConnection *dbus_cnx,
+					const char *rule,
+					DBusHandleMessageFunction filter,
+					void *user_data)
+{
+	return setup_watch(dbus_cnx, rule, filter, user_data, NULL);
+}
+
+void connline_dbus_remove_watch(DBusConnection *dbus_cnx,
+					const char *rule,
+					DBusHandleMessageFunction filter,
+					void *user_data)
 {
 	DBusError error;
 
-	dbus_error_init(&error);
+	remove_watch(dbus_cnx, rule, filter, user_data, &error);
+}
 
-	dbus_bus_remove_match(dbus_cnx, rule, &error);
-	if (dbus_error_is_set(&error) == TRUE)
-		dbus_error_free(&error);
+void connline_dbus_remove_watch_nowait(DBusConnection *dbus_cnx,
+					const char *rule,
+					DBusHandleMessageFunction filter,
+					void *user_data)
+{
+	remove_watch(dbus_cnx, rule, filter, user_data, NULL);
+}
 
-	dbus_connection_remove_filter(dbus_cnx, filter, user_data);
+static inline bool is_same_string(const char *str1, const char *str2)
+{
+	if (str1 == str2)
+		return true;
+
+	if (str1 == NULL || str2 == NULL)
+		return false;
+
+	return strcmp(str1, str2) == 0;
+}
+
+static struct method_call_template *lookup_template(const char *destination,
+							const char *path,
+							const char *interface,
+							const char *method)
+{
+	struct method_call_template *template;
+	int i;
+
+	for (i = 0; i < nb_templates; i++) {
+		template = &templates[i];
+
+		if (is_same_string(template->method, method) == true &&
+			is_same_string(template->path, path) == true &&
+			is_same_string(template->interface, interface) == true &&
+			is_same_string(template->destination,
+						destination) == true)
+			return template;
+	}
+
+	return NULL;
+}
+
+static void free_template(struct method_call_template *template)
+{
+	if (template->message != NULL)
+		dbus_message_unref(template->message);
+
+	__connline_free(template->destination);
+	__connline_free(template->path);
+	__connline_free(template->interface);
+	__connline_free(template->method);
+
+	memset(template, 0, sizeof(struct method_call_template));
+}
+
+static void add_template(DBusMessage *message,
+				const char *destination,
+				const char *path,
+				const char *interface,
+				const char *method)
+{
+	struct method_call_template *template;
+
+	if (nb_templates >= METHOD_CALL_TEMPLATES_MAX)
+		return;
+
+	template = &templates[nb_templates];
+
+	if (destination != NULL) {
+		template->destination = __connline_strdup(CONNLINE_MEMORY_DBUS,
+							destination);
+		if (template->destination == NULL)
+			goto error;
+	}
+
+	template->path = __connline_strdup(CONNLINE_MEMORY_DBUS, path);
+	if (template->path == NULL)
+		goto error;
+
+	if (interface != NULL) {
+		template->interface = __connline_strdup(CONNLINE_MEMORY_DBUS,
+							interface);
+		if (template->interface == NULL)
+			goto error;
+	}
+
+	template->method = __connline_strdup(CONNLINE_MEMORY_DBUS, method);
+	if (template->method == NULL)
+		goto error;
+
+	template->message = dbus_message_copy(message);
+	if (template->message == NULL)
+		goto error;
+
+	nb_templates++;
+
+	return;
+
+error:
+	free_template(template);
+}
+
+DBusMessage *connline_dbus_new_method_call(const char *destination,
+						const char *path,
+						const char *interface,
+						const char *method)
+{
+	struct method_call_template *template;
+	DBusMessage *message;
+
+	if (path == NULL || method == NULL)
+		return NULL;
+
+	/* The message itself is libdbus' own */
+	__connline_stats_add(CONNLINE_STATS_ALLOCATIONS, 1);
+
+	template = lookup_template(destination, path, interface, method);
+	if (template == NULL) {
+		message = dbus_message_new_method_call(destination,
+						path, interface, method);
+		if (message != NULL)
+			add_template(message, destination,
+						path, interface, method);
+
+		return message;
+	}
+
+	return dbus_message_copy(template->message);
+}
+
+void connline_dbus_cleanup_method_calls(void)
+{
+	int i;
+
+	for (i = 0; i < nb_templates; i++)
+		free_template(&templates[i]);
+
+	nb_templates = 0;
 }
@@ -20,9 +20,18 @@
 
 #include <connline/event.h>
 #include <connline/private.h>
+#include <connline/stats.h>
+#include <connline/utils.h>
+
+#define CONNLINE_DISPATCH_MESSAGES 64
+#define CONNLINE_DISPATCH_TIME 2000
 
 static struct connline_event_loop_plugin *event_loop = NULL;
 
+/* 0 means no limit */
+static unsigned int dispatch_messages = CONNLINE_DISPATCH_MESSAGES;
+static unsigned int dispatch_time = CONNLINE_DISPATCH_TIME;
+
 int __connline_setup_event_loop(enum connline_event_loop event_loop_type)
 {
 	if (event_loop_type == CONNLINE_EVENT_LOOP_UNKNOWN)
@@ -35,32 +44,605 @@ int __connline_setup_event_loop(enum connline_event_loop event_loop_type)
 	return 0;
 }
 
-DBusConnection *__connline_setup_dbus_event_loop(void *data)
+/* With no dbus_cnx, only the callbacks are set up on the event loop */
+int __connline_setup_dbus_event_loop(DBusConnection *dbus_cnx, void *data)
 {
 	if (event_loop == NULL)
-		return NULL;
+		return -EINVAL;
+
+	return event_loop->setup_event_loop(dbus_cnx, data);
+}
+
+struct connline_trigger {
+	struct connline_trigger *next;
+
+	enum connline_event event;
+	char **changed_property;
+
+	unsigned long sequence;
+	unsigned long queued_at;
+};
+
+/*
+ * Contexts with pending triggers, as a binary heap shared by all event
+ * loops: the plugin only schedules one dispatch at a time.  Contexts are
+ * ordered by their most urgent pending event,  foreground ones first,
+ * then by their oldest trigger.  A context's triggers stay in order:  a
+ * disconnection queued after a property makes that property go first.
+ */
+static struct connline_context **trigger_queue = NULL;
+static unsigned int queue_length = 0;
+static unsigned int queue_size = 0;
+
+static unsigned long trigger_sequence = 0;
+static unsigned int pending_triggers = 0;
+
+static struct connline_context dispatcher;
+static bool dispatch_scheduled = false;
+
+/* Events of contexts without a callback, kept until delivered at once */
+static connline_batch_callback_f batch_callback = NULL;
+static void *batch_data = NULL;
+
+/* Where the batch goes: a group's callback, or else the global one */
+static connline_batch_callback_f batch_group_callback = NULL;
+static void *batch_group_data = NULL;
+
+static struct connline_event_record *batch = NULL;
+static struct connline_trigger **batch_triggers = NULL;
+static unsigned int batch_length = 0;
+static unsigned int batch_size = 0;
+
+static unsigned int get_rank(enum connline_event event)
+{
+	switch (event) {
+	case CONNLINE_EVENT_ERROR:
+	case CONNLINE_EVENT_NO_BACKEND:
+	case CONNLINE_EVENT_DISCONNECTED:
+	case CONNLINE_EVENT_TIMEOUT:
+		return 0;
+	case CONNLINE_EVENT_CONNECTED:
+		return 1;
+	case CONNLINE_EVENT_PROPERTY:
+		break;
+	}
+
+	return CONNLINE_TRIGGER_RANKS - 1;
+}
+
+static unsigned int get_class(struct connline_context *context)
+{
+	unsigned int rank;
+
+	for (rank = 0; rank < CONNLINE_TRIGGER_RANKS - 1; rank++) {
+		if (context->ranked_triggers[rank] > 0)
+			break;
+	}
+
+	return rank * 2 + (context->background_connection == true ? 1 : 0);
+}
+
+static bool goes_before(struct connline_context *context,
+					struct connline_context *other)
+{
+	unsigned int class, other_class;
+
+	class = get_class(context);
+	other_class = get_class(other);
+
+	if (class != other_class)
+		return class < other_class;
+
+	return context->triggers->sequence < other->triggers->sequence;
+}
+
+static inline void place(unsigned int slot, struct connline_context *context)
+{
+	trigger_queue[slot] = context;
+	context->trigger_slot = slot + 1;
+}
+
+static void sift_up(unsigned int slot)
+{
+	struct connline_context *context = trigger_queue[slot];
+	unsigned int parent;
+
+	while (slot > 0) {
+		parent = (slot - 1) / 2;
+		if (goes_before(context, trigger_queue[parent]) == false)
+			break;
+
+		place(slot, trigger_queue[parent]);
+		slot = parent;
+	}
+
+	place(slot, context);
+}
+
+static void sift_down(unsigned int slot)
+{
+	struct connline_context *context = trigger_queue[slot];
+	unsigned int child;
+
+	for (;;) {
+		child = slot * 2 + 1;
+		if (child >= queue_length)
+			break;
+
+		if (child + 1 < queue_length && goes_before(
+				trigger_queue[child + 1], trigger_queue[child]))
+			child++;
+
+		if (goes_before(trigger_queue[child], context) == false)
+			break;
+
+		place(slot, trigger_queue[child]);
+		slot = child;
+	}
+
+	place(slot, context);
+}
+
+/* Its new trigger can only make it more urgent */
+static int queue_context(struct connline_context *context)
+{
+	struct connline_context **new_queue;
+	unsigned int new_size;
+
+	if (context->trigger_slot != 0) {
+		sift_up(context->trigger_slot - 1);
+		return 0;
+	}
 
-	return event_loop->setup_event_loop(data);
+	if (queue_length == queue_size) {
+		new_size = queue_size == 0 ? 16 : queue_size * 2;
+
+		new_queue = __connline_realloc(CONNLINE_MEMORY_EVENT,
+				trigger_queue, new_size * sizeof(*new_queue));
+		if (new_queue == NULL)
+			return -ENOMEM;
+
+		trigger_queue = new_queue;
+		queue_size = new_size;
+	}
+
+	queue_length++;
+	place(queue_length - 1, context);
+	sift_up(queue_length - 1);
+
+	return 0;
+}
+
+static void unqueue_context(struct connline_context *context)
+{
+	struct connline_context *last;
+	unsigned int slot;
+
+	slot = context->trigger_slot - 1;
+	context->trigger_slot = 0;
+
+	queue_length--;
+	if (slot == queue_length)
+		return;
+
+	last = trigger_queue[queue_length];
+
+	place(slot, last);
+	sift_up(slot);
+	sift_down(last->trigger_slot - 1);
 }
 
+static struct connline_trigger *pop_trigger(struct connline_context *context)
+{
+	struct connline_trigger *trigger = context->triggers;
+
+	context->triggers = trigger->next;
+	if (context->triggers == NULL)
+		context->last_trigger = NULL;
+
+	context->ranked_triggers[get_rank(trigger->event)]--;
+	context->pending_triggers--;
+	pending_triggers--;
+
+	return trigger;
+}
+
+static void free_trigger(struct connline_trigger *trigger)
+{
+	property_list_free(trigger->changed_property);
+	__connline_free(trigger);
+}
+
+/* Tells whether the trigger is still to be delivered */
+static bool run_trigger(struct connline_context *context,
+					struct connline_trigger *trigger)
+{
+	enum connline_event event = trigger->event;
+
+	CONNLINE_TRACE2(trigger_run, context, event);
+
+	__connline_stats_record(CONNLINE_STATS_CALLBACK_DELAY,
+							trigger->queued_at);
+
+	if (context->got_event == false) {
+		context->got_event = true;
+
+		__connline_stats_record(CONNLINE_STATS_FIRST_EVENT_LATENCY,
+							context->opened_at);
+	}
+
+	switch (event) {
+	case CONNLINE_EVENT_ERROR:
+	case CONNLINE_EVENT_NO_BACKEND:
+		context->state = CONNLINE_CONTEXT_INVALID;
+		break;
+	case CONNLINE_EVENT_DISCONNECTED:
+		context->state = CONNLINE_CONTEXT_DISCONNECTED;
+		break;
+	case CONNLINE_EVENT_CONNECTED:
+		context->state = CONNLINE_CONTEXT_CONNECTED;
+		break;
+	case CONNLINE_EVENT_PROPERTY:
+	case CONNLINE_EVENT_TIMEOUT:
+		break;
+	}
+
+	/* The mask changed since it got queued, or another thread closed it */
+	if (__connline_wants_event(context, event) == false ||
+			__atomic_load_n(&context->closing, __ATOMIC_RELAXED))
+		return false;
+
+	return true;
+}
+
+static void deliver_batch(void)
+{
+	unsigned int i;
+
+	if (batch_length == 0)
+		return;
+
+	/* The global one may have been unset in the meantime */
+	if (batch_group_callback != NULL)
+		batch_group_callback(batch, batch_length, batch_group_data);
+	else if (batch_callback != NULL)
+		batch_callback(batch, batch_length, batch_data);
+
+	for (i = 0; i < batch_length; i++)
+		free_trigger(batch_triggers[i]);
+
+	batch_length = 0;
+}
+
+static int grow_batch(void)
+{
+	struct connline_trigger **new_triggers;
+	struct connline_event_record *new_batch;
+	unsigned int new_size;
+
+	new_size = batch_size == 0 ? 16 : batch_size * 2;
+
+	new_batch = __connline_realloc(CONNLINE_MEMORY_EVENT, batch,
+					new_size * sizeof(*new_batch));
+	if (new_batch == NULL)
+		return -ENOMEM;
+
+	batch = new_batch;
+
+	new_triggers = __connline_realloc(CONNLINE_MEMORY_EVENT,
+					batch_triggers,
+					new_size * sizeof(*new_triggers));
+	if (new_triggers == NULL)
+		return -ENOMEM;
+
+	batch_triggers = new_triggers;
+	batch_size = new_size;
+
+	return 0;
+}
+
+/* The trigger is freed once the batch got delivered */
+static void batch_trigger(struct connline_context *context,
+					struct connline_trigger *trigger)
+{
+	connline_batch_callback_f group_callback = NULL;
+	struct connline_event_record *record;
+	void *group_data = NULL;
+
+	if (context->group != NULL) {
+		group_callback = context->group->batch_callback;
+		group_data = context->group->batch_data;
+	}
+
+	/* A batch goes to one callback only */
+	if (group_callback != batch_group_callback ||
+				group_data != batch_group_data) {
+		deliver_batch();
+
+		batch_group_callback = group_callback;
+		batch_group_data = group_data;
+	}
+
+	if (batch_length == batch_size && grow_batch() < 0) {
+		deliver_batch();
+
+		if (batch_size == 0) {
+			__connline_stats_add(CONNLINE_STATS_TRIGGERS_DROPPED, 1);
+			free_trigger(trigger);
+			return;
+		}
+	}
+
+	record = &batch[batch_length];
+	record->context = context;
+	record->event = trigger->event;
+	record->properties = (const char **) trigger->changed_property;
+	record->user_data = context->user_data;
+
+	batch_triggers[batch_length] = trigger;
+	batch_length++;
+}
+
+static void run_callback(struct connline_context *context,
+					struct connline_trigger *trigger)
+{
+	if (run_trigger(context, trigger) == false) {
+		free_trigger(trigger);
+		return;
+	}
+
+	if (context->event_callback == NULL) {
+		batch_trigger(context, trigger);
+		return;
+	}
+
+	/* Batched events came first */
+	deliver_batch();
+
+	context->event_callback(context, trigger->event,
+			(const char **) trigger->changed_property,
+			context->user_data);
+
+	free_trigger(trigger);
+
+	__connline_complete_groups();
+}
+
+static int schedule_dispatch(void);
+
+/*
+ * Triggers queued by the callbacks wait for the next dispatch,  so that
+ * the event loop gets back control in between.  What one daemon update
+ * brought is queued by the time the dispatch runs:  a batch delivers it.
+ */
+static void dispatch_triggers(struct connline_context *unused,
+					enum connline_event event,
+					const char **changed_property,
+					void *user_data)
+{
+	struct connline_context *context;
+	struct connline_trigger *trigger;
+	unsigned int budget;
+
+	budget = pending_triggers;
+
+	while (budget > 0 && queue_length > 0) {
+		context = trigger_queue[0];
+		trigger = pop_trigger(context);
+
+		if (context->triggers == NULL)
+			unqueue_context(context);
+		else
+			sift_down(0);
+
+		/* The callback may close the context */
+		run_callback(context, trigger);
+
+		budget--;
+	}
+
+	deliver_batch();
+	__connline_complete_groups();
+
+	dispatch_scheduled = false;
+
+	if (queue_length > 0 && schedule_dispatch() < 0)
+		DBG("cannot schedule pending triggers");
+}
+
+static int schedule_dispatch(void)
+{
+	int ret;
+
+	if (dispatch_scheduled == true)
+		return 0;
+
+	ret = event_loop->trigger_callback(&dispatcher, dispatch_triggers,
+						CONNLINE_EVENT_PROPERTY, NULL);
+	if (ret < 0)
+		return ret;
+
+	dispatch_scheduled = true;
+
+	return 0;
+}
+
+/* With nothing else to deliver, when the first events were masked */
+int __connline_schedule_completions(void)
+{
+	if (event_loop == NULL)
+		return -EINVAL;
+
+	return schedule_dispatch();
+}
+
+/* Callbacks run are always the context's one */
 int __connline_trigger_callback(struct connline_context *context,
 					connline_callback_f callback,
 					enum connline_event event,
 					char **changed_property)
 {
-	if (event_loop == NULL)
+	struct connline_trigger *trigger;
+	int ret;
+
+	if (event_loop == NULL) {
+		property_list_free(changed_property);
 		return -EINVAL;
+	}
+
+	/* Masked or not, these are connectivity changes to the probe */
+	if (event == CONNLINE_EVENT_CONNECTED) {
+		if (context->is_online == true)
+			__connline_probe_connected();
+	} else if (event != CONNLINE_EVENT_PROPERTY)
+		__connline_probe_changed();
+
+	__connline_publish_state(context);
+
+	if (__connline_wants_event(context, event) == false) {
+		property_list_free(changed_property);
+		return 0;
+	}
 
-	return event_loop->trigger_callback(context,
-					callback, event, changed_property);
+	trigger = __connline_calloc(CONNLINE_MEMORY_EVENT,
+					1, sizeof(struct connline_trigger));
+	if (trigger == NULL) {
+		ret = -ENOMEM;
+		goto dropped;
+	}
+
+	trigger->event = event;
+	trigger->changed_property = changed_property;
+	trigger->sequence = trigger_sequence++;
+	trigger->queued_at = __connline_stats_now();
+
+	ret = schedule_dispatch();
+	if (ret < 0)
+		goto dropped;
+
+	if (context->triggers == NULL)
+		context->triggers = trigger;
+	else
+		context->last_trigger->next = trigger;
+
+	context->last_trigger = trigger;
+	context->ranked_triggers[get_rank(event)]++;
+	context->pending_triggers++;
+	pending_triggers++;
+
+	ret = queue_context(context);
+	if (ret < 0) {
+		/* Not queued yet, this is its only trigger */
+		pop_trigger(context);
+		goto dropped;
+	}
+
+	CONNLINE_TRACE2(trigger_queue, context, event);
+
+	__connline_stats_add(CONNLINE_STATS_TRIGGERS_QUEUED, 1);
+
+	return 0;
+
+dropped:
+	if (trigger != NULL)
+		__connline_free(trigger);
+
+	property_list_free(changed_property);
+
+	__connline_stats_add(CONNLINE_STATS_TRIGGERS_DROPPED, 1);
+
+	return ret;
+}
+
+bool __connline_has_batch_callback(void)
+{
+	return batch_callback != NULL;
+}
+
+int connline_set_batch_callback(connline_batch_callback_f callback,
+							void *user_data)
+{
+	batch_callback = callback;
+	batch_data = user_data;
+
+	return 0;
 }
 
 void __connline_trigger_cleanup(struct connline_context *context)
+{
+	if (context->pending_triggers > 0)
+		__connline_stats_add(CONNLINE_STATS_TRIGGERS_DROPPED,
+					context->pending_triggers);
+
+	if (context->trigger_slot != 0)
+		unqueue_context(context);
+
+	while (context->triggers != NULL)
+		free_trigger(pop_trigger(context));
+}
+
+int __connline_watch_fd(void *data, int fd,
+			__connline_fd_callback_f callback, void *user_data)
 {
 	if (event_loop == NULL)
+		return -EINVAL;
+
+	if (event_loop->watch_fd == NULL || event_loop->unwatch_fd == NULL)
+		return -ENOTSUP;
+
+	return event_loop->watch_fd(data, fd, callback, user_data);
+}
+
+void __connline_unwatch_fd(int fd)
+{
+	if (event_loop == NULL || event_loop->unwatch_fd == NULL)
 		return;
 
-	event_loop->trigger_cleanup(context);
+	event_loop->unwatch_fd(fd);
+}
+
+int connline_set_dispatch_budget(unsigned int messages, unsigned int usec)
+{
+	dispatch_messages = messages;
+	dispatch_time = usec;
+
+	return 0;
+}
+
+bool __connline_dispatch_dbus(DBusConnection *dbus_cnx)
+{
+	DBusDispatchStatus status;
+	unsigned int dispatched = 0;
+	unsigned long start = 0;
+
+	status = dbus_connection_get_dispatch_status(dbus_cnx);
+	if (status != DBUS_DISPATCH_DATA_REMAINS)
+		return false;
+
+	if (dispatch_time > 0)
+		start = __connline_stats_now();
+
+	/* Each dispatch handles exactly one message */
+	while (status == DBUS_DISPATCH_DATA_REMAINS) {
+		status = dbus_connection_dispatch(dbus_cnx);
+		dispatched++;
+
+		if (dispatch_messages > 0 && dispatched >= dispatch_messages)
+			break;
+
+		if (dispatch_time > 0 &&
+				__connline_stats_now() - start >= dispatch_time)
+			break;
+	}
+
+	__connline_stats_add(CONNLINE_STATS_DBUS_DISPATCHED, dispatched);
+
+	if (status != DBUS_DISPATCH_DATA_REMAINS)
+		return false;
+
+	__connline_stats_add(CONNLINE_STATS_DISPATCH_YIELDS, 1);
+
+	return true;
 }
 
 void __connline_cleanup_event_loop(DBusConnection *dbus_cnx)
@@ -68,6 +650,21 @@ void __connline_cleanup_event_loop(DBusConnection *dbus_cnx)
 	if (event_loop == NULL)
 		return;
 
+	event_loop->trigger_cleanup(&dispatcher);
+	dispatch_scheduled = false;
+
+	__connline_free(trigger_queue);
+	trigger_queue = NULL;
+	queue_length = queue_size = 0;
+
+	__connline_free(batch);
+	__connline_free(batch_triggers);
+	batch = NULL;
+	batch_triggers = NULL;
+	batch_length = batch_size = 0;
+	batch_group_callback = NULL;
+	batch_group_data = NULL;
+
 	event_loop->cleanup_event_loop(dbus_cnx);
 
 	__connline_cleanup_event_plugin(event_loop);
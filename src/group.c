@@ -0,0 +1,141 @@
+/*
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License version 2.1,
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <connline/event.h>
+#include <connline/private.h>
+#include <connline/utils.h>
+
+#include <stdint.h>
+
+/* Groups whose last context got its first event */
+static struct connline_group *completed_groups = NULL;
+
+struct connline_group *__connline_group_new(unsigned int nb_contexts,
+					connline_completion_f completion,
+					void *completion_data)
+{
+	struct connline_group *group;
+	unsigned int i;
+
+	if (nb_contexts > (SIZE_MAX - sizeof(struct connline_group)) /
+					sizeof(struct connline_context))
+		return NULL;
+
+	group = __connline_calloc(CONNLINE_MEMORY_CONTEXT, 1,
+				sizeof(struct connline_group) +
+				nb_contexts * sizeof(struct connline_context));
+	if (group == NULL)
+		return NULL;
+
+	group->completion = completion;
+	group->completion_data = completion_data;
+	group->members = nb_contexts;
+	group->waiting = nb_contexts;
+	group->nb_contexts = nb_contexts;
+
+	for (i = 0; i < nb_contexts; i++) {
+		group->contexts[i].group = group;
+		group->contexts[i].pipelined = true;
+	}
+
+	return group;
+}
+
+/*
+ * Noted as the event is triggered,  as masked events and members without
+ * a callback never get to the queue.  The completion runs at the end of
+ * the dispatch delivering the events that were queued.
+ */
+void __connline_group_event(struct connline_context *context)
+{
+	struct connline_group *group = context->group;
+
+	if (group == NULL || context->group_noted == true)
+		return;
+
+	context->group_noted = true;
+
+	group->waiting--;
+	if (group->waiting > 0 || group->completion == NULL)
+		return;
+
+	group->completing = true;
+	group->next = completed_groups;
+	completed_groups = group;
+
+	if (__connline_schedule_completions() < 0)
+		DBG("cannot schedule the completion of group %p", group);
+}
+
+/* Once the events that completed them got delivered */
+void __connline_complete_groups(void)
+{
+	connline_completion_f completion;
+	struct connline_group *group;
+
+	while (completed_groups != NULL) {
+		group = completed_groups;
+		completed_groups = group->next;
+
+		group->completing = false;
+
+		completion = group->completion;
+		group->completion = NULL;
+
+		/* It may close the contexts, thus free the group */
+		completion(group->completion_data);
+	}
+}
+
+static void unlink_completed(struct connline_group *group)
+{
+	struct connline_group **position;
+
+	for (position = &completed_groups; *position != NULL;
+					position = &(*position)->next) {
+		if (*position == group) {
+			*position = group->next;
+			break;
+		}
+	}
+}
+
+/* The group is freed along its last context */
+void __connline_group_release(struct connline_context *context)
+{
+	struct connline_group *group = context->group;
+
+	if (group == NULL) {
+		__connline_free(context);
+		return;
+	}
+
+	if (context->group_noted == false)
+		group->completion = NULL;
+
+	group->members--;
+	if (group->members > 0)
+		return;
+
+	if (group->completing == true)
+		unlink_completed(group);
+
+	__connline_free(group);
+}
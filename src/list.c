@@ -29,13 +29,17 @@ struct _dlist {
 
 static inline dlist *dlist_new(void)
 {
-	return calloc(1, sizeof(dlist));
+	return __connline_calloc(CONNLINE_MEMORY_LIST, 1, sizeof(dlist));
 }
 
 void dlist_free_all(dlist *list)
 {
-	for(; list != NULL; list = list->next)
+	dlist *next;
+
+	for (; list != NULL; list = next) {
+		next = list->next;
 		dlist_free(list);
+	}
 }
 
 dlist *dlist_prepend(dlist *list, void *data)
@@ -98,9 +102,14 @@ dlist *dlist_remove(dlist *list, void *data)
 
 void dlist_foreach(dlist *list, dlist_data_cb_f callback)
 {
+	dlist *next;
+
 	if (callback == NULL)
 		return;
 
-	for (; list != NULL; list = list->next)
+	/* callback is allowed to remove its own data from the list */
+	for (; list != NULL; list = next) {
+		next = list->next;
 		callback(list->data);
+	}
 }
@@ -18,6 +18,7 @@
  *
  */
 
+#include <connline/alloc.h>
 #include <connline/connline.h>
 #include <connline/private.h>
 
@@ -41,6 +42,9 @@ static int populate_event_plugin(void *handle,
 					"connline_plugin_trigger_cleanup");
 	event_plugin->cleanup_event_loop = dlsym(handle,
 					"connline_plugin_cleanup_event_loop");
+	event_plugin->watch_fd = dlsym(handle, "connline_plugin_watch_fd");
+	event_plugin->unwatch_fd = dlsym(handle,
+					"connline_plugin_unwatch_fd");
 
 	if (event_plugin->setup_event_loop == NULL ||
 				event_plugin->trigger_callback == NULL ||
@@ -58,12 +62,17 @@ static int populate_backend_plugin(void *handle,
 
 	backend->setup = dlsym(handle, "connline_plugin_setup_backend");
 	pointer = dlsym(handle, "connline_backend_watch_rule");
-	backend->watch_rule = *pointer;
+	if (pointer != NULL)
+		backend->watch_rule = *pointer;
 	pointer = dlsym(handle, "connline_backend_service_name");
-	backend->service_name = *pointer;
+	if (pointer != NULL)
+		backend->service_name = *pointer;
 
-	if (backend->setup == NULL || backend->watch_rule == NULL ||
-						backend->service_name == NULL)
+	if (backend->setup == NULL)
+		return -1;
+
+	/* A daemonless backend has neither */
+	if ((backend->watch_rule == NULL) != (backend->service_name == NULL))
 		return -1;
 
 	return 0;
@@ -108,22 +117,23 @@ static int connline_load_plugin(enum connline_event_loop event_loop_type,
 		if (event_loop_type != CONNLINE_EVENT_LOOP_UNKNOWN) {
 			unsigned int *plugin_event_loop;
 
-			*event_plugin = calloc(
-				sizeof(struct connline_event_loop_plugin), 1);
-			if (*event_plugin == NULL) {
-				ret = -ENOMEM;
-				goto loop_or_error;
-			}
-
 			plugin_event_loop = dlsym(handle,
 					"connline_plugin_event_loop_type");
 			if (plugin_event_loop == NULL ||
 					*plugin_event_loop != event_loop_type)
 				goto loop_or_error;
 
+			*event_plugin = __connline_calloc(
+				CONNLINE_MEMORY_PLUGIN, 1,
+				sizeof(struct connline_event_loop_plugin));
+			if (*event_plugin == NULL) {
+				ret = -ENOMEM;
+				goto loop_or_error;
+			}
+
 			if (populate_event_plugin(handle,
 							*event_plugin) != 0) {
-				free(*event_plugin);
+				__connline_free(*event_plugin);
 				goto loop_or_error;
 			}
 
@@ -134,8 +144,9 @@ static int connline_load_plugin(enum connline_event_loop event_loop_type,
 		} else {
 			struct connline_backend_plugin *backend_plugin;
 
-			backend_plugin = calloc(
-				sizeof(struct connline_backend_plugin), 1);
+			backend_plugin = __connline_calloc(
+				CONNLINE_MEMORY_PLUGIN, 1,
+				sizeof(struct connline_backend_plugin));
 			if (backend_plugin == NULL) {
 				ret = -ENOMEM;
 				goto loop_or_error;
@@ -143,14 +154,14 @@ static int connline_load_plugin(enum connline_event_loop event_loop_type,
 
 			if (populate_backend_plugin(handle,
 							backend_plugin) != 0) {
-				free(backend_plugin);
+				__connline_free(backend_plugin);
 				goto loop_or_error;
 			}
 
 			backend_plugin->handle = handle;
 			ret = __connline_backend_add(backend_plugin);
 			if (ret < 0) {
-				free(backend_plugin);
+				__connline_free(backend_plugin);
 				goto loop_or_error;
 			}
 
@@ -192,11 +203,11 @@ int __connline_load_backend_plugins(void)
 void __connline_cleanup_event_plugin(struct connline_event_loop_plugin *event_plugin)
 {
 	dlclose(event_plugin->handle);
-	free(event_plugin);
+	__connline_free(event_plugin);
 }
 
 void __connline_cleanup_backend_plugin(struct connline_backend_plugin *backend_plugin)
 {
 	dlclose(backend_plugin->handle);
-	free(backend_plugin);
+	__connline_free(backend_plugin);
 }
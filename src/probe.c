@@ -0,0 +1,644 @@
+/*
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License version 2.1,
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <connline/backend.h>
+#include <connline/event.h>
+#include <connline/private.h>
+#include <connline/stats.h>
+#include <connline/utils.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <time.h>
+
+/* A probe not answered within this is a failed one, in milliseconds */
+#define PROBE_TIMEOUT 5000
+
+#define PROBE_HOST_SIZE 256
+#define PROBE_PATH_SIZE 256
+
+extern struct connline_backend_methods *connection_backend;
+
+struct probe_config {
+	char host[PROBE_HOST_SIZE];
+	char port[8];
+	char path[PROBE_PATH_SIZE];
+	unsigned int status;
+};
+
+/*
+ * A host name resolution, which the probe thread gives up on at its
+ * deadline or at cleanup.  One still running then is left to the resolver,
+ * and freed when it completes: hence plain malloc(), as it may outlive
+ * connline and its allocator.
+ */
+struct probe_lookup {
+	struct gaicb request;
+	struct addrinfo hints;
+	char host[PROBE_HOST_SIZE];
+	char port[8];
+	bool done;
+	bool abandoned;
+};
+
+enum probe_result {
+	PROBE_UNKNOWN = 0,
+	PROBE_ONLINE  = 1,
+	PROBE_OFFLINE = 2,
+};
+
+/*
+ * The loop thread asks for probes,  which the probe thread runs one at a
+ * time, at least interval apart, and writes their result to the socket
+ * pair the loop thread watches.  Only what is under probe_lock is shared.
+ */
+static pthread_mutex_t probe_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t probe_cond;
+static struct probe_config config;
+static bool configured = false;
+static unsigned long interval = CONNLINE_PROBE_INTERVAL * 1000000UL;
+static bool requested = false;
+static bool stopping = false;
+static unsigned long last_start = 0;
+static int probe_socket = -1;
+
+static pthread_t probe_thread;
+static bool thread_started = false;
+
+/* Loop thread only */
+static void *probe_data = NULL;
+static int result_pipe[2] = { -1, -1 };
+static enum probe_result result = PROBE_UNKNOWN;
+static bool running = false;
+/* A probe was asked for while one ran: its result is outdated */
+static bool again = false;
+/* Contexts got disconnected since the result was known */
+static bool changed = false;
+
+static int parse_url(const char *url, struct probe_config *parsed)
+{
+	const char *host, *end, *path;
+	unsigned long port = 80;
+	size_t length;
+	char *port_end;
+
+	if (strncmp(url, "http://", 7) != 0)
+		return -EINVAL;
+
+	host = url + 7;
+
+	/* An IPv6 address comes within brackets */
+	if (*host == '[') {
+		host++;
+		end = strchr(host, ']');
+		if (end == NULL)
+			return -EINVAL;
+
+		length = end - host;
+		end++;
+	} else {
+		length = strcspn(host, ":/");
+		end = host + length;
+	}
+
+	if (length == 0 || length >= PROBE_HOST_SIZE)
+		return -EINVAL;
+
+	if (*end == ':') {
+		port = strtoul(end + 1, &port_end, 10);
+		if (port == 0 || port > 65535 || port_end == end + 1)
+			return -EINVAL;
+
+		end = port_end;
+	}
+
+	if (*end != '/' && *end != '\0')
+		return -EINVAL;
+
+	path = *end == '\0' ? "/" : end;
+	if (strlen(path) >= PROBE_PATH_SIZE || strpbrk(path, " \r\n") != NULL)
+		return -EINVAL;
+
+	memcpy(parsed->host, host, length);
+	parsed->host[length] = '\0';
+	snprintf(parsed->port, sizeof(parsed->port), "%lu", port);
+	strcpy(parsed->path, path);
+
+	return 0;
+}
+
+/* Waits for events on fd until deadline, given by __connline_stats_now() */
+static bool wait_socket(int fd, short events, unsigned long deadline)
+{
+	struct pollfd pfd = { .fd = fd, .events = events };
+	unsigned long now;
+	int ret;
+
+	do {
+		now = __connline_stats_now();
+		if (now >= deadline)
+			return false;
+
+		ret = poll(&pfd, 1, (deadline - now + 999) / 1000);
+	} while (ret < 0 && errno == EINTR);
+
+	return ret > 0 && (pfd.revents & events) != 0;
+}
+
+static void set_probe_socket(int fd)
+{
+	pthread_mutex_lock(&probe_lock);
+
+	probe_socket = fd;
+
+	/* Cleanup may have shut the former one down just before */
+	if (fd >= 0 && stopping == true)
+		shutdown(fd, SHUT_RDWR);
+
+	pthread_mutex_unlock(&probe_lock);
+}
+
+static int connect_probe(struct addrinfo *address, unsigned long deadline)
+{
+	socklen_t length = sizeof(int);
+	int fd, error = 0;
+
+	fd = socket(address->ai_family, address->ai_socktype |
+				SOCK_NONBLOCK | SOCK_CLOEXEC,
+				address->ai_protocol);
+	if (fd < 0)
+		return -1;
+
+	set_probe_socket(fd);
+
+	if (connect(fd, address->ai_addr, address->ai_addrlen) < 0 &&
+							errno != EINPROGRESS)
+		goto error;
+
+	if (wait_socket(fd, POLLOUT, deadline) == false)
+		goto error;
+
+	if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 ||
+								error != 0)
+		goto error;
+
+	return fd;
+
+error:
+	set_probe_socket(-1);
+	close(fd);
+
+	return -1;
+}
+
+/* Only the status line of the answer matters */
+static bool request_status(int fd, const struct probe_config *probe,
+						unsigned long deadline)
+{
+	char request[PROBE_HOST_SIZE + PROBE_PATH_SIZE + 128];
+	unsigned int major, minor, status;
+	size_t length, sent = 0;
+	char answer[128];
+	ssize_t ret;
+
+	length = snprintf(request, sizeof(request),
+			"GET %s HTTP/1.1\r\nHost: %s\r\n"
+			"User-Agent: connline\r\nConnection: close\r\n\r\n",
+			probe->path, probe->host);
+
+	while (sent < length) {
+		if (wait_socket(fd, POLLOUT, deadline) == false)
+			return false;
+
+		ret = send(fd, request + sent, length - sent, MSG_NOSIGNAL);
+		if (ret < 0 && errno != EAGAIN && errno != EINTR)
+			return false;
+
+		if (ret > 0)
+			sent += ret;
+	}
+
+	length = 0;
+
+	while (memchr(answer, '\n', length) == NULL &&
+					length < sizeof(answer) - 1) {
+		if (wait_socket(fd, POLLIN, deadline) == false)
+			return false;
+
+		ret = recv(fd, answer + length, sizeof(answer) - 1 - length, 0);
+		if (ret == 0 || (ret < 0 && errno != EAGAIN && errno != EINTR))
+			break;
+
+		if (ret > 0)
+			length += ret;
+	}
+
+	answer[length] = '\0';
+
+	if (sscanf(answer, "HTTP/%u.%u %3u", &major, &minor, &status) != 3)
+		return false;
+
+	if (probe->status == 0)
+		return status >= 200 && status < 300;
+
+	return status == probe->status;
+}
+
+static void wait_until(unsigned long time);
+
+static void free_lookup(struct probe_lookup *lookup)
+{
+	if (lookup->request.ar_result != NULL)
+		freeaddrinfo(lookup->request.ar_result);
+
+	free(lookup);
+}
+
+/* Run by the resolver on a thread of its own */
+static void lookup_done(union sigval value)
+{
+	struct probe_lookup *lookup = value.sival_ptr;
+	bool abandoned;
+
+	pthread_mutex_lock(&probe_lock);
+
+	abandoned = lookup->abandoned;
+	lookup->done = true;
+
+	if (abandoned == false)
+		pthread_cond_signal(&probe_cond);
+
+	pthread_mutex_unlock(&probe_lock);
+
+	if (abandoned == true)
+		free_lookup(lookup);
+}
+
+/* As getaddrinfo(), but no longer than deadline, nor past cleanup */
+static struct addrinfo *resolve(const struct probe_config *probe,
+						unsigned long deadline)
+{
+	struct addrinfo *addresses = NULL;
+	struct probe_lookup *lookup;
+	struct gaicb *requests[1];
+	struct sigevent event;
+	bool done;
+
+	lookup = calloc(1, sizeof(struct probe_lookup));
+	if (lookup == NULL)
+		return NULL;
+
+	memcpy(lookup->host, probe->host, sizeof(lookup->host));
+	memcpy(lookup->port, probe->port, sizeof(lookup->port));
+
+	lookup->hints.ai_socktype = SOCK_STREAM;
+	lookup->hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG;
+
+	lookup->request.ar_name = lookup->host;
+	lookup->request.ar_service = lookup->port;
+	lookup->request.ar_request = &lookup->hints;
+	requests[0] = &lookup->request;
+
+	memset(&event, 0, sizeof(event));
+	event.sigev_notify = SIGEV_THREAD;
+	event.sigev_notify_function = lookup_done;
+	event.sigev_value.sival_ptr = lookup;
+
+	if (getaddrinfo_a(GAI_NOWAIT, requests, 1, &event) != 0) {
+		free(lookup);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&probe_lock);
+
+	while (lookup->done == false && stopping == false &&
+				__connline_stats_now() < deadline)
+		wait_until(deadline);
+
+	/* Under the lock, lookup_done() cannot free it in the meantime */
+	if (lookup->done == false &&
+			gai_cancel(&lookup->request) == EAI_CANCELED) {
+		pthread_mutex_unlock(&probe_lock);
+		free_lookup(lookup);
+
+		return NULL;
+	}
+
+	/* Not queued anymore: lookup_done() will free it, if still to run */
+	done = lookup->done;
+	if (done == false)
+		lookup->abandoned = true;
+
+	pthread_mutex_unlock(&probe_lock);
+
+	if (done == false)
+		return NULL;
+
+	if (gai_error(&lookup->request) == 0) {
+		addresses = lookup->request.ar_result;
+		lookup->request.ar_result = NULL;
+	}
+
+	free_lookup(lookup);
+
+	return addresses;
+}
+
+static bool run_probe(const struct probe_config *probe)
+{
+	struct addrinfo *addresses, *address;
+	unsigned long deadline;
+	bool online = false;
+	int fd;
+
+	deadline = __connline_stats_now() + PROBE_TIMEOUT * 1000UL;
+
+	addresses = resolve(probe, deadline);
+	if (addresses == NULL)
+		return false;
+
+	for (address = addresses; address != NULL; address = address->ai_next) {
+		fd = connect_probe(address, deadline);
+		if (fd < 0)
+			continue;
+
+		online = request_status(fd, probe, deadline);
+
+		set_probe_socket(-1);
+		close(fd);
+
+		break;
+	}
+
+	freeaddrinfo(addresses);
+
+	return online;
+}
+
+static void wait_until(unsigned long time)
+{
+	struct timespec ts;
+
+	ts.tv_sec = time / 1000000;
+	ts.tv_nsec = (time % 1000000) * 1000;
+
+	pthread_cond_timedwait(&probe_cond, &probe_lock, &ts);
+}
+
+static void *probe_loop(void *data)
+{
+	struct probe_config probe;
+	unsigned long now;
+	char online;
+
+	pthread_mutex_lock(&probe_lock);
+
+	while (stopping == false) {
+		if (requested == false) {
+			pthread_cond_wait(&probe_cond, &probe_lock);
+			continue;
+		}
+
+		now = __connline_stats_now();
+		if (last_start != 0 && now - last_start < interval) {
+			wait_until(last_start + interval);
+			continue;
+		}
+
+		requested = false;
+		last_start = now;
+		probe = config;
+
+		pthread_mutex_unlock(&probe_lock);
+
+		online = run_probe(&probe) == true ? 1 : 0;
+
+		pthread_mutex_lock(&probe_lock);
+
+		if (stopping == false &&
+				write(result_pipe[1], &online, 1) != 1)
+			DBG("cannot tell the probe result");
+	}
+
+	pthread_mutex_unlock(&probe_lock);
+
+	return NULL;
+}
+
+static bool probe_applies(void)
+{
+	if (configured == false || connection_backend == NULL)
+		return false;
+
+	return connection_backend->checks_online == false;
+}
+
+static void result_cb(int fd, void *user_data);
+
+static int start_thread(void)
+{
+	pthread_condattr_t attr;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+							0, result_pipe) < 0)
+		return -errno;
+
+	if (__connline_watch_fd(probe_data, result_pipe[0],
+						result_cb, NULL) < 0)
+		goto error;
+
+	/* Rate limiting waits on the same clock __connline_stats_now() reads */
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&probe_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	stopping = false;
+
+	if (pthread_create(&probe_thread, NULL, probe_loop, NULL) != 0) {
+		pthread_cond_destroy(&probe_cond);
+		__connline_unwatch_fd(result_pipe[0]);
+		goto error;
+	}
+
+	thread_started = true;
+
+	return 0;
+
+error:
+	close(result_pipe[0]);
+	close(result_pipe[1]);
+	result_pipe[0] = result_pipe[1] = -1;
+
+	return -EIO;
+}
+
+static void start_probe(void)
+{
+	if (thread_started == false && start_thread() < 0) {
+		/* Better not to tell online at all than to tell it wrong */
+		DBG("cannot run the online probe");
+		return;
+	}
+
+	running = true;
+
+	pthread_mutex_lock(&probe_lock);
+
+	requested = true;
+	pthread_cond_signal(&probe_cond);
+
+	pthread_mutex_unlock(&probe_lock);
+}
+
+static void result_cb(int fd, void *user_data)
+{
+	char online;
+
+	while (read(fd, &online, 1) == 1) {
+		running = false;
+
+		if (again == true) {
+			again = false;
+			start_probe();
+			continue;
+		}
+
+		if (online == 1) {
+			result = PROBE_ONLINE;
+			__connline_notify_online_contexts();
+			continue;
+		}
+
+		result = PROBE_OFFLINE;
+
+		/* Retried at the probe's pace, until some disconnection */
+		if (changed == false)
+			start_probe();
+	}
+}
+
+void __connline_probe_connected(void)
+{
+	if (probe_applies() == false)
+		return;
+
+	if (changed == true) {
+		changed = false;
+		result = PROBE_UNKNOWN;
+
+		/* The running one may have started before the change */
+		if (running == true) {
+			again = true;
+			return;
+		}
+	} else if (result != PROBE_UNKNOWN || running == true)
+		return;
+
+	start_probe();
+}
+
+void __connline_probe_changed(void)
+{
+	changed = true;
+}
+
+bool __connline_probe_is_online(void)
+{
+	if (probe_applies() == false)
+		return true;
+
+	return result == PROBE_ONLINE;
+}
+
+void __connline_setup_probe(void *data)
+{
+	probe_data = data;
+}
+
+void __connline_cleanup_probe(void)
+{
+	if (thread_started == true) {
+		pthread_mutex_lock(&probe_lock);
+
+		stopping = true;
+		if (probe_socket >= 0)
+			shutdown(probe_socket, SHUT_RDWR);
+		pthread_cond_signal(&probe_cond);
+
+		pthread_mutex_unlock(&probe_lock);
+
+		pthread_join(probe_thread, NULL);
+		pthread_cond_destroy(&probe_cond);
+
+		__connline_unwatch_fd(result_pipe[0]);
+		close(result_pipe[0]);
+		close(result_pipe[1]);
+		result_pipe[0] = result_pipe[1] = -1;
+
+		thread_started = false;
+	}
+
+	requested = false;
+	last_start = 0;
+	result = PROBE_UNKNOWN;
+	running = false;
+	again = false;
+	changed = false;
+	probe_data = NULL;
+}
+
+int connline_set_online_probe(const char *url, unsigned int status,
+						unsigned int interval_sec)
+{
+	struct probe_config parsed;
+
+	/* The probe thread reads the configuration */
+	if (thread_started == true)
+		return -EBUSY;
+
+	if (url == NULL) {
+		configured = false;
+		return 0;
+	}
+
+	memset(&parsed, 0, sizeof(parsed));
+
+	if (parse_url(url, &parsed) < 0)
+		return -EINVAL;
+
+	parsed.status = status;
+
+	config = parsed;
+	configured = true;
+	interval = (interval_sec == 0 ? CONNLINE_PROBE_INTERVAL :
+						interval_sec) * 1000000UL;
+
+	return 0;
+}
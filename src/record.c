@@ -0,0 +1,112 @@
+/*
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License version 2.1,
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <connline/record.h>
+#include <connline/private.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static FILE *record_file = NULL;
+
+static DBusHandlerResult record_filter(DBusConnection *dbus_cnx,
+						DBusMessage *message,
+						void *user_data)
+{
+	struct connline_record_entry entry;
+	struct timespec ts;
+	char *blob;
+	int size;
+
+	switch (dbus_message_get_type(message)) {
+	case DBUS_MESSAGE_TYPE_SIGNAL:
+	case DBUS_MESSAGE_TYPE_METHOD_CALL:
+		break;
+	default:
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	}
+
+	if (dbus_message_marshal(message, &blob, &size) == FALSE)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	memset(&entry, 0, sizeof(entry));
+	entry.timestamp = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	entry.size = size;
+
+	if (fwrite(&entry, sizeof(entry), 1, record_file) != 1 ||
+			fwrite(blob, size, 1, record_file) != 1)
+		perror("Connline: cannot record D-Bus message");
+
+	dbus_free(blob);
+
+	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+int __connline_setup_record(DBusConnection *dbus_cnx)
+{
+	struct connline_record_header header;
+	const char *path;
+
+	/* A setuid or setgid host must not write wherever its caller says */
+	path = secure_getenv(CONNLINE_RECORD_ENV);
+	if (path == NULL || *path == '\0')
+		return 0;
+
+	record_file = fopen(path, "w");
+	if (record_file == NULL)
+		return -errno;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CONNLINE_RECORD_MAGIC, sizeof(header.magic));
+	header.version = CONNLINE_RECORD_VERSION;
+
+	if (fwrite(&header, sizeof(header), 1, record_file) != 1)
+		goto error;
+
+	/* Filters run in the order they were added: this one goes first */
+	if (dbus_connection_add_filter(dbus_cnx,
+					record_filter, NULL, NULL) == FALSE)
+		goto error;
+
+	return 0;
+
+error:
+	fclose(record_file);
+	record_file = NULL;
+
+	return -EIO;
+}
+
+void __connline_cleanup_record(DBusConnection *dbus_cnx)
+{
+	if (record_file == NULL)
+		return;
+
+	dbus_connection_remove_filter(dbus_cnx, record_filter, NULL);
+
+	fclose(record_file);
+	record_file = NULL;
+}
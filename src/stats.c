@@ -0,0 +1,228 @@
+/*
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License version 2.1,
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <connline/stats.h>
+#include <connline/private.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Each thread only ever writes its own block, so updating a counter needs
+ * no lock nor atomic read-modify-write.  Blocks outlive their thread, thus
+ * no count is ever lost, and are only walked when statistics are asked for.
+ * A block may well go negative on a memory counter, freeing what another
+ * thread allocated: only the sum of all blocks makes sense.
+ */
+struct stats_block {
+	unsigned long counters[CONNLINE_STATS_COUNTERS_MAX];
+	unsigned long histograms[CONNLINE_STATS_HISTOGRAMS_MAX]
+						[CONNLINE_STATS_BUCKETS];
+
+	struct stats_block *next;
+};
+
+static __thread struct stats_block *thread_block = NULL;
+
+static pthread_mutex_t blocks_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct stats_block *blocks = NULL;
+
+/* Pending calls carry the time they were sent at */
+static dbus_int32_t sent_at_slot = -1;
+
+static struct stats_block *get_block(void)
+{
+	struct stats_block *block = thread_block;
+
+	if (block != NULL)
+		return block;
+
+	/* Never freed: not to be taken from connline_set_allocator()'s */
+	block = calloc(1, sizeof(struct stats_block));
+	if (block == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&blocks_lock);
+
+	block->next = blocks;
+	blocks = block;
+
+	pthread_mutex_unlock(&blocks_lock);
+
+	thread_block = block;
+
+	return block;
+}
+
+static inline void increment(unsigned long *value, unsigned long delta)
+{
+	__atomic_store_n(value, *value + delta, __ATOMIC_RELAXED);
+}
+
+static inline unsigned long load(unsigned long *value)
+{
+	return __atomic_load_n(value, __ATOMIC_RELAXED);
+}
+
+static unsigned int get_bucket(unsigned long duration)
+{
+	unsigned int bucket;
+
+	if (duration == 0)
+		return 0;
+
+	bucket = sizeof(unsigned long) * 8 - __builtin_clzl(duration);
+	if (bucket >= CONNLINE_STATS_BUCKETS)
+		bucket = CONNLINE_STATS_BUCKETS - 1;
+
+	return bucket;
+}
+
+unsigned long __connline_stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+void __connline_stats_add(enum connline_stats_counter counter, long value)
+{
+	struct stats_block *block;
+
+	block = get_block();
+	if (block == NULL)
+		return;
+
+	increment(&block->counters[counter], value);
+}
+
+void __connline_stats_record(enum connline_stats_histogram histogram,
+							unsigned long start)
+{
+	struct stats_block *block;
+	unsigned int bucket;
+
+	block = get_block();
+	if (block == NULL)
+		return;
+
+	bucket = get_bucket(__connline_stats_now() - start);
+
+	increment(&block->histograms[histogram][bucket], 1);
+}
+
+void __connline_stats_call(DBusPendingCall *pending)
+{
+	uintptr_t sent_at;
+
+	CONNLINE_TRACE1(dbus_call, pending);
+
+	__connline_stats_add(CONNLINE_STATS_DBUS_CALLS, 1);
+
+	if (pending == NULL)
+		return;
+
+	if (sent_at_slot < 0 &&
+		dbus_pending_call_allocate_data_slot(&sent_at_slot) == FALSE)
+		return;
+
+	sent_at = __connline_stats_now();
+
+	dbus_pending_call_set_data(pending, sent_at_slot,
+						(void *) sent_at, NULL);
+}
+
+void __connline_stats_reply(DBusPendingCall *pending)
+{
+	uintptr_t sent_at;
+
+	CONNLINE_TRACE1(dbus_reply, pending);
+
+	__connline_stats_add(CONNLINE_STATS_DBUS_REPLIES, 1);
+
+	if (sent_at_slot < 0)
+		return;
+
+	sent_at = (uintptr_t) dbus_pending_call_get_data(pending,
+								sent_at_slot);
+	if (sent_at != 0)
+		__connline_stats_record(CONNLINE_STATS_ROUND_TRIP, sent_at);
+}
+
+static void sum_histogram(struct connline_histogram *histogram,
+						unsigned long *buckets)
+{
+	int i;
+
+	for (i = 0; i < CONNLINE_STATS_BUCKETS; i++)
+		histogram->buckets[i] += load(&buckets[i]);
+}
+
+int connline_get_stats(struct connline_stats *stats)
+{
+	unsigned long counters[CONNLINE_STATS_COUNTERS_MAX];
+	struct stats_block *block;
+	int i;
+
+	if (stats == NULL)
+		return -EINVAL;
+
+	memset(stats, 0, sizeof(struct connline_stats));
+	memset(counters, 0, sizeof(counters));
+
+	pthread_mutex_lock(&blocks_lock);
+
+	for (block = blocks; block != NULL; block = block->next) {
+		for (i = 0; i < CONNLINE_STATS_COUNTERS_MAX; i++)
+			counters[i] += load(&block->counters[i]);
+
+		sum_histogram(&stats->first_event_latency, block->histograms
+					[CONNLINE_STATS_FIRST_EVENT_LATENCY]);
+		sum_histogram(&stats->round_trip,
+				block->histograms[CONNLINE_STATS_ROUND_TRIP]);
+		sum_histogram(&stats->callback_delay,
+			block->histograms[CONNLINE_STATS_CALLBACK_DELAY]);
+	}
+
+	pthread_mutex_unlock(&blocks_lock);
+
+	stats->dbus_calls = counters[CONNLINE_STATS_DBUS_CALLS];
+	stats->dbus_replies = counters[CONNLINE_STATS_DBUS_REPLIES];
+	stats->dbus_signals = counters[CONNLINE_STATS_DBUS_SIGNALS];
+	stats->match_rules = counters[CONNLINE_STATS_MATCH_RULES];
+	stats->triggers_queued = counters[CONNLINE_STATS_TRIGGERS_QUEUED];
+	stats->triggers_dropped = counters[CONNLINE_STATS_TRIGGERS_DROPPED];
+	stats->allocations = counters[CONNLINE_STATS_ALLOCATIONS];
+	stats->dbus_dispatched = counters[CONNLINE_STATS_DBUS_DISPATCHED];
+	stats->dispatch_yields = counters[CONNLINE_STATS_DISPATCH_YIELDS];
+	stats->dbus_timeouts = counters[CONNLINE_STATS_DBUS_TIMEOUTS];
+
+	for (i = 0; i < CONNLINE_MEMORY_MAX; i++)
+		stats->memory[i] = counters[CONNLINE_STATS_MEMORY + i];
+
+	__connline_count_contexts(stats);
+
+	return 0;
+}
@@ -0,0 +1,219 @@
+/*
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License version 2.1,
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <connline/trace.h>
+#include <connline/connline.h>
+
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static struct connline_trace_record ring[CONNLINE_TRACE_RECORDS];
+static uint64_t ring_head = 0;
+
+static char dump_path[PATH_MAX];
+
+/*
+ * A record's sequence is zeroed before it gets written and set last,
+ * thus a reader seeing the same non-zero sequence before and after
+ * copying a record got it whole.
+ */
+static struct connline_trace_record *start_record(
+					enum connline_trace_event event,
+					const void *context, unsigned int arg,
+					uint64_t *sequence)
+{
+	struct connline_trace_record *record;
+	struct timespec ts;
+
+	*sequence = __atomic_fetch_add(&ring_head, 1, __ATOMIC_RELAXED);
+	record = &ring[*sequence % CONNLINE_TRACE_RECORDS];
+
+	__atomic_store_n(&record->sequence, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	record->timestamp = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	record->context = (uintptr_t) context;
+	record->event = event;
+	record->arg = arg;
+
+	return record;
+}
+
+static inline void end_record(struct connline_trace_record *record,
+							uint64_t sequence)
+{
+	__atomic_store_n(&record->sequence, sequence + 1, __ATOMIC_RELEASE);
+}
+
+void __connline_trace_write(enum connline_trace_event event,
+				const void *context, unsigned int arg,
+				uint64_t value)
+{
+	struct connline_trace_record *record;
+	uint64_t sequence;
+
+	record = start_record(event, context, arg, &sequence);
+
+	record->data.value = value;
+
+	end_record(record, sequence);
+}
+
+void __connline_trace_write_string(enum connline_trace_event event,
+					const void *context, unsigned int arg,
+					const char *string)
+{
+	struct connline_trace_record *record;
+	uint64_t sequence;
+	int i = 0;
+
+	record = start_record(event, context, arg, &sequence);
+
+	if (string != NULL) {
+		for (; i < CONNLINE_TRACE_STRING_SIZE - 1 &&
+						string[i] != '\0'; i++)
+			record->data.string[i] = string[i];
+	}
+
+	for (; i < CONNLINE_TRACE_STRING_SIZE; i++)
+		record->data.string[i] = '\0';
+
+	end_record(record, sequence);
+}
+
+static int write_all(int fd, const void *buffer, size_t size)
+{
+	const char *data = buffer;
+	ssize_t ret;
+
+	while (size > 0) {
+		ret = write(fd, data, size);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return -errno;
+		}
+
+		data += ret;
+		size -= ret;
+	}
+
+	return 0;
+}
+
+static bool read_record(uint64_t sequence,
+				struct connline_trace_record *record)
+{
+	struct connline_trace_record *slot;
+
+	slot = &ring[sequence % CONNLINE_TRACE_RECORDS];
+
+	if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != sequence + 1)
+		return false;
+
+	memcpy(record, slot, sizeof(struct connline_trace_record));
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return __atomic_load_n(&slot->sequence,
+				__ATOMIC_RELAXED) == sequence + 1;
+}
+
+int connline_trace_dump(int fd)
+{
+	struct connline_trace_header header;
+	struct connline_trace_record record;
+	uint64_t sequence, head;
+	int ret;
+
+	if (fd < 0)
+		return -EINVAL;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CONNLINE_TRACE_MAGIC,
+				sizeof(CONNLINE_TRACE_MAGIC));
+	header.version = CONNLINE_TRACE_VERSION;
+	header.record_size = sizeof(struct connline_trace_record);
+
+	ret = write_all(fd, &header, sizeof(header));
+	if (ret < 0)
+		return ret;
+
+	head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+
+	sequence = 0;
+	if (head > CONNLINE_TRACE_RECORDS)
+		sequence = head - CONNLINE_TRACE_RECORDS;
+
+	/* Records being written, or already overwritten, are skipped */
+	for (; sequence < head; sequence++) {
+		if (read_record(sequence, &record) == false)
+			continue;
+
+		ret = write_all(fd, &record, sizeof(record));
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+static void dump_handler(int signum)
+{
+	int saved_errno = errno;
+	int fd;
+
+	fd = open(dump_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd >= 0) {
+		connline_trace_dump(fd);
+		close(fd);
+	}
+
+	errno = saved_errno;
+}
+
+int connline_trace_dump_on_signal(int signum, const char *path)
+{
+	struct sigaction action;
+
+	if (path == NULL || strlen(path) >= sizeof(dump_path))
+		return -EINVAL;
+
+	strcpy(dump_path, path);
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = dump_handler;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+
+	if (sigaction(signum, &action, NULL) < 0)
+		return -errno;
+
+	return 0;
+}
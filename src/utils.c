@@ -18,7 +18,10 @@
  *
  */
 
+#include <connline/alloc.h>
 #include <connline/utils.h>
+#include <connline/stats.h>
+#include <connline/token.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -26,31 +29,40 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
-#include <time.h>
 #include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <net/if_arp.h>
 
-char *get_processus_name(void)
+#define PROCESS_NAME_SIZE 32
+
+#define SYSFS_NET_PATH "/sys/class/net"
+
+static char process_name[PROCESS_NAME_SIZE];
+static char unique_name_prefix[UNIQUE_NAME_SIZE - 10];
+static unsigned int unique_name_counter = 0;
+
+static int get_processus_name(char *proc_name, size_t size)
 {
 	char cmdline_path[20];
 	FILE *cmdline_file;
 	char cmdline[512];
-	char *proc_name;
+	int ret = -EINVAL;
+	size_t length;
 	pid_t pid;
 	char *c;
 
-	proc_name = NULL;
-
 	pid = getpid();
 
 	if (snprintf(cmdline_path, 20, "/proc/%u/cmdline", pid) < 0)
-		return NULL;
+		return -EINVAL;
 
 	cmdline_file = fopen(cmdline_path, "r");
 	if (cmdline_file == NULL)
-		return NULL;
+		return -errno;
 
 	memset(cmdline, 0, 512);
-	if (fread(cmdline, 1, 512, cmdline_file) == 0)
+	if (fread(cmdline, 1, 511, cmdline_file) == 0)
 		goto error;
 
 	c = strchr(cmdline, ' ');
@@ -63,57 +75,74 @@ char *get_processus_name(void)
 	else
 		c++;
 
-	proc_name = calloc(strlen(c) + 1, sizeof(char));
-	if (proc_name == NULL)
+	length = strlen(c);
+	if (length == 0)
 		goto error;
 
-	strcpy(proc_name, c);
+	if (length >= size)
+		length = size - 1;
+
+	memcpy(proc_name, c, length);
+	proc_name[length] = '\0';
 
 	for (c = proc_name; *c != '\0'; c++)
 		if (isalnum(*c) == 0)
 			*c = '_';
 
+	ret = 0;
+
 error:
 	fclose(cmdline_file);
 
-	return proc_name;
+	return ret;
 }
 
-char *get_new_unique_name(void)
+static void set_unique_name_prefix(void)
 {
-	char *session_name = NULL;
-	char *unknown = "unknown";
-	time_t timestamp;
-	char *proc_name;
-	int rand_num;
-	int length;
+	snprintf(unique_name_prefix, sizeof(unique_name_prefix), "%s_%u_",
+						process_name, getpid());
+}
 
-	timestamp = time(NULL);
-	rand_num = rand();
+static void unique_name_atfork_child(void)
+{
+	/* Same process name, only the pid changed */
+	set_unique_name_prefix();
+}
 
-	proc_name = get_processus_name();
-	if (proc_name == NULL)
-		proc_name = unknown;
+int setup_unique_name_prefix(void)
+{
+	static bool atfork_registered = false;
 
-	length = strlen(proc_name);
-	length += 28; /* '_' + pid + '_' + timestamp + '_' + rand '\0' */
+	if (get_processus_name(process_name, PROCESS_NAME_SIZE) < 0)
+		strcpy(process_name, "unknown");
 
-	session_name = calloc(length, sizeof(char));
-	if (session_name == NULL)
-		goto error;
+	set_unique_name_prefix();
 
-	if (snprintf(session_name, length, "%s_%u_%lu_%d",
-				proc_name, getpid(), timestamp, rand_num) < 0)
-		goto error;
+	if (atfork_registered == false) {
+		if (pthread_atfork(NULL, NULL, unique_name_atfork_child) != 0)
+			return -ENOMEM;
+
+		atfork_registered = true;
+	}
 
-	if (proc_name != unknown)
-		free(proc_name);
+	return 0;
+}
 
-	return session_name;
+int get_new_unique_name(char *name, size_t size)
+{
+	unsigned int id;
+	int length;
 
-error:
-	free(session_name);
-	return NULL;
+	if (name == NULL || unique_name_prefix[0] == '\0')
+		return -EINVAL;
+
+	id = __sync_add_and_fetch(&unique_name_counter, 1);
+
+	length = snprintf(name, size, "%s%u", unique_name_prefix, id);
+	if (length < 0 || (size_t) length >= size)
+		return -ENAMETOOLONG;
+
+	return 0;
 }
 
 char **insert_into_property_list(char **properties,
@@ -140,7 +169,8 @@ char **insert_into_property_list(char **properties,
 	}
 
 	if (app >= length) {
-		new_name = calloc(n + 1, sizeof(char));
+		new_name = __connline_calloc(CONNLINE_MEMORY_PROPERTY,
+							n + 1, sizeof(char));
 		if (new_name == NULL)
 			return properties;
 
@@ -153,7 +183,8 @@ char **insert_into_property_list(char **properties,
 		app++;
 		n += strlen(properties[app]) + 1;
 
-		new_value = calloc(n, sizeof(char));
+		new_value = __connline_calloc(CONNLINE_MEMORY_PROPERTY,
+							n, sizeof(char));
 		if (new_value == NULL)
 			goto error;
 
@@ -161,11 +192,14 @@ char **insert_into_property_list(char **properties,
 					properties[app], value) < 0)
 			goto error;
 
-		length = app + 2;
+		/* Replaced in place: the list keeps its terminator */
+		__connline_free(properties[app]);
+		length = app + 1;
 	} else {
 		length += 2;
 
-		new_list = realloc(properties, sizeof(char *) * (length + 1));
+		new_list = __connline_realloc(CONNLINE_MEMORY_PROPERTY,
+				properties, sizeof(char *) * (length + 1));
 		if (new_list == NULL)
 			goto error;
 
@@ -175,7 +209,8 @@ char **insert_into_property_list(char **properties,
 		new_list[length - 1] = NULL;
 		new_list[length] = NULL;
 
-		new_value = calloc(n, sizeof(char));
+		new_value = __connline_calloc(CONNLINE_MEMORY_PROPERTY,
+							n, sizeof(char));
 		if (new_value == NULL)
 			goto error;
 
@@ -191,10 +226,10 @@ char **insert_into_property_list(char **properties,
 
 error:
 	if (new_name != NULL)
-		free(new_name);
+		__connline_free(new_name);
 
 	if (new_value != NULL)
-		free(new_value);
+		__connline_free(new_value);
 
 	return properties;
 }
@@ -207,9 +242,9 @@ void property_list_free(char **properties)
 		return;
 
 	for (i = 0; properties[i] != NULL; i++)
-		free(properties[i]);
+		__connline_free(properties[i]);
 
-	free(properties);
+	__connline_free(properties);
 }
 
 const char *connline_bearer_to_string(enum connline_bearer bearer)
@@ -234,3 +269,117 @@ const char *connline_bearer_to_string(enum connline_bearer bearer)
 
 	return "*";
 }
+
+static bool is_sysfs_entry(const char *name, const char *entry)
+{
+	char path[128];
+
+	snprintf(path, sizeof(path), SYSFS_NET_PATH "/%s/%s", name, entry);
+
+	return access(path, F_OK) == 0;
+}
+
+static enum connline_bearer get_devtype_bearer(const char *name)
+{
+	enum connline_bearer bearer = CONNLINE_BEARER_UNKNOWN;
+	char path[128], line[128];
+	FILE *uevent;
+
+	snprintf(path, sizeof(path), SYSFS_NET_PATH "/%s/uevent", name);
+
+	uevent = fopen(path, "r");
+	if (uevent == NULL)
+		return bearer;
+
+	while (fgets(line, sizeof(line), uevent) != NULL) {
+		if (strncmp(line, "DEVTYPE=", 8) != 0)
+			continue;
+
+		line[strcspn(line, "\n")] = '\0';
+
+		switch (connline_token_lookup(line + 8)) {
+		case CONNLINE_TOKEN_WLAN:
+			bearer = CONNLINE_BEARER_WIFI;
+			break;
+		case CONNLINE_TOKEN_WWAN:
+			bearer = CONNLINE_BEARER_CELLULAR;
+			break;
+		case CONNLINE_TOKEN_BLUETOOTH:
+			bearer = CONNLINE_BEARER_BLUETOOTH;
+			break;
+		case CONNLINE_TOKEN_WIMAX:
+			bearer = CONNLINE_BEARER_WIMAX;
+			break;
+		default:
+			break;
+		}
+
+		break;
+	}
+
+	fclose(uevent);
+
+	return bearer;
+}
+
+static bool is_usb_device(const char *name)
+{
+	char path[128], subsystem[256];
+	ssize_t size;
+
+	snprintf(path, sizeof(path),
+			SYSFS_NET_PATH "/%s/device/subsystem", name);
+
+	size = readlink(path, subsystem, sizeof(subsystem) - 1);
+	if (size < 3)
+		return false;
+
+	subsystem[size] = '\0';
+
+	return strcmp(subsystem + size - 3, "usb") == 0;
+}
+
+static int get_link_type(const char *name)
+{
+	char path[128];
+	FILE *file;
+	int type;
+
+	snprintf(path, sizeof(path), SYSFS_NET_PATH "/%s/type", name);
+
+	file = fopen(path, "r");
+	if (file == NULL)
+		return -1;
+
+	if (fscanf(file, "%d", &type) != 1)
+		type = -1;
+
+	fclose(file);
+
+	return type;
+}
+
+/* The kernel link type says little more than ethernet: sysfs tells */
+enum connline_bearer connline_interface_to_bearer(const char *name, int type)
+{
+	enum connline_bearer bearer;
+
+	if (is_sysfs_entry(name, "wireless") == true ||
+				is_sysfs_entry(name, "phy80211") == true)
+		return CONNLINE_BEARER_WIFI;
+
+	bearer = get_devtype_bearer(name);
+	if (bearer != CONNLINE_BEARER_UNKNOWN)
+		return bearer;
+
+	if (is_usb_device(name) == true)
+		return CONNLINE_BEARER_USB;
+
+	if (type < 0)
+		type = get_link_type(name);
+
+	if (type == ARPHRD_ETHER)
+		return CONNLINE_BEARER_ETHERNET;
+
+	return CONNLINE_BEARER_UNKNOWN;
+}
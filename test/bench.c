@@ -0,0 +1,655 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "bench.h"
+#include "mock_daemon.h"
+#include "private_bus.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Connection state changes, once all contexts got their first event */
+#define BENCH_TRANSITIONS 10
+
+/* Seconds each benchmark phase is given, before giving up */
+#define BENCH_TIMEOUT 60
+
+/* Seconds without activity telling a replay is over */
+#define BENCH_QUIET 0.2
+
+struct bench_context {
+	struct connline_context *context;
+	double opened;
+	double first_event;
+};
+
+static unsigned int nb_ready = 0;
+static unsigned int nb_events = 0;
+static unsigned int nb_state_events = 0;
+static unsigned int nb_errors = 0;
+
+/* Replaces the connection state changes, when set */
+static const char *replay_path = NULL;
+static bool replay_paced = false;
+
+/* Masks the property events, when set */
+static bool state_only = false;
+
+/* Delivers the events through one batch callback, when set */
+static bool batched = false;
+
+/* Opens the contexts with one connline_open_many() call, when set */
+static bool bulk = false;
+static unsigned int nb_completions = 0;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long read_rss(void)
+{
+	char line[128];
+	long rss = -1;
+	FILE *status;
+
+	status = fopen("/proc/self/status", "r");
+	if (status == NULL)
+		return -1;
+
+	while (fgets(line, sizeof(line), status) != NULL) {
+		if (sscanf(line, "VmRSS: %ld kB", &rss) == 1)
+			break;
+	}
+
+	fclose(status);
+
+	return rss;
+}
+
+static void bench_callback(struct connline_context *context,
+					enum connline_event event,
+					const char **properties,
+					void *user_data)
+{
+	struct bench_context *bench_context = user_data;
+
+	nb_events++;
+
+	switch (event) {
+	case CONNLINE_EVENT_ERROR:
+	case CONNLINE_EVENT_NO_BACKEND:
+		nb_errors++;
+		break;
+	case CONNLINE_EVENT_DISCONNECTED:
+	case CONNLINE_EVENT_CONNECTED:
+		nb_state_events++;
+		break;
+	case CONNLINE_EVENT_PROPERTY:
+	case CONNLINE_EVENT_TIMEOUT:
+		break;
+	}
+
+	if (bench_context->first_event == 0) {
+		bench_context->first_event = now();
+		nb_ready++;
+	}
+}
+
+static void bench_batch_callback(const struct connline_event_record *records,
+					unsigned int nb_records,
+					void *user_data)
+{
+	unsigned int i;
+
+	for (i = 0; i < nb_records; i++)
+		bench_callback(records[i].context, records[i].event,
+				records[i].properties, records[i].user_data);
+}
+
+static void bench_completion(void *user_data)
+{
+	nb_completions++;
+}
+
+/* One call for all, each context getting its bench_context */
+static int open_bulk(struct bench_context *contexts, unsigned int nb_contexts)
+{
+	struct connline_context **handles;
+	void **user_data;
+	unsigned int i;
+	double opened;
+	int ret;
+
+	handles = calloc(nb_contexts, sizeof(struct connline_context *));
+	user_data = calloc(nb_contexts, sizeof(void *));
+	if (handles == NULL || user_data == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < nb_contexts; i++)
+		user_data[i] = &contexts[i];
+
+	opened = now();
+
+	ret = connline_open_many(handles, nb_contexts,
+				CONNLINE_BEARER_UNKNOWN, false,
+				batched == true ? NULL : bench_callback,
+				user_data, bench_completion, NULL);
+	if (ret < 0)
+		goto out;
+
+	for (i = 0; i < nb_contexts; i++) {
+		contexts[i].opened = opened;
+		contexts[i].context = handles[i];
+	}
+
+out:
+	free(user_data);
+	free(handles);
+
+	return ret;
+}
+
+static int run_until(const struct bench_loop *loop,
+			unsigned int *counter, unsigned int target)
+{
+	double deadline = now() + BENCH_TIMEOUT;
+
+	while (*counter < target) {
+		if (nb_errors > 0)
+			return -EIO;
+
+		if (now() > deadline)
+			return -ETIMEDOUT;
+
+		loop->iterate();
+	}
+
+	return 0;
+}
+
+/* Upper bound, in microseconds, of the bucket holding the median */
+static unsigned long histogram_median(struct connline_histogram *histogram)
+{
+	unsigned long total = 0, count = 0;
+	int i;
+
+	for (i = 0; i < CONNLINE_STATS_BUCKETS; i++)
+		total += histogram->buckets[i];
+
+	for (i = 0; i < CONNLINE_STATS_BUCKETS; i++) {
+		count += histogram->buckets[i];
+		if (count * 2 >= total && total > 0)
+			break;
+	}
+
+	if (i >= CONNLINE_STATS_BUCKETS)
+		return 0;
+
+	return (1UL << i) - 1;
+}
+
+static void print_stats(void)
+{
+	struct connline_stats stats;
+	unsigned long total, contexts;
+	int i;
+
+	if (connline_get_stats(&stats) != 0)
+		return;
+
+	printf("  calls %lu replies %lu timeouts %lu signals %lu rules %lu "
+		"triggers %lu/%lu dropped allocs %lu dispatched %lu/%lu yields"
+		" | median us: 1st event <%lu round trip <%lu "
+		"callback delay <%lu\n",
+		stats.dbus_calls, stats.dbus_replies, stats.dbus_timeouts,
+		stats.dbus_signals, stats.match_rules, stats.triggers_queued,
+		stats.triggers_dropped, stats.allocations,
+		stats.dbus_dispatched, stats.dispatch_yields,
+		histogram_median(&stats.first_event_latency),
+		histogram_median(&stats.round_trip),
+		histogram_median(&stats.callback_delay));
+
+	total = 0;
+	for (i = 0; i < CONNLINE_MEMORY_MAX; i++)
+		total += stats.memory[i];
+
+	contexts = stats.contexts_opening + stats.contexts_connected +
+			stats.contexts_disconnected + stats.contexts_invalid;
+
+	printf("  memory bytes: contexts %lu lists %lu backends %lu "
+		"properties %lu events %lu dbus %lu plugins %lu | %lu per "
+		"context\n",
+		stats.memory[CONNLINE_MEMORY_CONTEXT],
+		stats.memory[CONNLINE_MEMORY_LIST],
+		stats.memory[CONNLINE_MEMORY_BACKEND],
+		stats.memory[CONNLINE_MEMORY_PROPERTY],
+		stats.memory[CONNLINE_MEMORY_EVENT],
+		stats.memory[CONNLINE_MEMORY_DBUS],
+		stats.memory[CONNLINE_MEMORY_PLUGIN],
+		contexts != 0 ? total / contexts : 0);
+}
+
+/* Tells whether anything happened since last time, or events are pending */
+static bool is_busy(struct connline_stats *before, unsigned int events,
+					unsigned long *activity)
+{
+	struct connline_stats stats;
+	unsigned long previous = *activity;
+
+	connline_get_stats(&stats);
+
+	*activity = nb_events + stats.dbus_dispatched + stats.triggers_queued;
+
+	return *activity != previous || stats.dispatch_pending != 0 ||
+			nb_events - events <
+			(stats.triggers_queued - before->triggers_queued) -
+			(stats.triggers_dropped - before->triggers_dropped);
+}
+
+/*
+ * The mock daemon sends the replayed messages before answering a ping,
+ * and the bus keeps their order: once the reply is there, connline got
+ * them all.  Backends may still have calls of their own going on, thus
+ * it is over once nothing happened for BENCH_QUIET seconds.
+ */
+static int run_replay(const struct bench_loop *loop,
+			struct mock_daemon *daemon, unsigned int nb_contexts)
+{
+	double start, deadline, last, duration;
+	struct connline_stats before, after;
+	unsigned long activity = 0;
+	DBusPendingCall *ping = NULL;
+	DBusConnection *dbus_cnx;
+	DBusMessage *message;
+	unsigned int events;
+	int sent, ret = 0;
+
+	connline_get_stats(&before);
+	events = nb_events;
+	start = now();
+
+	sent = mock_daemon_replay(daemon, replay_path, replay_paced);
+	if (sent < 0)
+		return sent;
+
+	message = dbus_message_new_method_call(
+				mock_backend_to_service(daemon->backend),
+				"/", DBUS_INTERFACE_PEER, "Ping");
+	if (message == NULL)
+		return -ENOMEM;
+
+	dbus_cnx = dbus_bus_get(DBUS_BUS_SYSTEM, NULL);
+	if (dbus_cnx == NULL || dbus_connection_send_with_reply(dbus_cnx,
+			message, &ping, DBUS_TIMEOUT_INFINITE) == FALSE ||
+			ping == NULL)
+		ret = -EIO;
+
+	dbus_message_unref(message);
+
+	deadline = now() + BENCH_TIMEOUT;
+
+	while (ret == 0 && dbus_pending_call_get_completed(ping) == FALSE) {
+		if (now() > deadline)
+			ret = -ETIMEDOUT;
+
+		loop->iterate();
+	}
+
+	last = now();
+
+	while (ret == 0 && now() - last < BENCH_QUIET) {
+		if (now() > deadline)
+			ret = -ETIMEDOUT;
+
+		if (is_busy(&before, events, &activity) == true)
+			last = now();
+
+		loop->iterate();
+	}
+
+	duration = last - start;
+
+	if (ping != NULL) {
+		dbus_pending_call_cancel(ping);
+		dbus_pending_call_unref(ping);
+	}
+
+	if (dbus_cnx != NULL)
+		dbus_connection_unref(dbus_cnx);
+
+	if (ret < 0)
+		return ret;
+
+	connline_get_stats(&after);
+
+	printf("%-9s %-8s %8u %10d %12.3f %12.0f %12lu %10u\n",
+		loop->name, mock_backend_to_string(daemon->backend),
+		nb_contexts, sent, duration * 1000, sent / duration,
+		after.dbus_signals - before.dbus_signals,
+		nb_events - events);
+
+	return 0;
+}
+
+static int run_bench(const struct bench_loop *loop,
+			struct mock_daemon *daemon, unsigned int nb_contexts)
+{
+	struct bench_context *contexts;
+	double start, ready, latency = 0;
+	unsigned int events, target;
+	long rss_start, rss_end;
+	int ret = -ENOMEM;
+	void *data = NULL;
+	unsigned int i;
+
+	contexts = calloc(nb_contexts, sizeof(struct bench_context));
+	if (contexts == NULL)
+		return -ENOMEM;
+
+	if (loop->setup != NULL)
+		data = loop->setup();
+
+	ret = connline_init(loop->type, data);
+	if (ret != 0)
+		goto out;
+
+	if (batched == true)
+		connline_set_batch_callback(bench_batch_callback, NULL);
+
+	rss_start = read_rss();
+	start = now();
+
+	if (bulk == true) {
+		ret = open_bulk(contexts, nb_contexts);
+		if (ret < 0)
+			goto out;
+	}
+
+	for (i = 0; i < nb_contexts; i++) {
+		if (bulk == false) {
+			contexts[i].opened = now();
+			contexts[i].context = connline_open(
+					CONNLINE_BEARER_UNKNOWN, false,
+					batched == true ? NULL : bench_callback,
+					&contexts[i]);
+		}
+
+		if (contexts[i].context == NULL) {
+			ret = -ENOMEM;
+			goto out;
+		}
+
+		if (state_only == true)
+			connline_set_event_mask(contexts[i].context,
+				CONNLINE_EVENT_MASK(CONNLINE_EVENT_CONNECTED) |
+				CONNLINE_EVENT_MASK(CONNLINE_EVENT_DISCONNECTED));
+	}
+
+	ret = run_until(loop, &nb_ready, nb_contexts);
+	if (ret == 0 && bulk == true)
+		ret = run_until(loop, &nb_completions, 1);
+	if (ret < 0)
+		goto out;
+
+	ready = now();
+	rss_end = read_rss();
+
+	for (i = 0; i < nb_contexts; i++)
+		latency += contexts[i].first_event - contexts[i].opened;
+
+	if (replay_path != NULL) {
+		ret = run_replay(loop, daemon, nb_contexts);
+		if (ret == 0)
+			print_stats();
+
+		goto out;
+	}
+
+	events = nb_events;
+	start = now();
+
+	for (i = 0; i < BENCH_TRANSITIONS; i++) {
+		target = nb_state_events + nb_contexts;
+
+		ret = mock_daemon_set_connected(daemon, i % 2);
+		if (ret < 0)
+			goto out;
+
+		ret = run_until(loop, &nb_state_events, target);
+		if (ret < 0)
+			goto out;
+	}
+
+	printf("%-9s %-8s %8u %14.3f %14.3f %12.0f %10ld %12.0f\n",
+		loop->name, mock_backend_to_string(daemon->backend),
+		nb_contexts, latency * 1000 / nb_contexts,
+		(ready - contexts[0].opened) * 1000,
+		(nb_events - events) / (now() - start), rss_end,
+		(rss_end - rss_start) * 1024.0 / nb_contexts);
+
+	print_stats();
+
+out:
+	if (ret < 0)
+		printf("%-9s %-8s %8u failed: %s (%u errors)\n", loop->name,
+			mock_backend_to_string(daemon->backend), nb_contexts,
+			strerror(-ret), nb_errors);
+
+	/* The last opened first, as connline_close_many() does */
+	for (i = nb_contexts; i > 0; i--)
+		connline_close(contexts[i - 1].context);
+
+	connline_cleanup();
+
+	if (loop->cleanup != NULL)
+		loop->cleanup();
+
+	mock_daemon_release(daemon);
+
+	free(contexts);
+
+	return ret;
+}
+
+/* Each benchmark gets its own process, so it starts from a clean state */
+static int fork_bench(const struct bench_loop *loop,
+			struct mock_daemon *daemon, unsigned int nb_contexts)
+{
+	int status;
+	pid_t pid;
+
+	fflush(stdout);
+
+	pid = fork();
+	if (pid < 0)
+		return -errno;
+
+	if (pid == 0)
+		exit(run_bench(loop, daemon, nb_contexts) < 0 ?
+						EXIT_FAILURE : EXIT_SUCCESS);
+
+	if (waitpid(pid, &status, 0) < 0)
+		return -errno;
+
+	if (WIFSIGNALED(status) != 0)
+		printf("%-9s %-8s %8u killed by signal %d\n", loop->name,
+			mock_backend_to_string(daemon->backend), nb_contexts,
+			WTERMSIG(status));
+
+	if (WIFEXITED(status) == 0 || WEXITSTATUS(status) != EXIT_SUCCESS)
+		return -EIO;
+
+	return 0;
+}
+
+static void usage(const char *program)
+{
+	printf("Usage: %s [-b backend] [-r record [-p]] [-P] [-s] [-B] [-m] "
+							"[contexts...]\n"
+		"  -b  runs against this mock daemon only\n"
+		"  -r  replays a CONNLINE_RECORD file, needs -b\n"
+		"  -p  replays at the recorded pace\n"
+		"  -P  uses a private D-Bus connection\n"
+		"  -s  masks all but the connected and disconnected events\n"
+		"  -B  delivers the events through one batch callback\n"
+		"  -m  opens the contexts with connline_open_many()\n",
+								program);
+}
+
+static int parse_backend(const char *name, enum mock_backend *backend)
+{
+	enum mock_backend i;
+
+	for (i = 0; i < MOCK_BACKEND_MAX; i++) {
+		if (strcmp(name, mock_backend_to_string(i)) == 0) {
+			*backend = i;
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
+int bench_main(int argc, char *argv[], const struct bench_loop *loop)
+{
+	unsigned int default_counts[] = { 1, 100, 10000 };
+	enum mock_backend first = 0, last = MOCK_BACKEND_MAX - 1;
+	unsigned int *counts = default_counts;
+	unsigned int nb_counts = 3;
+	enum mock_backend backend;
+	struct mock_daemon daemon;
+	int err = EXIT_SUCCESS;
+	struct private_bus bus;
+	unsigned int i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:r:pPsBm")) != -1) {
+		switch (opt) {
+		case 'b':
+			if (parse_backend(optarg, &first) < 0) {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+
+			last = first;
+			break;
+		case 'r':
+			replay_path = optarg;
+			break;
+		case 'p':
+			replay_paced = true;
+			break;
+		case 'P':
+			connline_set_private_dbus(true);
+			break;
+		case 's':
+			state_only = true;
+			break;
+		case 'B':
+			batched = true;
+			break;
+		case 'm':
+			bulk = true;
+			break;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* A record only makes sense for the backend it was made with */
+	if (replay_path != NULL && first != last) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (optind < argc) {
+		counts = calloc(argc - optind, sizeof(unsigned int));
+		if (counts == NULL)
+			return EXIT_FAILURE;
+
+		for (i = optind; i < (unsigned int) argc; i++) {
+			counts[i - optind] = strtoul(argv[i], NULL, 10);
+			if (counts[i - optind] == 0) {
+				usage(argv[0]);
+				free(counts);
+
+				return EXIT_FAILURE;
+			}
+		}
+
+		nb_counts = argc - optind;
+	}
+
+	if (private_bus_start(&bus) < 0) {
+		printf("Cannot start a private bus\n");
+		return EXIT_FAILURE;
+	}
+
+	/* Connline only knows about the system bus */
+	setenv("DBUS_SYSTEM_BUS_ADDRESS", bus.address, 1);
+
+	if (replay_path != NULL)
+		printf("%-9s %-8s %8s %10s %12s %12s %12s %10s\n", "loop",
+			"backend", "contexts", "replayed", "duration ms",
+			"messages/s", "handled", "events");
+	else
+		printf("%-9s %-8s %8s %14s %14s %12s %10s %12s\n", "loop",
+			"backend", "contexts", "1st event ms", "all ready ms",
+			"events/s", "RSS KiB", "RSS B/ctx");
+
+	for (backend = first; backend <= last; backend++) {
+		for (i = 0; i < nb_counts; i++) {
+			if (mock_daemon_start(&daemon, backend,
+							bus.address) < 0) {
+				printf("Cannot start %s mock daemon\n",
+					mock_backend_to_string(backend));
+				err = EXIT_FAILURE;
+				continue;
+			}
+
+			if (fork_bench(loop, &daemon, counts[i]) < 0)
+				err = EXIT_FAILURE;
+
+			mock_daemon_stop(&daemon);
+		}
+	}
+
+	private_bus_stop(&bus);
+
+	if (counts != default_counts)
+		free(counts);
+
+	return err;
+}
@@ -0,0 +1,48 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNLINE_TEST_BENCH_H__
+#define __CONNLINE_TEST_BENCH_H__
+
+#include <connline/connline.h>
+
+/*
+ * What a benchmark needs from an event loop.  iterate() runs it once, and
+ * must return within a fraction of a second even when nothing happens.
+ */
+struct bench_loop {
+	const char *name;
+	enum connline_event_loop type;
+
+	/* Returns the data given to connline_init() */
+	void *(*setup)(void);
+	void (*iterate)(void);
+	void (*cleanup)(void);
+};
+
+/*
+ * Runs, against each mock daemon, the benchmark for 1, 100 and 10000
+ * contexts, or for the context counts given as arguments.  Instead of
+ * connection state changes, it can replay a CONNLINE_RECORD file.
+ */
+int bench_main(int argc, char *argv[], const struct bench_loop *loop);
+
+#endif
@@ -0,0 +1,501 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Checks broker mode on a mock NetworkManager:  the shared page must never
+ * be read half written while a writer thread updates it,  a context opened
+ * on a broker telling there is no backend must get CONNLINE_EVENT_NO_BACKEND
+ * and then follow the page,  connlined must publish the mock's state, and
+ * connline must fall back to D-Bus when no broker listens.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <glib.h>
+#include <connline/connline.h>
+#include <connline/broker.h>
+
+#include "fixture.h"
+
+#define TEST_TIMEOUT 10000
+#define TEST_READS 200000
+#define TEST_START_TRIES 500
+
+static struct test_fixture fixture;
+static struct connline_broker_page *page;
+static enum connline_event expected;
+static enum connline_event first_event;
+static unsigned int nb_events;
+static bool failed;
+
+static void callback(struct connline_context *context,
+				enum connline_event event,
+				const char **properties,
+				void *user_data)
+{
+	if (nb_events++ == 0)
+		first_event = event;
+
+	if (event == CONNLINE_EVENT_ERROR) {
+		printf("unexpected error event\n");
+		failed = true;
+		g_main_loop_quit(fixture.loop);
+		return;
+	}
+
+	if (event == expected)
+		g_main_loop_quit(fixture.loop);
+}
+
+/* Every field of the state tells the same generation */
+static void write_state(uint32_t generation)
+{
+	__connline_broker_write_begin(page);
+
+	page->state.status = generation % 3;
+	page->state.bearer = generation;
+	page->state.generation = generation;
+	page->state.properties_size = generation % 64 + 1;
+	memset(page->state.properties, generation & 0xff,
+					page->state.properties_size);
+
+	__connline_broker_write_end(page);
+}
+
+static bool is_state_whole(const struct connline_broker_state *state)
+{
+	uint32_t i;
+
+	if (state->status != state->generation % 3 ||
+			state->bearer != state->generation ||
+			state->properties_size != state->generation % 64 + 1)
+		return false;
+
+	for (i = 0; i < state->properties_size; i++) {
+		if ((unsigned char) state->properties[i] !=
+						(state->generation & 0xff))
+			return false;
+	}
+
+	return true;
+}
+
+static bool stop_writing;
+
+static void *write_states(void *data)
+{
+	uint32_t generation = 0;
+
+	while (__atomic_load_n(&stop_writing, __ATOMIC_RELAXED) == false)
+		write_state(++generation);
+
+	return NULL;
+}
+
+static int run_seqlock(void)
+{
+	struct connline_broker_state state;
+	unsigned int i, torn = 0, seen = 0;
+	uint32_t last = 0;
+	pthread_t writer;
+
+	stop_writing = false;
+	write_state(0);
+
+	if (pthread_create(&writer, NULL, write_states, NULL) != 0) {
+		printf("Cannot start the writer\n");
+		return EXIT_FAILURE;
+	}
+
+	/* Reads only count once the writer runs */
+	while (__atomic_load_n(&page->sequence, __ATOMIC_ACQUIRE) < 4)
+		sched_yield();
+
+	for (i = 0; i < TEST_READS; i++) {
+		__connline_broker_read(page, &state);
+
+		if (is_state_whole(&state) == false)
+			torn++;
+
+		if (state.generation != last)
+			seen++;
+		last = state.generation;
+	}
+
+	__atomic_store_n(&stop_writing, true, __ATOMIC_RELAXED);
+	pthread_join(writer, NULL);
+
+	printf("seqlock: %u reads, %u generations seen, %u torn\n",
+						TEST_READS, seen, torn);
+
+	if (torn != 0 || seen < 2)
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
+
+static int listen_broker(const char *name)
+{
+	struct sockaddr_un addr;
+	socklen_t length;
+	int fd;
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path + 1, name, strlen(name));
+	length = offsetof(struct sockaddr_un, sun_path) + 1 + strlen(name);
+
+	if (bind(fd, (struct sockaddr *) &addr, length) < 0 ||
+						listen(fd, 1) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static bool is_listening(const char *name)
+{
+	struct sockaddr_un addr;
+	socklen_t length;
+	int fd, ret;
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return false;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path + 1, name, strlen(name));
+	length = offsetof(struct sockaddr_un, sun_path) + 1 + strlen(name);
+
+	ret = connect(fd, (struct sockaddr *) &addr, length);
+	close(fd);
+
+	return ret == 0;
+}
+
+/* What connlined does for each client, for the one connline_init() is */
+struct fake_broker {
+	int listen_fd;
+	int client_fd;
+	int page_fd;
+	int event_fd;
+};
+
+static void *serve_client(void *data)
+{
+	char control[CMSG_SPACE(2 * sizeof(int))];
+	uint32_t version = CONNLINE_BROKER_VERSION;
+	struct fake_broker *broker = data;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	int fds[2];
+
+	broker->client_fd = accept4(broker->listen_fd, NULL, NULL,
+							SOCK_CLOEXEC);
+	if (broker->client_fd < 0)
+		return NULL;
+
+	fds[0] = broker->page_fd;
+	fds[1] = broker->event_fd;
+
+	iov.iov_base = &version;
+	iov.iov_len = sizeof(version);
+
+	memset(control, 0, sizeof(control));
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	if (sendmsg(broker->client_fd, &msg, MSG_NOSIGNAL) != sizeof(version))
+		printf("Cannot send the broker fds\n");
+
+	return NULL;
+}
+
+static bool run_context(enum connline_event event)
+{
+	struct connline_context *context;
+
+	nb_events = 0;
+	expected = event;
+
+	context = connline_open(CONNLINE_BEARER_UNKNOWN, true, callback, NULL);
+	if (context == NULL) {
+		printf("Cannot open a context\n");
+		return false;
+	}
+
+	if (test_fixture_run(&fixture, TEST_TIMEOUT) == false)
+		failed = true;
+
+	connline_close(context);
+
+	return failed == false;
+}
+
+static gboolean publish_connected(gpointer user_data)
+{
+	struct fake_broker *broker = user_data;
+	uint64_t count = 1;
+
+	__connline_broker_write_begin(page);
+	page->state.status = CONNLINE_BROKER_CONNECTED;
+	page->state.bearer = CONNLINE_BEARER_ETHERNET;
+	page->state.generation++;
+	page->state.properties_size = 0;
+	__connline_broker_write_end(page);
+
+	if (write(broker->event_fd, &count, sizeof(count)) < 0)
+		printf("Cannot notify the client\n");
+
+	return FALSE;
+}
+
+/* No backend at first,  and then a connected one */
+static int run_no_backend(struct fake_broker *broker, const char *name)
+{
+	struct connline_context *context;
+	pthread_t server;
+
+	memset(&page->state, 0, sizeof(page->state));
+	page->state.status = CONNLINE_BROKER_NO_BACKEND;
+
+	if (pthread_create(&server, NULL, serve_client, broker) != 0) {
+		printf("Cannot start the fake broker\n");
+		return EXIT_FAILURE;
+	}
+
+	setenv(CONNLINE_BROKER_ENV, name, 1);
+
+	if (connline_init(CONNLINE_EVENT_LOOP_GLIB, NULL) != 0) {
+		printf("Cannot initialize connline\n");
+		pthread_join(server, NULL);
+		return EXIT_FAILURE;
+	}
+
+	pthread_join(server, NULL);
+
+	nb_events = 0;
+	expected = CONNLINE_EVENT_CONNECTED;
+
+	context = connline_open(CONNLINE_BEARER_UNKNOWN, true, callback, NULL);
+	if (context == NULL) {
+		printf("Cannot open a context\n");
+		connline_cleanup();
+		return EXIT_FAILURE;
+	}
+
+	g_timeout_add(50, publish_connected, broker);
+
+	if (test_fixture_run(&fixture, TEST_TIMEOUT) == false)
+		failed = true;
+
+	connline_close(context);
+	connline_cleanup();
+
+	printf("no backend: first event %d, %u events\n", first_event,
+								nb_events);
+
+	if (failed == true || first_event != CONNLINE_EVENT_NO_BACKEND)
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
+
+static int setup_fake_broker(struct fake_broker *broker, const char *name)
+{
+	broker->client_fd = -1;
+	broker->event_fd = -1;
+	broker->listen_fd = -1;
+
+	broker->page_fd = memfd_create("connline-test", MFD_CLOEXEC);
+	if (broker->page_fd < 0 ||
+		ftruncate(broker->page_fd, CONNLINE_BROKER_PAGE_SIZE) < 0)
+		return -1;
+
+	page = mmap(NULL, CONNLINE_BROKER_PAGE_SIZE, PROT_READ | PROT_WRITE,
+					MAP_SHARED, broker->page_fd, 0);
+	if (page == MAP_FAILED) {
+		page = NULL;
+		return -1;
+	}
+
+	broker->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (broker->event_fd < 0)
+		return -1;
+
+	broker->listen_fd = listen_broker(name);
+	if (broker->listen_fd < 0)
+		return -1;
+
+	return 0;
+}
+
+static void cleanup_fake_broker(struct fake_broker *broker)
+{
+	if (broker->client_fd >= 0)
+		close(broker->client_fd);
+	if (broker->listen_fd >= 0)
+		close(broker->listen_fd);
+	if (broker->event_fd >= 0)
+		close(broker->event_fd);
+	if (broker->page_fd >= 0)
+		close(broker->page_fd);
+
+	if (page != NULL)
+		munmap(page, CONNLINE_BROKER_PAGE_SIZE);
+	page = NULL;
+}
+
+static int run_connlined(const char *name)
+{
+	int err = EXIT_FAILURE;
+	pid_t pid;
+	int i;
+
+	pid = fork();
+	if (pid < 0)
+		return EXIT_FAILURE;
+
+	if (pid == 0) {
+		execl(CONNLINED, "connlined", name, NULL);
+		_exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < TEST_START_TRIES && is_listening(name) == false; i++)
+		usleep(10000);
+
+	if (i == TEST_START_TRIES) {
+		printf("connlined did not start\n");
+		goto out;
+	}
+
+	setenv(CONNLINE_BROKER_ENV, name, 1);
+
+	if (connline_init(CONNLINE_EVENT_LOOP_GLIB, NULL) != 0) {
+		printf("Cannot initialize connline\n");
+		goto out;
+	}
+
+	if (run_context(CONNLINE_EVENT_CONNECTED) == true)
+		err = EXIT_SUCCESS;
+
+	connline_cleanup();
+
+	printf("connlined: %s\n", err == EXIT_SUCCESS ?
+					"connected" : "not connected");
+
+out:
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+
+	return err;
+}
+
+static int run_fallback(const char *name)
+{
+	int err = EXIT_FAILURE;
+
+	setenv(CONNLINE_BROKER_ENV, name, 1);
+
+	if (connline_init(CONNLINE_EVENT_LOOP_GLIB, NULL) != 0) {
+		printf("Cannot initialize connline\n");
+		return EXIT_FAILURE;
+	}
+
+	if (run_context(CONNLINE_EVENT_CONNECTED) == true)
+		err = EXIT_SUCCESS;
+
+	connline_cleanup();
+
+	printf("no broker: %s\n", err == EXIT_SUCCESS ?
+				"connected over D-Bus" : "not connected");
+
+	return err;
+}
+
+int main(int argc, char *argv[])
+{
+	struct fake_broker broker;
+	char fake_name[64], name[64], none_name[64];
+	int err = EXIT_FAILURE;
+
+	snprintf(fake_name, sizeof(fake_name), "connline-test-fake-%d",
+								getpid());
+	snprintf(name, sizeof(name), "connline-test-%d", getpid());
+	snprintf(none_name, sizeof(none_name), "connline-test-none-%d",
+								getpid());
+
+	if (test_fixture_setup(&fixture, MOCK_BACKEND_NM) < 0)
+		return EXIT_FAILURE;
+
+	if (setup_fake_broker(&broker, fake_name) < 0) {
+		printf("Cannot set the fake broker up\n");
+		goto out;
+	}
+
+	err = run_seqlock();
+	if (err == EXIT_SUCCESS)
+		err = run_no_backend(&broker, fake_name);
+	if (err == EXIT_SUCCESS)
+		err = run_connlined(name);
+	if (err == EXIT_SUCCESS)
+		err = run_fallback(none_name);
+
+out:
+	cleanup_fake_broker(&broker);
+	unsetenv(CONNLINE_BROKER_ENV);
+
+	test_fixture_teardown(&fixture);
+
+	return err;
+}
@@ -0,0 +1,234 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Runs connline.hpp against a mock ConnMan on a private bus: a context
+ * per handler kind, then a coroutine awaiting online, offline and online
+ * again while the mock flips its state.  The waits must not allocate.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <type_traits>
+
+#include <glib.h>
+#include <connline/connline.hpp>
+
+extern "C" {
+#include "fixture.h"
+}
+
+#define TEST_TIMEOUT 3000
+
+static_assert(!std::is_copy_constructible_v<connline::context>);
+static_assert(std::is_nothrow_move_constructible_v<connline::context>);
+static_assert(std::is_nothrow_move_assignable_v<connline::context>);
+
+static unsigned long allocations;
+
+/* Counts C++ allocations:  connline itself allocates through malloc */
+void *operator new(std::size_t size)
+{
+	void *pointer;
+
+	allocations++;
+
+	pointer = std::malloc(size != 0 ? size : 1);
+	if (pointer == nullptr)
+		throw std::bad_alloc();
+
+	return pointer;
+}
+
+/* Not inlined, or gcc takes free() for a mismatch of the operator new */
+__attribute__((noinline)) void operator delete(void *pointer) noexcept
+{
+	std::free(pointer);
+}
+
+__attribute__((noinline)) void operator delete(void *pointer,
+						std::size_t) noexcept
+{
+	std::free(pointer);
+}
+
+static struct test_fixture fixture;
+
+struct watcher {
+	std::string events;
+	std::string bearer;
+
+	void on_event(connline::event event, connline::properties properties)
+	{
+		switch (event) {
+		case CONNLINE_EVENT_ERROR:
+			events += "error ";
+			break;
+		case CONNLINE_EVENT_NO_BACKEND:
+			events += "no_backend ";
+			break;
+		case CONNLINE_EVENT_DISCONNECTED:
+			events += "disconnected ";
+			break;
+		case CONNLINE_EVENT_CONNECTED:
+			events += "connected ";
+			break;
+		case CONNLINE_EVENT_PROPERTY:
+			events += "property ";
+			bearer = properties.find("bearer");
+			break;
+		case CONNLINE_EVENT_TIMEOUT:
+			events += "timeout ";
+			break;
+		}
+	}
+};
+
+static unsigned int lambda_connected;
+
+/* The coroutine runs eagerly, and its frame goes away once it is done */
+struct task {
+	struct promise_type {
+		task get_return_object() noexcept { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept { std::abort(); }
+	};
+};
+
+struct scenario_result {
+	std::string steps;
+	unsigned long allocations;
+	bool done;
+};
+
+static task scenario(scenario_result &result)
+{
+	unsigned long before;
+	connline::status status;
+
+	status = co_await connline::online();
+	result.steps += status && status.bearer == CONNLINE_BEARER_ETHERNET ?
+						"online " : "error ";
+
+	before = allocations;
+
+	mock_daemon_set_connected(&fixture.daemon, false);
+
+	status = co_await connline::offline();
+	result.steps += status ? "offline " : "error ";
+
+	mock_daemon_set_connected(&fixture.daemon, true);
+
+	status = co_await connline::online(CONNLINE_BEARER_ETHERNET |
+						CONNLINE_BEARER_WIFI);
+	result.steps += status ? "online" : "error";
+
+	result.allocations = allocations - before;
+	result.done = true;
+
+	g_main_loop_quit(fixture.loop);
+}
+
+static int run(void)
+{
+	scenario_result result = { "", 0, false };
+	const char *expected = "online offline online";
+	int err = EXIT_SUCCESS;
+	watcher watch;
+
+	/* So that only the waits could allocate, once they started */
+	result.steps.reserve(64);
+	watch.events.reserve(256);
+	watch.bearer.reserve(64);
+
+	connline::library library(CONNLINE_EVENT_LOOP_GLIB);
+	if (!library) {
+		printf("Cannot initialize connline\n");
+		return EXIT_FAILURE;
+	}
+
+	connline::context member =
+		connline::open<&watcher::on_event>(watch,
+						CONNLINE_BEARER_UNKNOWN);
+	connline::context function =
+		connline::open<[](struct connline_context *context,
+				connline::event event, connline::properties) {
+			if (event == CONNLINE_EVENT_CONNECTED &&
+						connline_is_online(context))
+				lambda_connected++;
+		}>(CONNLINE_BEARER_ETHERNET);
+	connline::context moved;
+
+	moved = std::move(function);
+	if (function || !moved || !member) {
+		printf("Cannot open the contexts\n");
+		return EXIT_FAILURE;
+	}
+
+	scenario(result);
+
+	test_fixture_run(&fixture, TEST_TIMEOUT);
+
+	printf("member: %s(bearer %s)\n", watch.events.c_str(),
+							watch.bearer.c_str());
+	printf("lambda: %u connected\n", lambda_connected);
+	printf("coroutine: %s, %lu allocations\n", result.steps.c_str(),
+							result.allocations);
+
+	if (watch.events.compare(0, 19, "connected property ") != 0 ||
+						watch.bearer != "ethernet") {
+		printf("member: expected connected property (bearer "
+							"ethernet)\n");
+		err = EXIT_FAILURE;
+	}
+
+	if (lambda_connected == 0) {
+		printf("lambda: expected connected\n");
+		err = EXIT_FAILURE;
+	}
+
+	if (!result.done || result.steps != expected ||
+						result.allocations != 0) {
+		printf("coroutine: expected %s, 0 allocations\n", expected);
+		err = EXIT_FAILURE;
+	}
+
+	return err;
+}
+
+int main(int argc, char *argv[])
+{
+	int err;
+
+	if (test_fixture_setup(&fixture, MOCK_BACKEND_CONNMAN) < 0)
+		return EXIT_FAILURE;
+
+	err = run();
+
+	test_fixture_teardown(&fixture);
+
+	return err;
+}
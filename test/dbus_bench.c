@@ -0,0 +1,178 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <dbus/dbus.h>
+#include <connline/dbus.h>
+
+#include "private_bus.h"
+
+#define BUILD_ITERATIONS 500000
+#define CALL_ITERATIONS  20000
+
+#define BENCH_DESTINATION "org.freedesktop.DBus"
+#define BENCH_PATH "/org/freedesktop/DBus"
+#define BENCH_INTERFACE "org.freedesktop.DBus.Peer"
+#define BENCH_METHOD "Ping"
+
+typedef DBusMessage *(*new_method_call_f)(const char *destination,
+						const char *path,
+						const char *interface,
+						const char *method);
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static DBusMessage *new_device_get_all(new_method_call_f new_method_call,
+							const char *path)
+{
+	const char *dbus_if = "org.freedesktop.NetworkManager.Device";
+	DBusMessage *message;
+
+	message = new_method_call("org.freedesktop.NetworkManager", path,
+				"org.freedesktop.DBus.Properties", "GetAll");
+	if (message == NULL)
+		return NULL;
+
+	dbus_message_append_args(message, DBUS_TYPE_STRING, &dbus_if,
+							DBUS_TYPE_INVALID);
+
+	return message;
+}
+
+static DBusMessage *new_state(new_method_call_f new_method_call,
+							const char *path)
+{
+	return new_method_call("org.freedesktop.NetworkManager",
+				"/org/freedesktop/NetworkManager",
+				"org.freedesktop.NetworkManager", "state");
+}
+
+static void bench_build(const char *name, const char *method,
+		DBusMessage *(*new_message)(new_method_call_f, const char *),
+		new_method_call_f new_method_call)
+{
+	const char *paths[] = {
+		"/org/freedesktop/NetworkManager/Devices/0",
+		"/org/freedesktop/NetworkManager/Devices/1",
+	};
+	DBusMessage *message;
+	double start;
+	int i;
+
+	start = now();
+
+	for (i = 0; i < BUILD_ITERATIONS; i++) {
+		message = new_message(new_method_call, paths[i & 1]);
+		if (message == NULL) {
+			printf("%s: cannot build message\n", name);
+			return;
+		}
+
+		dbus_message_unref(message);
+	}
+
+	printf("%-10s build %-12s %12.0f messages/s\n", name, method,
+					BUILD_ITERATIONS / (now() - start));
+}
+
+static void bench_calls(const char *name, DBusConnection *dbus_cnx,
+					new_method_call_f new_method_call)
+{
+	DBusMessage *message, *reply;
+	double start;
+	int i;
+
+	start = now();
+
+	for (i = 0; i < CALL_ITERATIONS; i++) {
+		message = new_method_call(BENCH_DESTINATION, BENCH_PATH,
+					BENCH_INTERFACE, BENCH_METHOD);
+		if (message == NULL)
+			return;
+
+		reply = dbus_connection_send_with_reply_and_block(dbus_cnx,
+					message, DBUS_TIMEOUT_USE_DEFAULT, NULL);
+		dbus_message_unref(message);
+
+		if (reply == NULL) {
+			printf("%s: call failed\n", name);
+			return;
+		}
+
+		dbus_message_unref(reply);
+	}
+
+	printf("%-10s call  %-12s %12.0f calls/s\n", name, BENCH_METHOD,
+					CALL_ITERATIONS / (now() - start));
+}
+
+int main(void)
+{
+	DBusConnection *dbus_cnx = NULL;
+	int err = EXIT_SUCCESS;
+	struct private_bus bus;
+
+	bench_build("plain", "state", new_state,
+					dbus_message_new_method_call);
+	bench_build("template", "state", new_state,
+					connline_dbus_new_method_call);
+	bench_build("plain", "GetAll", new_device_get_all,
+					dbus_message_new_method_call);
+	bench_build("template", "GetAll", new_device_get_all,
+					connline_dbus_new_method_call);
+
+	if (private_bus_start(&bus) < 0) {
+		printf("Cannot start a private bus\n");
+		return EXIT_FAILURE;
+	}
+
+	dbus_cnx = dbus_connection_open_private(bus.address, NULL);
+	if (dbus_cnx == NULL || dbus_bus_register(dbus_cnx, NULL) == FALSE) {
+		printf("Cannot connect to the private bus\n");
+		err = EXIT_FAILURE;
+		goto out;
+	}
+
+	bench_calls("plain", dbus_cnx, dbus_message_new_method_call);
+	bench_calls("template", dbus_cnx, connline_dbus_new_method_call);
+
+out:
+	if (dbus_cnx != NULL) {
+		dbus_connection_close(dbus_cnx);
+		dbus_connection_unref(dbus_cnx);
+	}
+
+	private_bus_stop(&bus);
+
+	connline_dbus_cleanup_method_calls();
+
+	return err;
+}
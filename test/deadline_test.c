@@ -0,0 +1,364 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Checks the request deadlines on a mock NetworkManager left to ignore
+ * the first two calls:  the context must get two timeouts, each within
+ * its deadline,  the request being sent again after a growing delay, and
+ * then get connected as usual.  Left to ignore more calls than there are
+ * retries,  a second context must get an error after its last timeout.
+ * Then,  on a mock ConnMan ignoring its first call, a context must get
+ * its timeouts without its session being asked for again, and get
+ * connected once the daemon answers, late, the only call it got.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include <glib.h>
+#include <connline/connline.h>
+
+#include "fixture.h"
+
+#define TEST_TIMEOUT 10000
+#define TEST_DEADLINE 100
+#define TEST_STALLED 2
+
+/* In milliseconds: the first backoff is 125 to 250, the second 250 to 500 */
+#define TEST_FIRST_GAP (TEST_DEADLINE + 125)
+#define TEST_SECOND_GAP 250
+#define TEST_SLACK 200
+
+#define TEST_TIMEOUT_MASK (CONNLINE_EVENT_MASK_ALL | \
+				CONNLINE_EVENT_MASK(CONNLINE_EVENT_TIMEOUT))
+
+static struct test_fixture fixture;
+static long opened_at;
+static long timeouts_at[TEST_STALLED];
+static unsigned int nb_timeouts;
+static long connected_at;
+static unsigned int nb_given_up_timeouts;
+static bool given_up;
+static unsigned int nb_once_timeouts;
+static bool once_connected;
+static bool failed;
+
+static long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void callback(struct connline_context *context,
+				enum connline_event event,
+				const char **properties,
+				void *user_data)
+{
+	long now = now_ms();
+
+	switch (event) {
+	case CONNLINE_EVENT_ERROR:
+	case CONNLINE_EVENT_NO_BACKEND:
+		printf("unexpected error event\n");
+		failed = true;
+		g_main_loop_quit(fixture.loop);
+		break;
+	case CONNLINE_EVENT_TIMEOUT:
+		if (nb_timeouts == TEST_STALLED || connected_at != 0) {
+			printf("unexpected timeout\n");
+			failed = true;
+			break;
+		}
+
+		timeouts_at[nb_timeouts++] = now;
+		break;
+	case CONNLINE_EVENT_CONNECTED:
+		if (connected_at == 0)
+			connected_at = now;
+
+		g_main_loop_quit(fixture.loop);
+		break;
+	case CONNLINE_EVENT_DISCONNECTED:
+	case CONNLINE_EVENT_PROPERTY:
+		break;
+	}
+}
+
+static void given_up_callback(struct connline_context *context,
+					enum connline_event event,
+					const char **properties,
+					void *user_data)
+{
+	switch (event) {
+	case CONNLINE_EVENT_ERROR:
+		given_up = true;
+		g_main_loop_quit(fixture.loop);
+		break;
+	case CONNLINE_EVENT_TIMEOUT:
+		nb_given_up_timeouts++;
+		break;
+	case CONNLINE_EVENT_NO_BACKEND:
+	case CONNLINE_EVENT_CONNECTED:
+	case CONNLINE_EVENT_DISCONNECTED:
+	case CONNLINE_EVENT_PROPERTY:
+		printf("unexpected event %d\n", event);
+		failed = true;
+		g_main_loop_quit(fixture.loop);
+		break;
+	}
+}
+
+static void once_callback(struct connline_context *context,
+					enum connline_event event,
+					const char **properties,
+					void *user_data)
+{
+	switch (event) {
+	case CONNLINE_EVENT_TIMEOUT:
+		nb_once_timeouts++;
+		if (nb_once_timeouts == TEST_STALLED)
+			g_main_loop_quit(fixture.loop);
+		break;
+	case CONNLINE_EVENT_CONNECTED:
+		once_connected = true;
+		g_main_loop_quit(fixture.loop);
+		break;
+	case CONNLINE_EVENT_ERROR:
+	case CONNLINE_EVENT_NO_BACKEND:
+		printf("unexpected event %d\n", event);
+		failed = true;
+		g_main_loop_quit(fixture.loop);
+		break;
+	case CONNLINE_EVENT_DISCONNECTED:
+	case CONNLINE_EVENT_PROPERTY:
+		break;
+	}
+}
+
+static bool check_gap(const char *name, long start, long end,
+							long minimum)
+{
+	printf("%s after %ld ms\n", name, end - start);
+
+	if (end - start >= minimum && end - start <= 2 * minimum + TEST_SLACK)
+		return true;
+
+	printf("%s: expected between %ld and %ld ms\n", name,
+			minimum, 2 * minimum + TEST_SLACK);
+
+	return false;
+}
+
+/* Its first request is already waiting, and gets the deadline as well */
+static struct connline_context *open_context(bool background,
+					connline_callback_f callback)
+{
+	struct connline_context *context;
+
+	context = connline_open(CONNLINE_BEARER_UNKNOWN, background,
+							callback, NULL);
+	if (context == NULL)
+		return NULL;
+
+	if (connline_set_event_mask(context, TEST_TIMEOUT_MASK) != 0 ||
+			connline_set_deadline(context, TEST_DEADLINE) != 0) {
+		connline_close(context);
+		return NULL;
+	}
+
+	return context;
+}
+
+static int run_give_up(void)
+{
+	struct connline_context *context;
+
+	if (mock_daemon_stall(&fixture.daemon,
+				CONNLINE_DEADLINE_RETRIES + 1) < 0) {
+		printf("Cannot stall the mock daemon\n");
+		return EXIT_FAILURE;
+	}
+
+	context = open_context(true, given_up_callback);
+	if (context == NULL) {
+		printf("Cannot open a context\n");
+		return EXIT_FAILURE;
+	}
+
+	if (test_fixture_run(&fixture, TEST_TIMEOUT) == false)
+		failed = true;
+
+	connline_close(context);
+
+	printf("given up after %u timeouts\n", nb_given_up_timeouts);
+
+	if (failed == true || given_up == false ||
+			nb_given_up_timeouts != CONNLINE_DEADLINE_RETRIES) {
+		printf("expected an error after %u timeouts\n",
+						CONNLINE_DEADLINE_RETRIES);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/* A second CreateSession would get a second session, or an error */
+static int run_once(void)
+{
+	struct connline_context *context;
+	int answered;
+
+	mock_daemon_stop(&fixture.daemon);
+
+	if (mock_daemon_start(&fixture.daemon, MOCK_BACKEND_CONNMAN,
+						fixture.bus.address) < 0) {
+		printf("Cannot start connman mock daemon\n");
+		return EXIT_FAILURE;
+	}
+
+	if (connline_init(CONNLINE_EVENT_LOOP_GLIB, NULL) != 0) {
+		printf("Cannot initialize connline\n");
+		return EXIT_FAILURE;
+	}
+
+	if (mock_daemon_stall(&fixture.daemon, 1) < 0) {
+		printf("Cannot stall the mock daemon\n");
+		connline_cleanup();
+		return EXIT_FAILURE;
+	}
+
+	context = open_context(false, once_callback);
+	if (context == NULL) {
+		printf("Cannot open a context\n");
+		connline_cleanup();
+		return EXIT_FAILURE;
+	}
+
+	if (test_fixture_run(&fixture, TEST_TIMEOUT) == false)
+		failed = true;
+
+	if (once_connected == true) {
+		printf("connected before the daemon answered\n");
+		failed = true;
+	}
+
+	answered = mock_daemon_resume(&fixture.daemon);
+
+	if (failed == false && test_fixture_run(&fixture,
+						TEST_TIMEOUT) == false)
+		failed = true;
+
+	connline_close(context);
+	connline_cleanup();
+
+	printf("%d late replies, connected after %u timeouts\n",
+					answered, nb_once_timeouts);
+
+	if (failed == true || answered != 1 || once_connected == false ||
+				nb_once_timeouts != TEST_STALLED) {
+		printf("expected one late reply, after %u timeouts\n",
+							TEST_STALLED);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+static int run(void)
+{
+	struct connline_context *context;
+	struct connline_stats stats;
+	int err;
+
+	if (connline_init(CONNLINE_EVENT_LOOP_GLIB, NULL) != 0) {
+		printf("Cannot initialize connline\n");
+		return EXIT_FAILURE;
+	}
+
+	if (mock_daemon_stall(&fixture.daemon, TEST_STALLED) < 0) {
+		printf("Cannot stall the mock daemon\n");
+		connline_cleanup();
+		return EXIT_FAILURE;
+	}
+
+	opened_at = now_ms();
+
+	context = open_context(true, callback);
+	if (context == NULL) {
+		printf("Cannot open a context\n");
+		connline_cleanup();
+		return EXIT_FAILURE;
+	}
+
+	if (test_fixture_run(&fixture, TEST_TIMEOUT) == false)
+		failed = true;
+
+	connline_get_stats(&stats);
+
+	connline_close(context);
+
+	err = EXIT_FAILURE;
+	if (failed == false)
+		err = run_give_up();
+
+	connline_cleanup();
+
+	if (err != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+
+	if (nb_timeouts != TEST_STALLED ||
+				stats.dbus_timeouts != TEST_STALLED) {
+		printf("%u timeouts, %lu counted\n", nb_timeouts,
+						stats.dbus_timeouts);
+		return EXIT_FAILURE;
+	}
+
+	if (check_gap("first timeout", opened_at, timeouts_at[0],
+						TEST_DEADLINE) == false ||
+		check_gap("second timeout", timeouts_at[0], timeouts_at[1],
+						TEST_FIRST_GAP) == false ||
+		check_gap("connected", timeouts_at[1], connected_at,
+						TEST_SECOND_GAP) == false)
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+	int err;
+
+	if (test_fixture_setup(&fixture, MOCK_BACKEND_NM) < 0)
+		return EXIT_FAILURE;
+
+	err = run();
+	if (err == EXIT_SUCCESS)
+		err = run_once();
+
+	test_fixture_teardown(&fixture);
+
+	return err;
+}
@@ -0,0 +1,68 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <Ecore.h>
+
+#include "bench.h"
+
+static Ecore_Timer *wakeup_timer = NULL;
+
+static Eina_Bool wakeup(void *data)
+{
+	return ECORE_CALLBACK_RENEW;
+}
+
+static void *efl_setup(void)
+{
+	ecore_init();
+
+	wakeup_timer = ecore_timer_add(0.1, wakeup, NULL);
+
+	return NULL;
+}
+
+static void efl_iterate(void)
+{
+	ecore_main_loop_iterate();
+}
+
+static void efl_cleanup(void)
+{
+	if (wakeup_timer != NULL)
+		ecore_timer_del(wakeup_timer);
+
+	wakeup_timer = NULL;
+
+	ecore_shutdown();
+}
+
+static const struct bench_loop efl_loop = {
+	"efl",
+	CONNLINE_EVENT_LOOP_EFL,
+	efl_setup,
+	efl_iterate,
+	efl_cleanup,
+};
+
+int main(int argc, char *argv[])
+{
+	return bench_main(argc, argv, &efl_loop);
+}
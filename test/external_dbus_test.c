@@ -0,0 +1,205 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Checks connline_init_with_dbus() on a private connection the test owns
+ * and drives, on a mock NetworkManager:  connline must neither close it
+ * nor drop a reference it does not hold,  so that the connection is still
+ * usable after connline_cleanup(),  twice,  and is freed once its owner
+ * closes it and drops its own reference,  not before.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <glib.h>
+#include <connline/connline.h>
+
+#include "fixture.h"
+
+#define TEST_TIMEOUT 10000
+#define TEST_DRIVE_INTERVAL 10
+#define TEST_ROUNDS 2
+
+static struct test_fixture fixture;
+static DBusConnection *dbus_cnx;
+static dbus_int32_t finalized_slot = -1;
+static bool finalized;
+static bool connected;
+static bool failed;
+
+static void finalized_cb(void *data)
+{
+	bool *flag = data;
+
+	*flag = true;
+}
+
+/* What the application does with its own connection */
+static gboolean drive_cb(gpointer user_data)
+{
+	while (dbus_connection_read_write_dispatch(dbus_cnx, 0) == TRUE &&
+				dbus_connection_get_dispatch_status(dbus_cnx) ==
+						DBUS_DISPATCH_DATA_REMAINS);
+
+	return TRUE;
+}
+
+static void callback(struct connline_context *context,
+				enum connline_event event,
+				const char **properties,
+				void *user_data)
+{
+	switch (event) {
+	case CONNLINE_EVENT_ERROR:
+	case CONNLINE_EVENT_NO_BACKEND:
+		printf("unexpected error event\n");
+		failed = true;
+		g_main_loop_quit(fixture.loop);
+		break;
+	case CONNLINE_EVENT_CONNECTED:
+		connected = true;
+		g_main_loop_quit(fixture.loop);
+		break;
+	case CONNLINE_EVENT_DISCONNECTED:
+	case CONNLINE_EVENT_PROPERTY:
+	case CONNLINE_EVENT_TIMEOUT:
+		break;
+	}
+}
+
+static bool is_usable(void)
+{
+	if (finalized == true ||
+			dbus_connection_get_is_connected(dbus_cnx) == FALSE)
+		return false;
+
+	/* A round trip to the bus, on the connection as it is left */
+	return dbus_bus_name_has_owner(dbus_cnx,
+				mock_backend_to_service(MOCK_BACKEND_NM),
+				NULL) == TRUE;
+}
+
+/* Once as if it were connline's own private connection, once not */
+static int run(bool private_dbus)
+{
+	struct connline_context *context;
+
+	connected = false;
+
+	if (connline_set_private_dbus(private_dbus) != 0 ||
+			connline_init_with_dbus(CONNLINE_EVENT_LOOP_GLIB,
+						NULL, dbus_cnx) != 0) {
+		printf("Cannot initialize connline\n");
+		return EXIT_FAILURE;
+	}
+
+	context = connline_open(CONNLINE_BEARER_UNKNOWN, true, callback, NULL);
+	if (context == NULL) {
+		printf("Cannot open a context\n");
+		connline_cleanup();
+		return EXIT_FAILURE;
+	}
+
+	if (test_fixture_run(&fixture, TEST_TIMEOUT) == false)
+		failed = true;
+
+	connline_close(context);
+	connline_cleanup();
+
+	if (failed == true || connected == false) {
+		printf("expected the context to get connected\n");
+		return EXIT_FAILURE;
+	}
+
+	if (is_usable() == false) {
+		printf("the connection is not usable anymore\n");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+static int run_rounds(void)
+{
+	int err = EXIT_SUCCESS;
+	guint drive_id;
+	int i;
+
+	drive_id = g_timeout_add(TEST_DRIVE_INTERVAL, drive_cb, NULL);
+
+	for (i = 0; i < TEST_ROUNDS && err == EXIT_SUCCESS; i++)
+		err = run(i == 0);
+
+	g_source_remove(drive_id);
+
+	if (err != EXIT_SUCCESS)
+		return err;
+
+	dbus_connection_close(dbus_cnx);
+	dbus_connection_unref(dbus_cnx);
+	dbus_cnx = NULL;
+
+	if (finalized == false) {
+		printf("the connection was not freed with its owner's "
+							"reference\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("%d rounds on the application's connection\n", TEST_ROUNDS);
+
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+	int err = EXIT_FAILURE;
+
+	if (test_fixture_setup(&fixture, MOCK_BACKEND_NM) < 0)
+		return EXIT_FAILURE;
+
+	dbus_cnx = dbus_connection_open_private(fixture.bus.address, NULL);
+	if (dbus_cnx == NULL || dbus_bus_register(dbus_cnx, NULL) == FALSE ||
+		dbus_connection_allocate_data_slot(&finalized_slot) == FALSE ||
+		dbus_connection_set_data(dbus_cnx, finalized_slot,
+					&finalized, finalized_cb) == FALSE) {
+		printf("Cannot connect to the private bus\n");
+		goto out;
+	}
+
+	dbus_connection_set_exit_on_disconnect(dbus_cnx, FALSE);
+
+	err = run_rounds();
+
+out:
+	if (dbus_cnx != NULL) {
+		dbus_connection_close(dbus_cnx);
+		dbus_connection_unref(dbus_cnx);
+	}
+
+	if (finalized_slot >= 0)
+		dbus_connection_free_data_slot(&finalized_slot);
+
+	test_fixture_teardown(&fixture);
+
+	return err;
+}
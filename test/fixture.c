@@ -0,0 +1,89 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fixture.h"
+
+static gboolean timeout_cb(gpointer user_data)
+{
+	struct test_fixture *fixture = user_data;
+
+	printf("timed out\n");
+
+	fixture->timeout_id = 0;
+	fixture->timed_out = true;
+	g_main_loop_quit(fixture->loop);
+
+	return FALSE;
+}
+
+int test_fixture_setup(struct test_fixture *fixture,
+				enum mock_backend backend)
+{
+	fixture->loop = NULL;
+	fixture->timeout_id = 0;
+	fixture->timed_out = false;
+
+	if (private_bus_start(&fixture->bus) < 0) {
+		printf("Cannot start a private bus\n");
+		return -1;
+	}
+
+	setenv("DBUS_SYSTEM_BUS_ADDRESS", fixture->bus.address, 1);
+	unsetenv("CONNLINE_BROKER");
+
+	if (mock_daemon_start(&fixture->daemon, backend,
+					fixture->bus.address) < 0) {
+		printf("Cannot start %s mock daemon\n",
+					mock_backend_to_string(backend));
+		private_bus_stop(&fixture->bus);
+		return -1;
+	}
+
+	fixture->loop = g_main_loop_new(NULL, FALSE);
+
+	return 0;
+}
+
+bool test_fixture_run(struct test_fixture *fixture, unsigned int timeout)
+{
+	fixture->timed_out = false;
+	fixture->timeout_id = g_timeout_add(timeout, timeout_cb, fixture);
+
+	g_main_loop_run(fixture->loop);
+
+	if (fixture->timeout_id != 0)
+		g_source_remove(fixture->timeout_id);
+	fixture->timeout_id = 0;
+
+	return fixture->timed_out == false;
+}
+
+void test_fixture_teardown(struct test_fixture *fixture)
+{
+	g_main_loop_unref(fixture->loop);
+	fixture->loop = NULL;
+
+	mock_daemon_stop(&fixture->daemon);
+	private_bus_stop(&fixture->bus);
+}
@@ -0,0 +1,57 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNLINE_TEST_FIXTURE_H__
+#define __CONNLINE_TEST_FIXTURE_H__
+
+#include <stdbool.h>
+
+#include <glib.h>
+
+#include "mock_daemon.h"
+#include "private_bus.h"
+
+/*
+ * What the glib tests run on: a private bus the system one points to, a
+ * mock daemon on it, and a main loop.  The broker is left out of it,
+ * whatever the environment says.
+ */
+struct test_fixture {
+	struct private_bus bus;
+	struct mock_daemon daemon;
+	GMainLoop *loop;
+
+	guint timeout_id;
+	bool timed_out;
+};
+
+int test_fixture_setup(struct test_fixture *fixture,
+				enum mock_backend backend);
+
+/*
+ * Runs the loop until something quits it, or for timeout milliseconds at
+ * most.  Returns false if it timed out.
+ */
+bool test_fixture_run(struct test_fixture *fixture, unsigned int timeout);
+
+void test_fixture_teardown(struct test_fixture *fixture);
+
+#endif
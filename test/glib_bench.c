@@ -0,0 +1,64 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <glib.h>
+
+#include "bench.h"
+
+static unsigned int wakeup_source = 0;
+
+static gboolean wakeup(gpointer user_data)
+{
+	return TRUE;
+}
+
+static void *glib_setup(void)
+{
+	wakeup_source = g_timeout_add(100, wakeup, NULL);
+
+	return NULL;
+}
+
+static void glib_iterate(void)
+{
+	g_main_context_iteration(NULL, TRUE);
+}
+
+static void glib_cleanup(void)
+{
+	if (wakeup_source > 0)
+		g_source_remove(wakeup_source);
+
+	wakeup_source = 0;
+}
+
+static const struct bench_loop glib_loop = {
+	"glib",
+	CONNLINE_EVENT_LOOP_GLIB,
+	glib_setup,
+	glib_iterate,
+	glib_cleanup,
+};
+
+int main(int argc, char *argv[])
+{
+	return bench_main(argc, argv, &glib_loop);
+}
@@ -0,0 +1,176 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Checks connline_open_many() completes on a mock NetworkManager, even
+ * when not all of its first events get delivered:  once with a member
+ * whose events are all masked,  once without any callback at all.  Then
+ * the group gets a batch callback of its own,  which must get its events
+ * rather than the global one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <glib.h>
+#include <connline/connline.h>
+
+#include "fixture.h"
+
+#define TEST_TIMEOUT 10000
+#define TEST_CONTEXTS 4
+#define TEST_MASKED 2
+
+enum test_mode {
+	TEST_CALLBACK,
+	TEST_NO_CALLBACK,
+	TEST_GROUP_BATCH,
+};
+
+static struct test_fixture fixture;
+static unsigned int nb_completions;
+static unsigned int nb_events[TEST_CONTEXTS];
+static bool failed;
+
+static void callback(struct connline_context *context,
+				enum connline_event event,
+				const char **properties,
+				void *user_data)
+{
+	unsigned int index = GPOINTER_TO_INT(user_data);
+
+	switch (event) {
+	case CONNLINE_EVENT_ERROR:
+	case CONNLINE_EVENT_NO_BACKEND:
+		printf("unexpected error event\n");
+		failed = true;
+		g_main_loop_quit(fixture.loop);
+		return;
+	case CONNLINE_EVENT_DISCONNECTED:
+	case CONNLINE_EVENT_CONNECTED:
+	case CONNLINE_EVENT_PROPERTY:
+	case CONNLINE_EVENT_TIMEOUT:
+		break;
+	}
+
+	nb_events[index]++;
+}
+
+static void group_batch_callback(const struct connline_event_record *records,
+					unsigned int nb_records,
+					void *user_data)
+{
+	unsigned int i;
+
+	for (i = 0; i < nb_records; i++)
+		callback(records[i].context, records[i].event,
+				records[i].properties, records[i].user_data);
+}
+
+static void global_batch_callback(const struct connline_event_record *records,
+					unsigned int nb_records,
+					void *user_data)
+{
+	printf("the global batch callback got %u events\n", nb_records);
+	failed = true;
+}
+
+static void completion(void *user_data)
+{
+	nb_completions++;
+	g_main_loop_quit(fixture.loop);
+}
+
+static int run(enum test_mode mode)
+{
+	struct connline_context *contexts[TEST_CONTEXTS];
+	void *user_data[TEST_CONTEXTS];
+	int i;
+
+	nb_completions = 0;
+
+	for (i = 0; i < TEST_CONTEXTS; i++) {
+		user_data[i] = GINT_TO_POINTER(i);
+		nb_events[i] = 0;
+	}
+
+	if (connline_init(CONNLINE_EVENT_LOOP_GLIB, NULL) != 0) {
+		printf("Cannot initialize connline\n");
+		return EXIT_FAILURE;
+	}
+
+	if (connline_open_many(contexts, TEST_CONTEXTS,
+				CONNLINE_BEARER_UNKNOWN, true,
+				mode == TEST_CALLBACK ? callback : NULL,
+				user_data, completion, NULL) != 0) {
+		printf("Cannot open the contexts\n");
+		connline_cleanup();
+		return EXIT_FAILURE;
+	}
+
+	if (mode == TEST_GROUP_BATCH) {
+		connline_set_batch_callback(global_batch_callback, NULL);
+		connline_set_group_batch_callback(contexts[0],
+						group_batch_callback, NULL);
+	}
+
+	/* Errors only, which it must not get */
+	connline_set_event_mask(contexts[TEST_MASKED], 0);
+
+	if (test_fixture_run(&fixture, TEST_TIMEOUT) == false)
+		failed = true;
+
+	connline_close_many(contexts, TEST_CONTEXTS);
+	connline_cleanup();
+
+	printf("mode %d: %u completion(s)\n", mode, nb_completions);
+
+	if (failed == true || nb_completions != 1)
+		return EXIT_FAILURE;
+
+	for (i = 0; i < TEST_CONTEXTS && mode != TEST_NO_CALLBACK; i++) {
+		if ((i == TEST_MASKED) != (nb_events[i] == 0)) {
+			printf("context %d got %u events\n", i, nb_events[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+	int err;
+
+	if (test_fixture_setup(&fixture, MOCK_BACKEND_NM) < 0)
+		return EXIT_FAILURE;
+
+	err = run(TEST_CALLBACK);
+	if (err == EXIT_SUCCESS)
+		err = run(TEST_NO_CALLBACK);
+	if (err == EXIT_SUCCESS)
+		err = run(TEST_GROUP_BATCH);
+
+	test_fixture_teardown(&fixture);
+
+	return err;
+}
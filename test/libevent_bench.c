@@ -0,0 +1,78 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdlib.h>
+
+#include <event2/event.h>
+
+#include "bench.h"
+
+static struct event_base *ev_base = NULL;
+static struct event *wakeup_event = NULL;
+
+static void wakeup(evutil_socket_t fd, short event, void *arg)
+{
+}
+
+static void *libevent_setup(void)
+{
+	struct timeval timeout = { 0, 100000 };
+
+	ev_base = event_base_new();
+	if (ev_base == NULL)
+		return NULL;
+
+	wakeup_event = event_new(ev_base, -1, EV_PERSIST, wakeup, NULL);
+	if (wakeup_event != NULL)
+		event_add(wakeup_event, &timeout);
+
+	return ev_base;
+}
+
+static void libevent_iterate(void)
+{
+	event_base_loop(ev_base, EVLOOP_ONCE);
+}
+
+static void libevent_cleanup(void)
+{
+	if (wakeup_event != NULL)
+		event_free(wakeup_event);
+
+	if (ev_base != NULL)
+		event_base_free(ev_base);
+
+	wakeup_event = NULL;
+	ev_base = NULL;
+}
+
+static const struct bench_loop libevent_loop = {
+	"libevent",
+	CONNLINE_EVENT_LOOP_LIBEVENT,
+	libevent_setup,
+	libevent_iterate,
+	libevent_cleanup,
+};
+
+int main(int argc, char *argv[])
+{
+	return bench_main(argc, argv, &libevent_loop);
+}
@@ -0,0 +1,1263 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "mock_daemon.h"
+
+#include <connline/record.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MOCK_PATH "/org/connline/Mock"
+#define MOCK_INTERFACE "org.connline.Mock"
+
+#define MOCK_WIRED_INTERFACE "eth0"
+#define MOCK_WIRELESS_INTERFACE "wlan0"
+#define MOCK_ADDRESS "192.168.1.2"
+
+#define CONNMAN_DBUS_NAME "net.connman"
+#define CONNMAN_MANAGER_INTERFACE CONNMAN_DBUS_NAME ".Manager"
+#define CONNMAN_SESSION_INTERFACE CONNMAN_DBUS_NAME ".Session"
+#define CONNMAN_SERVICE_INTERFACE CONNMAN_DBUS_NAME ".Service"
+#define CONNMAN_NOTIFICATION_INTERFACE CONNMAN_DBUS_NAME ".Notification"
+#define CONNMAN_SERVICE_PATH "/net/connman/service/ethernet_mock"
+
+#define NM_DBUS_NAME "org.freedesktop.NetworkManager"
+#define NM_MANAGER_PATH "/org/freedesktop/NetworkManager"
+#define NM_DEVICE_PATH NM_MANAGER_PATH "/Devices/0"
+#define NM_DEVICE_INTERFACE NM_DBUS_NAME ".Device"
+
+#define NM_STATE_DISCONNECTED 20
+#define NM_STATE_CONNECTED_GLOBAL 70
+#define NM_DEVICE_TYPE_ETHERNET 1
+#define NM_DEVICE_STATE_DISCONNECTED 30
+#define NM_DEVICE_STATE_ACTIVATED 100
+
+#define WICD_DBUS_NAME "org.wicd.daemon"
+#define WICD_MANAGER_PATH "/org/wicd/daemon"
+
+#define WICD_NOT_CONNECTED 0
+#define WICD_WIRED 3
+
+#define NETWORKD_DBUS_NAME "org.freedesktop.network1"
+#define NETWORKD_MANAGER_PATH "/org/freedesktop/network1"
+#define NETWORKD_MANAGER_INTERFACE NETWORKD_DBUS_NAME ".Manager"
+#define NETWORKD_LINK_INTERFACE NETWORKD_DBUS_NAME ".Link"
+/* Indexes 1 and 2, escaped as systemd does for a leading digit */
+#define NETWORKD_LOOPBACK_PATH NETWORKD_MANAGER_PATH "/link/_31"
+#define NETWORKD_LINK_PATH NETWORKD_MANAGER_PATH "/link/_32"
+
+typedef DBusMessage *(*mock_method_f)(DBusConnection *dbus_cnx,
+							DBusMessage *message);
+
+struct mock_method {
+	const char *interface;
+	const char *method;
+	mock_method_f function;
+};
+
+struct mock_service {
+	const char *name;
+	const struct mock_method *methods;
+	/* Called once the connection state has changed */
+	void (*notify)(DBusConnection *dbus_cnx);
+};
+
+struct connman_session {
+	char *owner;
+	char *notifier;
+	bool active;
+};
+
+static const struct mock_service *service = NULL;
+static bool connected = true;
+
+/* Backend method calls still to be left unanswered */
+static unsigned int stalled = 0;
+/* Those left unanswered, until the daemon resumes */
+static DBusMessage **held = NULL;
+static unsigned int nb_held = 0;
+
+static struct connman_session *sessions = NULL;
+static unsigned int nb_sessions = 0;
+
+static void append_variant(DBusMessageIter *iter, int type, const void *value)
+{
+	char signature[2] = { type, '\0' };
+	DBusMessageIter variant;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_VARIANT,
+							signature, &variant);
+	dbus_message_iter_append_basic(&variant, type, value);
+	dbus_message_iter_close_container(iter, &variant);
+}
+
+static void open_dict(DBusMessageIter *iter, DBusMessageIter *dict)
+{
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+			DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+			DBUS_TYPE_STRING_AS_STRING DBUS_TYPE_VARIANT_AS_STRING
+			DBUS_DICT_ENTRY_END_CHAR_AS_STRING, dict);
+}
+
+static void append_entry(DBusMessageIter *dict, const char *key,
+						int type, const void *value)
+{
+	DBusMessageIter entry;
+
+	dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY,
+								NULL, &entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+	append_variant(&entry, type, value);
+	dbus_message_iter_close_container(dict, &entry);
+}
+
+/* Appends key: { sub_key: value }, as ConnMan does for IPv4 or Ethernet */
+static void append_entry_dict(DBusMessageIter *dict, const char *key,
+				const char *sub_key, const char *value)
+{
+	DBusMessageIter entry, variant, sub_dict;
+
+	dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY,
+								NULL, &entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+
+	dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT,
+					"a{sv}", &variant);
+	open_dict(&variant, &sub_dict);
+	append_entry(&sub_dict, sub_key, DBUS_TYPE_STRING, &value);
+	dbus_message_iter_close_container(&variant, &sub_dict);
+	dbus_message_iter_close_container(&entry, &variant);
+
+	dbus_message_iter_close_container(dict, &entry);
+}
+
+static DBusMessage *set_connected(DBusConnection *dbus_cnx,
+							DBusMessage *message)
+{
+	dbus_bool_t value;
+
+	if (dbus_message_get_args(message, NULL, DBUS_TYPE_BOOLEAN, &value,
+						DBUS_TYPE_INVALID) == FALSE)
+		return NULL;
+
+	if (connected != value) {
+		connected = value;
+		service->notify(dbus_cnx);
+	}
+
+	return dbus_message_new_method_return(message);
+}
+
+/* ConnMan */
+
+static const char *connman_service_state(void)
+{
+	return connected ? "online" : "idle";
+}
+
+static void connman_append_service(DBusMessageIter *iter)
+{
+	const char *path = CONNMAN_SERVICE_PATH;
+	const char *type = "ethernet";
+	const char *state = connman_service_state();
+	DBusMessageIter structure, dict;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT,
+							NULL, &structure);
+	dbus_message_iter_append_basic(&structure,
+					DBUS_TYPE_OBJECT_PATH, &path);
+
+	open_dict(&structure, &dict);
+	append_entry(&dict, "Type", DBUS_TYPE_STRING, &type);
+	append_entry(&dict, "State", DBUS_TYPE_STRING, &state);
+	append_entry_dict(&dict, "Ethernet",
+				"Interface", MOCK_WIRED_INTERFACE);
+	append_entry_dict(&dict, "IPv4", "Address", MOCK_ADDRESS);
+	dbus_message_iter_close_container(&structure, &dict);
+
+	dbus_message_iter_close_container(iter, &structure);
+}
+
+static DBusMessage *connman_get_services(DBusConnection *dbus_cnx,
+							DBusMessage *message)
+{
+	DBusMessageIter iter, array;
+	DBusMessage *reply;
+
+	reply = dbus_message_new_method_return(message);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(oa{sv})",
+								&array);
+	connman_append_service(&array);
+	dbus_message_iter_close_container(&iter, &array);
+
+	return reply;
+}
+
+static void connman_send_update(DBusConnection *dbus_cnx,
+					struct connman_session *session)
+{
+	const char *state = connected ? "online" : "disconnected";
+	const char *interface = MOCK_WIRED_INTERFACE;
+	const char *bearer = "ethernet";
+	DBusMessageIter iter, dict;
+	DBusMessage *message;
+
+	message = dbus_message_new_method_call(session->owner,
+					session->notifier,
+					CONNMAN_NOTIFICATION_INTERFACE,
+					"Update");
+	if (message == NULL)
+		return;
+
+	dbus_message_set_no_reply(message, TRUE);
+
+	dbus_message_iter_init_append(message, &iter);
+
+	open_dict(&iter, &dict);
+	append_entry(&dict, "Bearer", DBUS_TYPE_STRING, &bearer);
+	append_entry(&dict, "State", DBUS_TYPE_STRING, &state);
+	append_entry(&dict, "Interface", DBUS_TYPE_STRING, &interface);
+	append_entry_dict(&dict, "IPv4", "Address", MOCK_ADDRESS);
+	dbus_message_iter_close_container(&iter, &dict);
+
+	dbus_connection_send(dbus_cnx, message, NULL);
+	dbus_message_unref(message);
+}
+
+static DBusMessage *connman_create_session(DBusConnection *dbus_cnx,
+							DBusMessage *message)
+{
+	struct connman_session *new_sessions;
+	struct connman_session *session;
+	DBusMessageIter iter;
+	DBusMessage *reply;
+	const char *notifier;
+	char path[32];
+	char *session_path = path;
+
+	/* Settings are not honoured: there is only one service anyway */
+	if (dbus_message_iter_init(message, &iter) == FALSE ||
+			dbus_message_iter_next(&iter) == FALSE ||
+			dbus_message_iter_get_arg_type(&iter) !=
+						DBUS_TYPE_OBJECT_PATH)
+		return NULL;
+
+	dbus_message_iter_get_basic(&iter, &notifier);
+
+	new_sessions = realloc(sessions, (nb_sessions + 1) *
+					sizeof(struct connman_session));
+	if (new_sessions == NULL)
+		return NULL;
+
+	sessions = new_sessions;
+
+	session = &sessions[nb_sessions];
+	session->owner = strdup(dbus_message_get_sender(message));
+	session->notifier = strdup(notifier);
+	session->active = false;
+
+	if (session->owner == NULL || session->notifier == NULL) {
+		free(session->owner);
+		free(session->notifier);
+
+		return NULL;
+	}
+
+	snprintf(path, sizeof(path), "/sessions/%u", nb_sessions);
+	nb_sessions++;
+
+	reply = dbus_message_new_method_return(message);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_append_args(reply, DBUS_TYPE_OBJECT_PATH, &session_path,
+							DBUS_TYPE_INVALID);
+
+	return reply;
+}
+
+static struct connman_session *connman_find_session(DBusMessage *message)
+{
+	unsigned int index;
+	const char *path;
+
+	path = dbus_message_get_path(message);
+	if (path == NULL || sscanf(path, "/sessions/%u", &index) != 1)
+		return NULL;
+
+	if (index >= nb_sessions || sessions[index].owner == NULL)
+		return NULL;
+
+	return &sessions[index];
+}
+
+static DBusMessage *connman_session_connect(DBusConnection *dbus_cnx,
+							DBusMessage *message)
+{
+	struct connman_session *session;
+
+	session = connman_find_session(message);
+	if (session == NULL)
+		return NULL;
+
+	session->active = true;
+	connman_send_update(dbus_cnx, session);
+
+	return dbus_message_new_method_return(message);
+}
+
+static DBusMessage *connman_session_destroy(DBusConnection *dbus_cnx,
+							DBusMessage *message)
+{
+	struct connman_session *session;
+
+	session = connman_find_session(message);
+	if (session == NULL)
+		return NULL;
+
+	free(session->owner);
+	free(session->notifier);
+
+	session->owner = NULL;
+	session->notifier = NULL;
+	session->active = false;
+
+	return dbus_message_new_method_return(message);
+}
+
+static void connman_notify(DBusConnection *dbus_cnx)
+{
+	const char *state = connman_service_state();
+	const char *name = "State";
+	DBusMessageIter iter;
+	DBusMessage *signal;
+	unsigned int i;
+
+	signal = dbus_message_new_signal(CONNMAN_SERVICE_PATH,
+				CONNMAN_SERVICE_INTERFACE, "PropertyChanged");
+	if (signal != NULL) {
+		dbus_message_iter_init_append(signal, &iter);
+		dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &name);
+		append_variant(&iter, DBUS_TYPE_STRING, &state);
+
+		dbus_connection_send(dbus_cnx, signal, NULL);
+		dbus_message_unref(signal);
+	}
+
+	for (i = 0; i < nb_sessions; i++) {
+		if (sessions[i].active == true)
+			connman_send_update(dbus_cnx, &sessions[i]);
+	}
+}
+
+static const struct mock_method connman_methods[] = {
+	{ CONNMAN_MANAGER_INTERFACE, "GetServices", connman_get_services },
+	{ CONNMAN_MANAGER_INTERFACE, "CreateSession", connman_create_session },
+	{ CONNMAN_SESSION_INTERFACE, "Connect", connman_session_connect },
+	{ CONNMAN_SESSION_INTERFACE, "Destroy", connman_session_destroy },
+	{ NULL }
+};
+
+/* NetworkManager */
+
+static DBusMessage *nm_state(DBusConnection *dbus_cnx, DBusMessage *message)
+{
+	dbus_uint32_t state;
+	DBusMessage *reply;
+
+	state = connected ? NM_STATE_CONNECTED_GLOBAL : NM_STATE_DISCONNECTED;
+
+	reply = dbus_message_new_method_return(message);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_append_args(reply, DBUS_TYPE_UINT32, &state,
+							DBUS_TYPE_INVALID);
+
+	return reply;
+}
+
+static DBusMessage *nm_get_devices(DBusConnection *dbus_cnx,
+							DBusMessage *message)
+{
+	const char *path = NM_DEVICE_PATH;
+	const char **paths = &path;
+	DBusMessage *reply;
+
+	reply = dbus_message_new_method_return(message);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_append_args(reply, DBUS_TYPE_ARRAY,
+				DBUS_TYPE_OBJECT_PATH, &paths, 1,
+				DBUS_TYPE_INVALID);
+
+	return reply;
+}
+
+static DBusMessage *nm_device_get_all(DBusConnection *dbus_cnx,
+							DBusMessage *message)
+{
+	const char *interface = MOCK_WIRED_INTERFACE;
+	dbus_uint32_t type = NM_DEVICE_TYPE_ETHERNET;
+	dbus_uint32_t address = inet_addr(MOCK_ADDRESS);
+	dbus_bool_t managed = TRUE;
+	DBusMessageIter iter, dict;
+	dbus_uint32_t state;
+	DBusMessage *reply;
+
+	if (strcmp(dbus_message_get_path(message), NM_DEVICE_PATH) != 0)
+		return NULL;
+
+	state = connected ? NM_DEVICE_STATE_ACTIVATED :
+					NM_DEVICE_STATE_DISCONNECTED;
+
+	reply = dbus_message_new_method_return(message);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	open_dict(&iter, &dict);
+	append_entry(&dict, "Managed", DBUS_TYPE_BOOLEAN, &managed);
+	append_entry(&dict, "State", DBUS_TYPE_UINT32, &state);
+	append_entry(&dict, "DeviceType", DBUS_TYPE_UINT32, &type);
+	append_entry(&dict, "Ip4Address", DBUS_TYPE_UINT32, &address);
+	append_entry(&dict, "IpInterface", DBUS_TYPE_STRING, &interface);
+	dbus_message_iter_close_container(&iter, &dict);
+
+	return reply;
+}
+
+static void nm_notify(DBusConnection *dbus_cnx)
+{
+	dbus_uint32_t state;
+	DBusMessage *signal;
+
+	state = connected ? NM_STATE_CONNECTED_GLOBAL : NM_STATE_DISCONNECTED;
+
+	signal = dbus_message_new_signal(NM_MANAGER_PATH,
+					NM_DBUS_NAME, "StateChanged");
+	if (signal == NULL)
+		return;
+
+	dbus_message_append_args(signal, DBUS_TYPE_UINT32, &state,
+							DBUS_TYPE_INVALID);
+
+	dbus_connection_send(dbus_cnx, signal, NULL);
+	dbus_message_unref(signal);
+}
+
+static const struct mock_method nm_methods[] = {
+	{ NM_DBUS_NAME, "state", nm_state },
+	{ NM_DBUS_NAME, "GetDevices", nm_get_devices },
+	{ DBUS_INTERFACE_PROPERTIES, "GetAll", nm_device_get_all },
+	{ NULL }
+};
+
+/* Wicd */
+
+static void wicd_append_status(DBusMessageIter *iter)
+{
+	const char *address = MOCK_ADDRESS;
+	DBusMessageIter array;
+	dbus_uint32_t state;
+
+	state = connected ? WICD_WIRED : WICD_NOT_CONNECTED;
+
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_UINT32, &state);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					DBUS_TYPE_STRING_AS_STRING, &array);
+	if (connected == true)
+		dbus_message_iter_append_basic(&array,
+					DBUS_TYPE_STRING, &address);
+	dbus_message_iter_close_container(iter, &array);
+}
+
+static DBusMessage *wicd_get_connection_status(DBusConnection *dbus_cnx,
+							DBusMessage *message)
+{
+	DBusMessageIter iter, structure;
+	DBusMessage *reply;
+
+	reply = dbus_message_new_method_return(message);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_STRUCT,
+							NULL, &structure);
+	wicd_append_status(&structure);
+	dbus_message_iter_close_container(&iter, &structure);
+
+	return reply;
+}
+
+static DBusMessage *wicd_reply_string(DBusMessage *message,
+							const char *value)
+{
+	DBusMessage *reply;
+
+	reply = dbus_message_new_method_return(message);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_append_args(reply, DBUS_TYPE_STRING, &value,
+							DBUS_TYPE_INVALID);
+
+	return reply;
+}
+
+static DBusMessage *wicd_get_wired_interface(DBusConnection *dbus_cnx,
+							DBusMessage *message)
+{
+	return wicd_reply_string(message, MOCK_WIRED_INTERFACE);
+}
+
+static DBusMessage *wicd_get_wireless_interface(DBusConnection *dbus_cnx,
+							DBusMessage *message)
+{
+	return wicd_reply_string(message, MOCK_WIRELESS_INTERFACE);
+}
+
+static void wicd_notify(DBusConnection *dbus_cnx)
+{
+	DBusMessageIter iter;
+	DBusMessage *signal;
+
+	signal = dbus_message_new_signal(WICD_MANAGER_PATH,
+					WICD_DBUS_NAME, "StatusChanged");
+	if (signal == NULL)
+		return;
+
+	dbus_message_iter_init_append(signal, &iter);
+	wicd_append_status(&iter);
+
+	dbus_connection_send(dbus_cnx, signal, NULL);
+	dbus_message_unref(signal);
+}
+
+static DBusMessage *wicd_autoconnect(DBusConnection *dbus_cnx,
+							DBusMessage *message)
+{
+	if (connected == false) {
+		connected = true;
+		wicd_notify(dbus_cnx);
+	}
+
+	return dbus_message_new_method_return(message);
+}
+
+static const struct mock_method wicd_methods[] = {
+	{ WICD_DBUS_NAME, "GetConnectionStatus", wicd_get_connection_status },
+	{ WICD_DBUS_NAME, "GetWiredInterface", wicd_get_wired_interface },
+	{ WICD_DBUS_NAME, "GetWirelessInterface", wicd_get_wireless_interface },
+	{ WICD_DBUS_NAME, "AutoConnect", wicd_autoconnect },
+	{ NULL }
+};
+
+/* systemd-networkd */
+
+static void networkd_append_link(DBusMessageIter *array, dbus_int32_t index,
+					const char *name, const char *path)
+{
+	DBusMessageIter structure;
+
+	dbus_message_iter_open_container(array, DBUS_TYPE_STRUCT,
+							NULL, &structure);
+	dbus_message_iter_append_basic(&structure, DBUS_TYPE_INT32, &index);
+	dbus_message_iter_append_basic(&structure, DBUS_TYPE_STRING, &name);
+	dbus_message_iter_append_basic(&structure,
+					DBUS_TYPE_OBJECT_PATH, &path);
+	dbus_message_iter_close_container(array, &structure);
+}
+
+static DBusMessage *networkd_list_links(DBusConnection *dbus_cnx,
+							DBusMessage *message)
+{
+	DBusMessageIter iter, array;
+	DBusMessage *reply;
+
+	reply = dbus_message_new_method_return(message);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(iso)",
+								&array);
+	networkd_append_link(&array, 1, "lo", NETWORKD_LOOPBACK_PATH);
+	networkd_append_link(&array, 2, MOCK_WIRED_INTERFACE,
+							NETWORKD_LINK_PATH);
+	dbus_message_iter_close_container(&iter, &array);
+
+	return reply;
+}
+
+static void networkd_append_states(DBusMessageIter *dict, bool loopback)
+{
+	const char *operational, *address;
+
+	if (loopback == true) {
+		operational = "carrier";
+		address = "off";
+	} else {
+		operational = connected ? "routable" : "no-carrier";
+		address = connected ? "routable" : "off";
+	}
+
+	append_entry(dict, "OperationalState", DBUS_TYPE_STRING, &operational);
+	append_entry(dict, "AddressState", DBUS_TYPE_STRING, &address);
+}
+
+static DBusMessage *networkd_link_get_all(DBusConnection *dbus_cnx,
+							DBusMessage *message)
+{
+	const char *administrative = "configured";
+	DBusMessageIter iter, dict;
+	DBusMessage *reply;
+	bool loopback;
+
+	if (dbus_message_has_path(message, NETWORKD_LINK_PATH) == TRUE)
+		loopback = false;
+	else if (dbus_message_has_path(message,
+					NETWORKD_LOOPBACK_PATH) == TRUE)
+		loopback = true;
+	else
+		return NULL;
+
+	reply = dbus_message_new_method_return(message);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	open_dict(&iter, &dict);
+	networkd_append_states(&dict, loopback);
+	append_entry(&dict, "AdministrativeState", DBUS_TYPE_STRING,
+							&administrative);
+	dbus_message_iter_close_container(&iter, &dict);
+
+	return reply;
+}
+
+static void networkd_notify(DBusConnection *dbus_cnx)
+{
+	const char *interface = NETWORKD_LINK_INTERFACE;
+	DBusMessageIter iter, dict, array;
+	DBusMessage *signal;
+
+	signal = dbus_message_new_signal(NETWORKD_LINK_PATH,
+				DBUS_INTERFACE_PROPERTIES, "PropertiesChanged");
+	if (signal == NULL)
+		return;
+
+	dbus_message_iter_init_append(signal, &iter);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &interface);
+
+	open_dict(&iter, &dict);
+	networkd_append_states(&dict, false);
+	dbus_message_iter_close_container(&iter, &dict);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_TYPE_STRING_AS_STRING, &array);
+	dbus_message_iter_close_container(&iter, &array);
+
+	dbus_connection_send(dbus_cnx, signal, NULL);
+	dbus_message_unref(signal);
+}
+
+static const struct mock_method networkd_methods[] = {
+	{ NETWORKD_MANAGER_INTERFACE, "ListLinks", networkd_list_links },
+	{ DBUS_INTERFACE_PROPERTIES, "GetAll", networkd_link_get_all },
+	{ NULL }
+};
+
+static const struct mock_service services[MOCK_BACKEND_MAX] = {
+	{ CONNMAN_DBUS_NAME, connman_methods, connman_notify },
+	{ NM_DBUS_NAME, nm_methods, nm_notify },
+	{ WICD_DBUS_NAME, wicd_methods, wicd_notify },
+	{ NETWORKD_DBUS_NAME, networkd_methods, networkd_notify },
+};
+
+/* Replay */
+
+/* ConnMan notifications go to each session's own notifier */
+static unsigned int replay_method_call(DBusConnection *dbus_cnx,
+							DBusMessage *message)
+{
+	DBusMessage *copy;
+	unsigned int i, sent = 0;
+
+	if (dbus_message_has_interface(message,
+				CONNMAN_NOTIFICATION_INTERFACE) == FALSE)
+		return 0;
+
+	for (i = 0; i < nb_sessions; i++) {
+		if (sessions[i].active == false)
+			continue;
+
+		copy = dbus_message_copy(message);
+		if (copy == NULL)
+			break;
+
+		dbus_message_set_destination(copy, sessions[i].owner);
+		dbus_message_set_path(copy, sessions[i].notifier);
+		dbus_message_set_no_reply(copy, TRUE);
+
+		if (dbus_connection_send(dbus_cnx, copy, NULL) == TRUE)
+			sent++;
+
+		dbus_message_unref(copy);
+	}
+
+	return sent;
+}
+
+static unsigned int replay_message(DBusConnection *dbus_cnx,
+							DBusMessage *message)
+{
+	DBusMessage *copy;
+	unsigned int sent = 0;
+
+	/* The bus' own messages cannot be sent by anybody else */
+	if (dbus_message_has_sender(message, DBUS_SERVICE_DBUS) == TRUE)
+		return 0;
+
+	switch (dbus_message_get_type(message)) {
+	case DBUS_MESSAGE_TYPE_SIGNAL:
+		copy = dbus_message_copy(message);
+		if (copy == NULL)
+			break;
+
+		dbus_message_set_destination(copy, NULL);
+
+		if (dbus_connection_send(dbus_cnx, copy, NULL) == TRUE)
+			sent++;
+
+		dbus_message_unref(copy);
+		break;
+	case DBUS_MESSAGE_TYPE_METHOD_CALL:
+		sent = replay_method_call(dbus_cnx, message);
+		break;
+	}
+
+	return sent;
+}
+
+static void wait_until(struct timespec *start, uint64_t delay)
+{
+	struct timespec deadline;
+
+	deadline.tv_sec = start->tv_sec + delay / 1000000000;
+	deadline.tv_nsec = start->tv_nsec + delay % 1000000000;
+
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+						&deadline, NULL) == EINTR);
+}
+
+static DBusMessage *replay(DBusConnection *dbus_cnx, DBusMessage *message)
+{
+	struct connline_record_header header;
+	struct connline_record_entry entry;
+	dbus_uint32_t sent = 0;
+	uint64_t first = 0;
+	struct timespec start;
+	DBusMessage *reply, *recorded;
+	const char *path;
+	dbus_bool_t paced;
+	char *blob;
+	FILE *file;
+
+	if (dbus_message_get_args(message, NULL, DBUS_TYPE_STRING, &path,
+					DBUS_TYPE_BOOLEAN, &paced,
+					DBUS_TYPE_INVALID) == FALSE)
+		return NULL;
+
+	file = fopen(path, "r");
+	if (file == NULL)
+		return dbus_message_new_error(message, DBUS_ERROR_FILE_NOT_FOUND,
+								path);
+
+	if (fread(&header, sizeof(header), 1, file) != 1 ||
+			memcmp(header.magic, CONNLINE_RECORD_MAGIC,
+						sizeof(header.magic)) != 0 ||
+			header.version != CONNLINE_RECORD_VERSION) {
+		fclose(file);
+
+		return dbus_message_new_error(message,
+				DBUS_ERROR_INVALID_ARGS, "Not a connline record");
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (fread(&entry, sizeof(entry), 1, file) == 1) {
+		blob = malloc(entry.size);
+		if (blob == NULL)
+			break;
+
+		if (fread(blob, entry.size, 1, file) != 1) {
+			free(blob);
+			break;
+		}
+
+		recorded = dbus_message_demarshal(blob, entry.size, NULL);
+		free(blob);
+
+		if (recorded == NULL)
+			continue;
+
+		if (first == 0)
+			first = entry.timestamp;
+
+		if (paced == TRUE)
+			wait_until(&start, entry.timestamp - first);
+
+		sent += replay_message(dbus_cnx, recorded);
+
+		dbus_message_unref(recorded);
+	}
+
+	fclose(file);
+
+	reply = dbus_message_new_method_return(message);
+	if (reply != NULL)
+		dbus_message_append_args(reply, DBUS_TYPE_UINT32, &sent,
+							DBUS_TYPE_INVALID);
+
+	return reply;
+}
+
+static DBusMessage *stall(DBusConnection *dbus_cnx, DBusMessage *message)
+{
+	dbus_uint32_t calls;
+
+	if (dbus_message_get_args(message, NULL, DBUS_TYPE_UINT32, &calls,
+						DBUS_TYPE_INVALID) == FALSE)
+		return NULL;
+
+	stalled = calls;
+
+	return dbus_message_new_method_return(message);
+}
+
+static mock_method_f find_method(const struct mock_method *methods,
+							DBusMessage *message)
+{
+	const struct mock_method *method;
+
+	for (method = methods; method->interface != NULL; method++) {
+		if (dbus_message_is_method_call(message, method->interface,
+						method->method) == TRUE)
+			return method->function;
+	}
+
+	return NULL;
+}
+
+static void hold(DBusMessage *message)
+{
+	DBusMessage **new_held;
+
+	new_held = realloc(held, (nb_held + 1) * sizeof(DBusMessage *));
+	if (new_held == NULL)
+		return;
+
+	held = new_held;
+	held[nb_held++] = dbus_message_ref(message);
+}
+
+static void answer(DBusConnection *dbus_cnx, DBusMessage *message,
+						mock_method_f function)
+{
+	DBusMessage *reply = NULL;
+
+	if (function != NULL)
+		reply = function(dbus_cnx, message);
+
+	if (reply == NULL)
+		reply = dbus_message_new_error(message,
+					DBUS_ERROR_UNKNOWN_METHOD,
+					"Not implemented by the mock daemon");
+
+	if (reply != NULL && dbus_message_get_no_reply(message) == FALSE)
+		dbus_connection_send(dbus_cnx, reply, NULL);
+
+	if (reply != NULL)
+		dbus_message_unref(reply);
+}
+
+/* Late replies: the callers may well have given up on them */
+static DBusMessage *resume(DBusConnection *dbus_cnx, DBusMessage *message)
+{
+	dbus_uint32_t answered = nb_held;
+	DBusMessage *reply;
+	unsigned int i;
+
+	stalled = 0;
+
+	for (i = 0; i < nb_held; i++) {
+		answer(dbus_cnx, held[i],
+				find_method(service->methods, held[i]));
+		dbus_message_unref(held[i]);
+	}
+
+	free(held);
+	held = NULL;
+	nb_held = 0;
+
+	reply = dbus_message_new_method_return(message);
+	if (reply != NULL)
+		dbus_message_append_args(reply, DBUS_TYPE_UINT32, &answered,
+							DBUS_TYPE_INVALID);
+
+	return reply;
+}
+
+static const struct mock_method control_methods[] = {
+	{ MOCK_INTERFACE, "SetConnected", set_connected },
+	{ MOCK_INTERFACE, "Stall", stall },
+	{ MOCK_INTERFACE, "Resume", resume },
+	{ MOCK_INTERFACE, "Replay", replay },
+	{ NULL }
+};
+
+static DBusHandlerResult mock_dispatch(DBusConnection *dbus_cnx,
+							DBusMessage *message,
+							void *user_data)
+{
+	mock_method_f function;
+
+	if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_METHOD_CALL)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	function = find_method(service->methods, message);
+	if (function != NULL && stalled > 0) {
+		/* A hung daemon: the call is read, and that is all */
+		stalled--;
+		hold(message);
+		return DBUS_HANDLER_RESULT_HANDLED;
+	}
+
+	if (function == NULL)
+		function = find_method(control_methods, message);
+
+	answer(dbus_cnx, message, function);
+
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+static int mock_run(enum mock_backend backend, const char *address,
+								int ready_fd)
+{
+	DBusConnection *dbus_cnx;
+
+	service = &services[backend];
+
+	dbus_cnx = dbus_connection_open_private(address, NULL);
+	if (dbus_cnx == NULL)
+		return EXIT_FAILURE;
+
+	if (dbus_bus_register(dbus_cnx, NULL) == FALSE)
+		return EXIT_FAILURE;
+
+	if (dbus_bus_request_name(dbus_cnx, service->name,
+				DBUS_NAME_FLAG_DO_NOT_QUEUE, NULL) !=
+				DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER)
+		return EXIT_FAILURE;
+
+	if (dbus_connection_add_filter(dbus_cnx,
+					mock_dispatch, NULL, NULL) == FALSE)
+		return EXIT_FAILURE;
+
+	/* The name is owned: the daemon is up for its clients */
+	if (write(ready_fd, "", 1) != 1)
+		return EXIT_FAILURE;
+
+	close(ready_fd);
+
+	while (dbus_connection_read_write_dispatch(dbus_cnx, -1) == TRUE);
+
+	return EXIT_SUCCESS;
+}
+
+const char *mock_backend_to_string(enum mock_backend backend)
+{
+	switch (backend) {
+	case MOCK_BACKEND_CONNMAN:
+		return "connman";
+	case MOCK_BACKEND_NM:
+		return "nm";
+	case MOCK_BACKEND_WICD:
+		return "wicd";
+	case MOCK_BACKEND_NETWORKD:
+		return "networkd";
+	case MOCK_BACKEND_MAX:
+		break;
+	}
+
+	return "unknown";
+}
+
+const char *mock_backend_to_service(enum mock_backend backend)
+{
+	if (backend >= MOCK_BACKEND_MAX)
+		return NULL;
+
+	return services[backend].name;
+}
+
+int mock_daemon_start(struct mock_daemon *daemon,
+				enum mock_backend backend,
+				const char *address)
+{
+	char ready;
+	int fds[2];
+
+	if (backend >= MOCK_BACKEND_MAX)
+		return -EINVAL;
+
+	memset(daemon, 0, sizeof(struct mock_daemon));
+
+	daemon->backend = backend;
+	strncpy(daemon->address, address, sizeof(daemon->address) - 1);
+
+	if (pipe(fds) < 0)
+		return -errno;
+
+	daemon->pid = fork();
+	if (daemon->pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+
+		return -errno;
+	}
+
+	if (daemon->pid == 0) {
+		close(fds[0]);
+		_exit(mock_run(backend, address, fds[1]));
+	}
+
+	close(fds[1]);
+
+	if (read(fds[0], &ready, 1) != 1) {
+		close(fds[0]);
+		mock_daemon_stop(daemon);
+
+		return -EIO;
+	}
+
+	close(fds[0]);
+
+	return 0;
+}
+
+static int open_control(struct mock_daemon *daemon)
+{
+	if (daemon->control != NULL)
+		return 0;
+
+	daemon->control = dbus_connection_open_private(daemon->address, NULL);
+	if (daemon->control == NULL)
+		return -EIO;
+
+	if (dbus_bus_register(daemon->control, NULL) == FALSE) {
+		mock_daemon_release(daemon);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+int mock_daemon_set_connected(struct mock_daemon *daemon, bool connected)
+{
+	dbus_bool_t value = connected;
+	DBusMessage *message, *reply;
+
+	if (open_control(daemon) < 0)
+		return -EIO;
+
+	message = dbus_message_new_method_call(services[daemon->backend].name,
+						MOCK_PATH, MOCK_INTERFACE,
+						"SetConnected");
+	if (message == NULL)
+		return -ENOMEM;
+
+	dbus_message_append_args(message, DBUS_TYPE_BOOLEAN, &value,
+							DBUS_TYPE_INVALID);
+
+	reply = dbus_connection_send_with_reply_and_block(daemon->control,
+				message, DBUS_TIMEOUT_USE_DEFAULT, NULL);
+	dbus_message_unref(message);
+
+	if (reply == NULL)
+		return -EIO;
+
+	dbus_message_unref(reply);
+
+	return 0;
+}
+
+int mock_daemon_stall(struct mock_daemon *daemon, unsigned int calls)
+{
+	dbus_uint32_t value = calls;
+	DBusMessage *message, *reply;
+
+	if (open_control(daemon) < 0)
+		return -EIO;
+
+	message = dbus_message_new_method_call(services[daemon->backend].name,
+						MOCK_PATH, MOCK_INTERFACE,
+						"Stall");
+	if (message == NULL)
+		return -ENOMEM;
+
+	dbus_message_append_args(message, DBUS_TYPE_UINT32, &value,
+							DBUS_TYPE_INVALID);
+
+	reply = dbus_connection_send_with_reply_and_block(daemon->control,
+				message, DBUS_TIMEOUT_USE_DEFAULT, NULL);
+	dbus_message_unref(message);
+
+	if (reply == NULL)
+		return -EIO;
+
+	dbus_message_unref(reply);
+
+	return 0;
+}
+
+int mock_daemon_replay(struct mock_daemon *daemon, const char *path,
+								bool paced)
+{
+	DBusMessage *message, *reply;
+	dbus_bool_t value = paced;
+	dbus_uint32_t sent;
+	DBusError error;
+
+	if (open_control(daemon) < 0)
+		return -EIO;
+
+	message = dbus_message_new_method_call(services[daemon->backend].name,
+						MOCK_PATH, MOCK_INTERFACE,
+						"Replay");
+	if (message == NULL)
+		return -ENOMEM;
+
+	dbus_message_append_args(message, DBUS_TYPE_STRING, &path,
+						DBUS_TYPE_BOOLEAN, &value,
+						DBUS_TYPE_INVALID);
+
+	dbus_error_init(&error);
+
+	reply = dbus_connection_send_with_reply_and_block(daemon->control,
+				message, DBUS_TIMEOUT_INFINITE, &error);
+	dbus_message_unref(message);
+
+	if (reply == NULL) {
+		printf("Cannot replay %s: %s\n", path, error.message);
+		dbus_error_free(&error);
+
+		return -EIO;
+	}
+
+	if (dbus_message_get_args(reply, NULL, DBUS_TYPE_UINT32, &sent,
+						DBUS_TYPE_INVALID) == FALSE) {
+		dbus_message_unref(reply);
+		return -EIO;
+	}
+
+	dbus_message_unref(reply);
+
+	return sent;
+}
+
+int mock_daemon_resume(struct mock_daemon *daemon)
+{
+	DBusMessage *message, *reply;
+	dbus_uint32_t answered;
+
+	if (open_control(daemon) < 0)
+		return -EIO;
+
+	message = dbus_message_new_method_call(services[daemon->backend].name,
+						MOCK_PATH, MOCK_INTERFACE,
+						"Resume");
+	if (message == NULL)
+		return -ENOMEM;
+
+	reply = dbus_connection_send_with_reply_and_block(daemon->control,
+				message, DBUS_TIMEOUT_USE_DEFAULT, NULL);
+	dbus_message_unref(message);
+
+	if (reply == NULL)
+		return -EIO;
+
+	if (dbus_message_get_args(reply, NULL, DBUS_TYPE_UINT32, &answered,
+						DBUS_TYPE_INVALID) == FALSE) {
+		dbus_message_unref(reply);
+		return -EIO;
+	}
+
+	dbus_message_unref(reply);
+
+	return answered;
+}
+
+void mock_daemon_release(struct mock_daemon *daemon)
+{
+	if (daemon->control == NULL)
+		return;
+
+	dbus_connection_close(daemon->control);
+	dbus_connection_unref(daemon->control);
+
+	daemon->control = NULL;
+}
+
+void mock_daemon_stop(struct mock_daemon *daemon)
+{
+	mock_daemon_release(daemon);
+
+	if (daemon->pid > 0) {
+		kill(daemon->pid, SIGTERM);
+		waitpid(daemon->pid, NULL, 0);
+	}
+
+	daemon->pid = 0;
+}
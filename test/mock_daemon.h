@@ -0,0 +1,86 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNLINE_TEST_MOCK_DAEMON_H__
+#define __CONNLINE_TEST_MOCK_DAEMON_H__
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include <dbus/dbus.h>
+
+enum mock_backend {
+	MOCK_BACKEND_CONNMAN  = 0,
+	MOCK_BACKEND_NM       = 1,
+	MOCK_BACKEND_WICD     = 2,
+	MOCK_BACKEND_NETWORKD = 3,
+	MOCK_BACKEND_MAX      = 4,
+};
+
+/*
+ * A fake connection manager, implementing only what connline backends use
+ * of the real one.  It runs in its own process, on the given bus, and starts
+ * connected through ethernet.  The connection state is driven from the
+ * process calling mock_daemon_set_connected().
+ */
+struct mock_daemon {
+	pid_t pid;
+	enum mock_backend backend;
+	char address[256];
+
+	DBusConnection *control;
+};
+
+const char *mock_backend_to_string(enum mock_backend backend);
+
+/* The D-Bus name the mock daemon owns */
+const char *mock_backend_to_service(enum mock_backend backend);
+
+int mock_daemon_start(struct mock_daemon *daemon,
+				enum mock_backend backend,
+				const char *address);
+
+int mock_daemon_set_connected(struct mock_daemon *daemon, bool connected);
+
+/* The next calls method calls to the daemon get no reply, as if it hung */
+int mock_daemon_stall(struct mock_daemon *daemon, unsigned int calls);
+
+/*
+ * The calls left unanswered get their replies,  late, and the next ones
+ * get theirs at once.  Returns how many calls were answered late.
+ */
+int mock_daemon_resume(struct mock_daemon *daemon);
+
+/*
+ * Sends again what a connline application recorded, see CONNLINE_RECORD,
+ * as fast as possible or at the recorded pace.  Only signals and ConnMan
+ * notifications are replayed, the latter to every active session.
+ * Returns how many messages were sent.
+ */
+int mock_daemon_replay(struct mock_daemon *daemon, const char *path,
+								bool paced);
+
+/* Drops the control connection only, the daemon keeps running */
+void mock_daemon_release(struct mock_daemon *daemon);
+
+void mock_daemon_stop(struct mock_daemon *daemon);
+
+#endif
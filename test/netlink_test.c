@@ -0,0 +1,435 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Replays rtnetlink traffic through the daemonless netlink backend:
+ * without argument, a synthetic record made here, whose events are
+ * checked; with a record path, as CONNLINE_NETLINK_RECORD captured it,
+ * whose events are printed.  connline allocates through a counting
+ * allocator, which must get everything back by connline_cleanup().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include <glib.h>
+#include <connline/connline.h>
+#include <connline/record.h>
+
+#define TEST_INTERFACE "cleth0"
+#define TEST_INDEX 4242
+#define TEST_IPV4 "192.0.2.10"
+#define TEST_IPV6 "2001:db8::10"
+
+#define TEST_TIMEOUT 3000
+#define TEST_EVENTS_SIZE 512
+#define TEST_CONTEXTS 3
+
+struct test_context {
+	const char *name;
+	char events[TEST_EVENTS_SIZE];
+	bool done;
+};
+
+static GMainLoop *loop;
+
+struct test_allocator {
+	unsigned long blocks;
+	size_t bytes;
+	bool size_mismatch;
+};
+
+static struct test_allocator counting;
+static struct test_context contexts[TEST_CONTEXTS];
+
+static char datagram[4096];
+static size_t datagram_size;
+
+static struct nlmsghdr *add_message(int type, size_t size)
+{
+	struct nlmsghdr *nh;
+
+	nh = (struct nlmsghdr *) (datagram + datagram_size);
+	memset(nh, 0, NLMSG_SPACE(size));
+
+	nh->nlmsg_len = NLMSG_LENGTH(size);
+	nh->nlmsg_type = type;
+	nh->nlmsg_flags = NLM_F_MULTI;
+
+	return nh;
+}
+
+static void add_attribute(struct nlmsghdr *nh, int type,
+					const void *data, size_t size)
+{
+	struct rtattr *rta;
+
+	rta = (struct rtattr *) ((char *) nh + NLMSG_ALIGN(nh->nlmsg_len));
+	rta->rta_type = type;
+	rta->rta_len = RTA_LENGTH(size);
+	memcpy(RTA_DATA(rta), data, size);
+
+	nh->nlmsg_len = NLMSG_ALIGN(nh->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+static void end_message(struct nlmsghdr *nh)
+{
+	datagram_size += NLMSG_ALIGN(nh->nlmsg_len);
+}
+
+static void add_link(void)
+{
+	struct ifinfomsg *ifi;
+	struct nlmsghdr *nh;
+
+	nh = add_message(RTM_NEWLINK, sizeof(*ifi));
+	ifi = NLMSG_DATA(nh);
+	ifi->ifi_family = AF_UNSPEC;
+	ifi->ifi_type = ARPHRD_ETHER;
+	ifi->ifi_index = TEST_INDEX;
+	ifi->ifi_flags = IFF_UP | IFF_RUNNING;
+
+	add_attribute(nh, IFLA_IFNAME, TEST_INTERFACE,
+					sizeof(TEST_INTERFACE));
+	end_message(nh);
+}
+
+static void add_address(int family, const char *address)
+{
+	unsigned char buffer[sizeof(struct in6_addr)];
+	struct ifaddrmsg *ifa;
+	struct nlmsghdr *nh;
+	size_t size;
+
+	size = family == AF_INET ? sizeof(struct in_addr) :
+						sizeof(struct in6_addr);
+	inet_pton(family, address, buffer);
+
+	nh = add_message(RTM_NEWADDR, sizeof(*ifa));
+	ifa = NLMSG_DATA(nh);
+	ifa->ifa_family = family;
+	ifa->ifa_prefixlen = family == AF_INET ? 24 : 64;
+	ifa->ifa_scope = RT_SCOPE_UNIVERSE;
+	ifa->ifa_index = TEST_INDEX;
+
+	add_attribute(nh, IFA_ADDRESS, buffer, size);
+	if (family == AF_INET)
+		add_attribute(nh, IFA_LOCAL, buffer, size);
+	end_message(nh);
+}
+
+static void add_default_route(int type)
+{
+	uint32_t index = TEST_INDEX, metric = 100;
+	struct rtmsg *rtm;
+	struct nlmsghdr *nh;
+
+	nh = add_message(type, sizeof(*rtm));
+	rtm = NLMSG_DATA(nh);
+	rtm->rtm_family = AF_INET;
+	rtm->rtm_table = RT_TABLE_MAIN;
+	rtm->rtm_protocol = RTPROT_DHCP;
+	rtm->rtm_scope = RT_SCOPE_UNIVERSE;
+	rtm->rtm_type = RTN_UNICAST;
+
+	add_attribute(nh, RTA_OIF, &index, sizeof(index));
+	add_attribute(nh, RTA_PRIORITY, &metric, sizeof(metric));
+	end_message(nh);
+}
+
+static void add_done(void)
+{
+	struct nlmsghdr *nh;
+
+	nh = add_message(NLMSG_DONE, sizeof(int));
+	end_message(nh);
+}
+
+static bool write_datagram(FILE *file)
+{
+	struct connline_record_entry entry;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.size = datagram_size;
+
+	datagram_size = 0;
+
+	return fwrite(&entry, sizeof(entry), 1, file) == 1 &&
+			fwrite(datagram, entry.size, 1, file) == 1;
+}
+
+/* The three dumps, then the default route going away */
+static bool write_record(const char *path)
+{
+	struct connline_record_header header;
+	bool ret = true;
+	FILE *file;
+
+	file = fopen(path, "w");
+	if (file == NULL)
+		return false;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CONNLINE_NETLINK_RECORD_MAGIC,
+						sizeof(header.magic));
+	header.version = CONNLINE_RECORD_VERSION;
+	ret &= fwrite(&header, sizeof(header), 1, file) == 1;
+
+	add_link();
+	add_done();
+	ret &= write_datagram(file);
+
+	add_address(AF_INET, TEST_IPV4);
+	add_address(AF_INET6, TEST_IPV6);
+	add_done();
+	ret &= write_datagram(file);
+
+	add_default_route(RTM_NEWROUTE);
+	add_done();
+	ret &= write_datagram(file);
+
+	add_default_route(RTM_DELROUTE);
+	ret &= write_datagram(file);
+
+	if (fclose(file) != 0)
+		ret = false;
+
+	return ret;
+}
+
+static void append_event(struct test_context *test, const char *fmt, ...)
+{
+	size_t length = strlen(test->events);
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(test->events + length, TEST_EVENTS_SIZE - length, fmt, ap);
+	va_end(ap);
+}
+
+static void callback(struct connline_context *context,
+					enum connline_event event,
+					const char **properties,
+					void *user_data)
+{
+	struct test_context *test = user_data;
+	int i;
+
+	switch (event) {
+	case CONNLINE_EVENT_ERROR:
+		append_event(test, "error ");
+		break;
+	case CONNLINE_EVENT_NO_BACKEND:
+		append_event(test, "no_backend ");
+		break;
+	case CONNLINE_EVENT_DISCONNECTED:
+		append_event(test, "disconnected ");
+		test->done = true;
+		break;
+	case CONNLINE_EVENT_CONNECTED:
+		append_event(test, "connected ");
+		break;
+	case CONNLINE_EVENT_PROPERTY:
+		append_event(test, "property(");
+		for (i = 0; properties != NULL &&
+					properties[i] != NULL; i += 2)
+			append_event(test, "%s%s=%s", i == 0 ? "" : ",",
+					properties[i], properties[i+1]);
+		append_event(test, ") ");
+		break;
+	default:
+		break;
+	}
+
+	for (i = 0; i < TEST_CONTEXTS; i++) {
+		if (contexts[i].done == false)
+			return;
+	}
+
+	g_main_loop_quit(loop);
+}
+
+/* Each block carries its size, to check the one connline gives back */
+static void *test_malloc(size_t size, void *user_data)
+{
+	struct test_allocator *allocator = user_data;
+	size_t *block;
+
+	block = malloc(sizeof(size_t) * 2 + size);
+	if (block == NULL)
+		return NULL;
+
+	block[0] = size;
+
+	allocator->blocks++;
+	allocator->bytes += size;
+
+	return block + 2;
+}
+
+static void test_free(void *ptr, size_t size, void *user_data)
+{
+	struct test_allocator *allocator = user_data;
+	size_t *block = (size_t *) ptr - 2;
+
+	if (block[0] != size)
+		allocator->size_mismatch = true;
+
+	allocator->blocks--;
+	allocator->bytes -= block[0];
+
+	free(block);
+}
+
+static gboolean timeout_cb(gpointer user_data)
+{
+	g_main_loop_quit(loop);
+
+	return FALSE;
+}
+
+int main(int argc, char *argv[])
+{
+	struct connline_allocator allocator = {
+		.malloc = test_malloc,
+		.free = test_free,
+		.user_data = &counting,
+	};
+	struct connline_context *cnx[TEST_CONTEXTS] = { NULL, NULL, NULL };
+	struct connline_stats stats;
+	unsigned long in_use = 0;
+	const char *expected[TEST_CONTEXTS];
+	char path[] = "/tmp/connline-netlink-XXXXXX";
+	const char *record = argv[1];
+	int err = EXIT_SUCCESS;
+	int i, fd = -1;
+
+	if (record == NULL) {
+		fd = mkstemp(path);
+		if (fd < 0 || write_record(path) == false) {
+			perror("Cannot write the netlink record");
+			err = EXIT_FAILURE;
+			goto out;
+		}
+
+		record = path;
+	}
+
+	/* No D-Bus, no broker: only daemonless backends are left */
+	setenv(CONNLINE_NETLINK_REPLAY_ENV, record, 1);
+	setenv("DBUS_SYSTEM_BUS_ADDRESS", "unix:path=/nonexistent", 1);
+	unsetenv("CONNLINE_BROKER");
+
+	loop = g_main_loop_new(NULL, FALSE);
+
+	if (connline_set_allocator(&allocator) != 0) {
+		printf("Cannot set the allocator\n");
+		err = EXIT_FAILURE;
+		goto out;
+	}
+
+	if (connline_init(CONNLINE_EVENT_LOOP_GLIB, NULL) != 0) {
+		printf("Cannot initialize connline: no netlink backend?\n");
+		err = EXIT_FAILURE;
+		goto out;
+	}
+
+	contexts[0].name = "any";
+	contexts[1].name = "wifi";
+	contexts[2].name = "state";
+
+	for (i = 0; i < TEST_CONTEXTS; i++) {
+		cnx[i] = connline_open(i == 1 ? CONNLINE_BEARER_WIFI :
+						CONNLINE_BEARER_UNKNOWN, true,
+						callback, &contexts[i]);
+	}
+
+	/* No property list is even built for it */
+	connline_set_event_mask(cnx[2],
+			CONNLINE_EVENT_MASK(CONNLINE_EVENT_CONNECTED) |
+			CONNLINE_EVENT_MASK(CONNLINE_EVENT_DISCONNECTED));
+
+	g_timeout_add(TEST_TIMEOUT, timeout_cb, NULL);
+	g_main_loop_run(loop);
+
+	connline_get_stats(&stats);
+	for (i = 0; i < CONNLINE_MEMORY_MAX; i++)
+		in_use += stats.memory[i];
+
+	if (counting.blocks == 0 || in_use == 0 || in_use > counting.bytes ||
+			stats.memory[CONNLINE_MEMORY_CONTEXT] == 0) {
+		printf("memory: %lu bytes accounted, %zu allocated\n",
+						in_use, counting.bytes);
+		err = EXIT_FAILURE;
+	}
+
+	expected[0] = "connected property(bearer=ethernet,interface="
+			TEST_INTERFACE ",address=" TEST_IPV4 "," TEST_IPV6 ")"
+			" disconnected ";
+	expected[1] = "disconnected ";
+	expected[2] = "connected disconnected ";
+
+	for (i = 0; i < TEST_CONTEXTS; i++) {
+		printf("%s: %s\n", contexts[i].name, contexts[i].events);
+
+		if (argv[1] == NULL &&
+			strcmp(contexts[i].events, expected[i]) != 0) {
+			printf("%s: expected %s\n", contexts[i].name,
+								expected[i]);
+			err = EXIT_FAILURE;
+		}
+
+		connline_close(cnx[i]);
+	}
+
+	connline_cleanup();
+	g_main_loop_unref(loop);
+
+	connline_get_stats(&stats);
+	for (i = 0, in_use = 0; i < CONNLINE_MEMORY_MAX; i++)
+		in_use += stats.memory[i];
+
+	printf("memory: %lu blocks left after cleanup\n", counting.blocks);
+
+	if (counting.blocks != 0 || in_use != 0 || counting.size_mismatch) {
+		printf("memory: expected no block left, %lu bytes accounted, "
+			"free sizes %s\n", in_use, counting.size_mismatch ?
+						"mismatching" : "matching");
+		err = EXIT_FAILURE;
+	}
+
+out:
+	if (fd >= 0) {
+		close(fd);
+		unlink(path);
+	}
+
+	return err;
+}
@@ -0,0 +1,266 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Checks the order events are delivered in, on a mock systemd-networkd:
+ * a foreground context gets opened first, then background ones.  When the
+ * connection goes away, or comes back, the foreground context must hear
+ * it first, and no property may come before a connection change.  It is
+ * run again with a batch callback:  each change must then come at once.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <glib.h>
+#include <connline/connline.h>
+
+#include "fixture.h"
+
+#define TEST_TIMEOUT 10000
+#define TEST_BACKGROUND 8
+#define TEST_CONTEXTS (TEST_BACKGROUND + 1)
+#define TEST_EVENTS_MAX 256
+
+struct test_event {
+	unsigned int context;
+	enum connline_event event;
+};
+
+static struct test_fixture fixture;
+static struct connline_context *contexts[TEST_CONTEXTS];
+static struct test_event events[TEST_EVENTS_MAX];
+static unsigned int nb_events;
+static unsigned int states[TEST_CONTEXTS];
+static unsigned int nb_batches;
+static unsigned int phase;
+static bool failed;
+
+static void callback(struct connline_context *context,
+				enum connline_event event,
+				const char **properties,
+				void *user_data)
+{
+	unsigned int index = GPOINTER_TO_INT(user_data);
+
+	switch (event) {
+	case CONNLINE_EVENT_ERROR:
+	case CONNLINE_EVENT_NO_BACKEND:
+		printf("unexpected error event\n");
+		failed = true;
+		return;
+	case CONNLINE_EVENT_DISCONNECTED:
+	case CONNLINE_EVENT_CONNECTED:
+		states[index]++;
+		break;
+	case CONNLINE_EVENT_PROPERTY:
+	case CONNLINE_EVENT_TIMEOUT:
+		break;
+	}
+
+	if (nb_events == TEST_EVENTS_MAX)
+		return;
+
+	events[nb_events].context = index;
+	events[nb_events].event = event;
+	nb_events++;
+}
+
+static void batch_callback(const struct connline_event_record *records,
+					unsigned int nb_records,
+					void *user_data)
+{
+	unsigned int i;
+
+	nb_batches++;
+
+	for (i = 0; i < nb_records; i++)
+		callback(records[i].context, records[i].event,
+				records[i].properties, records[i].user_data);
+}
+
+static bool all_changed(unsigned int changes)
+{
+	int i;
+
+	for (i = 0; i < TEST_CONTEXTS; i++) {
+		if (states[i] < changes)
+			return false;
+	}
+
+	return true;
+}
+
+static const char *event_to_string(enum connline_event event)
+{
+	switch (event) {
+	case CONNLINE_EVENT_ERROR:
+		return "error";
+	case CONNLINE_EVENT_NO_BACKEND:
+		return "no backend";
+	case CONNLINE_EVENT_DISCONNECTED:
+		return "disconnected";
+	case CONNLINE_EVENT_CONNECTED:
+		return "connected";
+	case CONNLINE_EVENT_PROPERTY:
+		return "property";
+	case CONNLINE_EVENT_TIMEOUT:
+		return "timeout";
+	}
+
+	return "unknown";
+}
+
+/* The foreground context is the first one */
+static void check_order(void)
+{
+	bool property = false;
+	unsigned int i;
+
+	for (i = 0; i < nb_events; i++)
+		printf(" %u:%s", events[i].context,
+					event_to_string(events[i].event));
+	printf("\n");
+
+	/* The backend handles a change at once, all contexts alike */
+	if (nb_batches > 1) {
+		printf("one change came in %u batches\n", nb_batches);
+		failed = true;
+	}
+
+	if (nb_events == 0 || events[0].context != 0 ||
+			events[0].event == CONNLINE_EVENT_PROPERTY) {
+		printf("the foreground context was not notified first\n");
+		failed = true;
+	}
+
+	for (i = 0; i < nb_events; i++) {
+		if (events[i].event == CONNLINE_EVENT_PROPERTY)
+			property = true;
+		else if (property == true) {
+			printf("a property came before a connection change\n");
+			failed = true;
+		}
+	}
+
+	nb_events = 0;
+	nb_batches = 0;
+}
+
+static gboolean step_cb(gpointer user_data)
+{
+	if (failed == true) {
+		g_main_loop_quit(fixture.loop);
+		return FALSE;
+	}
+
+	switch (phase) {
+	case 0:
+		if (all_changed(1) == false)
+			break;
+
+		nb_events = 0;
+		nb_batches = 0;
+		mock_daemon_set_connected(&fixture.daemon, false);
+		phase++;
+		break;
+	case 1:
+		if (all_changed(2) == false)
+			break;
+
+		check_order();
+		mock_daemon_set_connected(&fixture.daemon, true);
+		phase++;
+		break;
+	case 2:
+		if (all_changed(3) == false)
+			break;
+
+		check_order();
+		phase++;
+
+		g_main_loop_quit(fixture.loop);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static int run(bool batched)
+{
+	int i;
+
+	phase = 0;
+	nb_events = 0;
+	nb_batches = 0;
+
+	for (i = 0; i < TEST_CONTEXTS; i++)
+		states[i] = 0;
+
+	if (connline_init(CONNLINE_EVENT_LOOP_GLIB, NULL) != 0) {
+		printf("Cannot initialize connline\n");
+		return EXIT_FAILURE;
+	}
+
+	connline_set_batch_callback(batched == true ?
+					batch_callback : NULL, NULL);
+
+	for (i = 0; i < TEST_CONTEXTS; i++) {
+		contexts[i] = connline_open(CONNLINE_BEARER_UNKNOWN,
+					i > 0, batched == true ? NULL : callback,
+					GINT_TO_POINTER(i));
+		if (contexts[i] == NULL)
+			failed = true;
+	}
+
+	g_timeout_add(50, step_cb, NULL);
+	if (failed == false && test_fixture_run(&fixture, TEST_TIMEOUT) == false)
+		failed = true;
+
+	for (i = 0; i < TEST_CONTEXTS; i++)
+		connline_close(contexts[i]);
+
+	connline_cleanup();
+
+	if (failed == true || phase != 3) {
+		printf("events not delivered in priority order\n");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+	int err;
+
+	if (test_fixture_setup(&fixture, MOCK_BACKEND_NETWORKD) < 0)
+		return EXIT_FAILURE;
+
+	err = run(false);
+	if (err == EXIT_SUCCESS)
+		err = run(true);
+
+	test_fixture_teardown(&fixture);
+
+	return err;
+}
@@ -0,0 +1,155 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "private_bus.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define PRIVATE_BUS_CONFIG \
+	"<busconfig>\n" \
+	"  <type>session</type>\n" \
+	"  <listen>unix:tmpdir=/tmp</listen>\n" \
+	"  <auth>EXTERNAL</auth>\n" \
+	"  <policy context=\"default\">\n" \
+	"    <allow send_destination=\"*\" eavesdrop=\"true\"/>\n" \
+	"    <allow eavesdrop=\"true\"/>\n" \
+	"    <allow own=\"*\"/>\n" \
+	"  </policy>\n" \
+	"  <limit name=\"max_incoming_bytes\">1000000000</limit>\n" \
+	"  <limit name=\"max_outgoing_bytes\">1000000000</limit>\n" \
+	"  <limit name=\"max_replies_per_connection\">50000</limit>\n" \
+	"  <limit name=\"max_match_rules_per_connection\">50000</limit>\n" \
+	"</busconfig>\n"
+
+static int write_config(struct private_bus *bus)
+{
+	ssize_t length = sizeof(PRIVATE_BUS_CONFIG) - 1;
+	int fd;
+
+	strcpy(bus->config_path, "/tmp/connline-bus-XXXXXX");
+
+	fd = mkstemp(bus->config_path);
+	if (fd < 0)
+		return -errno;
+
+	if (write(fd, PRIVATE_BUS_CONFIG, length) != length) {
+		close(fd);
+		unlink(bus->config_path);
+
+		return -EIO;
+	}
+
+	close(fd);
+
+	return 0;
+}
+
+int private_bus_start(struct private_bus *bus)
+{
+	char config_arg[64];
+	char address_arg[32];
+	ssize_t length = 0;
+	int fds[2];
+	ssize_t n;
+	char *c;
+
+	memset(bus, 0, sizeof(struct private_bus));
+
+	if (write_config(bus) < 0)
+		return -EIO;
+
+	if (pipe(fds) < 0)
+		goto error;
+
+	bus->pid = fork();
+	if (bus->pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+
+		goto error;
+	}
+
+	if (bus->pid == 0) {
+		close(fds[0]);
+
+		snprintf(config_arg, sizeof(config_arg),
+					"--config-file=%s", bus->config_path);
+		snprintf(address_arg, sizeof(address_arg),
+					"--print-address=%d", fds[1]);
+
+		execlp("dbus-daemon", "dbus-daemon", "--nofork",
+					config_arg, address_arg, NULL);
+		_exit(EXIT_FAILURE);
+	}
+
+	close(fds[1]);
+
+	while (length < (ssize_t) sizeof(bus->address) - 1) {
+		n = read(fds[0], bus->address + length,
+				sizeof(bus->address) - 1 - length);
+		if (n <= 0)
+			break;
+
+		length += n;
+
+		if (strchr(bus->address, '\n') != NULL)
+			break;
+	}
+
+	close(fds[0]);
+
+	c = strchr(bus->address, '\n');
+	if (c == NULL) {
+		private_bus_stop(bus);
+		return -EIO;
+	}
+
+	*c = '\0';
+
+	return 0;
+
+error:
+	unlink(bus->config_path);
+
+	return -errno;
+}
+
+void private_bus_stop(struct private_bus *bus)
+{
+	if (bus->pid > 0) {
+		kill(bus->pid, SIGTERM);
+		waitpid(bus->pid, NULL, 0);
+	}
+
+	bus->pid = 0;
+
+	if (bus->config_path[0] != '\0')
+		unlink(bus->config_path);
+
+	bus->config_path[0] = '\0';
+}
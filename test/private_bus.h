@@ -0,0 +1,41 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNLINE_TEST_PRIVATE_BUS_H__
+#define __CONNLINE_TEST_PRIVATE_BUS_H__
+
+#include <sys/types.h>
+
+/*
+ * A dbus-daemon of our own, so tests and benchmarks depend neither on the
+ * system bus nor on any real connection manager.
+ */
+struct private_bus {
+	pid_t pid;
+	char config_path[32];
+	char address[256];
+};
+
+int private_bus_start(struct private_bus *bus);
+
+void private_bus_stop(struct private_bus *bus);
+
+#endif
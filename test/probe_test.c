@@ -0,0 +1,308 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Runs the online probe against a local HTTP stand-in, with contexts on a
+ * mock NetworkManager.  The stand-in answers 204, then 200 as a captive
+ * portal would, then 204 again:  all contexts must share each probe, go
+ * online after the first,  stay offline after the reconnection until the
+ * retry, and that retry must wait for the probe interval.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+#include <connline/connline.h>
+
+#include "fixture.h"
+
+#define TEST_TIMEOUT 10000
+#define TEST_CONTEXTS 3
+#define TEST_INTERVAL 1
+#define TEST_REQUESTS_MAX 8
+
+struct test_context {
+	struct connline_context *context;
+	unsigned int online;
+	unsigned int disconnected;
+};
+
+/* The stand-in's status for each request, the last one for the next */
+static const unsigned int statuses[] = { 204, 200, 204 };
+
+static struct {
+	int socket;
+	unsigned int requests;
+	double requested_at[TEST_REQUESTS_MAX];
+} server;
+
+static struct test_fixture fixture;
+static struct test_context contexts[TEST_CONTEXTS];
+static unsigned int phase;
+static bool failed;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *serve(void *data)
+{
+	const char *reason;
+	char request[1024];
+	unsigned int n, status;
+	char answer[128];
+	int fd;
+
+	while ((fd = accept(server.socket, NULL, NULL)) >= 0) {
+		if (recv(fd, request, sizeof(request), 0) <= 0 ||
+				strncmp(request, "GET /check HTTP/1.1\r\n", 21)) {
+			close(fd);
+			continue;
+		}
+
+		n = __atomic_load_n(&server.requests, __ATOMIC_ACQUIRE);
+		if (n < TEST_REQUESTS_MAX)
+			server.requested_at[n] = now();
+
+		status = statuses[n < 2 ? n : 2];
+		reason = status == 204 ? "No Content" : "OK";
+
+		snprintf(answer, sizeof(answer), "HTTP/1.1 %u %s\r\n"
+				"Content-Length: 0\r\nConnection: close\r\n\r\n",
+				status, reason);
+
+		__atomic_store_n(&server.requests, n + 1, __ATOMIC_RELEASE);
+
+		if (send(fd, answer, strlen(answer), MSG_NOSIGNAL) < 0)
+			perror("send");
+
+		close(fd);
+	}
+
+	return NULL;
+}
+
+static int start_server(unsigned short *port)
+{
+	struct sockaddr_in address;
+	socklen_t length = sizeof(address);
+	pthread_t thread;
+
+	server.socket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (server.socket < 0)
+		return -1;
+
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(server.socket, (struct sockaddr *) &address,
+						sizeof(address)) < 0 ||
+			listen(server.socket, 8) < 0 ||
+			getsockname(server.socket, (struct sockaddr *) &address,
+								&length) < 0)
+		return -1;
+
+	*port = ntohs(address.sin_port);
+
+	if (pthread_create(&thread, NULL, serve, NULL) != 0)
+		return -1;
+
+	pthread_detach(thread);
+
+	return 0;
+}
+
+static unsigned int get_requests(void)
+{
+	return __atomic_load_n(&server.requests, __ATOMIC_ACQUIRE);
+}
+
+static void callback(struct connline_context *context,
+				enum connline_event event,
+				const char **properties,
+				void *user_data)
+{
+	struct test_context *test = user_data;
+
+	switch (event) {
+	case CONNLINE_EVENT_ERROR:
+	case CONNLINE_EVENT_NO_BACKEND:
+		printf("unexpected error event\n");
+		failed = true;
+		break;
+	case CONNLINE_EVENT_DISCONNECTED:
+		test->disconnected++;
+		break;
+	case CONNLINE_EVENT_CONNECTED:
+		if (connline_is_online(context) == false)
+			break;
+
+		test->online++;
+
+		/* Only the last probe's answer tells online */
+		if (get_requests() != 1 && get_requests() != 3) {
+			printf("online after %u probes\n", get_requests());
+			failed = true;
+		}
+		break;
+	case CONNLINE_EVENT_PROPERTY:
+	case CONNLINE_EVENT_TIMEOUT:
+		break;
+	}
+}
+
+static bool all_reached(unsigned int online, unsigned int disconnected)
+{
+	int i;
+
+	for (i = 0; i < TEST_CONTEXTS; i++) {
+		if (contexts[i].online < online ||
+				contexts[i].disconnected < disconnected)
+			return false;
+	}
+
+	return true;
+}
+
+static gboolean step_cb(gpointer user_data)
+{
+	if (failed == true) {
+		g_main_loop_quit(fixture.loop);
+		return FALSE;
+	}
+
+	switch (phase) {
+	case 0:
+		if (all_reached(1, 0) == false)
+			break;
+
+		printf("online after %u probe\n", get_requests());
+
+		mock_daemon_set_connected(&fixture.daemon, false);
+		phase++;
+		break;
+	case 1:
+		if (all_reached(1, 1) == false)
+			break;
+
+		mock_daemon_set_connected(&fixture.daemon, true);
+		phase++;
+		break;
+	case 2:
+		if (all_reached(2, 1) == false)
+			break;
+
+		printf("online again after %u probes, retried after %.1f s\n",
+				get_requests(), server.requested_at[2] -
+						server.requested_at[1]);
+		phase++;
+
+		g_main_loop_quit(fixture.loop);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static int run(unsigned short port)
+{
+	char url[64];
+	int i;
+
+	snprintf(url, sizeof(url), "http://127.0.0.1:%u/check", port);
+
+	if (connline_set_online_probe("ftp://127.0.0.1/", 204, 0) == 0 ||
+		connline_set_online_probe("http://[::1/", 204, 0) == 0 ||
+		connline_set_online_probe(url, 204, TEST_INTERVAL) != 0) {
+		printf("Cannot set the online probe\n");
+		return EXIT_FAILURE;
+	}
+
+	if (connline_init(CONNLINE_EVENT_LOOP_GLIB, NULL) != 0) {
+		printf("Cannot initialize connline\n");
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < TEST_CONTEXTS; i++) {
+		contexts[i].context = connline_open(CONNLINE_BEARER_UNKNOWN,
+						true, callback, &contexts[i]);
+		if (contexts[i].context == NULL)
+			failed = true;
+	}
+
+	g_timeout_add(50, step_cb, NULL);
+	if (failed == false && test_fixture_run(&fixture, TEST_TIMEOUT) == false)
+		failed = true;
+
+	for (i = 0; i < TEST_CONTEXTS; i++)
+		connline_close(contexts[i].context);
+
+	connline_cleanup();
+
+	if (failed == true || phase != 3 || get_requests() != 3) {
+		printf("expected 3 probes shared by the contexts, got %u\n",
+							get_requests());
+		return EXIT_FAILURE;
+	}
+
+	if (server.requested_at[2] - server.requested_at[1] <
+							TEST_INTERVAL - 0.1) {
+		printf("expected a retry after %u s\n", TEST_INTERVAL);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned short port;
+	int err;
+
+	if (start_server(&port) < 0) {
+		perror("Cannot start the HTTP stand-in");
+		return EXIT_FAILURE;
+	}
+
+	if (test_fixture_setup(&fixture, MOCK_BACKEND_NM) < 0)
+		return EXIT_FAILURE;
+
+	err = run(port);
+
+	test_fixture_teardown(&fixture);
+
+	return err;
+}
@@ -0,0 +1,232 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Opens and closes contexts from worker threads, in thread-safe mode,
+ * against a mock NetworkManager.  Each worker waits from its own thread
+ * for its context to be published online on ethernet,  and some close
+ * theirs right after opening it:  every context must be freed in the end,
+ * and no callback may run on another thread than the loop's one.
+ * Some rounds open a group of contexts with connline_open_many() instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <glib.h>
+#include <connline/connline.h>
+
+#include "fixture.h"
+
+#define TEST_TIMEOUT 10000
+#define TEST_THREADS 4
+#define TEST_ROUNDS 25
+#define TEST_WAIT_ONLINE 2000
+#define TEST_GROUP 3
+
+static struct test_fixture fixture;
+static pthread_t loop_thread;
+static unsigned int workers_done;
+static unsigned int callbacks;
+static bool failed;
+
+static void fail(const char *message)
+{
+	printf("%s\n", message);
+	__atomic_store_n(&failed, true, __ATOMIC_RELAXED);
+}
+
+static void callback(struct connline_context *context,
+				enum connline_event event,
+				const char **properties,
+				void *user_data)
+{
+	if (pthread_equal(pthread_self(), loop_thread) == 0)
+		fail("callback run out of the loop thread");
+
+	if (event == CONNLINE_EVENT_ERROR ||
+				event == CONNLINE_EVENT_NO_BACKEND)
+		fail("unexpected error event");
+
+	__atomic_add_fetch(&callbacks, 1, __ATOMIC_RELAXED);
+}
+
+static void completion(void *user_data)
+{
+	if (pthread_equal(pthread_self(), loop_thread) == 0)
+		fail("completion run out of the loop thread");
+}
+
+static bool wait_online(struct connline_context *context)
+{
+	int i;
+
+	for (i = 0; i < TEST_WAIT_ONLINE; i++) {
+		if (connline_is_online(context) == true)
+			return true;
+
+		usleep(1000);
+	}
+
+	return false;
+}
+
+static void work_group(void)
+{
+	struct connline_context *contexts[TEST_GROUP];
+	int i;
+
+	if (connline_open_many(contexts, TEST_GROUP, CONNLINE_BEARER_UNKNOWN,
+				true, callback, NULL, completion, NULL) != 0) {
+		fail("cannot open a group of contexts");
+		return;
+	}
+
+	for (i = 0; i < TEST_GROUP; i++) {
+		if (wait_online(contexts[i]) == false)
+			fail("group context not published online");
+	}
+
+	connline_close_many(contexts, TEST_GROUP);
+}
+
+static void *work(void *data)
+{
+	struct connline_context *context;
+	int i;
+
+	for (i = 0; i < TEST_ROUNDS; i++) {
+		if (i % 4 == 3) {
+			work_group();
+			continue;
+		}
+
+		context = connline_open(CONNLINE_BEARER_UNKNOWN, true,
+							callback, NULL);
+		if (context == NULL) {
+			fail("cannot open a context");
+			break;
+		}
+
+		if (i % 2 == 0) {
+			connline_close(context);
+			continue;
+		}
+
+		if (wait_online(context) == false)
+			fail("context not published online");
+		else if (connline_get_bearer(context) !=
+						CONNLINE_BEARER_ETHERNET)
+			fail("context not published on ethernet");
+
+		connline_set_event_mask(context,
+				CONNLINE_EVENT_MASK(CONNLINE_EVENT_DISCONNECTED));
+
+		connline_close(context);
+	}
+
+	__atomic_add_fetch(&workers_done, 1, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+static gboolean check_cb(gpointer user_data)
+{
+	struct connline_stats stats;
+
+	if (__atomic_load_n(&workers_done, __ATOMIC_ACQUIRE) < TEST_THREADS)
+		return TRUE;
+
+	/* Their close commands may still be on their way */
+	if (connline_get_stats(&stats) == 0 &&
+				stats.memory[CONNLINE_MEMORY_CONTEXT] != 0)
+		return TRUE;
+
+	g_main_loop_quit(fixture.loop);
+
+	return FALSE;
+}
+
+static int run(void)
+{
+	pthread_t threads[TEST_THREADS];
+	int i, started;
+
+	if (connline_set_thread_safe(true) != 0 ||
+			connline_init(CONNLINE_EVENT_LOOP_GLIB, NULL) != 0) {
+		printf("Cannot initialize connline\n");
+		return EXIT_FAILURE;
+	}
+
+	if (connline_set_thread_safe(false) != -EALREADY) {
+		printf("Thread-safe mode changed once initialized\n");
+		connline_cleanup();
+		return EXIT_FAILURE;
+	}
+
+	loop_thread = pthread_self();
+
+	for (started = 0; started < TEST_THREADS; started++) {
+		if (pthread_create(&threads[started], NULL, work, NULL) != 0)
+			break;
+	}
+
+	if (started < TEST_THREADS)
+		fail("cannot start the workers");
+
+	g_timeout_add(10, check_cb, NULL);
+
+	if (started == TEST_THREADS &&
+			test_fixture_run(&fixture, TEST_TIMEOUT) == false)
+		__atomic_store_n(&failed, true, __ATOMIC_RELAXED);
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	connline_cleanup();
+
+	if (failed == true)
+		return EXIT_FAILURE;
+
+	printf("%u rounds of opens and closes by %u threads, %u callbacks\n",
+				TEST_THREADS * TEST_ROUNDS, TEST_THREADS,
+				callbacks);
+
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+	int err;
+
+	if (test_fixture_setup(&fixture, MOCK_BACKEND_NM) < 0)
+		return EXIT_FAILURE;
+
+	err = run();
+
+	test_fixture_teardown(&fixture);
+
+	return err;
+}
@@ -0,0 +1,261 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Checks connline_token_lookup() against every listed string, then
+ * compares it with the strncmp() and strcmp() chains the backends used.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <connline/connline.h>
+#include <connline/token.h>
+
+#define LOOKUP_ITERATIONS 2000000
+
+static volatile unsigned int sink;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* As ConnMan's Type was decoded: any prefix of a bearer matched it */
+static unsigned int chain_bearer(const char *bearer)
+{
+	int len;
+
+	len = strlen(bearer);
+
+	if (strncmp(bearer, "ethernet", len) == 0)
+		return CONNLINE_BEARER_ETHERNET;
+	if (strncmp(bearer, "wifi", len) == 0)
+		return CONNLINE_BEARER_WIFI;
+	if (strncmp(bearer, "cellular", len) == 0)
+		return CONNLINE_BEARER_CELLULAR;
+	if (strncmp(bearer, "wimax", len) == 0)
+		return CONNLINE_BEARER_WIMAX;
+	if (strncmp(bearer, "bluetooth", len) == 0)
+		return CONNLINE_BEARER_BLUETOOTH;
+	if (strncmp(bearer, "usb", len) == 0)
+		return CONNLINE_BEARER_USB;
+
+	return CONNLINE_BEARER_UNKNOWN;
+}
+
+static unsigned int token_bearer(const char *bearer)
+{
+	switch (connline_token_lookup(bearer)) {
+	case CONNLINE_TOKEN_ETHERNET:
+		return CONNLINE_BEARER_ETHERNET;
+	case CONNLINE_TOKEN_WIFI:
+		return CONNLINE_BEARER_WIFI;
+	case CONNLINE_TOKEN_CELLULAR:
+		return CONNLINE_BEARER_CELLULAR;
+	case CONNLINE_TOKEN_WIMAX:
+		return CONNLINE_BEARER_WIMAX;
+	case CONNLINE_TOKEN_BLUETOOTH:
+		return CONNLINE_BEARER_BLUETOOTH;
+	case CONNLINE_TOKEN_USB:
+		return CONNLINE_BEARER_USB;
+	default:
+		break;
+	}
+
+	return CONNLINE_BEARER_UNKNOWN;
+}
+
+/* Every filter checked its own member, so a signal went through all */
+static unsigned int chain_member(const char *member)
+{
+	if (strncmp(member, "NameOwnerChanged",
+					sizeof("NameOwnerChanged")) == 0)
+		return 1;
+	if (strcmp(member, "ServicesChanged") == 0)
+		return 2;
+	if (strcmp(member, "PropertyChanged") == 0)
+		return 3;
+	if (strcmp(member, "PropertiesChanged") == 0)
+		return 4;
+	if (strncmp(member, "StateChanged", sizeof("StateChanged")) == 0)
+		return 5;
+	if (strcmp(member, "StatusChanged") == 0)
+		return 6;
+
+	return 0;
+}
+
+static unsigned int token_member(const char *member)
+{
+	switch (connline_token_lookup(member)) {
+	case CONNLINE_TOKEN_MEMBER_NAME_OWNER_CHANGED:
+		return 1;
+	case CONNLINE_TOKEN_MEMBER_SERVICES_CHANGED:
+		return 2;
+	case CONNLINE_TOKEN_MEMBER_PROPERTY_CHANGED:
+		return 3;
+	case CONNLINE_TOKEN_MEMBER_PROPERTIES_CHANGED:
+		return 4;
+	case CONNLINE_TOKEN_MEMBER_STATE_CHANGED:
+		return 5;
+	case CONNLINE_TOKEN_MEMBER_STATUS_CHANGED:
+		return 6;
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static unsigned int chain_key(const char *name)
+{
+	if (strcmp(name, "Type") == 0)
+		return 1;
+	if (strcmp(name, "State") == 0)
+		return 2;
+	if (strcmp(name, "Ethernet") == 0)
+		return 3;
+	if (strcmp(name, "IPv4") == 0)
+		return 4;
+	if (strcmp(name, "IPv6") == 0)
+		return 5;
+
+	return 0;
+}
+
+static unsigned int token_key(const char *name)
+{
+	switch (connline_token_lookup(name)) {
+	case CONNLINE_TOKEN_KEY_TYPE:
+		return 1;
+	case CONNLINE_TOKEN_KEY_STATE:
+		return 2;
+	case CONNLINE_TOKEN_KEY_ETHERNET:
+		return 3;
+	case CONNLINE_TOKEN_KEY_IPV4:
+		return 4;
+	case CONNLINE_TOKEN_KEY_IPV6:
+		return 5;
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+struct bench_set {
+	const char *name;
+	unsigned int (*chain)(const char *string);
+	unsigned int (*token)(const char *string);
+	const char *strings[8];
+};
+
+/* Mostly what the daemons send, and some strings nobody looks for */
+static const struct bench_set sets[] = {
+	{ "bearer", chain_bearer, token_bearer,
+		{ "ethernet", "wifi", "cellular", "bluetooth", "usb",
+		"wimax", "vpn", "gadget" } },
+	{ "member", chain_member, token_member,
+		{ "PropertyChanged", "StatusChanged", "StateChanged",
+		"PropertiesChanged", "NameOwnerChanged", "ServicesChanged",
+		"NameAcquired", "DeviceAdded" } },
+	{ "key", chain_key, token_key,
+		{ "State", "IPv4", "IPv6", "Ethernet", "Type",
+		"Name", "Strength", "Nameservers" } },
+};
+
+static double run(const struct bench_set *set,
+				unsigned int (*lookup)(const char *string))
+{
+	unsigned int i, result = 0;
+	double start;
+
+	start = now();
+
+	for (i = 0; i < LOOKUP_ITERATIONS; i++)
+		result += lookup(set->strings[i & 7]);
+
+	sink = result;
+
+	return (now() - start) * 1e9 / LOOKUP_ITERATIONS;
+}
+
+static int check_tokens(void)
+{
+	const char *unlisted[] = { "", "eth", "onlin", "online ", "Stat",
+					"StateChangedX", "routablee" };
+	enum connline_token token;
+	const char *string;
+	unsigned int i;
+
+	for (token = 1; token < CONNLINE_TOKEN_MAX; token++) {
+		string = connline_token_to_string(token);
+		if (string == NULL || connline_token_lookup(string) != token) {
+			printf("token %d: lookup mismatch\n", token);
+			return -1;
+		}
+	}
+
+	for (i = 0; i < sizeof(unlisted) / sizeof(unlisted[0]); i++) {
+		if (connline_token_lookup(unlisted[i]) !=
+						CONNLINE_TOKEN_UNKNOWN) {
+			printf("\"%s\": should not be found\n", unlisted[i]);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int main(void)
+{
+	double chain, token;
+	unsigned int i, j;
+
+	if (check_tokens() < 0)
+		return EXIT_FAILURE;
+
+	for (i = 0; i < sizeof(sets) / sizeof(sets[0]); i++) {
+		for (j = 0; j < 8; j++) {
+			if (sets[i].chain(sets[i].strings[j]) !=
+					sets[i].token(sets[i].strings[j])) {
+				printf("%s: \"%s\" decoded differently\n",
+					sets[i].name, sets[i].strings[j]);
+				return EXIT_FAILURE;
+			}
+		}
+
+		chain = run(&sets[i], sets[i].chain);
+		token = run(&sets[i], sets[i].token);
+
+		printf("%-8s chain %8.1f ns   perfect hash %8.1f ns\n",
+						sets[i].name, chain, token);
+	}
+
+	return EXIT_SUCCESS;
+}
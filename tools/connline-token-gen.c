@@ -0,0 +1,289 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Generates the perfect hash of the strings connline recognizes:
+ *   connline-token-gen <token list> <source> <header>
+ * Each line of the list is a token name and its string.  The hash is
+ * FNV-1a from a seed searched for here,  so that every string gets its
+ * own slot: a lookup is then one hash and one comparison.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TOKEN_MAX 256
+#define TOKEN_LINE_SIZE 256
+#define SEED_TRIES 100000
+
+struct token {
+	char *name;
+	char *string;
+	size_t length;
+};
+
+static struct token tokens[TOKEN_MAX];
+static unsigned int nb_tokens;
+
+static uint32_t hash_string(uint32_t seed, const char *string)
+{
+	const unsigned char *c;
+	uint32_t hash = seed;
+
+	for (c = (const unsigned char *) string; *c != '\0'; c++)
+		hash = (hash ^ *c) * 16777619U;
+
+	return hash ^ (hash >> 16);
+}
+
+static int read_tokens(const char *path)
+{
+	char line[TOKEN_LINE_SIZE], name[TOKEN_LINE_SIZE];
+	char string[TOKEN_LINE_SIZE];
+	unsigned int i, number = 0;
+	FILE *list;
+
+	list = fopen(path, "r");
+	if (list == NULL) {
+		perror(path);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), list) != NULL) {
+		number++;
+
+		if (line[0] == '#' || line[strspn(line, " \t\n")] == '\0')
+			continue;
+
+		if (sscanf(line, "%255s %255s", name, string) != 2 ||
+						nb_tokens == TOKEN_MAX) {
+			fprintf(stderr, "%s:%u: cannot parse\n", path, number);
+			goto error;
+		}
+
+		for (i = 0; i < nb_tokens; i++) {
+			if (strcmp(tokens[i].name, name) == 0 ||
+				strcmp(tokens[i].string, string) == 0) {
+				fprintf(stderr, "%s:%u: duplicate\n",
+								path, number);
+				goto error;
+			}
+		}
+
+		tokens[nb_tokens].name = strdup(name);
+		tokens[nb_tokens].string = strdup(string);
+		tokens[nb_tokens].length = strlen(string);
+		nb_tokens++;
+	}
+
+	fclose(list);
+
+	return 0;
+
+error:
+	fclose(list);
+
+	return -1;
+}
+
+/* Fills slots, of size entries, with token indexes: -1 when free */
+static bool try_seed(uint32_t seed, int *slots, unsigned int size)
+{
+	unsigned int i, slot;
+
+	for (i = 0; i < size; i++)
+		slots[i] = -1;
+
+	for (i = 0; i < nb_tokens; i++) {
+		slot = hash_string(seed, tokens[i].string) & (size - 1);
+		if (slots[slot] >= 0)
+			return false;
+
+		slots[slot] = i;
+	}
+
+	return true;
+}
+
+static void write_header(FILE *file)
+{
+	unsigned int i;
+
+	fprintf(file, "/* Generated by connline-token-gen, do not edit */\n\n"
+		"#ifndef __CONNLINE_TOKEN_H__\n"
+		"#define __CONNLINE_TOKEN_H__\n\n"
+		"enum connline_token {\n"
+		"\tCONNLINE_TOKEN_UNKNOWN = 0,\n");
+
+	for (i = 0; i < nb_tokens; i++)
+		fprintf(file, "\tCONNLINE_TOKEN_%s = %u,\n",
+						tokens[i].name, i + 1);
+
+	fprintf(file, "};\n\n"
+		"#define CONNLINE_TOKEN_MAX %u\n\n"
+		"/* CONNLINE_TOKEN_UNKNOWN for NULL, or a string not listed */\n"
+		"enum connline_token connline_token_lookup(const char *string);\n\n"
+		"const char *connline_token_to_string(enum connline_token token);"
+		"\n\n#endif\n", nb_tokens + 1);
+}
+
+static void write_source(FILE *file, uint32_t seed,
+					int *slots, unsigned int size)
+{
+	unsigned int i;
+
+	fprintf(file, "/* Generated by connline-token-gen, do not edit */\n\n"
+		"#include <connline/token.h>\n\n"
+		"#include <stddef.h>\n"
+		"#include <stdint.h>\n"
+		"#include <string.h>\n\n"
+		"struct token_slot {\n"
+		"\tconst char *string;\n"
+		"\tunsigned int length;\n"
+		"\tenum connline_token token;\n"
+		"};\n\n"
+		"static const struct token_slot token_slots[%u] = {\n", size);
+
+	for (i = 0; i < size; i++) {
+		if (slots[i] < 0)
+			continue;
+
+		fprintf(file, "\t[%u] = { \"%s\", %zu, CONNLINE_TOKEN_%s },\n",
+				i, tokens[slots[i]].string,
+				tokens[slots[i]].length, tokens[slots[i]].name);
+	}
+
+	fprintf(file, "};\n\n"
+		"static const char *token_strings[CONNLINE_TOKEN_MAX] = {\n");
+
+	for (i = 0; i < nb_tokens; i++)
+		fprintf(file, "\t[CONNLINE_TOKEN_%s] = \"%s\",\n",
+					tokens[i].name, tokens[i].string);
+
+	fprintf(file, "};\n\n"
+		"enum connline_token connline_token_lookup(const char *string)\n"
+		"{\n"
+		"\tconst struct token_slot *slot;\n"
+		"\tconst unsigned char *c;\n"
+		"\tuint32_t hash = %uU;\n"
+		"\tsize_t length;\n\n"
+		"\tif (string == NULL)\n"
+		"\t\treturn CONNLINE_TOKEN_UNKNOWN;\n\n"
+		"\tfor (c = (const unsigned char *) string; *c != '\\0'; c++)\n"
+		"\t\thash = (hash ^ *c) * 16777619U;\n\n"
+		"\tlength = (const char *) c - string;\n"
+		"\thash ^= hash >> 16;\n\n"
+		"\tslot = &token_slots[hash & %uU];\n"
+		"\tif (slot->string == NULL || slot->length != length ||\n"
+		"\t\t\tmemcmp(slot->string, string, length) != 0)\n"
+		"\t\treturn CONNLINE_TOKEN_UNKNOWN;\n\n"
+		"\treturn slot->token;\n"
+		"}\n\n"
+		"const char *connline_token_to_string(enum connline_token token)\n"
+		"{\n"
+		"\tif (token >= CONNLINE_TOKEN_MAX)\n"
+		"\t\treturn NULL;\n\n"
+		"\treturn token_strings[token];\n"
+		"}\n", seed, size - 1);
+}
+
+static int write_file(const char *path, uint32_t seed,
+					int *slots, unsigned int size)
+{
+	FILE *file;
+	int ret = 0;
+
+	file = fopen(path, "w");
+	if (file == NULL) {
+		perror(path);
+		return -1;
+	}
+
+	if (slots == NULL)
+		write_header(file);
+	else
+		write_source(file, seed, slots, size);
+
+	if (ferror(file) != 0)
+		ret = -1;
+
+	if (fclose(file) != 0)
+		ret = -1;
+
+	if (ret < 0)
+		remove(path);
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int size = 1;
+	uint32_t seed = 0;
+	int *slots = NULL;
+	unsigned int i;
+
+	if (argc != 4) {
+		printf("Usage: %s <token list> <source> <header>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (read_tokens(argv[1]) < 0 || nb_tokens == 0)
+		return EXIT_FAILURE;
+
+	/* At most half full, growing until a seed fits */
+	while (size < nb_tokens * 2)
+		size <<= 1;
+
+	for (;;) {
+		free(slots);
+
+		slots = calloc(size, sizeof(int));
+		if (slots == NULL)
+			return EXIT_FAILURE;
+
+		for (i = 0; i < SEED_TRIES; i++) {
+			/* FNV-1a offset basis, then other odd seeds */
+			seed = 2166136261U + i * 2;
+			if (try_seed(seed, slots, size) == true)
+				break;
+		}
+
+		if (i < SEED_TRIES)
+			break;
+
+		size <<= 1;
+	}
+
+	if (write_file(argv[2], seed, slots, size) < 0 ||
+			write_file(argv[3], 0, NULL, 0) < 0) {
+		free(slots);
+		return EXIT_FAILURE;
+	}
+
+	free(slots);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,154 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Decodes what connline_trace_dump() wrote:
+ *   connline-trace [dump file]
+ */
+
+#include <connline/trace.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+static const char *trace_events[CONNLINE_TRACE_EVENTS_MAX] = {
+	[CONNLINE_TRACE_DEBUG]            = "debug",
+	[CONNLINE_TRACE_CONTEXT_OPEN]     = "context_open",
+	[CONNLINE_TRACE_CONTEXT_CLOSE]    = "context_close",
+	[CONNLINE_TRACE_BACKEND_SETUP]    = "backend_setup",
+	[CONNLINE_TRACE_BACKEND_TEARDOWN] = "backend_teardown",
+	[CONNLINE_TRACE_DBUS_CALL]        = "dbus_call",
+	[CONNLINE_TRACE_DBUS_REPLY]       = "dbus_reply",
+	[CONNLINE_TRACE_DBUS_SIGNAL]      = "dbus_signal",
+	[CONNLINE_TRACE_TRIGGER_QUEUE]    = "trigger_queue",
+	[CONNLINE_TRACE_TRIGGER_RUN]      = "trigger_run",
+};
+
+static const char *connline_events[] = {
+	"error", "no_backend", "disconnected", "connected", "property",
+	"timeout",
+};
+
+static const char *event_to_string(uint32_t event)
+{
+	if (event >= sizeof(connline_events) / sizeof(connline_events[0]))
+		return "unknown";
+
+	return connline_events[event];
+}
+
+static void print_record(struct connline_trace_record *record,
+							uint64_t start)
+{
+	uint64_t delta = record->timestamp - start;
+	char string[CONNLINE_TRACE_STRING_SIZE + 1];
+
+	printf("%6" PRIu64 ".%09" PRIu64 " %-16s", delta / 1000000000,
+				delta % 1000000000, trace_events[record->event]);
+
+	if (record->context != 0)
+		printf(" context 0x%" PRIx64, record->context);
+
+	memcpy(string, record->data.string, CONNLINE_TRACE_STRING_SIZE);
+	string[CONNLINE_TRACE_STRING_SIZE] = '\0';
+
+	switch (record->event) {
+	case CONNLINE_TRACE_DEBUG:
+		printf(" %s():%u", string, record->arg);
+		break;
+	case CONNLINE_TRACE_CONTEXT_OPEN:
+		printf(" bearer 0x%x", record->arg);
+		break;
+	case CONNLINE_TRACE_CONTEXT_CLOSE:
+		break;
+	case CONNLINE_TRACE_BACKEND_SETUP:
+		printf(" %s %s", string, record->arg != 0 ? "ok" : "failed");
+		break;
+	case CONNLINE_TRACE_BACKEND_TEARDOWN:
+	case CONNLINE_TRACE_DBUS_SIGNAL:
+		printf(" %s", string);
+		break;
+	case CONNLINE_TRACE_DBUS_CALL:
+	case CONNLINE_TRACE_DBUS_REPLY:
+		printf(" pending 0x%" PRIx64, record->data.value);
+		break;
+	case CONNLINE_TRACE_TRIGGER_QUEUE:
+	case CONNLINE_TRACE_TRIGGER_RUN:
+		printf(" %s", event_to_string(record->arg));
+		break;
+	}
+
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct connline_trace_header header;
+	struct connline_trace_record record;
+	uint64_t start = 0;
+	FILE *file = stdin;
+	int nb_records = 0;
+
+	if (argc > 2) {
+		printf("Usage: %s [dump file]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (argc == 2) {
+		file = fopen(argv[1], "r");
+		if (file == NULL) {
+			perror(argv[1]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (fread(&header, sizeof(header), 1, file) != 1 ||
+			memcmp(header.magic, CONNLINE_TRACE_MAGIC,
+				sizeof(CONNLINE_TRACE_MAGIC)) != 0) {
+		printf("Not a connline trace dump\n");
+		return EXIT_FAILURE;
+	}
+
+	if (header.version != CONNLINE_TRACE_VERSION ||
+			header.record_size != sizeof(record)) {
+		printf("Unsupported trace dump version %u\n", header.version);
+		return EXIT_FAILURE;
+	}
+
+	while (fread(&record, sizeof(record), 1, file) == 1) {
+		if (record.event >= CONNLINE_TRACE_EVENTS_MAX)
+			continue;
+
+		if (nb_records++ == 0)
+			start = record.timestamp;
+
+		print_record(&record, start);
+	}
+
+	printf("%d records\n", nb_records);
+
+	if (file != stdin)
+		fclose(file);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,436 @@
+/*
+ *
+ *  Connline library
+ *
+ *  Copyright (C) 2011-2013  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Publishes the connectivity state for connline processes in broker mode:
+ *   connlined [socket name]
+ * It runs one background context on D-Bus and shares what it gets through
+ * a memfd page, see include/broker.h.  Clients hanging up are forgotten.
+ */
+
+#define _GNU_SOURCE
+
+#include <connline/connline.h>
+#include <connline/broker.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define MAX_PROPERTIES 16
+
+struct broker_client {
+	int fd;
+	int event_fd;
+};
+
+static struct connline_broker_page *page = NULL;
+static int page_fd = -1;
+
+static struct broker_client *clients = NULL;
+static unsigned int clients_count = 0;
+
+static struct connline_context *context = NULL;
+
+static char *property_names[MAX_PROPERTIES];
+static char *property_values[MAX_PROPERTIES];
+
+static void notify_clients(void)
+{
+	uint64_t count = 1;
+	unsigned int i;
+
+	for (i = 0; i < clients_count; i++) {
+		if (write(clients[i].event_fd, &count, sizeof(count)) < 0 &&
+							errno != EAGAIN)
+			perror("connlined: cannot notify a client");
+	}
+}
+
+static void clear_properties(void)
+{
+	int i;
+
+	for (i = 0; i < MAX_PROPERTIES; i++) {
+		free(property_names[i]);
+		free(property_values[i]);
+
+		property_names[i] = NULL;
+		property_values[i] = NULL;
+	}
+}
+
+static void update_property(const char *name, const char *value)
+{
+	int i;
+
+	for (i = 0; i < MAX_PROPERTIES; i++) {
+		if (property_names[i] == NULL ||
+				strcmp(property_names[i], name) == 0)
+			break;
+	}
+
+	if (i == MAX_PROPERTIES)
+		return;
+
+	if (property_names[i] == NULL)
+		property_names[i] = strdup(name);
+
+	free(property_values[i]);
+	property_values[i] = strdup(value);
+}
+
+static void publish(uint32_t status, uint32_t bearer)
+{
+	struct connline_broker_state *state = &page->state;
+	size_t name_size, value_size;
+	uint32_t size = 0;
+	int i;
+
+	__connline_broker_write_begin(page);
+
+	state->status = status;
+	state->bearer = bearer;
+	state->generation++;
+
+	for (i = 0; i < MAX_PROPERTIES; i++) {
+		if (property_names[i] == NULL || property_values[i] == NULL)
+			continue;
+
+		name_size = strlen(property_names[i]) + 1;
+		value_size = strlen(property_values[i]) + 1;
+
+		if (size + name_size + value_size >
+					CONNLINE_BROKER_PROPERTIES_SIZE)
+			break;
+
+		memcpy(state->properties + size, property_names[i], name_size);
+		size += name_size;
+
+		memcpy(state->properties + size,
+					property_values[i], value_size);
+		size += value_size;
+	}
+
+	state->properties_size = size;
+
+	__connline_broker_write_end(page);
+
+	notify_clients();
+}
+
+static gboolean reopen_context(gpointer data);
+
+static void connline_cb(struct connline_context *cnx,
+				enum connline_event event,
+				const char **properties,
+				void *user_data)
+{
+	const char **property;
+
+	switch (event) {
+	case CONNLINE_EVENT_ERROR:
+		/* The context is dead, but it cannot be closed from here */
+		g_timeout_add(1000, reopen_context, NULL);
+		/* fall through */
+	case CONNLINE_EVENT_NO_BACKEND:
+		clear_properties();
+		publish(CONNLINE_BROKER_NO_BACKEND, CONNLINE_BEARER_UNKNOWN);
+		break;
+	case CONNLINE_EVENT_DISCONNECTED:
+		clear_properties();
+		publish(CONNLINE_BROKER_DISCONNECTED, CONNLINE_BEARER_UNKNOWN);
+		break;
+	case CONNLINE_EVENT_CONNECTED:
+		publish(CONNLINE_BROKER_CONNECTED, connline_get_bearer(cnx));
+		break;
+	case CONNLINE_EVENT_TIMEOUT:
+		/* Asked again already, what was published still holds */
+		break;
+	case CONNLINE_EVENT_PROPERTY:
+		for (property = properties; property != NULL &&
+				property[0] != NULL && property[1] != NULL;
+				property += 2)
+			update_property(property[0], property[1]);
+
+		publish(page->state.status, connline_get_bearer(cnx));
+		break;
+	}
+}
+
+static void open_context(void)
+{
+	context = connline_open(CONNLINE_BEARER_UNKNOWN, true,
+						connline_cb, NULL);
+	if (context == NULL)
+		fprintf(stderr, "connlined: cannot open a context\n");
+}
+
+static gboolean reopen_context(gpointer data)
+{
+	connline_close(context);
+	open_context();
+
+	return FALSE;
+}
+
+static void remove_client(int fd)
+{
+	unsigned int i;
+
+	for (i = 0; i < clients_count; i++) {
+		if (clients[i].fd == fd)
+			break;
+	}
+
+	if (i == clients_count)
+		return;
+
+	close(clients[i].fd);
+	close(clients[i].event_fd);
+
+	clients[i] = clients[--clients_count];
+}
+
+static gboolean client_cb(GIOChannel *source, GIOCondition condition,
+							gpointer data)
+{
+	remove_client(GPOINTER_TO_INT(data));
+
+	return FALSE;
+}
+
+static int send_fds(int fd, int event_fd)
+{
+	char control[CMSG_SPACE(2 * sizeof(int))];
+	uint32_t version = CONNLINE_BROKER_VERSION;
+	int fds[2] = { page_fd, event_fd };
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+
+	iov.iov_base = &version;
+	iov.iov_len = sizeof(version);
+
+	memset(control, 0, sizeof(control));
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	if (sendmsg(fd, &msg, MSG_NOSIGNAL) != sizeof(version))
+		return -1;
+
+	return 0;
+}
+
+/* Run by root, it serves everyone, else only its own user and root */
+static bool is_client_allowed(int fd)
+{
+	socklen_t length = sizeof(struct ucred);
+	struct ucred credentials;
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED,
+					&credentials, &length) < 0)
+		return false;
+
+	return getuid() == 0 || credentials.uid == 0 ||
+					credentials.uid == getuid();
+}
+
+static gboolean accept_cb(GIOChannel *source, GIOCondition condition,
+							gpointer data)
+{
+	struct broker_client *new_clients;
+	GIOChannel *io_channel;
+	int fd, event_fd;
+
+	fd = accept4(g_io_channel_unix_get_fd(source), NULL, NULL,
+							SOCK_CLOEXEC);
+	if (fd < 0)
+		return TRUE;
+
+	if (is_client_allowed(fd) == false) {
+		close(fd);
+		return TRUE;
+	}
+
+	event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (event_fd < 0)
+		goto error;
+
+	new_clients = realloc(clients, (clients_count + 1) *
+					sizeof(struct broker_client));
+	if (new_clients == NULL)
+		goto error;
+
+	clients = new_clients;
+
+	if (send_fds(fd, event_fd) < 0)
+		goto error;
+
+	clients[clients_count].fd = fd;
+	clients[clients_count].event_fd = event_fd;
+	clients_count++;
+
+	io_channel = g_io_channel_unix_new(fd);
+	g_io_add_watch(io_channel, G_IO_IN | G_IO_ERR | G_IO_HUP,
+					client_cb, GINT_TO_POINTER(fd));
+	g_io_channel_unref(io_channel);
+
+	return TRUE;
+
+error:
+	if (event_fd >= 0)
+		close(event_fd);
+	close(fd);
+
+	return TRUE;
+}
+
+static int listen_socket(const char *name)
+{
+	struct sockaddr_un addr;
+	socklen_t length;
+	size_t size;
+	int fd;
+
+	size = strlen(name);
+	if (size == 0 || size > sizeof(addr.sun_path) - 1)
+		return -1;
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path + 1, name, size);
+	length = offsetof(struct sockaddr_un, sun_path) + 1 + size;
+
+	if (bind(fd, (struct sockaddr *) &addr, length) < 0 ||
+						listen(fd, 16) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* Clients get a read-only fd, so they cannot map the page writable */
+static int setup_page(void)
+{
+	char path[64];
+	int fd;
+
+	fd = memfd_create("connline-broker", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0)
+		return -1;
+
+	if (ftruncate(fd, CONNLINE_BROKER_PAGE_SIZE) < 0)
+		goto error;
+
+	page = mmap(NULL, CONNLINE_BROKER_PAGE_SIZE, PROT_READ | PROT_WRITE,
+							MAP_SHARED, fd, 0);
+	if (page == MAP_FAILED) {
+		page = NULL;
+		goto error;
+	}
+
+	fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+	page_fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	close(fd);
+
+	if (page_fd < 0)
+		return -1;
+
+	return 0;
+
+error:
+	close(fd);
+
+	return -1;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *name = CONNLINE_BROKER_DEFAULT;
+	GIOChannel *io_channel;
+	GMainLoop *loop;
+	int fd;
+
+	if (argc > 1)
+		name = argv[1];
+
+	/* The broker itself has to use D-Bus */
+	unsetenv(CONNLINE_BROKER_ENV);
+
+	if (setup_page() < 0) {
+		perror("connlined: cannot create the shared page");
+		return EXIT_FAILURE;
+	}
+
+	fd = listen_socket(name);
+	if (fd < 0) {
+		perror("connlined: cannot listen");
+		return EXIT_FAILURE;
+	}
+
+	loop = g_main_loop_new(NULL, FALSE);
+
+	if (connline_init(CONNLINE_EVENT_LOOP_GLIB, NULL) != 0) {
+		fprintf(stderr, "connlined: cannot initialize connline\n");
+		return EXIT_FAILURE;
+	}
+
+	publish(CONNLINE_BROKER_NO_BACKEND, CONNLINE_BEARER_UNKNOWN);
+	open_context();
+
+	io_channel = g_io_channel_unix_new(fd);
+	g_io_add_watch(io_channel, G_IO_IN, accept_cb, NULL);
+	g_io_channel_unref(io_channel);
+
+	g_main_loop_run(loop);
+
+	connline_cleanup();
+	g_main_loop_unref(loop);
+
+	return EXIT_SUCCESS;
+}